@@ -1,12 +1,12 @@
 #!/bin/bash
 set -e
 
-echo "=== Building Miniplot Extension (100% Offline) ==="
+echo "=== Building DuckGL Extension (100% Offline) ==="
 
-# Step 1: Plotly.jsを埋め込み
+# Step 1: MapLibre GL / deck.gl を埋め込み
 echo ""
-echo "Step 1: Embedding Plotly.js..."
-bash scripts/embed_plotly.sh  # chmod不要で直接bashで実行
+echo "Step 1: Embedding frontend assets..."
+bash scripts/embed_assets.sh  # chmod不要で直接bashで実行
 
 # Step 2: DuckDBエクステンションをビルド
 echo ""
@@ -16,8 +16,8 @@ make release
 echo ""
 echo "=== Build Complete ==="
 echo ""
-ls -lh build/release/extension/miniplot/miniplot.duckdb_extension
+ls -lh build/release/extension/duckgl/duckgl.duckdb_extension
 echo ""
 echo "✓ Extension built successfully"
 echo "✓ 100% offline (no CDN dependencies)"
-echo "✓ Plotly.js embedded (~3MB)"
\ No newline at end of file
+echo "✓ MapLibre GL, deck.gl and earcut embedded (~3MB)"
\ No newline at end of file
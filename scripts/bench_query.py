@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+"""/api/query の JSON シリアライズのベンチマーク
+
+2M 行の表を作り、/api/query に同じ SQL を何度か POST して、本文を最後まで受け取るまでの時間から
+rows/s と MB/s を出す。拡張を2つ渡すと、それぞれを別プロセスで測って比べる。
+
+    # 列単位のシリアライザ（現在のビルド）と、GetValue/ToString の行単位の版（user-001 より前のビルド）を比べる
+    git worktree add /tmp/duckgl-baseline 2b44f22 && make -C /tmp/duckgl-baseline release
+    python3 scripts/bench_query.py \\
+        build/release/extension/duckgl/duckgl.duckdb_extension \\
+        /tmp/duckgl-baseline/build/release/extension/duckgl/duckgl.duckdb_extension
+
+Python の duckdb パッケージは拡張をビルドした DuckDB と同じバージョンのものを使うこと。
+リクエストは Accept-Encoding なしで送るので、圧縮の時間は含まれない。
+"""
+
+import argparse
+import json
+import os
+import socket
+import statistics
+import subprocess
+import sys
+import time
+import urllib.request
+
+QUERY = "SELECT * FROM bench"
+
+# 整数・浮動小数点・文字列・真偽値・日時の列を持つ表
+CREATE_TABLE = """
+CREATE TABLE bench AS
+SELECT
+    i::BIGINT AS id,
+    (i % 1000)::INTEGER AS category,
+    (i * 0.001 + 0.5)::DOUBLE AS value,
+    'name_' || (i % 5000)::VARCHAR AS name,
+    i % 2 = 0 AS flag,
+    TIMESTAMP '2024-01-01' + INTERVAL (i) SECOND AS ts
+FROM range({rows}) t(i)
+"""
+
+
+def free_port():
+    with socket.socket() as s:
+        s.bind(("127.0.0.1", 0))
+        return s.getsockname()[1]
+
+
+def run_worker(extension, rows, repeat):
+    import duckdb
+
+    con = duckdb.connect(config={"allow_unsigned_extensions": "true"})
+    con.execute(f"LOAD '{extension}'")
+    con.execute(CREATE_TABLE.format(rows=rows))
+    port = free_port()
+    con.execute(f"SELECT duckgl_start('127.0.0.1', {port})")
+    url = f"http://127.0.0.1:{port}/api/query"
+    try:
+        times = []
+        size = 0
+        # 1回目は捨てる（接続やページキャッシュの準備）
+        for attempt in range(repeat + 1):
+            request = urllib.request.Request(url, data=QUERY.encode(), method="POST")
+            start = time.perf_counter()
+            with urllib.request.urlopen(request) as response:
+                body = response.read()
+            elapsed = time.perf_counter() - start
+            if attempt == 0:
+                parsed = json.loads(body)
+                if isinstance(parsed, dict) and "error" in parsed:
+                    raise RuntimeError(parsed["error"])
+                continue
+            times.append(elapsed)
+            size = len(body)
+    finally:
+        con.execute("SELECT duckgl_stop()")
+    seconds = statistics.median(times)
+    return {"seconds": seconds, "bytes": size, "rows_per_s": rows / seconds, "mb_per_s": size / seconds / 1e6}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("extensions", nargs="+", help="duckgl.duckdb_extension のパス（1つか2つ）")
+    parser.add_argument("--rows", type=int, default=2_000_000)
+    parser.add_argument("--repeat", type=int, default=5)
+    parser.add_argument("--markdown", action="store_true", help="README の表に貼れる形で出す")
+    parser.add_argument("--worker", action="store_true", help=argparse.SUPPRESS)
+    args = parser.parse_args()
+
+    if args.worker:
+        print(json.dumps(run_worker(args.extensions[0], args.rows, args.repeat)))
+        return
+
+    results = []
+    for extension in args.extensions:
+        # 拡張は1プロセスに1つしか読み込めないので、それぞれ別のプロセスで測る
+        worker = subprocess.run(
+            [sys.executable, os.path.abspath(__file__), "--worker", "--rows", str(args.rows),
+             "--repeat", str(args.repeat), extension],
+            capture_output=True, text=True)
+        if worker.returncode != 0:
+            sys.exit(f"{extension}: {worker.stderr.strip()}")
+        results.append(json.loads(worker.stdout.strip().splitlines()[-1]))
+
+    if args.markdown:
+        print("| Build | Seconds | MB | Rows/s | MB/s |")
+        print("|---|---:|---:|---:|---:|")
+        for extension, r in zip(args.extensions, results):
+            print(f"| `{extension}` | {r['seconds']:.3f} | {r['bytes'] / 1e6:.1f} | {r['rows_per_s']:,.0f} | "
+                  f"{r['mb_per_s']:.1f} |")
+        if len(results) == 2:
+            print(f"\nSpeedup: {results[1]['seconds'] / results[0]['seconds']:.2f}x")
+        return
+
+    print(f"{args.rows} rows, median of {args.repeat} runs: {QUERY}")
+    print(f"{'extension':<60} {'seconds':>8} {'MB':>8} {'rows/s':>12} {'MB/s':>8}")
+    for extension, r in zip(args.extensions, results):
+        print(f"{extension[-60:]:<60} {r['seconds']:>8.3f} {r['bytes'] / 1e6:>8.1f} "
+              f"{r['rows_per_s']:>12,.0f} {r['mb_per_s']:>8.1f}")
+    if len(results) == 2:
+        print(f"speedup: {results[1]['seconds'] / results[0]['seconds']:.2f}x")
+
+
+if __name__ == "__main__":
+    main()
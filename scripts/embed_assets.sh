@@ -0,0 +1,89 @@
+#!/bin/bash
+set -e
+
+echo "=== Embedding frontend assets into C++ header ==="
+
+ASSET_DIR="src/assets"
+OUTPUT_FILE="src/include/embedded_assets.inc"
+
+MAPLIBRE_VERSION="${MAPLIBRE_VERSION:-3.6.0}"
+DECKGL_VERSION="${DECKGL_VERSION:-^9.0.0}"
+EARCUT_VERSION="${EARCUT_VERSION:-2.2.4}"
+
+# 名前|URL|Content-Type（名前は src/static_assets.cpp のCDNの一覧と合わせる）
+ASSETS=(
+    "maplibre-gl.js|https://unpkg.com/maplibre-gl@${MAPLIBRE_VERSION}/dist/maplibre-gl.js|application/javascript; charset=utf-8"
+    "maplibre-gl.css|https://unpkg.com/maplibre-gl@${MAPLIBRE_VERSION}/dist/maplibre-gl.css|text/css; charset=utf-8"
+    "deck.gl.min.js|https://unpkg.com/deck.gl@${DECKGL_VERSION}/dist.min.js|application/javascript; charset=utf-8"
+    "earcut.min.js|https://unpkg.com/earcut@${EARCUT_VERSION}/dist/earcut.min.js|application/javascript; charset=utf-8"
+)
+
+sha256() {
+    if command -v sha256sum > /dev/null; then
+        sha256sum "$1" | cut -c1-16
+    else
+        shasum -a 256 "$1" | cut -c1-16
+    fi
+}
+
+# バイト列をC++の配列の初期化子（10進のカンマ区切り）にする
+bytes() {
+    od -An -v -tu1 "$1" | sed -e 's/^ *//' -e 's/  */,/g' -e 's/$/,/'
+}
+
+mkdir -p "$ASSET_DIR"
+
+# ファイルをダウンロード（まだ存在しない場合のみ）
+for entry in "${ASSETS[@]}"; do
+    IFS='|' read -r name url type <<< "$entry"
+    if [ ! -f "$ASSET_DIR/$name" ]; then
+        echo "Downloading $name..."
+        curl -fL -o "$ASSET_DIR/$name" "$url"
+        echo "✓ Downloaded $name"
+    fi
+done
+
+echo "Generating C++ include file..."
+
+# 元のファイルとgzipしたもの（-n で時刻を入れず、同じ入力から同じ出力にする）を配列として埋め込む
+{
+    echo "// Auto-generated file - DO NOT EDIT"
+    echo "// Generated by scripts/embed_assets.sh"
+    echo ""
+    echo "namespace duckdb {"
+    echo "namespace embedded_assets {"
+    index=0
+    for entry in "${ASSETS[@]}"; do
+        IFS='|' read -r name url type <<< "$entry"
+        gzip -9 -n -c "$ASSET_DIR/$name" > "$ASSET_DIR/$name.gz"
+        echo ""
+        echo "// $name ($url)"
+        echo "static constexpr unsigned char ASSET_${index}[] = {"
+        bytes "$ASSET_DIR/$name"
+        echo "};"
+        echo "static constexpr unsigned char ASSET_${index}_GZIP[] = {"
+        bytes "$ASSET_DIR/$name.gz"
+        echo "};"
+        rm -f "$ASSET_DIR/$name.gz"
+        index=$((index + 1))
+    done
+    echo ""
+    echo "static constexpr StaticAsset ASSETS[] = {"
+    index=0
+    for entry in "${ASSETS[@]}"; do
+        IFS='|' read -r name url type <<< "$entry"
+        etag=$(sha256 "$ASSET_DIR/$name")
+        echo "    {\"$name\", \"$type\", \"\\\"$etag\\\"\", ASSET_${index}, sizeof(ASSET_${index}), ASSET_${index}_GZIP, sizeof(ASSET_${index}_GZIP)},"
+        index=$((index + 1))
+    done
+    echo "};"
+    echo ""
+    echo "} // namespace embedded_assets"
+    echo "} // namespace duckdb"
+} > "$OUTPUT_FILE"
+
+echo "✓ Frontend assets embedded successfully"
+FILE_SIZE=$(wc -c < "$OUTPUT_FILE")
+echo "  Output size: $((FILE_SIZE / 1024 / 1024))MB"
+echo "  Location: $OUTPUT_FILE"
+echo "  Re-run cmake (or make) so that the build picks it up"
@@ -0,0 +1,114 @@
+#include "admission_control.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+namespace duckdb {
+
+constexpr idx_t AdmissionController::CLASS_COUNT;
+
+AdmissionController::AdmissionController(Limits interactive, Limits batch) {
+    classes[idx_t(Class::INTERACTIVE)].limits = interactive;
+    classes[idx_t(Class::BATCH)].limits = batch;
+    for (auto& state : classes) {
+        state.limits.concurrency = std::max<idx_t>(1, state.limits.concurrency);
+        state.limits.threads = std::max<idx_t>(1, state.limits.threads);
+    }
+}
+
+AdmissionController::Limits AdmissionController::DefaultLimits(Class cls, idx_t http_workers) {
+    idx_t cores = std::max<idx_t>(1, std::thread::hardware_concurrency());
+    Limits limits;
+    if (cls == Class::BATCH) {
+        limits.concurrency = std::max<idx_t>(1, cores / 4);
+        limits.queue_depth = std::max<idx_t>(1, http_workers / 2 - std::min(http_workers / 2, limits.concurrency));
+    } else {
+        limits.concurrency = std::max<idx_t>(2, cores / 2);
+        limits.queue_depth = http_workers;
+    }
+    // 同時に実行するリクエスト全体でコア数を超えないようにする
+    limits.threads = std::max<idx_t>(1, cores / limits.concurrency);
+    return limits;
+}
+
+AdmissionController::Ticket::Ticket(AdmissionController& controller_p, Class cls_p)
+    : controller(controller_p), cls(cls_p) {
+}
+
+AdmissionController::Ticket::~Ticket() {
+    controller.Release(cls);
+}
+
+idx_t AdmissionController::Ticket::Threads() const {
+    return controller.classes[idx_t(cls)].limits.threads;
+}
+
+bool AdmissionController::CanRun(Class cls) const {
+    auto& state = classes[idx_t(cls)];
+    if (state.running >= state.limits.concurrency) return false;
+    // 地図のリクエストが待っている間はSQLを始めない
+    return cls == Class::INTERACTIVE || classes[idx_t(Class::INTERACTIVE)].queued == 0;
+}
+
+unique_ptr<AdmissionController::Ticket> AdmissionController::Admit(Class cls, const std::function<bool()>& gave_up,
+                                                                   bool always_queue) {
+    auto& state = classes[idx_t(cls)];
+    std::unique_lock<std::mutex> guard(lock);
+    if (!CanRun(cls)) {
+        if (!always_queue && state.queued >= state.limits.queue_depth) {
+            state.rejected++;
+            return nullptr;
+        }
+        auto start = std::chrono::steady_clock::now();
+        state.queued++;
+        // 待っている間にクライアントが切断したら諦めるので、定期的に起きて確かめる
+        while (!CanRun(cls)) {
+            released.wait_for(guard, std::chrono::milliseconds(100));
+            if (!CanRun(cls) && gave_up && gave_up()) {
+                state.queued--;
+                released.notify_all();
+                return nullptr;
+            }
+        }
+        state.queued--;
+        auto micros = uint64_t(
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+        state.wait_micros += micros;
+        state.max_wait_micros = std::max(state.max_wait_micros, micros);
+        // INTERACTIVE の待ちがなくなったので BATCH が入れるかもしれない
+        if (cls == Class::INTERACTIVE && state.queued == 0) released.notify_all();
+    }
+    state.running++;
+    state.admitted++;
+    return make_uniq<Ticket>(*this, cls);
+}
+
+void AdmissionController::Release(Class cls) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        classes[idx_t(cls)].running--;
+    }
+    released.notify_all();
+}
+
+string AdmissionController::StatsJSON() {
+    std::lock_guard<std::mutex> guard(lock);
+    string out = "{";
+    const char* names[CLASS_COUNT] = {"interactive", "batch"};
+    for (idx_t i = 0; i < CLASS_COUNT; i++) {
+        auto& state = classes[i];
+        char wait[64];
+        snprintf(wait, sizeof(wait), "\"wait_ms\":%.3f,\"max_wait_ms\":%.3f", double(state.wait_micros) / 1000.0,
+                 double(state.max_wait_micros) / 1000.0);
+        if (i > 0) out += ",";
+        out += "\"" + string(names[i]) + "\":{\"concurrency\":" + std::to_string(state.limits.concurrency) +
+               ",\"queue_depth\":" + std::to_string(state.limits.queue_depth) +
+               ",\"threads\":" + std::to_string(state.limits.threads) + ",\"running\":" + std::to_string(state.running) +
+               ",\"queued\":" + std::to_string(state.queued) + ",\"admitted\":" + std::to_string(state.admitted) +
+               ",\"rejected\":" + std::to_string(state.rejected) + "," + wait + "}";
+    }
+    return out + "}";
+}
+
+} // namespace duckdb
@@ -0,0 +1,132 @@
+#include "aggregate.hpp"
+#include "encoding_util.hpp"
+#include "json_writer.hpp"
+#include "duckdb/main/query_result.hpp"
+
+#include <cmath>
+#include <cstdio>
+
+namespace duckdb {
+
+static const char* FunctionName(AggregateRequest::Function function) {
+    switch (function) {
+    case AggregateRequest::Function::SUM:
+        return "sum";
+    case AggregateRequest::Function::AVG:
+        return "avg";
+    case AggregateRequest::Function::MIN:
+        return "min";
+    case AggregateRequest::Function::MAX:
+        return "max";
+    default:
+        return "count";
+    }
+}
+
+bool AggregateRequest::ParseCell(const string& value, string& error) {
+    if (value.empty() || value == "hex") {
+        cell = CellType::HEX;
+    } else if (value == "square") {
+        cell = CellType::SQUARE;
+    } else {
+        error = "cell must be hex or square";
+        return false;
+    }
+    return true;
+}
+
+bool AggregateRequest::ParseAggregate(const string& value, string& error) {
+    if (value.empty() || value == "count") {
+        function = Function::COUNT;
+        return true;
+    }
+    auto open = value.find('(');
+    if (open == string::npos || value.back() != ')' || open + 2 >= value.size()) {
+        error = "agg must be count, sum(col), avg(col), min(col) or max(col)";
+        return false;
+    }
+    auto name = value.substr(0, open);
+    column = value.substr(open + 1, value.size() - open - 2);
+    if (name == "sum") {
+        function = Function::SUM;
+    } else if (name == "avg") {
+        function = Function::AVG;
+    } else if (name == "min") {
+        function = Function::MIN;
+    } else if (name == "max") {
+        function = Function::MAX;
+    } else {
+        error = "agg must be count, sum(col), avg(col), min(col) or max(col)";
+        return false;
+    }
+    return true;
+}
+
+string AggregateRequest::BuildSQL(const string& table_name, const string& geom_col, const string& filter) const {
+    auto world = SQLDouble(512.0 * std::ldexp(1.0, zoom));
+    string lat = "greatest(least(ST_Y(" + geom_col + "), 85.0511287798066), -85.0511287798066)";
+    string value = function == Function::COUNT ? "NULL::DOUBLE" : QuoteIdentifier(column) + "::DOUBLE";
+
+    string sql = "WITH points AS (SELECT (ST_X(" + geom_col + ") + 180) / 360 * " + world + " AS px, "
+                 "(0.5 - ln((1 + sin(radians(" + lat + "))) / (1 - sin(radians(" + lat + ")))) / (4 * pi())) * " +
+                 world + " AS py, " + value + " AS v FROM " + QuoteIdentifier(table_name) +
+                 " WHERE ST_GeometryType(" + geom_col + ") = 'POINT'" + (filter.empty() ? "" : " AND " + filter) +
+                 "), ";
+    if (cell == CellType::SQUARE) {
+        auto s = SQLDouble(size);
+        sql += "cells AS (SELECT floor(px / " + s + ")::BIGINT AS cx, floor(py / " + s + ")::BIGINT AS cy, v FROM points) ";
+    } else {
+        // 2つの長方形格子（Aは格子点、Bはその中間）の近い方の中心が六角形の中心になる
+        auto w = SQLDouble(std::sqrt(3.0) * size);
+        auto h = SQLDouble(3.0 * size);
+        sql += "lattice AS (SELECT round(px / " + w + ") AS ai, round(py / " + h + ") AS aj, "
+               "floor(px / " + w + ") AS bi, floor(py / " + h + ") AS bj, px, py, v FROM points), "
+               "nearest AS (SELECT *, (px - ai * " + w + ") ^ 2 + (py - aj * " + h + ") ^ 2 <= "
+               "(px - (bi + 0.5) * " + w + ") ^ 2 + (py - (bj + 0.5) * " + h + ") ^ 2 AS in_a FROM lattice), "
+               "cells AS (SELECT (CASE WHEN in_a THEN 2 * ai ELSE 2 * bi + 1 END)::BIGINT AS cx, "
+               "(CASE WHEN in_a THEN 2 * aj ELSE 2 * bj + 1 END)::BIGINT AS cy, v FROM nearest) ";
+    }
+    sql += "SELECT cx, cy, count(*) AS n, ";
+    sql += function == Function::COUNT ? "count(*)::DOUBLE" : string(FunctionName(function)) + "(v)::DOUBLE";
+    sql += " AS v FROM cells GROUP BY cx, cy";
+    return sql;
+}
+
+string AggregateRequest::ResultToJSON(QueryResult& result) const {
+    string cols, rows, counts, values;
+    idx_t cells = 0;
+    while (true) {
+        auto chunk = result.Fetch();
+        if (!chunk || chunk->size() == 0) break;
+        idx_t count = chunk->size();
+        UnifiedVectorFormat data[4];
+        for (idx_t c = 0; c < 4; c++) {
+            chunk->data[c].ToUnifiedFormat(count, data[c]);
+        }
+        for (idx_t row = 0; row < count; row++) {
+            const char* sep = cells > 0 ? "," : "";
+            cols += sep + std::to_string(UnifiedVectorFormat::GetData<int64_t>(data[0])[data[0].sel->get_index(row)]);
+            rows += sep + std::to_string(UnifiedVectorFormat::GetData<int64_t>(data[1])[data[1].sel->get_index(row)]);
+            counts += sep + std::to_string(UnifiedVectorFormat::GetData<int64_t>(data[2])[data[2].sel->get_index(row)]);
+            // 集計対象の列がすべてNULLのセルは null
+            auto value_idx = data[3].sel->get_index(row);
+            double value = UnifiedVectorFormat::GetData<double>(data[3])[value_idx];
+            values += sep;
+            if (data[3].validity.RowIsValid(value_idx) && std::isfinite(value)) {
+                values += SQLDouble(value);
+            } else {
+                values += "null";
+            }
+            cells++;
+        }
+    }
+
+    string agg = FunctionName(function);
+    if (function != Function::COUNT) agg += "(" + column + ")";
+    return "{\"cell\":\"" + string(cell == CellType::HEX ? "hex" : "square") + "\",\"zoom\":" + std::to_string(zoom) +
+           ",\"size\":" + SQLDouble(size) + ",\"agg\":\"" + JSONChunkWriter::Escape(agg) +
+           "\",\"cells\":" + std::to_string(cells) + ",\"col\":[" + cols + "],\"row\":[" + rows + "],\"count\":[" +
+           counts + "],\"value\":[" + values + "]}";
+}
+
+} // namespace duckdb
@@ -0,0 +1,603 @@
+#include "arrow_ipc_writer.hpp"
+#include "duckdb/common/arrow/arrow_converter.hpp"
+#include "duckdb/common/string_util.hpp"
+#include "duckdb/common/vector_operations/vector_operations.hpp"
+
+#include <cctype>
+#include <cstdlib>
+
+namespace duckdb {
+
+// 後ろから前へ詰めていく最小限のFlatBuffersビルダー（Arrowのメタデータ用）
+// オフセットはすべて「バッファ末尾からの距離」で扱う
+class FlatBufferBuilder {
+public:
+    uint32_t Size() const {
+        return uint32_t(buf.size() - head);
+    }
+
+    void Pad(idx_t n) {
+        Reserve(n);
+        head -= n;
+        memset(&buf[head], 0, n);
+    }
+
+    // 続けて extra バイト書いた後に size 境界へ揃うようにパディングする
+    void Align(idx_t size, idx_t extra = 0) {
+        if (size > min_align) min_align = size;
+        Pad((~(Size() + extra) + 1) & (size - 1));
+    }
+
+    void PrependBytes(const void* data, idx_t n) {
+        Reserve(n);
+        head -= n;
+        memcpy(&buf[head], data, n);
+    }
+
+    template <class T>
+    void Prepend(T value) {
+        Align(sizeof(T));
+        PrependBytes(&value, sizeof(T));
+    }
+
+    uint32_t ReferTo(uint32_t ref) {
+        Align(4);
+        return Size() + 4 - ref;
+    }
+
+    uint32_t CreateString(const string& str) {
+        Align(4, str.size() + 1);
+        Pad(1);
+        PrependBytes(str.data(), str.size());
+        Prepend<uint32_t>(uint32_t(str.size()));
+        return Size();
+    }
+
+    uint32_t CreateOffsetVector(const vector<uint32_t>& refs) {
+        Align(4, refs.size() * 4);
+        for (idx_t i = refs.size(); i > 0; i--) {
+            Prepend<uint32_t>(ReferTo(refs[i - 1]));
+        }
+        Prepend<uint32_t>(uint32_t(refs.size()));
+        return Size();
+    }
+
+    // 2つのint64からなる構造体（FieldNode / Buffer）のベクター
+    uint32_t CreatePairVector(const vector<std::pair<int64_t, int64_t>>& pairs) {
+        Align(4, pairs.size() * 16);
+        Align(8, pairs.size() * 16);
+        for (idx_t i = pairs.size(); i > 0; i--) {
+            Prepend<int64_t>(pairs[i - 1].second);
+            Prepend<int64_t>(pairs[i - 1].first);
+        }
+        Prepend<uint32_t>(uint32_t(pairs.size()));
+        return Size();
+    }
+
+    void StartTable() {
+        fields.clear();
+        table_start = Size();
+    }
+
+    template <class T>
+    void AddScalar(uint16_t id, T value) {
+        Prepend<T>(value);
+        fields.emplace_back(id, Size());
+    }
+
+    void AddOffset(uint16_t id, uint32_t ref) {
+        Prepend<uint32_t>(ReferTo(ref));
+        fields.emplace_back(id, Size());
+    }
+
+    uint32_t EndTable() {
+        Prepend<int32_t>(0);
+        uint32_t table = Size();
+        uint16_t field_count = 0;
+        for (auto& field : fields) {
+            field_count = MaxValue<uint16_t>(field_count, uint16_t(field.first + 1));
+        }
+        vector<uint16_t> entries(field_count, 0);
+        for (auto& field : fields) {
+            entries[field.first] = uint16_t(table - field.second);
+        }
+        for (idx_t i = entries.size(); i > 0; i--) {
+            Prepend<uint16_t>(entries[i - 1]);
+        }
+        Prepend<uint16_t>(uint16_t(table - table_start));
+        Prepend<uint16_t>(uint16_t(4 + 2 * field_count));
+        // テーブル先頭のsoffsetはvtableへの相対位置
+        int32_t vtable_offset = int32_t(Size() - table);
+        memcpy(&buf[buf.size() - table], &vtable_offset, sizeof(int32_t));
+        return table;
+    }
+
+    string Finish(uint32_t root) {
+        Align(min_align, 4);
+        Prepend<uint32_t>(ReferTo(root));
+        return string(reinterpret_cast<const char*>(&buf[head]), Size());
+    }
+
+private:
+    void Reserve(idx_t n) {
+        if (head >= n) return;
+        idx_t used = Size();
+        idx_t new_size = MaxValue<idx_t>(buf.size() * 2, used + n + 64);
+        vector<uint8_t> new_buf(new_size);
+        memcpy(&new_buf[new_size - used], &buf[head], used);
+        buf = std::move(new_buf);
+        head = new_size - used;
+    }
+
+    vector<uint8_t> buf;
+    idx_t head = 0;
+    idx_t min_align = 1;
+    uint32_t table_start = 0;
+    vector<std::pair<uint16_t, uint32_t>> fields;
+};
+
+// Schema.fbs / Message.fbs の定数
+enum class MessageHeader : uint8_t { SCHEMA = 1, RECORD_BATCH = 3 };
+enum class ArrowTypeTag : uint8_t {
+    NULL_TYPE = 1,
+    INT = 2,
+    FLOATING_POINT = 3,
+    BINARY = 4,
+    UTF8 = 5,
+    BOOL = 6,
+    DECIMAL = 7,
+    DATE = 8,
+    TIME = 9,
+    TIMESTAMP = 10,
+    INTERVAL = 11,
+    LIST = 12,
+    STRUCT = 13,
+    FIXED_SIZE_BINARY = 15,
+    FIXED_SIZE_LIST = 16,
+    MAP = 17,
+    DURATION = 18,
+    LARGE_BINARY = 19,
+    LARGE_UTF8 = 20,
+    LARGE_LIST = 21
+};
+static constexpr int16_t METADATA_V5 = 4;
+
+// 型ごとのバッファ構成
+enum class BufferLayout { NONE, FIXED, BITMAP, VAR_BINARY, LARGE_VAR_BINARY, LIST, LARGE_LIST, FIXED_LIST, STRUCT };
+
+struct ArrowFormatInfo {
+    ArrowFormatInfo(ArrowTypeTag tag_p, BufferLayout layout_p, idx_t bit_width_p = 0)
+        : tag(tag_p), layout(layout_p), bit_width(bit_width_p) {
+    }
+
+    ArrowTypeTag tag;
+    BufferLayout layout;
+    idx_t bit_width;
+};
+
+static int16_t ParseTimeUnit(char c) {
+    switch (c) {
+    case 's': return 0;
+    case 'm': return 1;
+    case 'u': return 2;
+    case 'n': return 3;
+    default: throw InvalidInputException("Unsupported Arrow time unit \"%s\"", string(1, c));
+    }
+}
+
+static idx_t ParseInteger(const string& str) {
+    return idx_t(strtoull(str.c_str(), nullptr, 10));
+}
+
+static ArrowFormatInfo ParseFormat(const string& format) {
+    if (format.size() == 1) {
+        switch (format[0]) {
+        case 'n': return {ArrowTypeTag::NULL_TYPE, BufferLayout::NONE};
+        case 'b': return {ArrowTypeTag::BOOL, BufferLayout::BITMAP, 1};
+        case 'c':
+        case 'C': return {ArrowTypeTag::INT, BufferLayout::FIXED, 8};
+        case 's':
+        case 'S': return {ArrowTypeTag::INT, BufferLayout::FIXED, 16};
+        case 'i':
+        case 'I': return {ArrowTypeTag::INT, BufferLayout::FIXED, 32};
+        case 'l':
+        case 'L': return {ArrowTypeTag::INT, BufferLayout::FIXED, 64};
+        case 'e': return {ArrowTypeTag::FLOATING_POINT, BufferLayout::FIXED, 16};
+        case 'f': return {ArrowTypeTag::FLOATING_POINT, BufferLayout::FIXED, 32};
+        case 'g': return {ArrowTypeTag::FLOATING_POINT, BufferLayout::FIXED, 64};
+        case 'z': return {ArrowTypeTag::BINARY, BufferLayout::VAR_BINARY};
+        case 'Z': return {ArrowTypeTag::LARGE_BINARY, BufferLayout::LARGE_VAR_BINARY};
+        case 'u': return {ArrowTypeTag::UTF8, BufferLayout::VAR_BINARY};
+        case 'U': return {ArrowTypeTag::LARGE_UTF8, BufferLayout::LARGE_VAR_BINARY};
+        default: break;
+        }
+    } else if (format[0] == 'd' && format.size() > 2) {
+        auto parts = StringUtil::Split(format.substr(2), ',');
+        idx_t width = parts.size() > 2 ? ParseInteger(parts[2]) : 128;
+        return {ArrowTypeTag::DECIMAL, BufferLayout::FIXED, width};
+    } else if (format[0] == 'w' && format.size() > 2) {
+        return {ArrowTypeTag::FIXED_SIZE_BINARY, BufferLayout::FIXED, ParseInteger(format.substr(2)) * 8};
+    } else if (format == "tdD") {
+        return {ArrowTypeTag::DATE, BufferLayout::FIXED, 32};
+    } else if (format == "tdm") {
+        return {ArrowTypeTag::DATE, BufferLayout::FIXED, 64};
+    } else if (format == "tts" || format == "ttm") {
+        return {ArrowTypeTag::TIME, BufferLayout::FIXED, 32};
+    } else if (format == "ttu" || format == "ttn") {
+        return {ArrowTypeTag::TIME, BufferLayout::FIXED, 64};
+    } else if (StringUtil::StartsWith(format, "ts") && format.size() >= 4) {
+        return {ArrowTypeTag::TIMESTAMP, BufferLayout::FIXED, 64};
+    } else if (StringUtil::StartsWith(format, "tD") && format.size() == 3) {
+        return {ArrowTypeTag::DURATION, BufferLayout::FIXED, 64};
+    } else if (format == "tiM") {
+        return {ArrowTypeTag::INTERVAL, BufferLayout::FIXED, 32};
+    } else if (format == "tiD") {
+        return {ArrowTypeTag::INTERVAL, BufferLayout::FIXED, 64};
+    } else if (format == "tin") {
+        return {ArrowTypeTag::INTERVAL, BufferLayout::FIXED, 128};
+    } else if (format == "+l") {
+        return {ArrowTypeTag::LIST, BufferLayout::LIST};
+    } else if (format == "+L") {
+        return {ArrowTypeTag::LARGE_LIST, BufferLayout::LARGE_LIST};
+    } else if (StringUtil::StartsWith(format, "+w:")) {
+        return {ArrowTypeTag::FIXED_SIZE_LIST, BufferLayout::FIXED_LIST};
+    } else if (format == "+s") {
+        return {ArrowTypeTag::STRUCT, BufferLayout::STRUCT};
+    } else if (format == "+m") {
+        return {ArrowTypeTag::MAP, BufferLayout::LIST};
+    }
+    throw InvalidInputException("Unsupported Arrow format \"%s\" for IPC output", format);
+}
+
+// 型テーブル（Int, Timestamp など）を作って union の値として返す
+static uint32_t BuildTypeTable(FlatBufferBuilder& fbb, const string& format, const ArrowFormatInfo& info) {
+    uint32_t timezone = 0;
+    if (info.tag == ArrowTypeTag::TIMESTAMP && format.size() > 4) {
+        timezone = fbb.CreateString(format.substr(4));
+    }
+    fbb.StartTable();
+    switch (info.tag) {
+    case ArrowTypeTag::INT:
+        fbb.AddScalar<int32_t>(0, int32_t(info.bit_width));
+        fbb.AddScalar<uint8_t>(1, islower(format[0]) ? 1 : 0);
+        break;
+    case ArrowTypeTag::FLOATING_POINT:
+        fbb.AddScalar<int16_t>(0, info.bit_width == 16 ? 0 : info.bit_width == 32 ? 1 : 2);
+        break;
+    case ArrowTypeTag::DECIMAL: {
+        auto parts = StringUtil::Split(format.substr(2), ',');
+        fbb.AddScalar<int32_t>(0, int32_t(ParseInteger(parts[0])));
+        fbb.AddScalar<int32_t>(1, parts.size() > 1 ? int32_t(ParseInteger(parts[1])) : 0);
+        fbb.AddScalar<int32_t>(2, int32_t(info.bit_width));
+        break;
+    }
+    case ArrowTypeTag::FIXED_SIZE_BINARY:
+        fbb.AddScalar<int32_t>(0, int32_t(info.bit_width / 8));
+        break;
+    case ArrowTypeTag::DATE:
+        fbb.AddScalar<int16_t>(0, format[2] == 'D' ? 0 : 1);
+        break;
+    case ArrowTypeTag::TIME:
+        fbb.AddScalar<int16_t>(0, ParseTimeUnit(format[2]));
+        fbb.AddScalar<int32_t>(1, int32_t(info.bit_width));
+        break;
+    case ArrowTypeTag::TIMESTAMP:
+        fbb.AddScalar<int16_t>(0, ParseTimeUnit(format[2]));
+        if (timezone) fbb.AddOffset(1, timezone);
+        break;
+    case ArrowTypeTag::DURATION:
+        fbb.AddScalar<int16_t>(0, ParseTimeUnit(format[2]));
+        break;
+    case ArrowTypeTag::INTERVAL:
+        fbb.AddScalar<int16_t>(0, format[2] == 'M' ? 0 : format[2] == 'D' ? 1 : 2);
+        break;
+    case ArrowTypeTag::FIXED_SIZE_LIST:
+        fbb.AddScalar<int32_t>(0, int32_t(ParseInteger(format.substr(3))));
+        break;
+    case ArrowTypeTag::MAP:
+        fbb.AddScalar<uint8_t>(0, 0);
+        break;
+    default:
+        break;
+    }
+    return fbb.EndTable();
+}
+
+// ArrowSchema.metadata: int32 n, (int32 len, key, int32 len, value) * n
+static uint32_t BuildMetadata(FlatBufferBuilder& fbb, const char* metadata) {
+    if (!metadata) return 0;
+    auto read_int = [&metadata]() {
+        int32_t value;
+        memcpy(&value, metadata, sizeof(int32_t));
+        metadata += sizeof(int32_t);
+        return value;
+    };
+    auto read_string = [&metadata, &read_int]() {
+        auto len = read_int();
+        string result(metadata, idx_t(len));
+        metadata += len;
+        return result;
+    };
+    auto count = read_int();
+    vector<std::pair<string, string>> entries;
+    for (int32_t i = 0; i < count; i++) {
+        auto key = read_string();
+        auto value = read_string();
+        entries.emplace_back(std::move(key), std::move(value));
+    }
+    vector<uint32_t> refs;
+    for (auto& entry : entries) {
+        auto key = fbb.CreateString(entry.first);
+        auto value = fbb.CreateString(entry.second);
+        fbb.StartTable();
+        fbb.AddOffset(0, key);
+        fbb.AddOffset(1, value);
+        refs.push_back(fbb.EndTable());
+    }
+    return fbb.CreateOffsetVector(refs);
+}
+
+static uint32_t BuildField(FlatBufferBuilder& fbb, const ArrowSchema& field) {
+    if (field.dictionary) {
+        throw InvalidInputException("Dictionary-encoded Arrow columns are not supported for IPC output");
+    }
+    string format(field.format);
+    auto info = ParseFormat(format);
+
+    vector<uint32_t> children;
+    for (int64_t i = 0; i < field.n_children; i++) {
+        children.push_back(BuildField(fbb, *field.children[i]));
+    }
+    auto children_ref = fbb.CreateOffsetVector(children);
+    auto name_ref = fbb.CreateString(field.name ? field.name : "");
+    auto type_ref = BuildTypeTable(fbb, format, info);
+    auto metadata_ref = BuildMetadata(fbb, field.metadata);
+
+    fbb.StartTable();
+    fbb.AddOffset(0, name_ref);
+    fbb.AddScalar<uint8_t>(1, (field.flags & ARROW_FLAG_NULLABLE) ? 1 : 0);
+    fbb.AddScalar<uint8_t>(2, uint8_t(info.tag));
+    fbb.AddOffset(3, type_ref);
+    fbb.AddOffset(5, children_ref);
+    if (metadata_ref) fbb.AddOffset(6, metadata_ref);
+    return fbb.EndTable();
+}
+
+static uint32_t BuildMessage(FlatBufferBuilder& fbb, MessageHeader header_type, uint32_t header, int64_t body_length) {
+    fbb.StartTable();
+    fbb.AddScalar<int64_t>(3, body_length);
+    fbb.AddOffset(2, header);
+    fbb.AddScalar<int16_t>(0, METADATA_V5);
+    fbb.AddScalar<uint8_t>(1, uint8_t(header_type));
+    return fbb.EndTable();
+}
+
+// 継続マーカー + メタデータ長 + FlatBuffer（8バイト境界までパディング）
+static void WriteMessage(const string& metadata, string& out) {
+    idx_t padded = (metadata.size() + 8 + 7) / 8 * 8 - 8;
+    uint32_t continuation = 0xFFFFFFFF;
+    int32_t length = int32_t(padded);
+    out.append(reinterpret_cast<const char*>(&continuation), sizeof(uint32_t));
+    out.append(reinterpret_cast<const char*>(&length), sizeof(int32_t));
+    out += metadata;
+    out.append(padded - metadata.size(), '\0');
+}
+
+void ArrowIPCWriter::WriteSchema(const ArrowSchema& schema, string& out) {
+    FlatBufferBuilder fbb;
+    vector<uint32_t> fields;
+    for (int64_t i = 0; i < schema.n_children; i++) {
+        fields.push_back(BuildField(fbb, *schema.children[i]));
+    }
+    auto fields_ref = fbb.CreateOffsetVector(fields);
+    auto metadata_ref = BuildMetadata(fbb, schema.metadata);
+    fbb.StartTable();
+    fbb.AddOffset(1, fields_ref);
+    if (metadata_ref) fbb.AddOffset(2, metadata_ref);
+    fbb.AddScalar<int16_t>(0, 0);
+    auto schema_ref = fbb.EndTable();
+    WriteMessage(fbb.Finish(BuildMessage(fbb, MessageHeader::SCHEMA, schema_ref, 0)), out);
+}
+
+// レコードバッチ本文の組み立て（フィールドを深さ優先で走査）
+struct RecordBatchBody {
+    vector<std::pair<int64_t, int64_t>> nodes;
+    vector<std::pair<int64_t, int64_t>> buffers;
+    vector<std::pair<const void*, idx_t>> data;
+    idx_t length = 0;
+
+    void AddBuffer(const void* ptr, idx_t size) {
+        buffers.emplace_back(int64_t(length), int64_t(size));
+        data.emplace_back(ptr, size);
+        length += (size + 7) / 8 * 8;
+    }
+
+    static int64_t CountNulls(const uint8_t* validity, idx_t count) {
+        int64_t nulls = 0;
+        for (idx_t i = 0; i < count; i++) {
+            if (!(validity[i / 8] & (1 << (i % 8)))) nulls++;
+        }
+        return nulls;
+    }
+
+    template <class T>
+    static T GetOffset(const ArrowArray& array, idx_t index) {
+        return reinterpret_cast<const T*>(array.buffers[1])[index];
+    }
+
+    void AddArray(const ArrowSchema& field, const ArrowArray& array) {
+        if (array.offset != 0) {
+            throw InvalidInputException("Arrow arrays with a non-zero offset are not supported for IPC output");
+        }
+        auto info = ParseFormat(field.format);
+        auto count = idx_t(array.length);
+        auto null_count = array.null_count;
+        if (null_count < 0) {
+            null_count = array.buffers[0] ? CountNulls(static_cast<const uint8_t*>(array.buffers[0]), count) : 0;
+        }
+        nodes.emplace_back(array.length, null_count);
+        if (info.layout == BufferLayout::NONE) {
+            return;
+        }
+        if (null_count != 0 && array.buffers[0]) {
+            AddBuffer(array.buffers[0], (count + 7) / 8);
+        } else {
+            AddBuffer(nullptr, 0);
+        }
+        switch (info.layout) {
+        case BufferLayout::FIXED:
+        case BufferLayout::BITMAP:
+            AddBuffer(array.buffers[1], (count * info.bit_width + 7) / 8);
+            break;
+        case BufferLayout::VAR_BINARY:
+            AddBuffer(array.buffers[1], (count + 1) * sizeof(int32_t));
+            AddBuffer(array.buffers[2], count ? idx_t(GetOffset<int32_t>(array, count)) : 0);
+            break;
+        case BufferLayout::LARGE_VAR_BINARY:
+            AddBuffer(array.buffers[1], (count + 1) * sizeof(int64_t));
+            AddBuffer(array.buffers[2], count ? idx_t(GetOffset<int64_t>(array, count)) : 0);
+            break;
+        case BufferLayout::LIST:
+            AddBuffer(array.buffers[1], (count + 1) * sizeof(int32_t));
+            break;
+        case BufferLayout::LARGE_LIST:
+            AddBuffer(array.buffers[1], (count + 1) * sizeof(int64_t));
+            break;
+        default:
+            break;
+        }
+        for (int64_t i = 0; i < field.n_children; i++) {
+            AddArray(*field.children[i], *array.children[i]);
+        }
+    }
+};
+
+void ArrowIPCWriter::WriteRecordBatch(const ArrowSchema& schema, const ArrowArray& array, string& out) {
+    RecordBatchBody body;
+    for (int64_t i = 0; i < schema.n_children; i++) {
+        body.AddArray(*schema.children[i], *array.children[i]);
+    }
+
+    FlatBufferBuilder fbb;
+    auto buffers_ref = fbb.CreatePairVector(body.buffers);
+    auto nodes_ref = fbb.CreatePairVector(body.nodes);
+    fbb.StartTable();
+    fbb.AddScalar<int64_t>(0, array.length);
+    fbb.AddOffset(1, nodes_ref);
+    fbb.AddOffset(2, buffers_ref);
+    auto batch_ref = fbb.EndTable();
+    WriteMessage(fbb.Finish(BuildMessage(fbb, MessageHeader::RECORD_BATCH, batch_ref, int64_t(body.length))), out);
+
+    out.reserve(out.size() + body.length);
+    for (auto& buffer : body.data) {
+        if (buffer.second > 0) {
+            if (buffer.first) {
+                out.append(static_cast<const char*>(buffer.first), buffer.second);
+            } else {
+                out.append(buffer.second, '\0');
+            }
+        }
+        out.append((8 - buffer.second % 8) % 8, '\0');
+    }
+}
+
+void ArrowIPCWriter::WriteEndOfStream(string& out) {
+    uint32_t marker[2] = {0xFFFFFFFF, 0};
+    out.append(reinterpret_cast<const char*>(marker), sizeof(marker));
+}
+
+bool ArrowResultSerializer::IsSupportedType(const LogicalType& type) {
+    switch (type.id()) {
+    case LogicalTypeId::SQLNULL:
+    case LogicalTypeId::BOOLEAN:
+    case LogicalTypeId::TINYINT:
+    case LogicalTypeId::SMALLINT:
+    case LogicalTypeId::INTEGER:
+    case LogicalTypeId::BIGINT:
+    case LogicalTypeId::UTINYINT:
+    case LogicalTypeId::USMALLINT:
+    case LogicalTypeId::UINTEGER:
+    case LogicalTypeId::UBIGINT:
+    case LogicalTypeId::HUGEINT:
+    case LogicalTypeId::FLOAT:
+    case LogicalTypeId::DOUBLE:
+    case LogicalTypeId::DECIMAL:
+    case LogicalTypeId::VARCHAR:
+    case LogicalTypeId::BLOB:
+    case LogicalTypeId::UUID:
+    case LogicalTypeId::DATE:
+    case LogicalTypeId::TIME:
+    case LogicalTypeId::TIMESTAMP:
+    case LogicalTypeId::TIMESTAMP_SEC:
+    case LogicalTypeId::TIMESTAMP_MS:
+    case LogicalTypeId::TIMESTAMP_NS:
+    case LogicalTypeId::TIMESTAMP_TZ:
+    case LogicalTypeId::INTERVAL:
+        return true;
+    case LogicalTypeId::LIST:
+        return IsSupportedType(ListType::GetChildType(type));
+    case LogicalTypeId::ARRAY:
+        return IsSupportedType(ArrayType::GetChildType(type));
+    case LogicalTypeId::MAP:
+        return IsSupportedType(MapType::KeyType(type)) && IsSupportedType(MapType::ValueType(type));
+    case LogicalTypeId::STRUCT:
+        for (auto& child : StructType::GetChildTypes(type)) {
+            if (!IsSupportedType(child.second)) return false;
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+ArrowResultSerializer::ArrowResultSerializer(ClientContext& context, const vector<string>& names_p,
+                                             const vector<LogicalType>& types, ClientProperties options_p)
+    : names(names_p), options(std::move(options_p)) {
+    schema.release = nullptr;
+    for (auto& type : types) {
+        bool supported = IsSupportedType(type);
+        needs_cast.push_back(!supported);
+        arrow_types.push_back(supported ? type : LogicalType::VARCHAR);
+    }
+    extension_types = ArrowTypeExtensionData::GetExtensionTypes(context, arrow_types);
+    cast_chunk.Initialize(Allocator::Get(context), arrow_types);
+}
+
+ArrowResultSerializer::~ArrowResultSerializer() {
+    if (schema.release) {
+        schema.release(&schema);
+    }
+}
+
+void ArrowResultSerializer::Begin(string& out) {
+    ArrowConverter::ToArrowSchema(&schema, arrow_types, names, options);
+    ArrowIPCWriter::WriteSchema(schema, out);
+}
+
+void ArrowResultSerializer::Write(DataChunk& chunk, string& out) {
+    cast_chunk.Reset();
+    for (idx_t col = 0; col < chunk.ColumnCount(); col++) {
+        if (needs_cast[col]) {
+            VectorOperations::DefaultCast(chunk.data[col], cast_chunk.data[col], chunk.size());
+        } else {
+            cast_chunk.data[col].Reference(chunk.data[col]);
+        }
+    }
+    cast_chunk.SetCardinality(chunk.size());
+
+    ArrowArray array;
+    ArrowConverter::ToArrowArray(cast_chunk, &array, options, extension_types);
+    try {
+        ArrowIPCWriter::WriteRecordBatch(schema, array, out);
+    } catch (...) {
+        array.release(&array);
+        throw;
+    }
+    array.release(&array);
+}
+
+void ArrowResultSerializer::End(string& out) {
+    ArrowIPCWriter::WriteEndOfStream(out);
+}
+
+} // namespace duckdb
@@ -0,0 +1,299 @@
+#include "cluster_index.hpp"
+#include "encoding_util.hpp"
+#include "parallel_for.hpp"
+#include "duckdb/main/connection.hpp"
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+
+namespace duckdb {
+
+constexpr idx_t KDTree::NODE_SIZE;
+constexpr int ClusterIndex::MAX_ZOOM;
+constexpr double ClusterIndex::RADIUS;
+constexpr double ClusterIndex::EXTENT;
+
+static constexpr double PI = 3.14159265358979323846;
+static constexpr double MAX_LATITUDE = 85.0511287798066;
+
+static double LonToX(double lon) {
+    return lon / 360.0 + 0.5;
+}
+
+static double LatToY(double lat) {
+    double s = std::sin(std::max(-MAX_LATITUDE, std::min(MAX_LATITUDE, lat)) * PI / 180.0);
+    return 0.5 - 0.25 * std::log((1 + s) / (1 - s)) / PI;
+}
+
+static double XToLon(double x) {
+    return (x - 0.5) * 360.0;
+}
+
+static double YToLat(double y) {
+    return std::atan(std::sinh(PI * (1 - 2 * y))) * 180.0 / PI;
+}
+
+KDTree::KDTree(const vector<double>& xy, WorkerPool& pool, idx_t thread_count) : ids(xy.size() / 2) {
+    std::iota(ids.begin(), ids.end(), 0);
+    // 上の方の階層の左右をスレッドに分けて並べる
+    idx_t parallel_depth = 0;
+    while ((idx_t(1) << parallel_depth) < thread_count) parallel_depth++;
+    if (!ids.empty()) Sort(xy, 0, ids.size() - 1, 0, pool, parallel_depth);
+
+    coords.resize(xy.size());
+    ParallelFor(pool, ids.size(), thread_count, [&](idx_t begin, idx_t end) {
+        for (idx_t i = begin; i < end; i++) {
+            coords[i * 2] = xy[ids[i] * 2];
+            coords[i * 2 + 1] = xy[ids[i] * 2 + 1];
+        }
+    });
+}
+
+void KDTree::Sort(const vector<double>& xy, idx_t left, idx_t right, idx_t axis, WorkerPool& pool,
+                  idx_t parallel_depth) {
+    if (right - left <= NODE_SIZE) return;
+    idx_t middle = (left + right) >> 1;
+    std::nth_element(ids.begin() + left, ids.begin() + middle, ids.begin() + right + 1,
+                     [&](uint32_t a, uint32_t b) { return xy[a * 2 + axis] < xy[b * 2 + axis]; });
+    if (parallel_depth > 0 && right - left >= MIN_ITEMS_PER_THREAD) {
+        // 左右を2つの区間としてプールと自分で分け合う
+        ParallelFor(pool, 2, 2, [&](idx_t begin, idx_t end) {
+            for (idx_t side = begin; side < end; side++) {
+                if (side == 0) {
+                    Sort(xy, left, middle - 1, 1 - axis, pool, parallel_depth - 1);
+                } else {
+                    Sort(xy, middle + 1, right, 1 - axis, pool, parallel_depth - 1);
+                }
+            }
+        }, 1);
+        return;
+    }
+    Sort(xy, left, middle - 1, 1 - axis, pool, 0);
+    Sort(xy, middle + 1, right, 1 - axis, pool, 0);
+}
+
+template <class FUNC>
+void KDTree::Visit(const BoundingBox& box, FUNC&& fn) const {
+    if (ids.empty()) return;
+    auto visit = [&](idx_t i) {
+        double x = coords[i * 2], y = coords[i * 2 + 1];
+        if (x >= box.min_x && x <= box.max_x && y >= box.min_y && y <= box.max_y) fn(i, x, y);
+    };
+    // (left, right, axis)。区間は毎回半分になるので、深さ優先なら積まれるのは高々 2 * 64 個
+    std::array<idx_t, 3> stack[128];
+    idx_t depth = 0;
+    stack[depth++] = {{0, ids.size() - 1, 0}};
+    while (depth > 0) {
+        auto node = stack[--depth];
+        idx_t left = node[0], right = node[1], axis = node[2];
+        if (right - left <= NODE_SIZE) {
+            for (idx_t i = left; i <= right; i++) visit(i);
+            continue;
+        }
+        idx_t middle = (left + right) >> 1;
+        visit(middle);
+        double value = coords[middle * 2 + axis];
+        if ((axis == 0 ? box.min_x : box.min_y) <= value) stack[depth++] = {{left, middle - 1, 1 - axis}};
+        if ((axis == 0 ? box.max_x : box.max_y) >= value) stack[depth++] = {{middle + 1, right, 1 - axis}};
+    }
+}
+
+void KDTree::Range(const BoundingBox& box, vector<uint32_t>& out) const {
+    out.clear();
+    Visit(box, [&](idx_t i, double, double) { out.push_back(ids[i]); });
+}
+
+void KDTree::Within(double x, double y, double radius, vector<uint32_t>& out) const {
+    out.clear();
+    double r2 = radius * radius;
+    Visit(BoundingBox {x - radius, y - radius, x + radius, y + radius}, [&](idx_t i, double px, double py) {
+        if ((px - x) * (px - x) + (py - y) * (py - y) <= r2) out.push_back(ids[i]);
+    });
+}
+
+ClusterIndex::ClusterIndex(const vector<double>& lon_lat, vector<int64_t> row_ids, WorkerPool& pool, idx_t thread_count)
+    : levels(MAX_ZOOM + 2) {
+    auto& points = levels.back();
+    idx_t count = lon_lat.size() / 2;
+    points.xy.resize(count * 2);
+    ParallelFor(pool, count, thread_count, [&](idx_t begin, idx_t end) {
+        for (idx_t i = begin; i < end; i++) {
+            points.xy[i * 2] = LonToX(lon_lat[i * 2]);
+            points.xy[i * 2 + 1] = LatToY(lon_lat[i * 2 + 1]);
+        }
+    });
+    points.counts.assign(count, 1);
+    points.row_ids = std::move(row_ids);
+    points.tree = make_uniq<KDTree>(points.xy, pool, thread_count);
+
+    // 各階層のまとめ方は1つ上の階層の結果に依存するので、ズームの順に作る（KD木の構築は並列）
+    for (int zoom = MAX_ZOOM; zoom >= 0; zoom--) {
+        auto& level = levels[zoom];
+        Cluster(levels[zoom + 1], zoom, level);
+        level.tree = make_uniq<KDTree>(level.xy, pool, thread_count);
+    }
+}
+
+void ClusterIndex::Cluster(const Level& next, int zoom, Level& out) {
+    double radius = RADIUS / (EXTENT * std::ldexp(1.0, zoom));
+    idx_t count = next.counts.size();
+    vector<bool> visited(count, false);
+    vector<uint32_t> neighbors;
+    // 近い点を続けて調べると木の同じ辺りを辿るので、木の並びの順にまとめていく
+    for (idx_t i : next.tree->Order()) {
+        if (visited[i]) continue;
+        visited[i] = true;
+        double x = next.xy[i * 2], y = next.xy[i * 2 + 1];
+        next.tree->Within(x, y, radius, neighbors);
+
+        // 近くのまだまとめていない点と合わせ、点の数で重み付けした重心に置く
+        double weight = next.counts[i];
+        double wx = x * weight, wy = y * weight;
+        uint32_t total = next.counts[i];
+        for (auto neighbor : neighbors) {
+            if (visited[neighbor]) continue;
+            visited[neighbor] = true;
+            double w = next.counts[neighbor];
+            wx += next.xy[neighbor * 2] * w;
+            wy += next.xy[neighbor * 2 + 1] * w;
+            total += next.counts[neighbor];
+        }
+        if (total == next.counts[i]) {
+            out.xy.push_back(x);
+            out.xy.push_back(y);
+            out.counts.push_back(total);
+            out.row_ids.push_back(next.row_ids[i]);
+        } else {
+            out.xy.push_back(wx / total);
+            out.xy.push_back(wy / total);
+            out.counts.push_back(total);
+            out.row_ids.push_back(-1);
+        }
+    }
+}
+
+string ClusterIndex::QueryJSON(int zoom, const BoundingBox& box) const {
+    zoom = std::max(0, std::min(MAX_ZOOM + 1, zoom));
+    auto& level = levels[zoom];
+    vector<uint32_t> found;
+    level.tree->Range(BoundingBox {LonToX(box.min_x), LatToY(box.max_y), LonToX(box.max_x), LatToY(box.min_y)},
+                      found);
+
+    string lons, lats, counts, row_ids;
+    char buf[32];
+    for (idx_t i = 0; i < found.size(); i++) {
+        auto id = found[i];
+        const char* sep = i > 0 ? "," : "";
+        snprintf(buf, sizeof(buf), "%s%.15g", sep, XToLon(level.xy[id * 2]));
+        lons += buf;
+        snprintf(buf, sizeof(buf), "%s%.15g", sep, YToLat(level.xy[id * 2 + 1]));
+        lats += buf;
+        counts += sep + std::to_string(level.counts[id]);
+        row_ids += sep;
+        row_ids += level.row_ids[id] < 0 ? "null" : std::to_string(level.row_ids[id]);
+    }
+    return "{\"zoom\":" + std::to_string(zoom) + ",\"clusters\":" + std::to_string(found.size()) + ",\"lon\":[" + lons +
+           "],\"lat\":[" + lats + "],\"count\":[" + counts + "],\"rowid\":[" + row_ids + "]}";
+}
+
+idx_t ClusterIndex::MemoryUsage() const {
+    idx_t bytes = 0;
+    for (auto& level : levels) {
+        bytes += level.xy.size() * sizeof(double) + level.counts.size() * sizeof(uint32_t) +
+                 level.row_ids.size() * sizeof(int64_t) + level.tree->MemoryUsage();
+    }
+    return bytes;
+}
+
+shared_ptr<const ClusterIndex> ClusterIndexManager::Build(Connection& conn, const string& table_name,
+                                                          const string& geom_col, WorkerPool& pool, idx_t threads) {
+    auto result = conn.SendQuery("SELECT rowid, ST_X(" + geom_col + "), ST_Y(" + geom_col + ") FROM " +
+                                 QuoteIdentifier(table_name) + " WHERE ST_GeometryType(" + geom_col + ") = 'POINT'");
+    if (result->HasError()) return nullptr;
+
+    vector<double> lon_lat;
+    vector<int64_t> row_ids;
+    while (true) {
+        auto chunk = result->Fetch();
+        if (!chunk || chunk->size() == 0) break;
+        idx_t count = chunk->size();
+        UnifiedVectorFormat data[3];
+        for (idx_t col = 0; col < 3; col++) {
+            chunk->data[col].ToUnifiedFormat(count, data[col]);
+        }
+        auto rowids = UnifiedVectorFormat::GetData<int64_t>(data[0]);
+        auto xs = UnifiedVectorFormat::GetData<double>(data[1]);
+        auto ys = UnifiedVectorFormat::GetData<double>(data[2]);
+        for (idx_t row = 0; row < count; row++) {
+            auto x_idx = data[1].sel->get_index(row);
+            auto y_idx = data[2].sel->get_index(row);
+            // 空の点（POINT EMPTY）は座標を持たない
+            if (!data[1].validity.RowIsValid(x_idx) || !data[2].validity.RowIsValid(y_idx)) continue;
+            if (!std::isfinite(xs[x_idx]) || !std::isfinite(ys[y_idx])) continue;
+            lon_lat.push_back(xs[x_idx]);
+            lon_lat.push_back(ys[y_idx]);
+            row_ids.push_back(rowids[data[0].sel->get_index(row)]);
+        }
+    }
+    if (result->HasError()) return nullptr;
+
+    return make_shared_ptr<const ClusterIndex>(lon_lat, std::move(row_ids), pool, std::max<idx_t>(1, threads));
+}
+
+shared_ptr<const ClusterIndex> ClusterIndexManager::Get(Connection& conn, const string& table_name,
+                                                        const string& geom_col, uint64_t version, idx_t threads) {
+    std::promise<shared_ptr<const ClusterIndex>> promise;
+    std::shared_future<shared_ptr<const ClusterIndex>> index;
+    bool build = false;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto entry = entries.find(table_name);
+        if (entry != entries.end() && entry->second.version >= version) {
+            index = entry->second.index;
+        } else {
+            index = promise.get_future().share();
+            entries[table_name] = Entry {version, index};
+            build = true;
+        }
+    }
+    if (build) {
+        shared_ptr<const ClusterIndex> clusters;
+        try {
+            clusters = Build(conn, table_name, geom_col, pool, threads);
+        } catch (std::exception&) {
+            clusters = nullptr;
+        }
+        if (clusters) {
+            builds++;
+        } else {
+            std::lock_guard<std::mutex> guard(lock);
+            auto entry = entries.find(table_name);
+            if (entry != entries.end() && entry->second.version == version) entries.erase(entry);
+        }
+        promise.set_value(clusters);
+    }
+    return index.get();
+}
+
+string ClusterIndexManager::StatsJSON() {
+    idx_t tables = 0;
+    idx_t points = 0;
+    idx_t bytes = 0;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto& entry : entries) {
+            auto& index = entry.second.index;
+            if (index.wait_for(std::chrono::seconds(0)) != std::future_status::ready || !index.get()) continue;
+            tables++;
+            points += index.get()->Size();
+            bytes += index.get()->MemoryUsage();
+        }
+    }
+    return "{\"tables\":" + std::to_string(tables) + ",\"points\":" + std::to_string(points) +
+           ",\"bytes\":" + std::to_string(bytes) + ",\"builds\":" + std::to_string(builds.load()) + "}";
+}
+
+} // namespace duckdb
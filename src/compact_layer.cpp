@@ -0,0 +1,259 @@
+#include "compact_layer.hpp"
+#include "encoding_util.hpp"
+#include "geometry_ops.hpp"
+#include "duckdb/common/vector_operations/vector_operations.hpp"
+
+#include <cmath>
+
+namespace duckdb {
+
+constexpr int CompactLayerBuilder::MAX_PRECISION;
+constexpr int CompactLayerBuilder::DEFAULT_PRECISION;
+constexpr const char* CompactLayerBuilder::CONTENT_TYPE;
+constexpr uint32_t CompactLayerBuilder::INVALID_VALUE;
+
+namespace {
+
+enum ValueKind : uint8_t { STRING = 0, DOUBLE = 1, SINT = 2, UINT = 3, FALSE_VALUE = 4, TRUE_VALUE = 5 };
+
+static void WriteString(const char* data, idx_t len, string& out) {
+    WriteVarint(len, out);
+    out.append(data, len);
+}
+
+// 先頭3列（x, y, wkb）の後が属性
+static constexpr idx_t FIRST_PROPERTY = 3;
+
+} // namespace
+
+CompactLayerBuilder::CompactLayerBuilder(const vector<string>& names, const vector<LogicalType>& types_p,
+                                         int precision_p, double tolerance_p)
+    : types(types_p), precision(precision_p), scale(std::pow(10.0, precision_p)), tolerance(tolerance_p) {
+    for (idx_t col = FIRST_PROPERTY; col < names.size(); col++) {
+        keys.push_back(names[col]);
+    }
+    formats.resize(keys.size());
+    casts.resize(keys.size());
+}
+
+int CompactLayerBuilder::ZoomPrecision(int zoom) {
+    double per_degree = 10.0 * 256.0 * double(uint64_t(1) << zoom) / 360.0;
+    return std::max(0, std::min(MAX_PRECISION, int(std::ceil(std::log10(per_degree)))));
+}
+
+uint32_t CompactLayerBuilder::Intern(const string& encoded) {
+    auto entry = value_index.find(encoded);
+    if (entry != value_index.end()) return entry->second;
+    auto id = uint32_t(values.size());
+    values.push_back(encoded);
+    value_index[encoded] = id;
+    return id;
+}
+
+uint32_t CompactLayerBuilder::InternValue(idx_t col, idx_t row) {
+    auto& format = formats[col];
+    auto idx = format.sel->get_index(row);
+    if (!format.validity.RowIsValid(idx)) return INVALID_VALUE;
+    string encoded;
+    auto write_int = [&](int64_t value) {
+        encoded += char(SINT);
+        WriteVarint(ZigZag(value), encoded);
+    };
+    auto write_uint = [&](uint64_t value) {
+        encoded += char(UINT);
+        WriteVarint(value, encoded);
+    };
+    auto id = casts[col] ? LogicalTypeId::VARCHAR : types[col + FIRST_PROPERTY].id();
+    switch (id) {
+    case LogicalTypeId::BOOLEAN:
+        encoded += char(UnifiedVectorFormat::GetData<bool>(format)[idx] ? TRUE_VALUE : FALSE_VALUE);
+        break;
+    case LogicalTypeId::TINYINT:
+        write_int(UnifiedVectorFormat::GetData<int8_t>(format)[idx]);
+        break;
+    case LogicalTypeId::SMALLINT:
+        write_int(UnifiedVectorFormat::GetData<int16_t>(format)[idx]);
+        break;
+    case LogicalTypeId::INTEGER:
+        write_int(UnifiedVectorFormat::GetData<int32_t>(format)[idx]);
+        break;
+    case LogicalTypeId::BIGINT:
+        write_int(UnifiedVectorFormat::GetData<int64_t>(format)[idx]);
+        break;
+    case LogicalTypeId::UTINYINT:
+        write_uint(UnifiedVectorFormat::GetData<uint8_t>(format)[idx]);
+        break;
+    case LogicalTypeId::USMALLINT:
+        write_uint(UnifiedVectorFormat::GetData<uint16_t>(format)[idx]);
+        break;
+    case LogicalTypeId::UINTEGER:
+        write_uint(UnifiedVectorFormat::GetData<uint32_t>(format)[idx]);
+        break;
+    case LogicalTypeId::UBIGINT:
+        write_uint(UnifiedVectorFormat::GetData<uint64_t>(format)[idx]);
+        break;
+    case LogicalTypeId::FLOAT:
+    case LogicalTypeId::DOUBLE: {
+        double value = id == LogicalTypeId::FLOAT ? double(UnifiedVectorFormat::GetData<float>(format)[idx])
+                                                  : UnifiedVectorFormat::GetData<double>(format)[idx];
+        // NaN/Infは属性なしとして扱う
+        if (!std::isfinite(value)) return INVALID_VALUE;
+        // 整数値なら可変長整数の方が短い
+        if (value == std::trunc(value) && std::fabs(value) < 9007199254740992.0) {
+            write_int(int64_t(value));
+            break;
+        }
+        encoded += char(DOUBLE);
+        encoded.append(reinterpret_cast<const char*>(&value), sizeof(double));
+        break;
+    }
+    default: {
+        auto& str = UnifiedVectorFormat::GetData<string_t>(format)[idx];
+        encoded += char(STRING);
+        WriteString(str.GetData(), str.GetSize(), encoded);
+        break;
+    }
+    }
+    return Intern(encoded);
+}
+
+bool CompactLayerBuilder::WritePosition(double x, double y) {
+    double qx = std::round(x * scale);
+    double qy = std::round(y * scale);
+    // 経度緯度以外の座標系で極端に大きい値は表せない
+    if (!(std::fabs(qx) < 4e18) || !(std::fabs(qy) < 4e18)) return false;
+    auto ix = int64_t(qx);
+    auto iy = int64_t(qy);
+    WriteVarint(ZigZag(ix - last_x), features);
+    WriteVarint(ZigZag(iy - last_y), features);
+    last_x = ix;
+    last_y = iy;
+    return true;
+}
+
+bool CompactLayerBuilder::WriteRing(const Geometry& geom, idx_t ring, bool polygon) {
+    idx_t start = geom.rings[ring];
+    idx_t count = geom.rings[ring + 1] - start;
+    auto xy = &geom.xy[start * 2];
+    // 閉じたリングの最後の頂点は先頭と同じなので書かない
+    if (polygon && count > 1 && std::round(xy[0] * scale) == std::round(xy[(count - 1) * 2] * scale) &&
+        std::round(xy[1] * scale) == std::round(xy[(count - 1) * 2 + 1] * scale)) {
+        count--;
+    }
+    WriteVarint(count, features);
+    for (idx_t v = 0; v < count; v++) {
+        if (!WritePosition(xy[v * 2], xy[v * 2 + 1])) return false;
+    }
+    return true;
+}
+
+bool CompactLayerBuilder::WritePart(const Geometry& geom, idx_t part) {
+    switch (geom.type) {
+    case GeometryType::POINT: {
+        auto v = geom.rings[geom.parts[part]];
+        return WritePosition(geom.xy[v * 2], geom.xy[v * 2 + 1]);
+    }
+    case GeometryType::LINESTRING:
+        return WriteRing(geom, geom.parts[part], false);
+    default:
+        WriteVarint(geom.parts[part + 1] - geom.parts[part], features);
+        for (idx_t ring = geom.parts[part]; ring < geom.parts[part + 1]; ring++) {
+            if (!WriteRing(geom, ring, true)) return false;
+        }
+        return true;
+    }
+}
+
+bool CompactLayerBuilder::WriteGeometry(const Geometry& geom) {
+    bool multi = geom.multi || geom.PartCount() > 1;
+    WriteVarint(uint8_t(geom.type) + (multi ? 3 : 0), features);
+    if (multi) WriteVarint(geom.PartCount(), features);
+    for (idx_t part = 0; part < geom.PartCount(); part++) {
+        if (!WritePart(geom, part)) return false;
+    }
+    return true;
+}
+
+void CompactLayerBuilder::WriteProperties(idx_t row) {
+    tags.clear();
+    for (idx_t col = 0; col < keys.size(); col++) {
+        auto value = InternValue(col, row);
+        if (value == INVALID_VALUE) continue;
+        tags.push_back(uint32_t(col));
+        tags.push_back(value);
+    }
+    WriteVarint(tags.size() / 2, features);
+    for (auto tag : tags) {
+        WriteVarint(tag, features);
+    }
+}
+
+void CompactLayerBuilder::AddChunk(DataChunk& chunk) {
+    idx_t count = chunk.size();
+    for (idx_t col = 0; col < keys.size(); col++) {
+        auto& vec = chunk.data[col + FIRST_PROPERTY];
+        if (IsNativeValueType(types[col + FIRST_PROPERTY].id())) {
+            vec.ToUnifiedFormat(count, formats[col]);
+            continue;
+        }
+        casts[col] = make_uniq<Vector>(LogicalType::VARCHAR, count);
+        VectorOperations::DefaultCast(vec, *casts[col], count);
+        casts[col]->ToUnifiedFormat(count, formats[col]);
+    }
+
+    UnifiedVectorFormat x_data, y_data, wkb_data;
+    chunk.data[0].ToUnifiedFormat(count, x_data);
+    chunk.data[1].ToUnifiedFormat(count, y_data);
+    chunk.data[2].ToUnifiedFormat(count, wkb_data);
+    auto xs = UnifiedVectorFormat::GetData<double>(x_data);
+    auto ys = UnifiedVectorFormat::GetData<double>(y_data);
+    auto wkbs = UnifiedVectorFormat::GetData<string_t>(wkb_data);
+
+    for (idx_t row = 0; row < count; row++) {
+        auto x_idx = x_data.sel->get_index(row);
+        auto y_idx = y_data.sel->get_index(row);
+        auto wkb_idx = wkb_data.sel->get_index(row);
+        auto feature_start = features.size();
+        auto start_x = last_x;
+        auto start_y = last_y;
+        bool written;
+        // 点の高速パス：WKBを経由せずx/yをそのまま使う
+        if (x_data.validity.RowIsValid(x_idx) && y_data.validity.RowIsValid(y_idx)) {
+            WriteVarint(uint8_t(GeometryType::POINT), features);
+            written = WritePosition(xs[x_idx], ys[y_idx]);
+        } else {
+            if (!wkb_data.validity.RowIsValid(wkb_idx)) continue;
+            auto& wkb = wkbs[wkb_idx];
+            if (!WKBReader::Read(wkb.GetData(), wkb.GetSize(), geom) || geom.IsEmpty()) continue;
+            GeometryOps::Simplify(geom, tolerance);
+            if (geom.IsEmpty()) continue;
+            written = WriteGeometry(geom);
+        }
+        if (!written) {
+            features.resize(feature_start);
+            last_x = start_x;
+            last_y = start_y;
+            continue;
+        }
+        WriteProperties(row);
+        feature_count++;
+    }
+}
+
+string CompactLayerBuilder::Finish() const {
+    string out = "DGLC";
+    WriteVarint(uint64_t(precision), out);
+    WriteVarint(keys.size(), out);
+    for (auto& key : keys) {
+        WriteString(key.data(), key.size(), out);
+    }
+    WriteVarint(values.size(), out);
+    for (auto& value : values) {
+        out += value;
+    }
+    WriteVarint(feature_count, out);
+    out += features;
+    return out;
+}
+
+} // namespace duckdb
@@ -0,0 +1,115 @@
+#include "connection_pool.hpp"
+#include "duckdb/main/connection.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+namespace duckdb {
+
+PooledConnection::PooledConnection(ConnectionPool* pool_p, unique_ptr<Connection> conn_p)
+    : pool(pool_p), conn(std::move(conn_p)) {
+}
+
+PooledConnection::PooledConnection(PooledConnection&& other) noexcept
+    : pool(other.pool), conn(std::move(other.conn)), reusable(other.reusable) {
+    other.pool = nullptr;
+}
+
+PooledConnection& PooledConnection::operator=(PooledConnection&& other) noexcept {
+    if (this != &other) {
+        Release();
+        pool = other.pool;
+        conn = std::move(other.conn);
+        reusable = other.reusable;
+        other.pool = nullptr;
+    }
+    return *this;
+}
+
+PooledConnection::~PooledConnection() {
+    Release();
+}
+
+void PooledConnection::Release() {
+    if (pool && conn) {
+        pool->Release(std::move(conn), reusable);
+    }
+    pool = nullptr;
+}
+
+ConnectionPool::ConnectionPool(DatabaseInstance& db_p, idx_t size_p) : db(db_p), size(std::max<idx_t>(1, size_p)) {
+}
+
+PooledConnection ConnectionPool::Acquire() {
+    acquired++;
+    std::unique_lock<std::mutex> guard(lock);
+    if (idle.empty() && open >= size) {
+        auto start = std::chrono::steady_clock::now();
+        available.wait(guard, [&]() { return !idle.empty() || open < size; });
+        auto micros = uint64_t(
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+        waited++;
+        wait_micros += micros;
+        auto max = max_wait_micros.load();
+        while (micros > max && !max_wait_micros.compare_exchange_weak(max, micros)) {
+        }
+    }
+    if (!idle.empty()) {
+        auto conn = std::move(idle.back());
+        idle.pop_back();
+        return PooledConnection(this, std::move(conn));
+    }
+    // 接続の作成（ClientContextの構築）はロックの外で行う
+    open++;
+    guard.unlock();
+    try {
+        auto conn = make_uniq<Connection>(db);
+        created++;
+        return PooledConnection(this, std::move(conn));
+    } catch (...) {
+        std::lock_guard<std::mutex> relock(lock);
+        open--;
+        available.notify_one();
+        throw;
+    }
+}
+
+void ConnectionPool::Release(unique_ptr<Connection> conn, bool reusable) {
+    if (reusable) {
+        // 途中で終わったリクエストのトランザクションを次の利用者に持ち越さない
+        try {
+            if (conn->HasActiveTransaction()) conn->Rollback();
+        } catch (std::exception&) {
+            reusable = false;
+        }
+    }
+    if (!reusable) {
+        conn.reset();
+        discarded++;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    if (conn) {
+        idle.push_back(std::move(conn));
+    } else {
+        open--;
+    }
+    available.notify_one();
+}
+
+string ConnectionPool::StatsJSON() {
+    idx_t open_count, idle_count;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        open_count = open;
+        idle_count = idle.size();
+    }
+    char wait[64];
+    snprintf(wait, sizeof(wait), "\"wait_ms\":%.3f,\"max_wait_ms\":%.3f", double(wait_micros.load()) / 1000.0,
+             double(max_wait_micros.load()) / 1000.0);
+    return "{\"size\":" + std::to_string(size) + ",\"open\":" + std::to_string(open_count) +
+           ",\"idle\":" + std::to_string(idle_count) + ",\"acquired\":" + std::to_string(acquired.load()) +
+           ",\"waited\":" + std::to_string(waited.load()) + "," + wait + ",\"created\":" +
+           std::to_string(created.load()) + ",\"discarded\":" + std::to_string(discarded.load()) + "}";
+}
+
+} // namespace duckdb
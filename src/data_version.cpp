@@ -0,0 +1,177 @@
+#include "data_version.hpp"
+#include "duckdb/common/string_util.hpp"
+#include "duckdb/main/client_context.hpp"
+#include "duckdb/main/client_context_state.hpp"
+#include "duckdb/main/config.hpp"
+#include "duckdb/main/prepared_statement_data.hpp"
+#include "duckdb/parser/parsed_data/copy_info.hpp"
+#include "duckdb/parser/parsed_data/create_table_info.hpp"
+#include "duckdb/parser/parsed_data/create_view_info.hpp"
+#include "duckdb/parser/parsed_data/drop_info.hpp"
+#include "duckdb/parser/statement/copy_statement.hpp"
+#include "duckdb/parser/statement/create_statement.hpp"
+#include "duckdb/parser/statement/delete_statement.hpp"
+#include "duckdb/parser/statement/drop_statement.hpp"
+#include "duckdb/parser/statement/insert_statement.hpp"
+#include "duckdb/parser/statement/update_statement.hpp"
+#include "duckdb/parser/tableref/basetableref.hpp"
+#include "duckdb/planner/extension_callback.hpp"
+#include "duckdb/transaction/meta_transaction.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace duckdb {
+
+// どのテーブルへの書き込みでも増える値。テーブルごとの値もここから払い出す
+static std::atomic<uint64_t> data_version {1};
+
+static std::mutex versions_lock;
+// 書き込み先の分からないコミットの値（全テーブルに効く）
+static uint64_t all_version = 1;
+// DDLの値
+static uint64_t catalog_version = 1;
+// 小文字のテーブル名ごとの最後の書き込みの値
+static std::unordered_map<string, uint64_t> table_versions;
+
+namespace {
+
+class WriteTracker : public ClientContextState {
+public:
+    RebindQueryInfo OnFinalizePrepare(ClientContext& context, PreparedStatementData& prepared,
+                                      PreparedStatementMode mode) override {
+        // PREPARE だけのときは実行時（OnExecutePrepared）に記録する
+        if (mode == PreparedStatementMode::PREPARE_AND_EXECUTE) Record(prepared);
+        return RebindQueryInfo::DO_NOT_REBIND;
+    }
+
+    RebindQueryInfo OnExecutePrepared(ClientContext& context, PreparedStatementCallbackInfo& info,
+                                      RebindQueryInfo current_rebind) override {
+        Record(info.prepared_statement);
+        return current_rebind;
+    }
+
+    void TransactionCommit(MetaTransaction& transaction, ClientContext& context) override {
+        // 読み取りだけのトランザクションではバージョンを変えない
+        if (transaction.ModifiedDatabase()) {
+            std::lock_guard<std::mutex> guard(versions_lock);
+            auto version = ++data_version;
+            for (auto& table : tables) {
+                table_versions[table] = version;
+            }
+            // 文を経由しない書き込み（Appenderなど）は書き込み先が記録されない
+            if (unknown || tables.empty()) all_version = version;
+            if (unknown || ddl || tables.empty()) catalog_version = version;
+        }
+        Clear();
+    }
+
+    void TransactionRollback(MetaTransaction& transaction, ClientContext& context) override {
+        Clear();
+    }
+
+private:
+    void Record(PreparedStatementData& prepared) {
+        if (prepared.properties.IsReadOnly() || !prepared.unbound_statement) return;
+        auto& statement = *prepared.unbound_statement;
+        switch (statement.type) {
+        case StatementType::INSERT_STATEMENT:
+            Add(statement.Cast<InsertStatement>().table);
+            return;
+        case StatementType::DELETE_STATEMENT:
+            AddRef(*statement.Cast<DeleteStatement>().table);
+            return;
+        case StatementType::UPDATE_STATEMENT:
+            AddRef(*statement.Cast<UpdateStatement>().table);
+            return;
+        case StatementType::CREATE_STATEMENT: {
+            auto& info = *statement.Cast<CreateStatement>().info;
+            ddl = true;
+            if (info.type == CatalogType::TABLE_ENTRY) {
+                Add(info.Cast<CreateTableInfo>().table);
+            } else if (info.type == CatalogType::VIEW_ENTRY) {
+                Add(info.Cast<CreateViewInfo>().view_name);
+            }
+            // インデックスなどはテーブルの内容を変えない
+            return;
+        }
+        case StatementType::DROP_STATEMENT:
+            ddl = true;
+            Add(statement.Cast<DropStatement>().info->name);
+            return;
+        case StatementType::COPY_STATEMENT: {
+            auto& info = *statement.Cast<CopyStatement>().info;
+            if (info.is_from) {
+                Add(info.table);
+            } else {
+                unknown = true;
+            }
+            return;
+        }
+        default:
+            // ALTER・ATTACH など書き込み先を特定できないもの
+            unknown = true;
+            return;
+        }
+    }
+
+    void AddRef(TableRef& ref) {
+        if (ref.type == TableReferenceType::BASE_TABLE) {
+            Add(ref.Cast<BaseTableRef>().table_name);
+        } else {
+            unknown = true;
+        }
+    }
+
+    void Add(const string& table) {
+        tables.insert(StringUtil::Lower(table));
+    }
+
+    void Clear() {
+        tables.clear();
+        unknown = false;
+        ddl = false;
+    }
+
+    // 実行中のトランザクションが書き込んだテーブル
+    std::unordered_set<string> tables;
+    bool unknown = false;
+    bool ddl = false;
+};
+
+class WriteTrackerCallback : public ExtensionCallback {
+public:
+    void OnConnectionOpened(ClientContext& context) override {
+        DataVersion::Track(context);
+    }
+};
+
+} // namespace
+
+uint64_t DataVersion::Current() {
+    return data_version.load();
+}
+
+uint64_t DataVersion::Current(const string& table_name) {
+    std::lock_guard<std::mutex> guard(versions_lock);
+    auto entry = table_versions.find(StringUtil::Lower(table_name));
+    if (entry == table_versions.end()) return all_version;
+    return MaxValue(all_version, entry->second);
+}
+
+uint64_t DataVersion::Catalog() {
+    std::lock_guard<std::mutex> guard(versions_lock);
+    return catalog_version;
+}
+
+void DataVersion::Register(DatabaseInstance& db) {
+    DBConfig::GetConfig(db).extension_callbacks.push_back(make_uniq<WriteTrackerCallback>());
+}
+
+void DataVersion::Track(ClientContext& context) {
+    context.registered_state->GetOrCreate<WriteTracker>("duckgl_write_tracker");
+}
+
+} // namespace duckdb
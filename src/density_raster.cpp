@@ -0,0 +1,276 @@
+#include "density_raster.hpp"
+#include "encoding_util.hpp"
+#include "parallel_for.hpp"
+#include "png_writer.hpp"
+#include "duckdb/main/query_result.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+
+namespace duckdb {
+
+constexpr uint8_t TransferFunction::MIN_ALPHA;
+constexpr const char* DensityRaster::FLOAT32_CONTENT_TYPE;
+
+bool TransferFunction::ParseHow(const string& value, string& error) {
+    if (value.empty() || value == "eq_hist") {
+        how = How::EQ_HIST;
+    } else if (value == "linear") {
+        how = How::LINEAR;
+    } else if (value == "log") {
+        how = How::LOG;
+    } else if (value == "cbrt") {
+        how = How::CBRT;
+    } else {
+        error = "how must be linear, log, cbrt or eq_hist";
+        return false;
+    }
+    return true;
+}
+
+bool TransferFunction::ParseColorMap(const string& value, string& error) {
+    if (value.empty() || value == "fire") {
+        cmap = ColorMap::FIRE;
+    } else if (value == "viridis") {
+        cmap = ColorMap::VIRIDIS;
+    } else if (value == "blues") {
+        cmap = ColorMap::BLUES;
+    } else {
+        error = "cmap must be fire, viridis or blues";
+        return false;
+    }
+    return true;
+}
+
+DensityRaster::DensityRaster(const TileProjection& projection_p)
+    : projection(projection_p), size(projection_p.Extent()), grid(idx_t(size) * size, 0) {
+}
+
+string DensityRaster::BuildSQL(const string& table_name, const string& geom_col, const string& weight,
+                               const string& filter) {
+    string is_point = "ST_GeometryType(" + geom_col + ") = 'POINT'";
+    string sql = "SELECT CASE WHEN " + is_point + " THEN ST_X(" + geom_col + ") END AS x, "
+                 "CASE WHEN " + is_point + " THEN ST_Y(" + geom_col + ") END AS y, "
+                 "CASE WHEN NOT " + is_point + " THEN ST_AsWKB(" + geom_col + ") END AS wkb";
+    if (!weight.empty()) sql += ", " + QuoteIdentifier(weight) + "::DOUBLE AS weight";
+    sql += " FROM " + QuoteIdentifier(table_name) + " WHERE " + geom_col + " IS NOT NULL";
+    if (!filter.empty()) sql += " AND " + filter;
+    return sql;
+}
+
+void DensityRaster::AddSegment(double x0, double y0, double x1, double y1, float weight, vector<float>& target,
+                               int64_t& last) const {
+    // Liang–Barskyで [0, size] の範囲に切り詰める
+    double t0 = 0, t1 = 1;
+    double dx = x1 - x0, dy = y1 - y0;
+    double p[4] = {-dx, dx, -dy, dy};
+    double q[4] = {x0, size - x0, y0, size - y0};
+    for (int i = 0; i < 4; i++) {
+        if (p[i] == 0) {
+            if (q[i] < 0) return;
+            continue;
+        }
+        double t = q[i] / p[i];
+        if (p[i] < 0) {
+            t0 = std::max(t0, t);
+        } else {
+            t1 = std::min(t1, t);
+        }
+        if (t0 > t1) return;
+    }
+    double sx = x0 + t0 * dx, sy = y0 + t0 * dy;
+    double ex = x0 + t1 * dx, ey = y0 + t1 * dy;
+
+    // 長い方の軸で1画素ずつ進め、通った画素に1回ずつ足す
+    idx_t steps = idx_t(std::ceil(std::max(std::fabs(ex - sx), std::fabs(ey - sy))));
+    int64_t max_index = int64_t(size) - 1;
+    for (idx_t step = 0; step <= steps; step++) {
+        double t = steps == 0 ? 0 : double(step) / double(steps);
+        auto px = std::min(max_index, std::max<int64_t>(0, int64_t(sx + (ex - sx) * t)));
+        auto py = std::min(max_index, std::max<int64_t>(0, int64_t(sy + (ey - sy) * t)));
+        int64_t index = py * size + px;
+        if (index == last) continue;
+        target[index] += weight;
+        last = index;
+    }
+}
+
+void DensityRaster::AddChunk(DataChunk& chunk, vector<float>& target, Geometry& scratch) const {
+    idx_t count = chunk.size();
+    bool weighted = chunk.ColumnCount() > 3;
+    UnifiedVectorFormat x_data, y_data, wkb_data, weight_data;
+    chunk.data[0].ToUnifiedFormat(count, x_data);
+    chunk.data[1].ToUnifiedFormat(count, y_data);
+    chunk.data[2].ToUnifiedFormat(count, wkb_data);
+    if (weighted) chunk.data[3].ToUnifiedFormat(count, weight_data);
+    auto xs = UnifiedVectorFormat::GetData<double>(x_data);
+    auto ys = UnifiedVectorFormat::GetData<double>(y_data);
+    auto wkbs = UnifiedVectorFormat::GetData<string_t>(wkb_data);
+
+    for (idx_t row = 0; row < count; row++) {
+        float weight = 1;
+        if (weighted) {
+            auto weight_idx = weight_data.sel->get_index(row);
+            if (!weight_data.validity.RowIsValid(weight_idx)) continue;
+            weight = float(UnifiedVectorFormat::GetData<double>(weight_data)[weight_idx]);
+        }
+        auto x_idx = x_data.sel->get_index(row);
+        auto y_idx = y_data.sel->get_index(row);
+        if (x_data.validity.RowIsValid(x_idx) && y_data.validity.RowIsValid(y_idx)) {
+            double px, py;
+            projection.Project(xs[x_idx], ys[y_idx], px, py);
+            if (px >= 0 && py >= 0 && px < size && py < size) {
+                target[idx_t(py) * size + idx_t(px)] += weight;
+            }
+            continue;
+        }
+        auto wkb_idx = wkb_data.sel->get_index(row);
+        if (!wkb_data.validity.RowIsValid(wkb_idx)) continue;
+        auto& wkb = wkbs[wkb_idx];
+        if (!WKBReader::Read(wkb.GetData(), wkb.GetSize(), scratch) || scratch.IsEmpty()) continue;
+        projection.Project(scratch);
+        // マルチポイントは各点、線とポリゴンは各リングの辺を数える
+        for (idx_t ring = 0; ring < scratch.RingCount(); ring++) {
+            idx_t begin = scratch.rings[ring], end = scratch.rings[ring + 1];
+            const double* xy = scratch.xy.data();
+            int64_t last = -1;
+            if (end - begin == 1) {
+                AddSegment(xy[begin * 2], xy[begin * 2 + 1], xy[begin * 2], xy[begin * 2 + 1], weight, target, last);
+                continue;
+            }
+            // 閉じたリングは始点と終点が同じ画素なので、始点は最後の辺の終わりで1回だけ数える
+            // （1画素に収まるリングは辺で何も数えないので、最後にその画素を1回数える）
+            double x0 = xy[begin * 2], y0 = xy[begin * 2 + 1];
+            int64_t start = -1;
+            if (end - begin > 2 && x0 == xy[(end - 1) * 2] && y0 == xy[(end - 1) * 2 + 1] && x0 >= 0 && y0 >= 0 &&
+                x0 < size && y0 < size) {
+                start = int64_t(y0) * size + int64_t(x0);
+                last = start;
+            }
+            bool left_start = false;
+            for (idx_t i = begin + 1; i < end; i++) {
+                AddSegment(xy[(i - 1) * 2], xy[(i - 1) * 2 + 1], xy[i * 2], xy[i * 2 + 1], weight, target, last);
+                left_start = left_start || last != start;
+            }
+            if (start >= 0 && !left_start) target[start] += weight;
+        }
+    }
+}
+
+void DensityRaster::Accumulate(QueryResult& result, WorkerPool& pool, idx_t thread_count) {
+    thread_count = std::max<idx_t>(1, thread_count);
+    std::mutex fetch_lock;
+    bool done = false;
+    vector<vector<float>> grids(thread_count);
+
+    // QueryResult::Fetch はスレッドセーフではないので取得だけ順番に行い、格子への書き込みは並列にする
+    auto worker = [&](idx_t thread) {
+        auto& target = grids[thread];
+        target.assign(grid.size(), 0);
+        Geometry scratch;
+        while (true) {
+            unique_ptr<DataChunk> chunk;
+            {
+                std::lock_guard<std::mutex> guard(fetch_lock);
+                if (done) break;
+                try {
+                    chunk = result.Fetch();
+                } catch (std::exception&) {
+                    chunk = nullptr;
+                }
+                if (!chunk || chunk->size() == 0) {
+                    done = true;
+                    break;
+                }
+            }
+            AddChunk(*chunk, target, scratch);
+        }
+    };
+    // 先に始まった worker が取り尽くしたら、後の worker は空の格子のまま終わる
+    ParallelFor(pool, thread_count, thread_count, [&](idx_t begin, idx_t end) {
+        for (idx_t thread = begin; thread < end; thread++) worker(thread);
+    }, 1);
+
+    for (auto& local : grids) {
+        for (idx_t i = 0; i < grid.size(); i++) {
+            grid[i] += local[i];
+        }
+    }
+}
+
+string DensityRaster::ToFloat32() const {
+    string out(grid.size() * sizeof(float), '\0');
+    memcpy(&out[0], grid.data(), out.size());
+    return out;
+}
+
+namespace {
+
+struct Color {
+    double r, g, b;
+};
+
+static const vector<Color>& ColorStops(TransferFunction::ColorMap cmap) {
+    static const vector<Color> fire {{128, 0, 0}, {220, 40, 0}, {255, 140, 0}, {255, 220, 60}, {255, 255, 200}};
+    static const vector<Color> viridis {{68, 1, 84}, {59, 82, 139}, {33, 145, 140}, {94, 201, 98}, {253, 231, 37}};
+    static const vector<Color> blues {{198, 219, 239}, {107, 174, 214}, {33, 113, 181}, {8, 48, 107}};
+    switch (cmap) {
+    case TransferFunction::ColorMap::VIRIDIS:
+        return viridis;
+    case TransferFunction::ColorMap::BLUES:
+        return blues;
+    default:
+        return fire;
+    }
+}
+
+} // namespace
+
+string DensityRaster::ToPNG(const TransferFunction& transfer) const {
+    // 0以外の画素を [0, 1] に写す
+    vector<float> sorted;
+    float max_value = 0;
+    for (auto value : grid) {
+        if (value > 0) {
+            max_value = std::max(max_value, value);
+            if (transfer.how == TransferFunction::How::EQ_HIST) sorted.push_back(value);
+        }
+    }
+    std::sort(sorted.begin(), sorted.end());
+    double span = transfer.span > 0 ? transfer.span : double(max_value);
+    auto normalize = [&](float value) -> double {
+        switch (transfer.how) {
+        case TransferFunction::How::LINEAR:
+            return value / span;
+        case TransferFunction::How::LOG:
+            return std::log1p(value) / std::log1p(span);
+        case TransferFunction::How::CBRT:
+            return std::cbrt(value) / std::cbrt(span);
+        default:
+            // 値以下の画素の割合（ヒストグラム平坦化）
+            return double(std::upper_bound(sorted.begin(), sorted.end(), value) - sorted.begin()) /
+                   double(sorted.size());
+        }
+    };
+
+    auto& stops = ColorStops(transfer.cmap);
+    vector<uint8_t> rgba(grid.size() * 4, 0);
+    for (idx_t i = 0; i < grid.size(); i++) {
+        if (!(grid[i] > 0)) continue;
+        double t = std::max(0.0, std::min(1.0, normalize(grid[i])));
+        double position = t * double(stops.size() - 1);
+        idx_t stop = std::min<idx_t>(idx_t(position), stops.size() - 2);
+        double f = position - double(stop);
+        auto& a = stops[stop];
+        auto& b = stops[stop + 1];
+        rgba[i * 4] = uint8_t(a.r + (b.r - a.r) * f);
+        rgba[i * 4 + 1] = uint8_t(a.g + (b.g - a.g) * f);
+        rgba[i * 4 + 2] = uint8_t(a.b + (b.b - a.b) * f);
+        rgba[i * 4 + 3] = uint8_t(TransferFunction::MIN_ALPHA + (255 - TransferFunction::MIN_ALPHA) * t);
+    }
+    return PNGWriter::EncodeRGBA(rgba.data(), size, size);
+}
+
+} // namespace duckdb
@@ -3,20 +3,70 @@
 #include "duckgl_extension.hpp"
 #include "duckdb.hpp"
 #include "duckdb/common/exception.hpp"
+#include "duckdb/common/string_util.hpp"
 #include "duckdb/function/scalar_function.hpp"
 #include "duckdb/main/connection.hpp"
 #include "duckdb/main/database.hpp"
+#include "duckdb/main/config.hpp"
 #include "duckdb/catalog/catalog.hpp"
 #include "duckdb/parser/parsed_data/create_scalar_function_info.hpp"
+#include "yyjson.hpp"
 
 #include <thread>
 #include <atomic>
 #include <memory>
+#include <cmath>
+#include <algorithm>
 
 #include "httplib_wrapper.hpp"
+#include "json_writer.hpp"
+#include "parallel_serializer.hpp"
+#include "arrow_ipc_writer.hpp"
+#include "compact_layer.hpp"
+#include "geoarrow_layer.hpp"
+#include "vector_tile.hpp"
+#include "response_cache.hpp"
+#include "request_coalescer.hpp"
+#include "data_version.hpp"
+#include "spatial_index.hpp"
+#include "geojson_writer.hpp"
+#include "topology.hpp"
+#include "aggregate.hpp"
+#include "cluster_index.hpp"
+#include "density_raster.hpp"
+#include "encoding_util.hpp"
+#include "schema_cache.hpp"
+#include "connection_pool.hpp"
+#include "request_watchdog.hpp"
+#include "admission_control.hpp"
+#include "query_jobs.hpp"
+#include "query_cursors.hpp"
+#include "png_writer.hpp"
+#include "static_assets.hpp"
+#include "response_compression.hpp"
 
 namespace duckdb {
 
+static constexpr const char* ARROW_STREAM_MIME = "application/vnd.apache.arrow.stream";
+
+// ベクタータイルの座標分解能とクリップ時の余白（タイル内座標）
+static constexpr uint32_t MVT_EXTENT = 4096;
+static constexpr double MVT_BUFFER = 64;
+static constexpr double MVT_DEFAULT_TOLERANCE = 4;
+// 密度タイルの一辺の画素数
+static constexpr uint32_t RASTER_SIZE = 256;
+
+static constexpr const char* DEFAULT_CACHE_SIZE = "256MB";
+// リクエストの既定の期限（秒、0なら期限なし）
+static constexpr double DEFAULT_REQUEST_TIMEOUT = 300;
+// ジョブの結果の既定のページの行数
+static constexpr idx_t DEFAULT_JOB_PAGE_ROWS = 1000;
+// 1つのジョブの結果としてメモリに持つ既定の上限
+static constexpr const char* DEFAULT_JOB_RESULT_LIMIT = "1GB";
+
+// zoom 指定時の簡略化の許容誤差（画面上のピクセル数）
+static constexpr double SIMPLIFY_PIXELS = 0.5;
+
 static std::string GetDuckGLHTML() {
     std::string html;
     
@@ -26,9 +76,13 @@ static std::string GetDuckGLHTML() {
 <head>
     <meta charset="utf-8">
     <title>DuckGL - DuckDB Geospatial Visualization</title>
-    <script src="https://unpkg.com/maplibre-gl@3.6.0/dist/maplibre-gl.js"></script>
-    <link href="https://unpkg.com/maplibre-gl@3.6.0/dist/maplibre-gl.css" rel="stylesheet" />
-    <script src="https://unpkg.com/deck.gl@^9.0.0/dist.min.js"></script>
+)HTML";
+    // 埋め込んだファイルがあればサーバーから、なければCDNから読み込む
+    html += "    <script src=\"" + StaticAssets::URL("maplibre-gl.js") + "\"></script>\n";
+    html += "    <link href=\"" + StaticAssets::URL("maplibre-gl.css") + "\" rel=\"stylesheet\" />\n";
+    html += "    <script src=\"" + StaticAssets::URL("deck.gl.min.js") + "\"></script>\n";
+    html += "    <script src=\"" + StaticAssets::URL("earcut.min.js") + "\"></script>\n";
+    html += R"HTML(
     <style>
         * { margin: 0; padding: 0; box-sizing: border-box; }
         body { font-family: 'Segoe UI', Tahoma, Geneva, Verdana, sans-serif; }
@@ -47,6 +101,7 @@ static std::string GetDuckGLHTML() {
         .table-item:hover { background: #3d5a6b; border-left-color: #1abc9c; }
         .table-name { font-weight: bold; color: #ecf0f1; }
         .table-info { font-size: 12px; color: #95a5a6; margin-top: 4px; }
+        #layer-mode { width: 100%; padding: 6px; background: #34495e; color: #ecf0f1; border: 1px solid #1abc9c; border-radius: 4px; margin-bottom: 8px; }
         #status { position: fixed; top: 10px; right: 10px; background: rgba(0,0,0,0.8); color: white; padding: 10px 15px; border-radius: 4px; font-size: 12px; z-index: 1001; }
         .loading { color: #f39c12; }
         .success { color: #2ecc71; }
@@ -71,9 +126,21 @@ static std::string GetDuckGLHTML() {
                 <h3>SQL Query</h3>
                 <textarea id="sql-editor" placeholder="SELECT * FROM my_table">SELECT 1 as id</textarea>
                 <button onclick="executeQuery()">Execute</button>
+                <button onclick="executeJob()">Run in background</button>
             </div>
             <div class="section">
                 <h3>Tables</h3>
+                <select id="layer-mode">
+                    <option value="tiles">Vector tiles (MVT)</option>
+                    <option value="viewport">Visible extent (GeoJSON)</option>
+                    <option value="compact">Visible extent (compact)</option>
+                    <option value="topology">Visible extent (TopoJSON)</option>
+                    <option value="clusters">Point clusters</option>
+                    <option value="hexbin">Hexagon bins (count)</option>
+                    <option value="density">Density raster</option>
+                    <option value="grid">Square grid (count)</option>
+                    <option value="binary">Full layer (binary)</option>
+                </select>
                 <div id="tables-list">Loading...</div>
             </div>
         </div>
@@ -89,11 +156,38 @@ static std::string GetDuckGLHTML() {
     <script>
         let map = null;
         let deckOverlay = null;
+        // 表示範囲に応じて取り直すモードの再取得関数と、実行中のリクエスト
+        let viewportReload = null;
+        let viewportTimer = null;
+        let viewportAbort = null;
+        // 読み込み中のレイヤー全体（/api/layer）のリクエスト
+        let layerAbort = null;
+        
+        const BASEMAP_STYLE = 'https://basemaps.cartocdn.com/gl/positron-gl-style/style.json';
+        // 背景地図のスタイルを取れない（外に出られない）環境では背景色だけの地図にする
+        const BLANK_STYLE = {
+            version: 8,
+            sources: {},
+            layers: [{ id: 'background', type: 'background', paint: { 'background-color': '#f4f4f2' } }]
+        };
+        
+        async function basemapStyle() {
+            const controller = new AbortController();
+            const timer = setTimeout(() => controller.abort(), 3000);
+            try {
+                const res = await fetch(BASEMAP_STYLE, { signal: controller.signal });
+                if (res.ok) return await res.json();
+            } catch (e) {
+            } finally {
+                clearTimeout(timer);
+            }
+            return BLANK_STYLE;
+        }
         
-        function initMap() {
+        async function initMap() {
             map = new maplibregl.Map({
                 container: 'map',
-                style: 'https://basemaps.cartocdn.com/gl/positron-gl-style/style.json',
+                style: await basemapStyle(),
                 center: [139.7, 35.7],
                 zoom: 4
             });
@@ -102,6 +196,7 @@ static std::string GetDuckGLHTML() {
                 const {MapboxOverlay} = deck;
                 deckOverlay = new MapboxOverlay({ layers: [] });
                 map.addControl(deckOverlay);
+                map.on('moveend', scheduleViewport);
                 setStatus('Ready', 'success');
             });
         }
@@ -116,7 +211,7 @@ static std::string GetDuckGLHTML() {
             document.getElementById('result-panel').classList.remove('show');
         }
         
-        function showResults(data) {
+        function showResults(data, limit = 50) {
             const panel = document.getElementById('result-panel');
             const content = document.getElementById('result-content');
             if (!data || data.length === 0) {
@@ -133,7 +228,7 @@ static std::string GetDuckGLHTML() {
             let h = '<table><thead><tr>';
             cols.forEach(c => h += '<th>' + c + '</th>');
             h += '</tr></thead><tbody>';
-            data.slice(0, 50).forEach(row => {
+            data.slice(0, limit).forEach(row => {
                 h += '<tr>';
                 cols.forEach(c => h += '<td>' + (row[c] === null ? 'NULL' : row[c]) + '</td>');
                 h += '</tr>';
@@ -163,54 +258,642 @@ static std::string GetDuckGLHTML() {
 )HTML";
 
     html += R"HTML(
+        // /api/layer のバイナリ（"DGLB" + ヘッダ長 + JSONヘッダ + バッファ）を型付き配列に展開する
+        function decodeLayer(buf) {
+            const headerLen = new DataView(buf).getUint32(4, true);
+            const header = JSON.parse(new TextDecoder().decode(new Uint8Array(buf, 8, headerLen)));
+            const base = 8 + headerLen;
+            const Coords = header.coords === 'float64' ? Float64Array : Float32Array;
+            const view = (b, T) => new T(buf, base + b[0], b[1] / T.BYTES_PER_ELEMENT);
+            const groups = {};
+            ['points', 'lines', 'polygons'].forEach(name => {
+                const g = header[name];
+                if (!g) return;
+                groups[name] = {
+                    count: g.count,
+                    coords: view(g.coords, Coords),
+                    geomOffsets: view(g.geom_offsets, Uint32Array),
+                    partOffsets: g.part_offsets ? view(g.part_offsets, Uint32Array) : null,
+                    ringOffsets: g.ring_offsets ? view(g.ring_offsets, Uint32Array) : null,
+                    featureIds: view(g.feature_ids, Uint32Array)
+                };
+            });
+            return { features: header.features, groups: groups };
+        }
+        
+        // /api/layer?format=compact（"DGLC" + 可変長整数の列）をGeoJSONのFeatureCollectionに戻す
+        function decodeCompactLayer(buf) {
+            const bytes = new Uint8Array(buf);
+            const view = new DataView(buf);
+            const text = new TextDecoder();
+            let pos = 4;
+            // 2^53 を超えないよう掛け算で組み立てる
+            const varint = () => {
+                let value = 0, scale = 1, b;
+                do {
+                    b = bytes[pos++];
+                    value += (b & 0x7f) * scale;
+                    scale *= 128;
+                } while (b & 0x80);
+                return value;
+            };
+            const sint = () => {
+                const v = varint();
+                return v % 2 ? -(v + 1) / 2 : v / 2;
+            };
+            const str = () => {
+                const n = varint();
+                const s = text.decode(bytes.subarray(pos, pos + n));
+                pos += n;
+                return s;
+            };
+            const scale = Math.pow(10, varint());
+            const keys = [];
+            for (let n = varint(); n > 0; n--) keys.push(str());
+            const values = [];
+            for (let n = varint(); n > 0; n--) {
+                const kind = varint();
+                if (kind === 0) values.push(str());
+                else if (kind === 1) { values.push(view.getFloat64(pos, true)); pos += 8; }
+                else if (kind === 2) values.push(sint());
+                else if (kind === 3) values.push(varint());
+                else values.push(kind === 5);
+            }
+            // 座標は直前の頂点からの差（地物をまたいで続く）
+            let x = 0, y = 0;
+            const point = () => {
+                x += sint();
+                y += sint();
+                return [x / scale, y / scale];
+            };
+            const many = read => () => {
+                const items = [];
+                for (let n = varint(); n > 0; n--) items.push(read());
+                return items;
+            };
+            const line = many(point);
+            const ring = () => {
+                const r = line();
+                if (r.length) r.push(r[0]);
+                return r;
+            };
+            const polygon = many(ring);
+            const TYPES = [null, 'Point', 'LineString', 'Polygon', 'MultiPoint', 'MultiLineString', 'MultiPolygon'];
+            const READERS = [null, point, line, polygon, many(point), many(line), many(polygon)];
+            const features = [];
+            for (let n = varint(); n > 0; n--) {
+                const type = varint();
+                const geometry = { type: TYPES[type], coordinates: READERS[type]() };
+                const properties = {};
+                for (let k = varint(); k > 0; k--) {
+                    const key = keys[varint()];
+                    properties[key] = values[varint()];
+                }
+                features.push({ type: 'Feature', geometry: geometry, properties: properties });
+            }
+            return { type: 'FeatureCollection', features: features };
+        }
+        
+        // /api/topology の TopoJSON をGeoJSONのFeatureCollectionに戻す（弧は差分で量子化されている）
+        function decodeTopology(topo) {
+            const scale = topo.transform.scale, translate = topo.transform.translate;
+            const position = p => [p[0] * scale[0] + translate[0], p[1] * scale[1] + translate[1]];
+            const arcs = topo.arcs.map(arc => {
+                let x = 0, y = 0;
+                return arc.map(d => {
+                    x += d[0];
+                    y += d[1];
+                    return position([x, y]);
+                });
+            });
+            // 弧をつなぐ。逆向きの弧は ~番号で、隣り合う弧の継ぎ目の頂点は1つにする
+            const line = refs => {
+                const coords = [];
+                refs.forEach(ref => {
+                    const arc = ref < 0 ? arcs[~ref].slice().reverse() : arcs[ref];
+                    for (let i = coords.length ? 1 : 0; i < arc.length; i++) coords.push(arc[i]);
+                });
+                return coords;
+            };
+            const polygon = rings => rings.map(line);
+            const READERS = {
+                Point: position,
+                MultiPoint: points => points.map(position),
+                LineString: line,
+                MultiLineString: lines => lines.map(line),
+                Polygon: polygon,
+                MultiPolygon: polygons => polygons.map(polygon)
+            };
+            const features = [];
+            Object.values(topo.objects).forEach(collection => {
+                collection.geometries.forEach(g => {
+                    const coordinates = READERS[g.type](g.type.endsWith('Point') ? g.coordinates : g.arcs);
+                    features.push({
+                        type: 'Feature',
+                        geometry: { type: g.type, coordinates: coordinates },
+                        properties: g.properties || {}
+                    });
+                });
+            });
+            return { type: 'FeatureCollection', features: features };
+        }
+        
+        // deck.glのGeoJsonLayerが受け付けるバイナリ形式（loaders.glのBinaryFeatureCollection）に変換する
+        function toBinaryFeatures(layer) {
+            const empty = type => ({
+                type: type,
+                positions: { value: new Float32Array(0), size: 2 },
+                featureIds: { value: new Uint32Array(0), size: 1 },
+                globalFeatureIds: { value: new Uint32Array(0), size: 1 },
+                numericProps: {}, properties: [], fields: []
+            });
+            const fill = (g, vertexStart) => {
+                const n = g.coords.length / 2;
+                const local = new Uint32Array(n);
+                const global = new Uint32Array(n);
+                for (let i = 0; i < g.count; i++) {
+                    local.fill(i, vertexStart(i), vertexStart(i + 1));
+                    global.fill(g.featureIds[i], vertexStart(i), vertexStart(i + 1));
+                }
+                return {
+                    positions: { value: g.coords, size: 2 },
+                    featureIds: { value: local, size: 1 },
+                    globalFeatureIds: { value: global, size: 1 }
+                };
+            };
+            const data = {
+                points: empty('Point'),
+                lines: Object.assign(empty('LineString'), { pathIndices: { value: new Uint32Array([0]), size: 1 } }),
+                polygons: Object.assign(empty('Polygon'), {
+                    polygonIndices: { value: new Uint32Array([0]), size: 1 },
+                    primitivePolygonIndices: { value: new Uint32Array([0]), size: 1 },
+                    triangles: { value: new Uint32Array(0), size: 1 }
+                })
+            };
+            const p = layer.groups.points;
+            if (p) {
+                Object.assign(data.points, fill(p, i => p.geomOffsets[i]));
+            }
+            const l = layer.groups.lines;
+            if (l) {
+                Object.assign(data.lines, fill(l, i => l.partOffsets[l.geomOffsets[i]]));
+                data.lines.pathIndices = { value: l.partOffsets, size: 1 };
+            }
+            const g = layer.groups.polygons;
+            if (g) {
+                Object.assign(data.polygons, fill(g, i => g.ringOffsets[g.partOffsets[g.geomOffsets[i]]]));
+                const polygonCount = g.partOffsets.length - 1;
+                const polygonIndices = new Uint32Array(polygonCount + 1);
+                const triangles = [];
+                for (let k = 0; k <= polygonCount; k++) polygonIndices[k] = g.ringOffsets[g.partOffsets[k]];
+                for (let k = 0; k < polygonCount; k++) {
+                    const start = polygonIndices[k];
+                    const holes = [];
+                    for (let r = g.partOffsets[k] + 1; r < g.partOffsets[k + 1]; r++) holes.push(g.ringOffsets[r] - start);
+                    const tri = earcut(g.coords.subarray(start * 2, polygonIndices[k + 1] * 2), holes, 2);
+                    for (let t = 0; t < tri.length; t++) triangles.push(tri[t] + start);
+                }
+                data.polygons.polygonIndices = { value: polygonIndices, size: 1 };
+                data.polygons.primitivePolygonIndices = { value: g.ringOffsets, size: 1 };
+                data.polygons.triangles = { value: new Uint32Array(triangles), size: 1 };
+            }
+            return data;
+        }
+        
+        const layerStyle = {
+            filled: true,
+            stroked: true,
+            getFillColor: [26, 188, 156, 180],
+            getLineColor: [80, 80, 80, 255],
+            getLineWidth: 2,
+            lineWidthMinPixels: 1,
+            pickable: true
+        };
+        
+        async function showTableData(name) {
+            document.getElementById('sql-editor').value = 'SELECT * FROM ' + name + ' LIMIT 100';
+            await executeQuery();
+        }
+        
+        // タイルはズームごとにサーバー側でクリップ・簡略化される。z=0のタイルでジオメトリ列の有無を確かめる
+        async function loadTiles(name) {
+            const url = '/api/tiles/' + encodeURIComponent(name);
+            const probe = await fetch(url + '/0/0/0.mvt');
+            if ((probe.headers.get('Content-Type') || '').includes('json')) {
+                await showTableData(name);
+                return;
+            }
+            const layer = new deck.MVTLayer(Object.assign({}, layerStyle, {
+                id: name + '-tiles',
+                data: url + '/{z}/{x}/{y}.mvt',
+                minZoom: 0,
+                maxZoom: 16,
+                pointRadiusUnits: 'pixels',
+                getPointRadius: 5,
+                // デコード用のワーカーはCDNから読み込まれるので、オフラインでも動くようにメインスレッドで読む
+                loadOptions: { worker: false },
+                onClick: info => info.coordinate && pickFeatures(name, info.coordinate)
+            }));
+            if (deckOverlay) deckOverlay.setProps({ layers: [layer] });
+            setStatus('Streaming tiles for ' + name, 'success');
+        }
+        
+        // サーバーで描いた密度タイル（PNG）を画像として並べる
+        async function loadDensity(name) {
+            const url = '/api/raster/' + encodeURIComponent(name);
+            const probe = await fetch(url + '/0/0/0');
+            if ((probe.headers.get('Content-Type') || '').includes('json')) {
+                await showTableData(name);
+                return;
+            }
+            const layer = new deck.TileLayer({
+                id: name + '-density',
+                data: url + '/{z}/{x}/{y}',
+                minZoom: 0,
+                maxZoom: 22,
+                tileSize: 256,
+                renderSubLayers: props => {
+                    const box = props.tile.boundingBox;
+                    return new deck.BitmapLayer(props, {
+                        data: null,
+                        image: props.data,
+                        bounds: [box[0][0], box[0][1], box[1][0], box[1][1]]
+                    });
+                }
+            });
+            if (deckOverlay) deckOverlay.setProps({ layers: [layer] });
+            setStatus('Rendering density tiles for ' + name, 'success');
+        }
+        
+        // クリック位置の地物の属性を取得する（許容範囲は約5ピクセル）
+        async function pickFeatures(name, coordinate) {
+            const tolerance = 5 * 360 / (512 * Math.pow(2, map.getZoom()));
+            const params = new URLSearchParams({ lon: coordinate[0], lat: coordinate[1], tolerance: tolerance });
+            const res = await fetch('/api/pick/' + encodeURIComponent(name) + '?' + params);
+            showResults(await res.json());
+        }
+        
+        // 地図の移動が止まってから少し待って取り直す
+        function scheduleViewport() {
+            if (!viewportReload) return;
+            clearTimeout(viewportTimer);
+            viewportTimer = setTimeout(viewportReload, 250);
+        }
+        
+        function cancelViewport() {
+            viewportReload = null;
+            if (viewportAbort) viewportAbort.abort();
+            if (layerAbort) layerAbort.abort();
+        }
+        
+        // 表示範囲のパラメータで取得する。新しい取得を始めたら古いリクエストは中断する
+        async function fetchViewport(url, extra, read) {
+            if (viewportAbort) viewportAbort.abort();
+            const controller = new AbortController();
+            viewportAbort = controller;
+            const b = map.getBounds();
+            const params = new URLSearchParams(Object.assign({
+                bbox: [b.getWest(), b.getSouth(), b.getEast(), b.getNorth()].map(v => v.toFixed(6)).join(','),
+                zoom: Math.floor(map.getZoom())
+            }, extra || {}));
+            try {
+                const res = await fetch(url + '?' + params, { signal: controller.signal });
+                return await (read ? read(res) : res.json());
+            } finally {
+                if (viewportAbort === controller) viewportAbort = null;
+            }
+        }
+        
+        async function loadViewport(name) {
+            viewportReload = () => loadViewport(name);
+            try {
+                const data = await fetchViewport('/api/geojson/' + encodeURIComponent(name));
+                // truncated は送り始めた後でクエリが失敗したもの。届いた分は描き、エラーを表示する
+                if (data.error && !data.truncated) {
+                    cancelViewport();
+                    await showTableData(name);
+                    return;
+                }
+                const layer = new deck.GeoJsonLayer(Object.assign({}, layerStyle, {
+                    id: name + '-viewport',
+                    data: data,
+                    getPointRadius: 100,
+                    pointRadiusMinPixels: 5
+                }));
+                if (deckOverlay) deckOverlay.setProps({ layers: [layer] });
+                if (data.truncated) {
+                    setStatus('Error after ' + data.features.length + ' features: ' + data.error, 'error');
+                } else {
+                    setStatus('Loaded ' + data.features.length + ' features in view', 'success');
+                }
+            } catch (e) {
+                if (e.name !== 'AbortError') setStatus('Error', 'error');
+            }
+        }
+        
+        // 回線が遅いとき用：表示範囲をコンパクト形式（量子化した座標）で取る
+        // 境界を共有するポリゴンのレイヤーは TopoJSON で取ると共有する境界が1度しか転送されない
+        async function loadCompact(name, topology) {
+            viewportReload = () => loadCompact(name, topology);
+            try {
+                const data = topology
+                    ? await fetchViewport('/api/topology/' + encodeURIComponent(name), {}, async res => {
+                        const topo = await res.json();
+                        return topo.error ? topo : decodeTopology(topo);
+                    })
+                    : await fetchViewport('/api/layer/' + encodeURIComponent(name), { format: 'compact' }, async res =>
+                        (res.headers.get('Content-Type') || '').includes('json') ? res.json() : decodeCompactLayer(await res.arrayBuffer()));
+                if (data.error) {
+                    cancelViewport();
+                    await showTableData(name);
+                    return;
+                }
+                const layer = new deck.GeoJsonLayer(Object.assign({}, layerStyle, {
+                    id: name + '-compact',
+                    data: data,
+                    getPointRadius: 100,
+                    pointRadiusMinPixels: 5
+                }));
+                if (deckOverlay) deckOverlay.setProps({ layers: [layer] });
+                setStatus('Loaded ' + data.features.length + ' features in view', 'success');
+            } catch (e) {
+                if (e.name !== 'AbortError') setStatus('Error', 'error');
+            }
+        }
+        
+        // /api/aggregate のセル番号から経度緯度の多角形を作る（画素座標は世界幅 512 * 2^zoom のWebメルカトル）
+        function cellPolygons(data) {
+            const world = 512 * Math.pow(2, data.zoom);
+            const unproject = (x, y) => [
+                x / world * 360 - 180,
+                Math.atan(Math.sinh(Math.PI * (1 - 2 * y / world))) * 180 / Math.PI
+            ];
+            const s = data.size;
+            const cells = [];
+            for (let i = 0; i < data.cells; i++) {
+                const c = data.col[i], r = data.row[i];
+                let ring;
+                if (data.cell === 'hex') {
+                    const cx = c * Math.sqrt(3) * s / 2, cy = r * 3 * s / 2;
+                    ring = [];
+                    for (let k = 0; k < 6; k++) {
+                        const a = Math.PI / 6 + k * Math.PI / 3;
+                        ring.push(unproject(cx + s * Math.cos(a), cy + s * Math.sin(a)));
+                    }
+                } else {
+                    ring = [[c, r], [c + 1, r], [c + 1, r + 1], [c, r + 1]].map(p => unproject(p[0] * s, p[1] * s));
+                }
+                cells.push({ polygon: ring, count: data.count[i], value: data.value[i] });
+            }
+            return cells;
+        }
+        
+        async function loadAggregate(name, cell) {
+            viewportReload = () => loadAggregate(name, cell);
+            try {
+                const data = await fetchViewport('/api/aggregate/' + encodeURIComponent(name), { cell: cell, size: 24 });
+                if (data.error) {
+                    cancelViewport();
+                    setStatus('Error: ' + data.error, 'error');
+                    return;
+                }
+                const max = Math.max(1, ...data.value.filter(v => v !== null));
+                const layer = new deck.PolygonLayer({
+                    id: name + '-' + cell,
+                    data: cellPolygons(data),
+                    getPolygon: d => d.polygon,
+                    getFillColor: d => {
+                        const t = Math.sqrt((d.value || 0) / max);
+                        return [255 * t, 120 + 60 * (1 - t), 200 * (1 - t), 200];
+                    },
+                    stroked: false,
+                    pickable: true
+                });
+                if (deckOverlay) deckOverlay.setProps({ layers: [layer] });
+                setStatus(data.cells + ' cells', 'success');
+            } catch (e) {
+                if (e.name !== 'AbortError') setStatus('Error', 'error');
+            }
+        }
+        
+        // ズームごとのクラスタを取得し、まとまった点は件数付きの円で描く
+        async function loadClusters(name) {
+            viewportReload = () => loadClusters(name);
+            try {
+                const zoom = Math.floor(map.getZoom());
+                const data = await fetchViewport('/api/clusters/' + encodeURIComponent(name), { z: zoom });
+                if (data.error) {
+                    cancelViewport();
+                    await showTableData(name);
+                    return;
+                }
+                const items = data.lon.map((lon, i) => ({ position: [lon, data.lat[i]], count: data.count[i] }));
+                const layers = [
+                    new deck.ScatterplotLayer({
+                        id: name + '-clusters',
+                        data: items,
+                        getPosition: d => d.position,
+                        getRadius: d => d.count > 1 ? 10 + 3 * Math.log2(d.count) : 5,
+                        radiusUnits: 'pixels',
+                        getFillColor: d => d.count > 1 ? [255, 140, 0, 200] : [0, 128, 255, 200],
+                        getLineColor: [255, 255, 255],
+                        lineWidthMinPixels: 1,
+                        stroked: true,
+                        pickable: true,
+                        onClick: info => {
+                            if (!info.object) return;
+                            if (info.object.count > 1) {
+                                map.easeTo({ center: info.object.position, zoom: zoom + 2 });
+                            } else {
+                                pickFeatures(name, info.object.position);
+                            }
+                        }
+                    }),
+                    new deck.TextLayer({
+                        id: name + '-cluster-counts',
+                        data: items.filter(d => d.count > 1),
+                        getPosition: d => d.position,
+                        getText: d => String(d.count),
+                        getSize: 12,
+                        getColor: [255, 255, 255]
+                    })
+                ];
+                if (deckOverlay) deckOverlay.setProps({ layers: layers });
+                setStatus(data.clusters + ' clusters in view', 'success');
+            } catch (e) {
+                if (e.name !== 'AbortError') setStatus('Error', 'error');
+            }
+        }
+        
         async function loadTableData(name) {
             setStatus('Loading ' + name + '...', 'loading');
+            cancelViewport();
             try {
-                const res = await fetch('/api/geojson/' + name);
-                const geojson = await res.json();
-                if (geojson.error || !geojson.features || geojson.features.length === 0) {
-                    document.getElementById('sql-editor').value = 'SELECT * FROM ' + name + ' LIMIT 100';
-                    await executeQuery();
+                const mode = document.getElementById('layer-mode').value;
+                if (mode === 'tiles') {
+                    await loadTiles(name);
+                    return;
+                }
+                if (mode === 'viewport') {
+                    await loadViewport(name);
+                    return;
+                }
+                if (mode === 'compact' || mode === 'topology') {
+                    await loadCompact(name, mode === 'topology');
+                    return;
+                }
+                if (mode === 'density') {
+                    await loadDensity(name);
+                    return;
+                }
+                if (mode === 'clusters') {
+                    await loadClusters(name);
+                    return;
+                }
+                if (mode === 'hexbin' || mode === 'grid') {
+                    await loadAggregate(name, mode === 'hexbin' ? 'hex' : 'square');
                     return;
                 }
-                const layer = new deck.GeoJsonLayer({
+                const controller = new AbortController();
+                layerAbort = controller;
+                const res = await fetch('/api/layer/' + encodeURIComponent(name), { signal: controller.signal });
+                const isBinary = !(res.headers.get('Content-Type') || '').includes('json');
+                const layerData = isBinary ? decodeLayer(await res.arrayBuffer()) : null;
+                if (!layerData || layerData.features === 0) {
+                    await showTableData(name);
+                    return;
+                }
+                const layer = new deck.GeoJsonLayer(Object.assign({}, layerStyle, {
                     id: name + '-layer',
-                    data: geojson,
-                    filled: true,
-                    stroked: true,
-                    getFillColor: [26, 188, 156, 180],
-                    getLineColor: [80, 80, 80, 255],
-                    getLineWidth: 2,
-                    lineWidthMinPixels: 1,
+                    data: toBinaryFeatures(layerData),
                     getPointRadius: 100,
-                    pointRadiusMinPixels: 5,
-                    pickable: true
-                });
+                    pointRadiusMinPixels: 5
+                }));
                 if (deckOverlay) deckOverlay.setProps({ layers: [layer] });
-                setStatus('Loaded ' + geojson.features.length + ' features', 'success');
+                setStatus('Loaded ' + layerData.features + ' features', 'success');
             } catch (e) {
-                setStatus('Error', 'error');
+                if (e.name !== 'AbortError') setStatus('Error', 'error');
+            }
+        }
+        
+        // 実行中のクエリ。新しいクエリを実行したら前のリクエストを中断し、サーバー側のクエリも止める
+        let queryAbort = null;
+        
+        // SQLエディタの結果はサーバー側のカーソルから1ページずつ取る（全行を転送しない）
+        const QUERY_PAGE_ROWS = 50;
+        let queryCursor = null;
+        let queryRows = [];
+        
+        function closeQueryCursor() {
+            if (queryCursor) fetch('/api/cursors/' + queryCursor, { method: 'DELETE' });
+            queryCursor = null;
+        }
+        
+        function showQueryPage(page, append) {
+            queryRows = append ? queryRows.concat(page.data) : page.data;
+            queryCursor = page.cursor;
+            let total = '?';
+            if (page.total !== null) total = page.total;
+            else if (page.estimated_total !== null) total = '~' + page.estimated_total;
+            setStatus('Showing ' + queryRows.length + ' of ' + total + ' rows', 'success');
+            showResults(queryRows, queryRows.length);
+            if (queryCursor && queryRows.length > 0) {
+                document.getElementById('result-content').insertAdjacentHTML('beforeend',
+                    '<button onclick="loadMoreRows()">Load more</button>');
+            }
+        }
+        
+        async function fetchQueryPage(url, options, append) {
+            if (queryAbort) queryAbort.abort();
+            const controller = new AbortController();
+            queryAbort = controller;
+            try {
+                const res = await fetch(url, Object.assign({ signal: controller.signal }, options));
+                const result = await res.json();
+                if (res.status === 404) {
+                    queryCursor = null;
+                    setStatus('The result was closed, run the query again', 'error');
+                } else if (result.error) {
+                    queryCursor = null;
+                    setStatus('Error: ' + result.error, 'error');
+                    showResults(result);
+                } else {
+                    showQueryPage(result, append);
+                }
+            } catch (e) {
+                if (e.name !== 'AbortError') setStatus('Query failed', 'error');
+            } finally {
+                if (queryAbort === controller) queryAbort = null;
             }
         }
         
         async function executeQuery() {
             const sql = document.getElementById('sql-editor').value;
             setStatus('Executing...', 'loading');
+            closeQueryCursor();
+            await fetchQueryPage('/api/query?page=' + QUERY_PAGE_ROWS, {
+                method: 'POST',
+                headers: { 'Content-Type': 'text/plain' },
+                body: sql
+            }, false);
+        }
+        
+        async function loadMoreRows() {
+            if (!queryCursor) return;
+            setStatus('Loading more rows...', 'loading');
+            await fetchQueryPage('/api/cursors/' + queryCursor + '?limit=' + QUERY_PAGE_ROWS, {}, true);
+        }
+        
+        // バックグラウンドのジョブ。新しいジョブを投げたら前のジョブは取り消す
+        let currentJob = null;
+        const JOB_POLL_MS = 500;
+        
+        async function executeJob() {
+            const sql = document.getElementById('sql-editor').value;
+            if (currentJob) fetch('/api/jobs/' + currentJob, { method: 'DELETE' });
+            setStatus('Submitting job...', 'loading');
+            let id = null;
             try {
-                const res = await fetch('/api/query', {
+                const submitted = await (await fetch('/api/jobs', {
                     method: 'POST',
                     headers: { 'Content-Type': 'text/plain' },
                     body: sql
-                });
-                const result = await res.json();
-                if (result.error) {
-                    setStatus('Error: ' + result.error, 'error');
-                } else {
-                    setStatus('Returned ' + result.length + ' rows', 'success');
+                })).json();
+                if (submitted.error) {
+                    setStatus('Error: ' + submitted.error, 'error');
+                    return;
+                }
+                id = submitted.id;
+                currentJob = id;
+                while (currentJob === id) {
+                    const res = await fetch('/api/jobs/' + id);
+                    const job = await res.json();
+                    if (currentJob !== id) return;
+                    if (!res.ok) {
+                        setStatus('Error: ' + job.error, 'error');
+                        return;
+                    }
+                    const seconds = (job.elapsed_ms / 1000).toFixed(1) + ' s';
+                    if (job.state === 'queued') {
+                        setStatus('Job queued...', 'loading');
+                    } else if (job.state === 'running') {
+                        const progress = job.progress === null ? '' : job.progress.toFixed(0) + '%, ';
+                        setStatus('Running: ' + progress + seconds + ', ' + job.rows + ' rows', 'loading');
+                    } else if (job.state === 'done') {
+                        const page = await (await fetch('/api/jobs/' + id + '/result?limit=50')).json();
+                        setStatus('Returned ' + page.total + ' rows in ' + seconds, 'success');
+                        showResults(page.error ? page : page.data);
+                        return;
+                    } else {
+                        setStatus('Job ' + job.state + (job.error ? ': ' + job.error : ''), 'error');
+                        return;
+                    }
+                    await new Promise(resolve => setTimeout(resolve, JOB_POLL_MS));
                 }
-                showResults(result);
             } catch (e) {
-                setStatus('Query failed', 'error');
+                setStatus('Job failed', 'error');
+            } finally {
+                if (currentJob === id) currentJob = null;
             }
         }
         
@@ -224,6 +907,12 @@ static std::string GetDuckGLHTML() {
     return html;
 }
 
+// HTTPのワーカースレッド数（httplibの既定値と同じ）
+static idx_t HttpWorkerCount() {
+    idx_t cores = std::thread::hardware_concurrency();
+    return std::max<idx_t>(8, cores > 0 ? cores - 1 : 0);
+}
+
 class DuckGLServer {
 private:
     unique_ptr<httplib::Server> server;
@@ -231,132 +920,582 @@ private:
     std::atomic<bool> running{false};
     DatabaseInstance* db_instance;
     int port;
+    // 結果のシリアライズと索引・ラスター・トポロジーの構築を並列にするスレッド（リクエストごとには作らない）
+    // 索引の管理が参照するので、それより先に作る
+    WorkerPool worker_pool;
+    ResponseCache cache;
+    RequestCoalescer coalescer;
+    SpatialIndexManager indexes;
+    ClusterIndexManager clusters;
+    SchemaCache schemas;
+    ConnectionPool connections;
+    RequestWatchdog watchdog;
+    double request_timeout;
+    AdmissionController admission;
+    QueryJobManager jobs;
+    QueryCursorManager cursors;
+    // GET / のHTMLは起動時に一度だけ組み立てる
+    string index_html;
+    string index_etag;
+    string index_gzip;
+    ResponseCompression compression;
+    
+    // threads はリクエストの実行の枠のスレッド数（Ticket::Threads）
+    string SerializeResult(QueryResult& result, ResultSerializer& serializer, idx_t threads = 1) {
+        string out;
+        serializer.Begin(out);
+        ParallelSerializer(serializer, worker_pool, threads).Write(result, out);
+        serializer.End(out);
+        return out;
+    }
     
-    static string ResultToJSON(unique_ptr<QueryResult> result) {
+    string ResultToJSON(unique_ptr<QueryResult> result) {
         if (!result || result->HasError()) {
             string err_msg = result ? result->GetError() : "Unknown error";
-            string escaped;
-            for (char c : err_msg) {
-                if (c == '"') escaped += "\\\"";
-                else if (c == '\\') escaped += "\\\\";
-                else if (c == '\n') escaped += "\\n";
-                else escaped += c;
-            }
-            return "{\"error\": \"" + escaped + "\"}";
-        }
-        
-        string json = "[";
-        bool first_row = true;
-        
-        while (true) {
-            auto chunk = result->Fetch();
-            if (!chunk || chunk->size() == 0) break;
-            
-            for (idx_t row = 0; row < chunk->size(); row++) {
-                if (!first_row) json += ",";
-                json += "{";
-                
-                bool first_col = true;
-                for (idx_t col = 0; col < chunk->ColumnCount(); col++) {
-                    if (!first_col) json += ",";
-                    
-                    auto &col_name = result->names[col];
-                    json += "\"" + col_name + "\":";
-                    
-                    auto val = chunk->GetValue(col, row);
-                    if (val.IsNull()) {
-                        json += "null";
-                    } else {
-                        string str_val = val.ToString();
-                        json += "\"";
-                        for (char c : str_val) {
-                            if (c == '"') json += "\\\"";
-                            else if (c == '\\') json += "\\\\";
-                            else if (c == '\n') json += "\\n";
-                            else if (c == '\r') json += "\\r";
-                            else if (c == '\t') json += "\\t";
-                            else json += c;
-                        }
-                        json += "\"";
-                    }
-                    
-                    first_col = false;
-                }
-                
-                json += "}";
-                first_row = false;
-            }
+            return "{\"error\": \"" + JSONChunkWriter::Escape(err_msg) + "\"}";
         }
         
-        json += "]";
-        return json;
+        JSONResultSerializer serializer(result->names, result->types, JSONLayout::ARRAY);
+        return SerializeResult(*result, serializer);
     }
     
-    static string ResultToGeoJSONWithProperties(unique_ptr<QueryResult> result) {
+    string ResultToGeoJSONWithProperties(unique_ptr<QueryResult> result) {
         if (!result || result->HasError()) {
             string err_msg = result ? result->GetError() : "Query failed";
-            return "{\"error\":\"" + err_msg + "\",\"type\":\"FeatureCollection\",\"features\":[]}";
+            return "{\"error\":\"" + JSONChunkWriter::Escape(err_msg) + "\",\"type\":\"FeatureCollection\",\"features\":[]}";
         }
         
-        auto& names = result->names;
-        auto& types = result->types;
+        JSONResultSerializer serializer(result->names, result->types, JSONLayout::FEATURES);
+        return SerializeResult(*result, serializer);
+    }
+    
+    static constexpr idx_t STREAM_FLUSH_SIZE = 64 * 1024;
+    // ストリーミングで送った本文を同じリクエストと共有する最大の大きさ（キャッシュの1エントリの上限がこれより大きければそちら）
+    static constexpr idx_t MAX_SHARED_STREAM_SIZE = 16 * 1024 * 1024;
+    
+    // SendQueryの結果をDataChunk単位でシリアライズしてchunked transferで送る
+    // 接続と結果はプロバイダが破棄されるまで保持する
+    struct ResultStream {
+        ResultStream(unique_ptr<AdmissionController::Ticket> ticket_p, PooledConnection conn_p,
+                     unique_ptr<RequestWatchdog::Scope> watch_p, unique_ptr<QueryResult> result_p,
+                     unique_ptr<ResultSerializer> serializer_p, WorkerPool& pool)
+            : ticket(std::move(ticket_p)), conn(std::move(conn_p)), watch(std::move(watch_p)),
+              result(std::move(result_p)), serializer(std::move(serializer_p)),
+              pipeline(*serializer, pool, ticket ? ticket->Threads() : 1) {
+            serializer->Begin(buffer);
+        }
         
-        string geojson = "{\"type\":\"FeatureCollection\",\"features\":[";
-        bool first_feature = true;
+        // 送り終わるまで実行の枠を持ち続ける
+        unique_ptr<AdmissionController::Ticket> ticket;
+        // 結果を破棄してから接続をプールに返す（メンバは宣言の逆順に破棄される）
+        PooledConnection conn;
+        // 送り終わるまで切断を監視する。期限は最初のチャンクを送るまで（実行の時間だけを数え、受信の遅さは数えない）
+        unique_ptr<RequestWatchdog::Scope> watch;
+        unique_ptr<QueryResult> result;
+        unique_ptr<ResultSerializer> serializer;
+        // チャンクのシリアライズは実行の枠のスレッド数で並列に行う
+        ParallelSerializer pipeline;
+        bool finished = false;
+        bool started = false;
+        string buffer;
+        // Accept-Encoding に応じてチャンクごとに圧縮する（キャッシュには圧縮前の内容を入れる）
+        unique_ptr<StreamCompressor> compressor;
+        string compressed;
         
-        while (true) {
-            auto chunk = result->Fetch();
-            if (!chunk || chunk->size() == 0) break;
-            
-            for (idx_t row = 0; row < chunk->size(); row++) {
-                auto geom_val = chunk->GetValue(0, row);
-                if (geom_val.IsNull()) continue;
-                
-                if (!first_feature) geojson += ",";
-                
-                geojson += "{\"type\":\"Feature\",";
-                geojson += "\"geometry\":" + geom_val.ToString() + ",";
-                geojson += "\"properties\":{";
-                
-                bool first_prop = true;
-                for (idx_t col = 1; col < chunk->ColumnCount(); col++) {
-                    auto val = chunk->GetValue(col, row);
-                    
-                    if (!first_prop) geojson += ",";
-                    geojson += "\"" + names[col] + "\":";
-                    
-                    if (val.IsNull()) {
-                        geojson += "null";
-                    } else if (types[col].IsNumeric()) {
-                        geojson += val.ToString();
-                    } else {
-                        string str_val = val.ToString();
-                        string escaped;
-                        for (char c : str_val) {
-                            if (c == '"') escaped += "\\\"";
-                            else if (c == '\\') escaped += "\\\\";
-                            else if (c == '\n') escaped += "\\n";
-                            else if (c == '\r') escaped += "\\r";
-                            else if (c == '\t') escaped += "\\t";
-                            else escaped += c;
-                        }
-                        geojson += "\"" + escaped + "\"";
-                    }
-                    first_prop = false;
+        // 送った内容を溜めておき、最後まで送れたらキャッシュに入れ、同じ内容を待っているリクエストに渡す
+        // capture_limit を超えたら溜めるのをやめ、待っているリクエストはそれぞれ自分で実行する
+        unique_ptr<RequestCoalescer::Flight> flight;
+        ResponseCache* cache = nullptr;
+        idx_t capture_limit = 0;
+        bool capturing = false;
+        string captured;
+        
+        // ヘッダを送った後の失敗は状態コードで伝えられないので、本文の終わりとトレーラ（X-DuckGL-Error）で伝える
+        // fetch はトレーラを読めないので、JSON は本文にも error を入れて閉じる（行の配列と Arrow IPC は閉じずに終える）
+        bool Fail(httplib::DataSink& sink, string message) {
+            finished = true;
+            capturing = false;
+            if (watch && watch->TimedOut()) message = "Query exceeded the request timeout";
+            try {
+                serializer->EndWithError(message, buffer);
+                if (compressor) {
+                    compressed.clear();
+                    compressor->Write(buffer.data(), buffer.size(), compressed);
+                    compressor->Finish(compressed);
                 }
-                
-                geojson += "}}";
-                first_feature = false;
+            } catch (std::exception&) {
+                return false;
+            }
+            auto& out = compressor ? compressed : buffer;
+            if (!out.empty() && !sink.write(out.data(), out.size())) {
+                return false;
             }
+            // ヘッダの値は1行にする
+            std::replace(message.begin(), message.end(), '\r', ' ');
+            std::replace(message.begin(), message.end(), '\n', ' ');
+            sink.done_with_trailer({{"X-DuckGL-Error", message.substr(0, 1024)}});
+            return true;
         }
         
-        geojson += "]}";
-        return geojson;
+        // ソケットへの書き込みがブロックする間は次のチャンクを取得しない（バックプレッシャー）
+        bool Pump(httplib::DataSink& sink) {
+            try {
+                // 並列の場合はスレッドごとに1回分を目安にまとめて書く
+                if (!finished && pipeline.Write(*result, buffer, STREAM_FLUSH_SIZE * pipeline.Threads())) {
+                    if (result->HasError()) return Fail(sink, result->GetError());
+                    serializer->End(buffer);
+                    finished = true;
+                }
+                if (compressor) {
+                    compressed.clear();
+                    if (!buffer.empty()) compressor->Write(buffer.data(), buffer.size(), compressed);
+                    if (finished) compressor->Finish(compressed);
+                }
+            } catch (std::exception& e) {
+                return Fail(sink, e.what());
+            }
+            auto& out = compressor ? compressed : buffer;
+            if (!out.empty() && !sink.write(out.data(), out.size())) {
+                return false;
+            }
+            if (!started) {
+                started = true;
+                if (watch) watch->ClearDeadline();
+            }
+            if (capturing) {
+                captured += buffer;
+                if (captured.size() > capture_limit) {
+                    capturing = false;
+                    string().swap(captured);
+                }
+            }
+            buffer.clear();
+            if (finished) {
+                if (capturing) {
+                    CachedResponse response {serializer->ContentType(), make_shared_ptr<const string>(std::move(captured))};
+                    cache->Put(flight->Key(), flight->Version(), response);
+                    flight->Publish(response);
+                }
+                sink.done();
+            }
+            return true;
+        }
+    };
+    
+    void SendStreaming(const httplib::Request& req, httplib::Response& res,
+                       unique_ptr<AdmissionController::Ticket> ticket, PooledConnection conn,
+                       unique_ptr<RequestWatchdog::Scope> watch, unique_ptr<QueryResult> result,
+                       unique_ptr<ResultSerializer> serializer,
+                       unique_ptr<RequestCoalescer::Flight> flight = nullptr) {
+        auto content_type = serializer->ContentType();
+        auto stream = make_shared_ptr<ResultStream>(std::move(ticket), std::move(conn), std::move(watch),
+                                                    std::move(result), std::move(serializer), worker_pool);
+        auto encoding = NegotiateEncoding(req, res, content_type, DConstants::INVALID_INDEX);
+        if (encoding != ResponseCompression::Encoding::NONE) {
+            stream->compressor = make_uniq<StreamCompressor>(compression, encoding);
+        }
+        if (flight) {
+            stream->flight = std::move(flight);
+            stream->cache = &cache;
+            // キャッシュを無効にしていても、同時に来た同じリクエストとは共有できるようにする
+            stream->capture_limit = std::max<idx_t>(cache.MaxEntrySize(), MAX_SHARED_STREAM_SIZE);
+            stream->capturing = true;
+        }
+        // 途中で失敗したらトレーラでエラーを送る
+        res.set_header("Trailer", "X-DuckGL-Error");
+        res.set_chunked_content_provider(content_type, [stream](size_t, httplib::DataSink& sink) {
+            return stream->Pump(sink);
+        });
+    }
+    
+    static bool WantsStreaming(const httplib::Request& req) {
+        return req.get_param_value("stream") != "0";
+    }
+    
+    // 変わらない内容をETag付きで送る。If-None-Match が一致すれば本文なしの 304
+    // gzip があってクライアントが受け付けるなら、圧縮済みのものをそのまま送る（ETagは表現ごとに変える）
+    static void SendStatic(const httplib::Request& req, httplib::Response& res, const char* content_type,
+                           const string& etag, const char* cache_control, const char* data, size_t size,
+                           const unsigned char* gzip = nullptr, size_t gzip_size = 0) {
+        bool use_gzip = gzip && ResponseCompression::Accepts(req.get_header_value("Accept-Encoding"), "gzip");
+        string tag = use_gzip ? etag.substr(0, etag.size() - 1) + "-gzip\"" : etag;
+        res.set_header("ETag", tag);
+        res.set_header("Cache-Control", cache_control);
+        if (gzip) res.set_header("Vary", "Accept-Encoding");
+        if (StaticAssets::ETagMatches(req.get_header_value("If-None-Match"), tag)) {
+            res.status = 304;
+            return;
+        }
+        if (use_gzip) {
+            res.set_header("Content-Encoding", "gzip");
+            data = reinterpret_cast<const char*>(gzip);
+            size = gzip_size;
+        }
+        res.set_content_provider(size, content_type, [data](size_t offset, size_t length, httplib::DataSink& sink) {
+            return sink.write(data + offset, length);
+        });
+    }
+    
+    // 圧縮するかを決め、圧縮するなら Content-Encoding を付ける。size が分からなければ DConstants::INVALID_INDEX
+    ResponseCompression::Encoding NegotiateEncoding(const httplib::Request& req, httplib::Response& res,
+                                                    const string& content_type, idx_t size) {
+        if (compression.Level() > 0 && ResponseCompression::IsCompressible(content_type)) {
+            res.set_header("Vary", "Accept-Encoding");
+        }
+        auto encoding = compression.Choose(req.get_header_value("Accept-Encoding"), content_type, size);
+        if (encoding != ResponseCompression::Encoding::NONE) {
+            res.set_header("Content-Encoding", ResponseCompression::Name(encoding));
+        }
+        return encoding;
+    }
+    
+    // キャッシュの本文は共有したまま、コピーせずに送る
+    // 圧縮する場合は、エンコーディングごとに最初の送信で圧縮したものを CachedResponse に残して以後も送る
+    void SendCached(const httplib::Request& req, httplib::Response& res, const CachedResponse& cached) {
+        auto body = cached.body;
+        auto encoding = NegotiateEncoding(req, res, cached.content_type, body->size());
+        if (encoding != ResponseCompression::Encoding::NONE) {
+            body = cached.compressed->Get(compression, encoding, *body);
+        }
+        res.set_content_provider(body->size(), cached.content_type,
+                                 [body](size_t offset, size_t length, httplib::DataSink& sink) {
+            return sink.write(body->data() + offset, length);
+        });
+    }
+    
+    // テーブルを読むエンドポイントは正規化したパスとパラメータ（RequestKey / ViewportKey）をキーにキャッシュする
+    bool ServeFromCache(const httplib::Request& req, const string& key, httplib::Response& res, uint64_t version) {
+        CachedResponse cached;
+        if (!cache.Get(key, version, cached)) return false;
+        SendCached(req, res, cached);
+        return true;
+    }
+    
+    // キャッシュにあればそれを送る。同じキーとバージョンのリクエストが実行中なら、その完了を待って同じ本文を送る
+    // どちらでもなければ自分が実行するので Flight を返す（結果は StoreAndSend / SendStreaming に渡す）。送り済みなら nullptr
+    // 待つ間は実行の枠も接続も持たない
+    unique_ptr<RequestCoalescer::Flight> ServeShared(const httplib::Request& req, httplib::Response& res,
+                                                     const string& key, uint64_t version) {
+        if (ServeFromCache(req, key, res, version)) return nullptr;
+        unique_ptr<RequestCoalescer::Flight> flight;
+        CachedResponse shared;
+        switch (coalescer.Join(key, version, req.is_connection_closed, shared, flight)) {
+        case RequestCoalescer::Role::LEADER:
+            // 確かめてから Join するまでの間に、前に実行していたものがキャッシュに入れて終わっていることがある
+            if (ServeFromCache(req, key, res, version)) return nullptr;
+            return flight;
+        case RequestCoalescer::Role::SHARED:
+            SendCached(req, res, shared);
+            return nullptr;
+        default:
+            return nullptr;
+        }
+    }
+    
+    void StoreAndSend(const httplib::Request& req, RequestCoalescer::Flight& flight, httplib::Response& res,
+                      string body, const string& content_type) {
+        CachedResponse response {content_type, make_shared_ptr<const string>(std::move(body))};
+        cache.Put(flight.Key(), flight.Version(), response);
+        flight.Publish(response);
+        SendCached(req, res, response);
+    }
+    
+    // bbox=minx,miny,maxx,maxy と zoom=z の表示範囲指定
+    struct Viewport {
+        bool has_bbox = false;
+        BoundingBox bbox;
+        int zoom = -1;
+    };
+    
+    // zoom があるときはbboxをそのズームのタイル幅の格子に外側へ揃え、少しのパンでも同じキャッシュキーになるようにする
+    static bool ParseViewport(const httplib::Request& req, Viewport& viewport, string& error) {
+        if (req.has_param("zoom")) {
+            viewport.zoom = std::stoi(req.get_param_value("zoom"));
+            if (viewport.zoom < 0 || viewport.zoom > int(TileProjection::MAX_ZOOM)) {
+                error = "zoom must be between 0 and " + std::to_string(TileProjection::MAX_ZOOM);
+                return false;
+            }
+        }
+        if (!req.has_param("bbox")) return true;
+        
+        double values[4];
+        auto parts = StringUtil::Split(req.get_param_value("bbox"), ',');
+        if (parts.size() != 4) {
+            error = "bbox must be minx,miny,maxx,maxy";
+            return false;
+        }
+        for (idx_t i = 0; i < 4; i++) {
+            values[i] = std::stod(parts[i]);
+        }
+        if (!(values[0] <= values[2]) || !(values[1] <= values[3])) {
+            error = "bbox must be minx,miny,maxx,maxy";
+            return false;
+        }
+        if (viewport.zoom >= 0) {
+            double step = 360.0 / double(uint64_t(1) << viewport.zoom);
+            values[0] = std::floor(values[0] / step) * step;
+            values[1] = std::floor(values[1] / step) * step;
+            values[2] = std::ceil(values[2] / step) * step;
+            values[3] = std::ceil(values[3] / step) * step;
+        }
+        viewport.has_bbox = true;
+        viewport.bbox = BoundingBox {std::max(values[0], -180.0), std::max(values[1], -90.0), std::min(values[2], 180.0),
+                                     std::min(values[3], 90.0)};
+        return true;
+    }
+    
+    // ズームzで1ピクセルに相当する経度の幅から簡略化の許容誤差（度）を求める
+    static double SimplifyTolerance(int zoom) {
+        return SIMPLIFY_PIXELS * 360.0 / (256.0 * double(uint64_t(1) << zoom));
+    }
+    
+    // パスとパラメータ（名前順）をキーにする。結果に影響しないもの（timeout、stream）は含めない
+    static string RequestKey(const httplib::Request& req) {
+        string key = req.path;
+        char separator = '?';
+        for (auto& param : req.params) {
+            if (param.first == "timeout" || param.first == "stream") continue;
+            key += separator + EscapeKeyPart(param.first) + "=" + EscapeKeyPart(param.second);
+            separator = '&';
+        }
+        return key;
+    }
+    
+    static string EscapeKeyPart(const string& part) {
+        string escaped;
+        for (auto c : part) {
+            if (c == '%') escaped += "%25";
+            else if (c == '&') escaped += "%26";
+            else if (c == '=') escaped += "%3D";
+            else escaped += c;
+        }
+        return escaped;
+    }
+    
+    static string ViewportKey(const string& path, const Viewport& viewport) {
+        string key = path;
+        if (viewport.has_bbox) {
+            key += "?bbox=" + SQLDouble(viewport.bbox.min_x) + "," + SQLDouble(viewport.bbox.min_y) + "," +
+                   SQLDouble(viewport.bbox.max_x) + "," + SQLDouble(viewport.bbox.max_y);
+        }
+        if (viewport.zoom >= 0) {
+            key += (viewport.has_bbox ? "&zoom=" : "?zoom=") + std::to_string(viewport.zoom);
+        }
+        return key;
+    }
+    
+    // 種類ごとの実行の枠を取る。待ち行列が一杯なら 503 を返し、待っている間に切断されたら諦めて nullptr を返す
+    unique_ptr<AdmissionController::Ticket> Admit(const httplib::Request& req, httplib::Response& res,
+                                                  AdmissionController::Class cls) {
+        auto ticket = admission.Admit(cls, req.is_connection_closed);
+        if (!ticket) {
+            res.status = 503;
+            res.set_header("Retry-After", "1");
+            res.set_content("{\"error\":\"Server is busy, try again later\"}", "application/json");
+        }
+        return ticket;
+    }
+    
+    // リクエストの接続を監視に登録する。?timeout=（秒）ではサーバーの期限より短い期限だけを指定できる
+    unique_ptr<RequestWatchdog::Scope> Watch(const httplib::Request& req, Connection& conn) {
+        double timeout = request_timeout;
+        if (req.has_param("timeout")) {
+            double requested = std::stod(req.get_param_value("timeout"));
+            if (requested > 0 && (timeout <= 0 || requested < timeout)) timeout = requested;
+        }
+        return watchdog.Watch(conn, req.is_connection_closed, timeout);
+    }
+    
+    // テーブルのデータバージョン。ビューや読み込み済みのカタログにない名前は依存先が分からないので、どの書き込みでも進む値を使う
+    uint64_t TableVersion(const string& table_name) {
+        auto schema = schemas.Peek();
+        auto table = schema ? schema->Find(table_name) : nullptr;
+        if (!table || table->view) return DataVersion::Current();
+        return DataVersion::Current(table_name);
+    }
+    
+    // テーブルのジオメトリ列（引用符付き）をメタデータのキャッシュから返す。見つからない場合は空文字列で error に理由を入れる
+    // 見つからない理由に合わせて res.status も設定する（本文は呼び出し側が書く）
+    string FindGeometryColumn(Connection& conn, const string& table_name, string& error, httplib::Response& res) {
+        auto version = DataVersion::Catalog();
+        auto schema = schemas.Get(conn, version);
+        // 監視していない接続で作られたテーブルや後から読み込まれたspatialもあるので、見つからないときは読み直す
+        // 読み直しはカタログのバージョンごとに一度だけにし、同じバージョンの間は見つからない結果をそのまま使う
+        if (schema && (!schema->spatial || !schema->Find(table_name)) && schemas.Refresh(version)) {
+            schema = schemas.Get(conn, version);
+        }
+        if (!schema) {
+            res.status = 500;
+            error = "Could not read the catalog";
+            return string();
+        }
+        if (!schema->spatial) {
+            res.status = 503;
+            error = "Spatial extension not available";
+            return string();
+        }
+        auto table = schema->Find(table_name);
+        if (!table) {
+            res.status = 404;
+            error = "Table not found";
+            return string();
+        }
+        if (!table->HasGeometry()) {
+            res.status = 400;
+            error = "No geometry column found";
+            return string();
+        }
+        return table->GeometryColumn();
+    }
+    
+    // 範囲の条件をSQLにし、R-treeで得たrowidの範囲で読む行グループを絞る
+    // 範囲に地物がないことが索引で分かった場合は空文字列
+    string ViewportFilter(Connection& conn, const string& table_name, const string& geom_col, const BoundingBox& box,
+                          uint64_t version, idx_t threads) {
+        string filter = "ST_Intersects_Extent(" + geom_col + ", ST_MakeEnvelope(" + SQLDouble(box.min_x) + ", " +
+                        SQLDouble(box.min_y) + ", " + SQLDouble(box.max_x) + ", " + SQLDouble(box.max_y) + "))";
+        auto index = indexes.Get(conn, table_name, geom_col, version, threads);
+        if (!index) return filter;
+        vector<int64_t> row_ids;
+        index->Search(box, row_ids);
+        if (row_ids.empty()) return string();
+        return SpatialIndexManager::RowIdFilter(row_ids) + " AND " + filter;
+    }
+    
+    // EXPLAIN (FORMAT JSON) の木をルートから最初の子へたどり、最初の0でない Estimated Cardinality を返す
+    // ORDER BY の上の射影などは 0 になっていることがあるので、その下の演算子の値を使う
+    static int64_t PlanCardinality(duckdb_yyjson::yyjson_val* node) {
+        using namespace duckdb_yyjson;
+        while (node && yyjson_is_obj(node)) {
+            auto extra_info = yyjson_obj_get(node, "extra_info");
+            auto value = yyjson_is_obj(extra_info) ? yyjson_obj_get(extra_info, "Estimated Cardinality") : nullptr;
+            int64_t estimate = -1;
+            if (yyjson_is_str(value)) {
+                estimate = std::stoll(yyjson_get_str(value));
+            } else if (yyjson_is_int(value)) {
+                estimate = yyjson_get_sint(value);
+            }
+            if (estimate > 0) return estimate;
+            auto children = yyjson_obj_get(node, "children");
+            node = yyjson_is_arr(children) ? yyjson_arr_get_first(children) : nullptr;
+        }
+        return -1;
+    }
+    
+    // SELECT 1文ならDuckDBの見積もり行数（EXPLAIN のルートの Estimated Cardinality）。分からなければ -1
+    // 複数の文は EXPLAIN すると2文目以降が実行されてしまうので見積もらない
+    static int64_t EstimateRows(Connection& conn, const string& sql) {
+        using namespace duckdb_yyjson;
+        try {
+            auto statements = conn.ExtractStatements(sql);
+            if (statements.size() != 1 || statements[0]->type != StatementType::SELECT_STATEMENT) return -1;
+            auto plan = conn.Query("EXPLAIN (FORMAT JSON) " + sql);
+            if (plan->HasError() || plan->RowCount() == 0) return -1;
+            auto json = plan->GetValue(1, 0).ToString();
+            auto doc = yyjson_read(json.c_str(), json.size(), YYJSON_READ_NOFLAG);
+            if (!doc) return -1;
+            // 出力は演算子の木の配列で、SELECT 1文なら要素は1つ
+            auto root = yyjson_doc_get_root(doc);
+            int64_t estimate = -1;
+            try {
+                estimate = PlanCardinality(yyjson_is_arr(root) ? yyjson_arr_get_first(root) : root);
+            } catch (std::exception&) {
+            }
+            yyjson_doc_free(doc);
+            return estimate;
+        } catch (std::exception&) {
+            return -1;
+        }
+    }
+    
+    void SendCursorPage(httplib::Response& res, QueryCursorManager::Lease& lease, idx_t limit) {
+        string page, error;
+        if (!lease.Page(limit, page, error)) {
+            res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(error) + "\"}", "application/json");
+            return;
+        }
+        res.set_content(page, "application/json");
+    }
+    
+    // ?page= 付きの /api/query。最初の page 行と、続きがあればカーソルのidを返す（続きは /api/cursors/{id}）
+    // 結果は開いたまま持ち、読んだ分しか実行・シリアライズしない
+    void HandleCursorQuery(const httplib::Request& req, httplib::Response& res) {
+        try {
+            int64_t page = std::stoll(req.get_param_value("page"));
+            if (page <= 0) {
+                res.status = 400;
+                res.set_content("{\"error\":\"page must be > 0\"}", "application/json");
+                return;
+            }
+            auto ticket = Admit(req, res, AdmissionController::Class::BATCH);
+            if (!ticket) return;
+            // 監視を外してからカーソル（接続）を放す
+            unique_ptr<QueryCursorManager::Lease> lease;
+            auto conn = make_uniq<Connection>(*db_instance);
+            auto watch = Watch(req, *conn);
+            auto estimated = EstimateRows(*conn, req.body);
+            auto result = conn->SendQuery(req.body);
+            if (result->HasError()) {
+                res.set_content(ResultToJSON(std::move(result)), "application/json");
+                return;
+            }
+            lease = cursors.Open(std::move(conn), std::move(result), estimated, idx_t(page));
+            SendCursorPage(res, *lease, 0);
+        } catch (std::exception& e) {
+            res.status = 500;
+            res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(e.what()) + "\"}", "application/json");
+        }
+    }
+    
+    void HandleQuery(const httplib::Request& req, httplib::Response& res, bool arrow) {
+        if (!arrow && req.has_param("page")) {
+            HandleCursorQuery(req, res);
+            return;
+        }
+        try {
+            auto ticket = Admit(req, res, AdmissionController::Class::BATCH);
+            if (!ticket) return;
+            auto conn = connections.Acquire();
+            auto watch = Watch(req, *conn);
+            // 任意のSQLは接続に設定や一時テーブルを残しうるので、使い終わった接続は再利用しない
+            conn.Discard();
+            auto result = WantsStreaming(req) ? conn->SendQuery(req.body)
+                                              : unique_ptr<QueryResult>(conn->Query(req.body));
+            if (result->HasError()) {
+                res.set_content(ResultToJSON(std::move(result)), "application/json");
+                return;
+            }
+            
+            unique_ptr<ResultSerializer> serializer;
+            if (arrow) {
+                serializer = make_uniq<ArrowResultSerializer>(*conn->context, result->names, result->types,
+                                                              result->client_properties);
+            } else {
+                // stream=1 を明示したときは、途中の失敗を本文で伝えられるように {"data":[..]} で包む
+                auto layout = req.get_param_value("stream") == "1" ? JSONLayout::ENVELOPE : JSONLayout::ARRAY;
+                serializer = make_uniq<JSONResultSerializer>(result->names, result->types, layout);
+            }
+            
+            if (!WantsStreaming(req)) {
+                res.set_content(SerializeResult(*result, *serializer, ticket->Threads()), serializer->ContentType());
+                return;
+            }
+            SendStreaming(req, res, std::move(ticket), std::move(conn), std::move(watch), std::move(result), std::move(serializer));
+        } catch (std::exception& e) {
+            res.status = 500;
+            res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(e.what()) + "\"}", "application/json");
+        }
     }
     
 public:
-    DuckGLServer(DatabaseInstance* db, int port_num) 
-        : db_instance(db), port(port_num) {
+    DuckGLServer(DatabaseInstance* db, int port_num, idx_t cache_size, double request_timeout_p,
+                 int compression_level, idx_t compression_threshold, idx_t job_result_limit)
+        : db_instance(db), port(port_num), worker_pool(std::max<idx_t>(1, std::thread::hardware_concurrency())),
+          cache(cache_size), indexes(worker_pool), clusters(worker_pool), connections(*db, HttpWorkerCount()),
+          request_timeout(request_timeout_p),
+          admission(AdmissionController::DefaultLimits(AdmissionController::Class::INTERACTIVE, HttpWorkerCount()),
+                    AdmissionController::DefaultLimits(AdmissionController::Class::BATCH, HttpWorkerCount())),
+          jobs(*db, admission, job_result_limit), compression(compression_level, compression_threshold) {
     }
     
     ~DuckGLServer() {
@@ -365,86 +1504,724 @@ public:
     
     void Start(const string& host) {
         server = make_uniq<httplib::Server>();
+        // ワーカーは接続プールと同じ数にし、1リクエストが1接続を借りる
+        auto workers = connections.Size();
+        server->new_task_queue = [workers]() { return new httplib::ThreadPool(workers); };
         
-        server->Get("/", [](const httplib::Request&, httplib::Response& res) {
-            res.set_content(GetDuckGLHTML(), "text/html; charset=utf-8");
+        index_html = GetDuckGLHTML();
+        index_etag = StaticAssets::ETag(index_html);
+        if (compression.Level() > 0) {
+            index_gzip = compression.Compress(ResponseCompression::Encoding::GZIP, index_html.data(), index_html.size());
+        }
+        server->Get("/", [this](const httplib::Request& req, httplib::Response& res) {
+            SendStatic(req, res, "text/html; charset=utf-8", index_etag, StaticAssets::HTML_CACHE_CONTROL,
+                       index_html.data(), index_html.size(),
+                       index_gzip.empty() ? nullptr : reinterpret_cast<const unsigned char*>(index_gzip.data()),
+                       index_gzip.size());
+        });
+        
+        // ハンドラが本文を set_content で入れたレスポンスは、送る直前にこのワーカースレッドで圧縮する
+        // （チャンクで送るものは SendStreaming / SendCached が圧縮する）
+        server->set_post_routing_handler([this](const httplib::Request& req, httplib::Response& res) {
+            if (res.body.empty() || res.status != 200 || res.has_header("Content-Encoding")) return;
+            auto encoding = NegotiateEncoding(req, res, res.get_header_value("Content-Type"), res.body.size());
+            if (encoding == ResponseCompression::Encoding::NONE) return;
+            res.body = compression.Compress(encoding, res.body.data(), res.body.size());
+            // httplibはこの時点で圧縮前の Content-Length を付けているので付け直す
+            res.headers.erase("Content-Length");
+            res.set_header("Content-Length", std::to_string(res.body.size()));
+        });
+        
+        // ビルド時に埋め込んだJS/CSS（scripts/embed_assets.sh）
+        server->Get(R"(/assets/([^/]+))", [](const httplib::Request& req, httplib::Response& res) {
+            auto asset = StaticAssets::Find(req.matches[1]);
+            if (!asset) {
+                res.status = 404;
+                res.set_content("{\"error\":\"Asset not found\"}", "application/json");
+                return;
+            }
+            SendStatic(req, res, asset->content_type, asset->etag, StaticAssets::ASSET_CACHE_CONTROL,
+                       reinterpret_cast<const char*>(asset->data), asset->size, asset->gzip, asset->gzip_size);
         });
         
         server->Post("/api/query", [this](const httplib::Request& req, httplib::Response& res) {
+            bool arrow = req.get_header_value("Accept").find(ARROW_STREAM_MIME) != string::npos;
+            HandleQuery(req, res, arrow);
+        });
+        
+        server->Post("/api/arrow", [this](const httplib::Request& req, httplib::Response& res) {
+            HandleQuery(req, res, true);
+        });
+        
+        // 長いクエリはジョブとして受け付けてすぐにidを返し、進捗をポーリングしてから結果をページごとに取る
+        server->Post("/api/jobs", [this](const httplib::Request& req, httplib::Response& res) {
             try {
-                Connection conn(*db_instance);
-                auto result = conn.Query(req.body);
-                res.set_content(ResultToJSON(std::move(result)), "application/json");
+                if (req.body.empty()) {
+                    res.status = 400;
+                    res.set_content("{\"error\":\"SQL is required\"}", "application/json");
+                    return;
+                }
+                auto id = jobs.Submit(req.body);
+                res.status = 202;
+                res.set_content("{\"id\":\"" + id + "\",\"state\":\"queued\"}", "application/json");
             } catch (std::exception& e) {
                 res.status = 500;
-                res.set_content("{\"error\":\"" + string(e.what()) + "\"}", "application/json");
+                res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(e.what()) + "\"}", "application/json");
+            }
+        });
+        
+        server->Get(R"(/api/jobs/([0-9a-f]+))", [this](const httplib::Request& req, httplib::Response& res) {
+            string status;
+            if (!jobs.StatusJSON(req.matches[1], status)) {
+                res.status = 404;
+                res.set_content("{\"error\":\"Job not found\"}", "application/json");
+                return;
             }
+            res.set_content(status, "application/json");
         });
         
-        server->Get("/api/tables", [this](const httplib::Request&, httplib::Response& res) {
+        server->Get(R"(/api/jobs/([0-9a-f]+)/result)", [this](const httplib::Request& req, httplib::Response& res) {
             try {
-                Connection conn(*db_instance);
-                auto result = conn.Query(
-                    "SELECT table_name, table_schema "
-                    "FROM information_schema.tables "
-                    "WHERE table_schema NOT IN ('information_schema', 'pg_catalog')"
-                );
-                res.set_content(ResultToJSON(std::move(result)), "application/json");
+                int64_t offset = req.has_param("offset") ? std::stoll(req.get_param_value("offset")) : 0;
+                int64_t limit = req.has_param("limit") ? std::stoll(req.get_param_value("limit")) : DEFAULT_JOB_PAGE_ROWS;
+                if (offset < 0 || limit <= 0) {
+                    res.status = 400;
+                    res.set_content("{\"error\":\"offset must be >= 0 and limit > 0\"}", "application/json");
+                    return;
+                }
+                string page, error;
+                if (!jobs.PageJSON(req.matches[1], idx_t(offset), idx_t(limit), page, error)) {
+                    // まだ終わっていない・失敗したジョブは 409、見つからなければ 404
+                    res.status = error.empty() ? 404 : 409;
+                    res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(error.empty() ? "Job not found" : error) +
+                                    "\"}", "application/json");
+                    return;
+                }
+                res.set_content(page, "application/json");
             } catch (std::exception& e) {
                 res.status = 500;
-                res.set_content("{\"error\":\"" + string(e.what()) + "\"}", "application/json");
+                res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(e.what()) + "\"}", "application/json");
+            }
+        });
+        
+        server->Delete(R"(/api/jobs/([0-9a-f]+))", [this](const httplib::Request& req, httplib::Response& res) {
+            if (!jobs.Cancel(req.matches[1])) {
+                res.status = 404;
+                res.set_content("{\"error\":\"Job not found\"}", "application/json");
+                return;
+            }
+            res.set_content("{\"cancelled\":true}", "application/json");
+        });
+        
+        server->Get(R"(/api/cursors/([0-9a-f]+))", [this](const httplib::Request& req, httplib::Response& res) {
+            try {
+                int64_t limit = req.has_param("limit") ? std::stoll(req.get_param_value("limit")) : 0;
+                if (req.has_param("limit") && limit <= 0) {
+                    res.status = 400;
+                    res.set_content("{\"error\":\"limit must be > 0\"}", "application/json");
+                    return;
+                }
+                auto ticket = Admit(req, res, AdmissionController::Class::BATCH);
+                if (!ticket) return;
+                auto lease = cursors.Borrow(req.matches[1]);
+                if (!lease) {
+                    // 最後まで読んだか、使われないまま閉じられた
+                    res.status = 404;
+                    res.set_content("{\"error\":\"Cursor not found\"}", "application/json");
+                    return;
+                }
+                auto watch = Watch(req, lease->GetConnection());
+                SendCursorPage(res, *lease, idx_t(limit));
+            } catch (std::exception& e) {
+                res.status = 500;
+                res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(e.what()) + "\"}", "application/json");
+            }
+        });
+        
+        server->Delete(R"(/api/cursors/([0-9a-f]+))", [this](const httplib::Request& req, httplib::Response& res) {
+            if (!cursors.Close(req.matches[1])) {
+                res.status = 404;
+                res.set_content("{\"error\":\"Cursor not found\"}", "application/json");
+                return;
+            }
+            res.set_content("{\"closed\":true}", "application/json");
+        });
+        
+        server->Get("/api/tables", [this](const httplib::Request& req, httplib::Response& res) {
+            try {
+                auto ticket = Admit(req, res, AdmissionController::Class::INTERACTIVE);
+                if (!ticket) return;
+                auto conn = connections.Acquire();
+                auto watch = Watch(req, *conn);
+                auto schema = schemas.Get(*conn, DataVersion::Catalog());
+                if (!schema) {
+                    res.set_content("{\"error\":\"Could not read the catalog\"}", "application/json");
+                    return;
+                }
+                res.set_content(schema->TablesJSON(), "application/json");
+            } catch (std::exception& e) {
+                res.status = 500;
+                res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(e.what()) + "\"}", "application/json");
             }
         });
         
         server->Get(R"(/api/geojson/(.+))", [this](const httplib::Request& req, httplib::Response& res) {
             try {
                 string table_name = req.matches[1];
-                Connection conn(*db_instance);
+                Viewport viewport;
+                string error;
+                if (!ParseViewport(req, viewport, error)) {
+                    res.status = 400;
+                    res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(error) + "\",\"type\":\"FeatureCollection\",\"features\":[]}", "application/json");
+                    return;
+                }
+                // precision=n で座標を小数点以下n桁に丸める（省略時は元の値に戻る最短の桁数）
+                int precision = -1;
+                if (req.has_param("precision")) {
+                    precision = std::stoi(req.get_param_value("precision"));
+                    if (precision < 0 || precision > GeoJSONGeometryWriter::MAX_PRECISION) {
+                        res.status = 400;
+                        res.set_content("{\"error\":\"precision must be between 0 and " +
+                                            std::to_string(GeoJSONGeometryWriter::MAX_PRECISION) +
+                                            "\",\"type\":\"FeatureCollection\",\"features\":[]}",
+                                        "application/json");
+                        return;
+                    }
+                }
+                auto cache_key = ViewportKey(req.path + (precision >= 0 ? ":p" + std::to_string(precision) : ""), viewport);
+                auto version = TableVersion(table_name);
+                auto flight = ServeShared(req, res, cache_key, version);
+                if (!flight) return;
+                auto ticket = Admit(req, res, AdmissionController::Class::INTERACTIVE);
+                if (!ticket) return;
+                auto conn = connections.Acquire();
+                auto watch = Watch(req, *conn);
+                
+                string geom_col = FindGeometryColumn(*conn, table_name, error, res);
+                if (geom_col.empty()) {
+                    res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(error) + "\",\"type\":\"FeatureCollection\",\"features\":[]}", "application/json");
+                    return;
+                }
+                
+                // ジオメトリはWKBのまま取り出し、C++で直接GeoJSONに書く（ST_AsGeoJSON の文字列を作らない）
+                // zoom があれば簡略化してから書く（キャッシュはズームごと）
+                bool simplify = viewport.zoom >= 0;
+                string sql = "SELECT ST_AsWKB(" + geom_col + ") as wkb, * EXCLUDE(" + geom_col + ") FROM " +
+                             QuoteIdentifier(table_name);
+                if (viewport.has_bbox) {
+                    auto filter = ViewportFilter(*conn, table_name, geom_col, viewport.bbox, version, ticket->Threads());
+                    if (filter.empty()) {
+                        StoreAndSend(req, *flight, res, "{\"type\":\"FeatureCollection\",\"features\":[]}", "application/json");
+                        return;
+                    }
+                    sql += " WHERE " + filter;
+                }
+                auto result = WantsStreaming(req) ? conn->SendQuery(sql) : unique_ptr<QueryResult>(conn->Query(sql));
+                if (result->HasError()) {
+                    res.set_content(ResultToGeoJSONWithProperties(std::move(result)), "application/json");
+                    return;
+                }
+                
+                unique_ptr<ResultSerializer> serializer = make_uniq<WKBGeoJSONSerializer>(
+                    result->names, result->types, simplify ? SimplifyTolerance(viewport.zoom) : 0, precision);
+                if (!WantsStreaming(req)) {
+                    StoreAndSend(req, *flight, res, SerializeResult(*result, *serializer, ticket->Threads()), "application/json");
+                    return;
+                }
+                SendStreaming(req, res, std::move(ticket), std::move(conn), std::move(watch), std::move(result), std::move(serializer), std::move(flight));
+            } catch (std::exception& e) {
+                res.status = 500;
+                res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(e.what()) + "\",\"type\":\"FeatureCollection\",\"features\":[]}", "application/json");
+            }
+        });
+        
+        // 境界を共有するポリゴンのレイヤーを TopoJSON で返す（共有する境界は1本の弧として1度だけ書く）
+        // 弧の抽出と簡略化は実行の枠のスレッド数で行う。座標の桁数は precision か zoom から決める
+        server->Get(R"(/api/topology/(.+))", [this](const httplib::Request& req, httplib::Response& res) {
+            try {
+                string table_name = req.matches[1];
+                Viewport viewport;
+                string error;
+                if (!ParseViewport(req, viewport, error)) {
+                    res.status = 400;
+                    res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(error) + "\"}", "application/json");
+                    return;
+                }
+                int precision = viewport.zoom >= 0 ? CompactLayerBuilder::ZoomPrecision(viewport.zoom)
+                                                   : CompactLayerBuilder::DEFAULT_PRECISION;
+                if (req.has_param("precision")) {
+                    precision = std::stoi(req.get_param_value("precision"));
+                    if (precision < 0 || precision > CompactLayerBuilder::MAX_PRECISION) {
+                        res.status = 400;
+                        res.set_content("{\"error\":\"precision must be between 0 and " +
+                                            std::to_string(CompactLayerBuilder::MAX_PRECISION) + "\"}",
+                                        "application/json");
+                        return;
+                    }
+                }
+                auto cache_key = ViewportKey(req.path + ":" + std::to_string(precision), viewport);
+                auto version = TableVersion(table_name);
+                auto flight = ServeShared(req, res, cache_key, version);
+                if (!flight) return;
+                auto ticket = Admit(req, res, AdmissionController::Class::INTERACTIVE);
+                if (!ticket) return;
+                auto conn = connections.Acquire();
+                auto watch = Watch(req, *conn);
+                
+                string geom_col = FindGeometryColumn(*conn, table_name, error, res);
+                if (geom_col.empty()) {
+                    res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(error) + "\"}", "application/json");
+                    return;
+                }
+                
+                string sql = "SELECT ST_AsWKB(" + geom_col + ") as wkb, * EXCLUDE(" + geom_col + ") FROM " +
+                             QuoteIdentifier(table_name);
+                if (viewport.has_bbox) {
+                    auto filter = ViewportFilter(*conn, table_name, geom_col, viewport.bbox, version, ticket->Threads());
+                    if (filter.empty()) {
+                        StoreAndSend(req, *flight, res, TopologyBuilder(table_name, {}, {}, precision, 0).Finish(worker_pool, 1), "application/json");
+                        return;
+                    }
+                    sql += " WHERE " + filter;
+                }
+                auto result = conn->SendQuery(sql);
+                if (result->HasError()) {
+                    res.set_content(ResultToJSON(std::move(result)), "application/json");
+                    return;
+                }
+                
+                TopologyBuilder builder(table_name, result->names, result->types, precision,
+                                        viewport.zoom >= 0 ? SimplifyTolerance(viewport.zoom) : 0);
+                while (true) {
+                    auto chunk = result->Fetch();
+                    if (!chunk || chunk->size() == 0) break;
+                    builder.AddChunk(*chunk);
+                }
+                if (result->HasError()) {
+                    res.set_content(ResultToJSON(std::move(result)), "application/json");
+                    return;
+                }
+                
+                StoreAndSend(req, *flight, res, builder.Finish(worker_pool, ticket->Threads()), "application/json");
+            } catch (std::exception& e) {
+                res.status = 500;
+                res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(e.what()) + "\"}", "application/json");
+            }
+        });
+        
+        // GeoArrowレイアウトのバイナリレイヤー。点はST_X/ST_Yで直接取り出し、それ以外はWKBを解析する
+        server->Get(R"(/api/layer/(.+))", [this](const httplib::Request& req, httplib::Response& res) {
+            try {
+                string table_name = req.matches[1];
+                Viewport viewport;
+                string error;
+                if (!ParseViewport(req, viewport, error)) {
+                    res.status = 400;
+                    res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(error) + "\"}", "application/json");
+                    return;
+                }
+                bool float64 = req.get_param_value("coords") == "f64";
+                // format=compact は量子化した座標と属性の辞書による小さい形式。桁数は precision か zoom から決める
+                bool compact = req.get_param_value("format") == "compact";
+                int precision = viewport.zoom >= 0 ? CompactLayerBuilder::ZoomPrecision(viewport.zoom)
+                                                   : CompactLayerBuilder::DEFAULT_PRECISION;
+                if (compact && req.has_param("precision")) {
+                    precision = std::stoi(req.get_param_value("precision"));
+                    if (precision < 0 || precision > CompactLayerBuilder::MAX_PRECISION) {
+                        res.status = 400;
+                        res.set_content("{\"error\":\"precision must be between 0 and " +
+                                            std::to_string(CompactLayerBuilder::MAX_PRECISION) + "\"}",
+                                        "application/json");
+                        return;
+                    }
+                }
+                string variant = compact ? ":compact:" + std::to_string(precision) : float64 ? ":f64" : "";
+                auto cache_key = ViewportKey(req.path + variant, viewport);
+                auto version = TableVersion(table_name);
+                auto flight = ServeShared(req, res, cache_key, version);
+                if (!flight) return;
+                auto ticket = Admit(req, res, AdmissionController::Class::INTERACTIVE);
+                if (!ticket) return;
+                auto conn = connections.Acquire();
+                auto watch = Watch(req, *conn);
                 
-                auto load_result = conn.Query("LOAD spatial;");
-                bool has_spatial = !load_result->HasError();
+                string geom_col = FindGeometryColumn(*conn, table_name, error, res);
+                if (geom_col.empty()) {
+                    res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(error) + "\"}", "application/json");
+                    return;
+                }
                 
-                if (!has_spatial) {
-                    res.set_content("{\"error\":\"Spatial extension not available\",\"type\":\"FeatureCollection\",\"features\":[]}", "application/json");
+                string filter = geom_col + " IS NOT NULL";
+                if (viewport.has_bbox) {
+                    auto bbox_filter = ViewportFilter(*conn, table_name, geom_col, viewport.bbox, version, ticket->Threads());
+                    if (bbox_filter.empty()) {
+                        if (compact) {
+                            StoreAndSend(req, *flight, res, CompactLayerBuilder({}, {}, precision, 0).Finish(), CompactLayerBuilder::CONTENT_TYPE);
+                        } else {
+                            StoreAndSend(req, *flight, res, GeoArrowLayerBuilder(false).Finish(), GeoArrowLayerBuilder::CONTENT_TYPE);
+                        }
+                        return;
+                    }
+                    filter += " AND " + bbox_filter;
+                }
+                string is_point = "ST_GeometryType(" + geom_col + ") = 'POINT'";
+                string sql = "SELECT CASE WHEN " + is_point + " THEN ST_X(" + geom_col + ") END AS x, "
+                             "CASE WHEN " + is_point + " THEN ST_Y(" + geom_col + ") END AS y, "
+                             "CASE WHEN NOT " + is_point + " THEN ST_AsWKB(" + geom_col + ") END AS wkb" +
+                             // コンパクト形式は属性も含める
+                             (compact ? ", * EXCLUDE(" + geom_col + ")" : string()) +
+                             " FROM " + QuoteIdentifier(table_name) + " WHERE " + filter;
+                auto result = conn->SendQuery(sql);
+                if (result->HasError()) {
+                    res.set_content(ResultToJSON(std::move(result)), "application/json");
                     return;
                 }
                 
-                string check_sql = "SELECT column_name FROM information_schema.columns "
-                                  "WHERE table_name = '" + table_name + "' "
-                                  "AND (column_name = 'geometry' OR column_name = 'geom' OR column_name = 'the_geom')";
-                auto check_result = conn.Query(check_sql);
+                double tolerance = viewport.zoom >= 0 ? SimplifyTolerance(viewport.zoom) : 0;
+                unique_ptr<GeoArrowLayerBuilder> builder;
+                unique_ptr<CompactLayerBuilder> compact_builder;
+                if (compact) {
+                    compact_builder = make_uniq<CompactLayerBuilder>(result->names, result->types, precision, tolerance);
+                } else {
+                    builder = make_uniq<GeoArrowLayerBuilder>(float64, tolerance);
+                }
+                while (true) {
+                    auto chunk = result->Fetch();
+                    if (!chunk || chunk->size() == 0) break;
+                    if (compact_builder) {
+                        compact_builder->AddChunk(*chunk);
+                    } else {
+                        builder->AddChunk(*chunk);
+                    }
+                }
+                if (result->HasError()) {
+                    res.set_content(ResultToJSON(std::move(result)), "application/json");
+                    return;
+                }
                 
-                if (!check_result || check_result->HasError()) {
-                    res.set_content("{\"error\":\"Could not check columns\",\"type\":\"FeatureCollection\",\"features\":[]}", "application/json");
+                if (compact_builder) {
+                    StoreAndSend(req, *flight, res, compact_builder->Finish(), CompactLayerBuilder::CONTENT_TYPE);
+                } else {
+                    StoreAndSend(req, *flight, res, builder->Finish(), GeoArrowLayerBuilder::CONTENT_TYPE);
+                }
+            } catch (std::exception& e) {
+                res.status = 500;
+                res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(e.what()) + "\"}", "application/json");
+            }
+        });
+        
+        // 点を画面上のセル（六角形・正方形）に集計して列ごとの配列で返す
+        server->Get(R"(/api/aggregate/(.+))", [this](const httplib::Request& req, httplib::Response& res) {
+            try {
+                string table_name = req.matches[1];
+                Viewport viewport;
+                AggregateRequest aggregate;
+                string error;
+                if (!ParseViewport(req, viewport, error) || !aggregate.ParseCell(req.get_param_value("cell"), error) ||
+                    !aggregate.ParseAggregate(req.get_param_value("agg"), error)) {
+                    res.status = 400;
+                    res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(error) + "\"}", "application/json");
+                    return;
+                }
+                if (viewport.zoom < 0) {
+                    res.status = 400;
+                    res.set_content("{\"error\":\"zoom is required\"}", "application/json");
                     return;
                 }
+                aggregate.zoom = viewport.zoom;
+                if (req.has_param("size")) {
+                    aggregate.size = std::max(1.0, std::min(512.0, std::stod(req.get_param_value("size"))));
+                }
+                auto cache_key = ViewportKey(req.path, viewport) + "|" + req.get_param_value("cell") + "|" +
+                                 req.get_param_value("agg") + "|" + SQLDouble(aggregate.size);
+                auto version = TableVersion(table_name);
+                auto flight = ServeShared(req, res, cache_key, version);
+                if (!flight) return;
                 
-                auto chunk = check_result->Fetch();
-                if (!chunk || chunk->size() == 0) {
-                    res.set_content("{\"error\":\"No geometry column found\",\"type\":\"FeatureCollection\",\"features\":[]}", "application/json");
+                auto ticket = Admit(req, res, AdmissionController::Class::INTERACTIVE);
+                if (!ticket) return;
+                auto conn = connections.Acquire();
+                auto watch = Watch(req, *conn);
+                string geom_col = FindGeometryColumn(*conn, table_name, error, res);
+                if (geom_col.empty()) {
+                    res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(error) + "\"}", "application/json");
                     return;
                 }
                 
-                string geom_col = chunk->GetValue(0, 0).ToString();
+                string filter;
+                if (viewport.has_bbox) {
+                    filter = ViewportFilter(*conn, table_name, geom_col, viewport.bbox, version, ticket->Threads());
+                    if (filter.empty()) filter = "false";
+                }
+                auto result = conn->Query(aggregate.BuildSQL(table_name, geom_col, filter));
+                if (result->HasError()) {
+                    res.set_content(ResultToJSON(std::move(result)), "application/json");
+                    return;
+                }
+                StoreAndSend(req, *flight, res, aggregate.ResultToJSON(*result), "application/json");
+            } catch (std::exception& e) {
+                res.status = 500;
+                res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(e.what()) + "\"}", "application/json");
+            }
+        });
+        
+        // 点のクラスタ。テーブルごとのクラスタ索引を初回に作り、ズーム z の階層からbbox内のクラスタを返す
+        server->Get(R"(/api/clusters/(.+))", [this](const httplib::Request& req, httplib::Response& res) {
+            try {
+                string table_name = req.matches[1];
+                Viewport viewport;
+                string error;
+                if (!ParseViewport(req, viewport, error)) {
+                    res.status = 400;
+                    res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(error) + "\"}", "application/json");
+                    return;
+                }
+                if (!req.has_param("z")) {
+                    res.status = 400;
+                    res.set_content("{\"error\":\"z is required\"}", "application/json");
+                    return;
+                }
+                int zoom = std::stoi(req.get_param_value("z"));
+                auto box = viewport.has_bbox ? viewport.bbox : BoundingBox {-180, -90, 180, 90};
                 
-                string sql = "SELECT ST_AsGeoJSON(" + geom_col + ") as geojson, * EXCLUDE(" + geom_col + ") FROM \"" + table_name + "\"";
-                auto result = conn.Query(sql);
+                auto ticket = Admit(req, res, AdmissionController::Class::INTERACTIVE);
+                if (!ticket) return;
+                auto conn = connections.Acquire();
+                auto watch = Watch(req, *conn);
+                string geom_col = FindGeometryColumn(*conn, table_name, error, res);
+                if (geom_col.empty()) {
+                    res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(error) + "\"}", "application/json");
+                    return;
+                }
+                auto index = clusters.Get(*conn, table_name, geom_col, TableVersion(table_name), ticket->Threads());
+                if (!index) {
+                    res.set_content("{\"error\":\"Could not build the cluster index\"}", "application/json");
+                    return;
+                }
+                res.set_content(index->QueryJSON(zoom, box), "application/json");
+            } catch (std::exception& e) {
+                res.status = 500;
+                res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(e.what()) + "\"}", "application/json");
+            }
+        });
+        
+        server->Get("/api/stats", [this](const httplib::Request&, httplib::Response& res) {
+            res.set_content("{\"cache\":" + cache.StatsJSON() + ",\"indexes\":" + indexes.StatsJSON() +
+                            ",\"clusters\":" + clusters.StatsJSON() +
+                            ",\"schema\":" + schemas.StatsJSON() +
+                            ",\"connections\":" + connections.StatsJSON() +
+                            ",\"requests\":" + watchdog.StatsJSON() +
+                            ",\"jobs\":" + jobs.StatsJSON() +
+                            ",\"cursors\":" + cursors.StatsJSON() +
+                            ",\"admission\":" + admission.StatsJSON() +
+                            ",\"compression\":" + compression.StatsJSON() +
+                            ",\"coalescing\":" + coalescer.StatsJSON() + "}", "application/json");
+        });
+        
+        // Mapbox Vector Tile。タイル範囲（余白込み）に掛かる行だけをSQLで取り出し、クリップと簡略化はC++で行う
+        server->Get(R"(/api/tiles/([^/]+)/(\d+)/(\d+)/(\d+)\.mvt)", [this](const httplib::Request& req, httplib::Response& res) {
+            try {
+                string table_name = req.matches[1];
+                uint32_t z = std::stoul(req.matches[2]);
+                uint32_t x = std::stoul(req.matches[3]);
+                uint32_t y = std::stoul(req.matches[4]);
+                if (!TileProjection::IsValid(z, x, y)) {
+                    res.status = 400;
+                    res.set_content("{\"error\":\"Invalid tile coordinates\"}", "application/json");
+                    return;
+                }
+                double tolerance = MVT_DEFAULT_TOLERANCE;
+                if (req.has_param("tolerance")) {
+                    tolerance = std::stod(req.get_param_value("tolerance"));
+                }
+                auto cache_key = RequestKey(req);
+                auto version = TableVersion(table_name);
+                auto flight = ServeShared(req, res, cache_key, version);
+                if (!flight) return;
                 
+                auto ticket = Admit(req, res, AdmissionController::Class::INTERACTIVE);
+                if (!ticket) return;
+                auto conn = connections.Acquire();
+                auto watch = Watch(req, *conn);
+                string error;
+                string geom_col = FindGeometryColumn(*conn, table_name, error, res);
+                if (geom_col.empty()) {
+                    res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(error) + "\"}", "application/json");
+                    return;
+                }
+                
+                TileProjection projection(z, x, y, MVT_EXTENT);
+                double min_lon, min_lat, max_lon, max_lat;
+                projection.Bounds(MVT_BUFFER, min_lon, min_lat, max_lon, max_lat);
+                string filter = "ST_Intersects_Extent(" + geom_col + ", ST_MakeEnvelope(" + SQLDouble(min_lon) + ", " +
+                                SQLDouble(min_lat) + ", " + SQLDouble(max_lon) + ", " + SQLDouble(max_lat) + "))";
+                
+                // R-treeで候補のrowidを絞り、該当する行グループだけを読む
+                auto index = indexes.Get(*conn, table_name, geom_col, version, ticket->Threads());
+                if (index) {
+                    vector<int64_t> row_ids;
+                    index->Search(BoundingBox {min_lon, min_lat, max_lon, max_lat}, row_ids);
+                    if (row_ids.empty()) {
+                        StoreAndSend(req, *flight, res, string(), VectorTileBuilder::CONTENT_TYPE);
+                        return;
+                    }
+                    filter = SpatialIndexManager::RowIdFilter(row_ids) + " AND " + filter;
+                }
+                string sql = "SELECT ST_AsWKB(" + geom_col + ") AS wkb, * EXCLUDE(" + geom_col + ") "
+                             "FROM " + QuoteIdentifier(table_name) + " WHERE " + filter;
+                auto result = conn->SendQuery(sql);
+                if (result->HasError()) {
+                    res.set_content(ResultToJSON(std::move(result)), "application/json");
+                    return;
+                }
+                
+                VectorTileBuilder builder(projection, table_name, result->names, result->types, MVT_BUFFER, tolerance);
+                while (true) {
+                    auto chunk = result->Fetch();
+                    if (!chunk || chunk->size() == 0) break;
+                    builder.AddChunk(*chunk);
+                }
                 if (result->HasError()) {
-                    res.set_content("{\"error\":\"" + result->GetError() + "\",\"type\":\"FeatureCollection\",\"features\":[]}", "application/json");
+                    res.set_content(ResultToJSON(std::move(result)), "application/json");
                     return;
                 }
                 
-                res.set_content(ResultToGeoJSONWithProperties(std::move(result)), "application/json");
+                StoreAndSend(req, *flight, res, builder.Finish(), VectorTileBuilder::CONTENT_TYPE);
             } catch (std::exception& e) {
                 res.status = 500;
-                res.set_content("{\"error\":\"" + string(e.what()) + "\",\"type\":\"FeatureCollection\",\"features\":[]}", "application/json");
+                res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(e.what()) + "\"}", "application/json");
+            }
+        });
+        
+        // 密度タイル。タイルに掛かる行の点・線を画素ごとに数え、PNG（色付け済み）か生のfloat32で返す
+        server->Get(R"(/api/raster/([^/]+)/(\d+)/(\d+)/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
+            try {
+                string table_name = req.matches[1];
+                uint32_t z = std::stoul(req.matches[2]);
+                uint32_t x = std::stoul(req.matches[3]);
+                uint32_t y = std::stoul(req.matches[4]);
+                if (!TileProjection::IsValid(z, x, y)) {
+                    res.status = 400;
+                    res.set_content("{\"error\":\"Invalid tile coordinates\"}", "application/json");
+                    return;
+                }
+                auto format = req.get_param_value("format");
+                TransferFunction transfer;
+                string error;
+                if (!transfer.ParseHow(req.get_param_value("how"), error) ||
+                    !transfer.ParseColorMap(req.get_param_value("cmap"), error)) {
+                    res.status = 400;
+                    res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(error) + "\"}", "application/json");
+                    return;
+                }
+                if (!format.empty() && format != "png" && format != "f32") {
+                    res.status = 400;
+                    res.set_content("{\"error\":\"format must be png or f32\"}", "application/json");
+                    return;
+                }
+                if (req.has_param("span")) transfer.span = std::stod(req.get_param_value("span"));
+                auto cache_key = RequestKey(req);
+                auto version = TableVersion(table_name);
+                auto flight = ServeShared(req, res, cache_key, version);
+                if (!flight) return;
+                
+                auto ticket = Admit(req, res, AdmissionController::Class::INTERACTIVE);
+                if (!ticket) return;
+                auto conn = connections.Acquire();
+                auto watch = Watch(req, *conn);
+                string geom_col = FindGeometryColumn(*conn, table_name, error, res);
+                if (geom_col.empty()) {
+                    res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(error) + "\"}", "application/json");
+                    return;
+                }
+                
+                TileProjection projection(z, x, y, RASTER_SIZE);
+                DensityRaster raster(projection);
+                double min_lon, min_lat, max_lon, max_lat;
+                projection.Bounds(0, min_lon, min_lat, max_lon, max_lat);
+                auto filter = ViewportFilter(*conn, table_name, geom_col, BoundingBox {min_lon, min_lat, max_lon, max_lat},
+                                             version, ticket->Threads());
+                // 索引でタイルに行がないと分かった場合は空の格子のまま返す
+                if (!filter.empty()) {
+                    auto result = conn->SendQuery(
+                        DensityRaster::BuildSQL(table_name, geom_col, req.get_param_value("weight"), filter));
+                    if (result->HasError()) {
+                        res.set_content(ResultToJSON(std::move(result)), "application/json");
+                        return;
+                    }
+                    raster.Accumulate(*result, worker_pool, ticket->Threads());
+                    if (result->HasError()) {
+                        res.set_content(ResultToJSON(std::move(result)), "application/json");
+                        return;
+                    }
+                }
+                
+                if (format == "f32") {
+                    StoreAndSend(req, *flight, res, raster.ToFloat32(), DensityRaster::FLOAT32_CONTENT_TYPE);
+                } else {
+                    StoreAndSend(req, *flight, res, raster.ToPNG(transfer), PNGWriter::CONTENT_TYPE);
+                }
+            } catch (std::exception& e) {
+                res.status = 500;
+                res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(e.what()) + "\"}", "application/json");
+            }
+        });
+        
+        // 指定位置（経度・緯度、tolerance度以内）にある地物の属性を返す
+        server->Get(R"(/api/pick/(.+))", [this](const httplib::Request& req, httplib::Response& res) {
+            try {
+                string table_name = req.matches[1];
+                if (!req.has_param("lon") || !req.has_param("lat")) {
+                    res.status = 400;
+                    res.set_content("{\"error\":\"lon and lat are required\"}", "application/json");
+                    return;
+                }
+                double lon = std::stod(req.get_param_value("lon"));
+                double lat = std::stod(req.get_param_value("lat"));
+                double tolerance = req.has_param("tolerance") ? std::stod(req.get_param_value("tolerance")) : 0;
+                auto version = TableVersion(table_name);
+                
+                auto ticket = Admit(req, res, AdmissionController::Class::INTERACTIVE);
+                if (!ticket) return;
+                auto conn = connections.Acquire();
+                auto watch = Watch(req, *conn);
+                string error;
+                string geom_col = FindGeometryColumn(*conn, table_name, error, res);
+                if (geom_col.empty()) {
+                    res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(error) + "\"}", "application/json");
+                    return;
+                }
+                
+                string filter = "ST_DWithin(" + geom_col + ", ST_Point(" + SQLDouble(lon) + ", " + SQLDouble(lat) +
+                                "), " + SQLDouble(tolerance) + ")";
+                auto index = indexes.Get(*conn, table_name, geom_col, version, ticket->Threads());
+                if (index) {
+                    vector<int64_t> row_ids;
+                    index->Search(BoundingBox {lon - tolerance, lat - tolerance, lon + tolerance, lat + tolerance}, row_ids);
+                    if (row_ids.empty()) {
+                        res.set_content("[]", "application/json");
+                        return;
+                    }
+                    filter = SpatialIndexManager::RowIdFilter(row_ids) + " AND " + filter;
+                }
+                string sql = "SELECT * EXCLUDE(" + geom_col + ") FROM " + QuoteIdentifier(table_name) + " WHERE " +
+                             filter + " LIMIT 100";
+                res.set_content(ResultToJSON(conn->Query(sql)), "application/json");
+            } catch (std::exception& e) {
+                res.status = 500;
+                res.set_content("{\"error\":\"" + JSONChunkWriter::Escape(e.what()) + "\"}", "application/json");
             }
         });
         
         running = true;
         
         server_thread = std::thread([this, host]() {
+            // 最初のリクエストより前にカタログを読んでおく（間に合わなかったリクエストは読み込みの完了を待つ）
+            try {
+                auto conn = connections.Acquire();
+                schemas.Get(*conn, DataVersion::Catalog());
+            } catch (std::exception&) {
+            }
             server->listen(host.c_str(), port);
         });
         
@@ -485,7 +2262,37 @@ inline void DuckGLStartFunction(DataChunk &args, ExpressionState &state, Vector
     }
     
     auto &db = DatabaseInstance::GetDatabase(context);
-    global_server = make_uniq<DuckGLServer>(&db, port);
+    // duckgl_start を呼んだ接続はコールバック登録前に開かれている可能性があるので個別に監視する
+    DataVersion::Track(context);
+    
+    Value cache_size_value;
+    string cache_size = DEFAULT_CACHE_SIZE;
+    if (context.TryGetCurrentSetting("duckgl_cache_size", cache_size_value) && !cache_size_value.IsNull()) {
+        cache_size = cache_size_value.ToString();
+    }
+    double request_timeout = DEFAULT_REQUEST_TIMEOUT;
+    Value timeout_value;
+    if (context.TryGetCurrentSetting("duckgl_request_timeout", timeout_value) && !timeout_value.IsNull()) {
+        request_timeout = timeout_value.GetValue<double>();
+    }
+    int compression_level = ResponseCompression::DEFAULT_LEVEL;
+    Value level_value;
+    if (context.TryGetCurrentSetting("duckgl_compression_level", level_value) && !level_value.IsNull()) {
+        compression_level = level_value.GetValue<int32_t>();
+    }
+    string compression_threshold = ResponseCompression::DEFAULT_THRESHOLD;
+    Value threshold_value;
+    if (context.TryGetCurrentSetting("duckgl_compression_threshold", threshold_value) && !threshold_value.IsNull()) {
+        compression_threshold = threshold_value.ToString();
+    }
+    string job_result_limit = DEFAULT_JOB_RESULT_LIMIT;
+    Value job_limit_value;
+    if (context.TryGetCurrentSetting("duckgl_job_result_limit", job_limit_value) && !job_limit_value.IsNull()) {
+        job_result_limit = job_limit_value.ToString();
+    }
+    global_server = make_uniq<DuckGLServer>(&db, port, DBConfig::ParseMemoryLimit(cache_size), request_timeout,
+                                            compression_level, DBConfig::ParseMemoryLimit(compression_threshold),
+                                            DBConfig::ParseMemoryLimit(job_result_limit));
     global_server->Start(host);
     
     string message = "DuckGL server started on " + host + ":" + std::to_string(port);
@@ -501,7 +2308,43 @@ inline void DuckGLStopFunction(DataChunk &args, ExpressionState &state, Vector &
     }
 }
 
+static void RegisterSettings(DatabaseInstance &db) {
+    DBConfig::GetConfig(db).AddExtensionOption(
+        "duckgl_cache_size",
+        "Memory budget for cached tiles and layers served by DuckGL (e.g. 256MB, 0 to disable)",
+        LogicalType::VARCHAR,
+        Value(DEFAULT_CACHE_SIZE)
+    );
+    DBConfig::GetConfig(db).AddExtensionOption(
+        "duckgl_request_timeout",
+        "Seconds after which DuckGL interrupts a request's query (0 for no limit)",
+        LogicalType::DOUBLE,
+        Value::DOUBLE(DEFAULT_REQUEST_TIMEOUT)
+    );
+    DBConfig::GetConfig(db).AddExtensionOption(
+        "duckgl_compression_level",
+        "zlib level (1-9) for gzip/deflate compressed DuckGL responses (0 to disable)",
+        LogicalType::INTEGER,
+        Value::INTEGER(ResponseCompression::DEFAULT_LEVEL)
+    );
+    DBConfig::GetConfig(db).AddExtensionOption(
+        "duckgl_compression_threshold",
+        "Responses smaller than this are sent uncompressed (e.g. 1KB)",
+        LogicalType::VARCHAR,
+        Value(ResponseCompression::DEFAULT_THRESHOLD)
+    );
+    DBConfig::GetConfig(db).AddExtensionOption(
+        "duckgl_job_result_limit",
+        "Memory budget for one DuckGL background job's result; larger results fail the job (e.g. 1GB, 0 for no limit)",
+        LogicalType::VARCHAR,
+        Value(DEFAULT_JOB_RESULT_LIMIT)
+    );
+    DataVersion::Register(db);
+}
+
 void DuckglExtension::Load(ExtensionLoader &loader) {
+    RegisterSettings(loader.GetDatabaseInstance());
+    
     loader.RegisterFunction(ScalarFunction(
         "duckgl_start",
         {LogicalType::VARCHAR, LogicalType::INTEGER},
@@ -540,6 +2383,7 @@ DUCKDB_EXTENSION_API void duckgl_duckdb_cpp_init(duckdb::ExtensionLoader &loader
 
 DUCKDB_EXTENSION_API void duckgl_init(duckdb::DatabaseInstance &db) {
     duckdb::Connection con(db);
+    duckdb::RegisterSettings(db);
     con.BeginTransaction();
     
     auto &catalog = duckdb::Catalog::GetSystemCatalog(*con.context);
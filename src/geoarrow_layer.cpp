@@ -0,0 +1,144 @@
+#include "geoarrow_layer.hpp"
+#include "geometry_ops.hpp"
+
+namespace duckdb {
+
+constexpr const char* GeoArrowLayerBuilder::CONTENT_TYPE;
+
+GeoArrowLayerBuilder::GeoArrowLayerBuilder(bool float64_p, double tolerance_p) : float64(float64_p), tolerance(tolerance_p) {
+}
+
+uint32_t GeoArrowLayerBuilder::VertexCount(const Group& group) const {
+    return uint32_t((float64 ? group.coords64.size() : group.coords32.size()) / 2);
+}
+
+void GeoArrowLayerBuilder::AddVertices(Group& group, const double* xy, idx_t count) {
+    if (float64) {
+        group.coords64.insert(group.coords64.end(), xy, xy + count * 2);
+    } else {
+        for (idx_t i = 0; i < count * 2; i++) {
+            group.coords32.push_back(float(xy[i]));
+        }
+    }
+}
+
+void GeoArrowLayerBuilder::AddPoint(double x, double y, uint32_t feature_id) {
+    double xy[2] = {x, y};
+    AddVertices(points, xy, 1);
+    points.geom_offsets.push_back(VertexCount(points));
+    points.feature_ids.push_back(feature_id);
+}
+
+void GeoArrowLayerBuilder::AddGeometry(const Geometry& geom, uint32_t feature_id) {
+    if (geom.IsEmpty()) return;
+    switch (geom.type) {
+    case GeometryType::POINT:
+        AddVertices(points, geom.xy.data(), geom.VertexCount());
+        points.geom_offsets.push_back(VertexCount(points));
+        points.feature_ids.push_back(feature_id);
+        break;
+    case GeometryType::LINESTRING:
+        for (idx_t ring = 0; ring < geom.RingCount(); ring++) {
+            AddVertices(lines, &geom.xy[geom.rings[ring] * 2], geom.rings[ring + 1] - geom.rings[ring]);
+            lines.part_offsets.push_back(VertexCount(lines));
+        }
+        lines.geom_offsets.push_back(uint32_t(lines.part_offsets.size() - 1));
+        lines.feature_ids.push_back(feature_id);
+        break;
+    case GeometryType::POLYGON:
+        for (idx_t part = 0; part < geom.PartCount(); part++) {
+            for (idx_t ring = geom.parts[part]; ring < geom.parts[part + 1]; ring++) {
+                AddVertices(polygons, &geom.xy[geom.rings[ring] * 2], geom.rings[ring + 1] - geom.rings[ring]);
+                polygons.ring_offsets.push_back(VertexCount(polygons));
+            }
+            polygons.part_offsets.push_back(uint32_t(polygons.ring_offsets.size() - 1));
+        }
+        polygons.geom_offsets.push_back(uint32_t(polygons.part_offsets.size() - 1));
+        polygons.feature_ids.push_back(feature_id);
+        break;
+    default:
+        break;
+    }
+}
+
+void GeoArrowLayerBuilder::AddChunk(DataChunk& chunk) {
+    idx_t count = chunk.size();
+    UnifiedVectorFormat x_data, y_data, wkb_data;
+    chunk.data[0].ToUnifiedFormat(count, x_data);
+    chunk.data[1].ToUnifiedFormat(count, y_data);
+    chunk.data[2].ToUnifiedFormat(count, wkb_data);
+    auto xs = UnifiedVectorFormat::GetData<double>(x_data);
+    auto ys = UnifiedVectorFormat::GetData<double>(y_data);
+    auto wkbs = UnifiedVectorFormat::GetData<string_t>(wkb_data);
+
+    for (idx_t row = 0; row < count; row++) {
+        auto x_idx = x_data.sel->get_index(row);
+        auto y_idx = y_data.sel->get_index(row);
+        auto wkb_idx = wkb_data.sel->get_index(row);
+        // 点の高速パス：WKBを経由せずx/yをそのまま使う
+        if (x_data.validity.RowIsValid(x_idx) && y_data.validity.RowIsValid(y_idx)) {
+            AddPoint(xs[x_idx], ys[y_idx], next_feature++);
+            continue;
+        }
+        if (!wkb_data.validity.RowIsValid(wkb_idx)) continue;
+        auto& wkb = wkbs[wkb_idx];
+        if (!WKBReader::Read(wkb.GetData(), wkb.GetSize(), scratch) || scratch.IsEmpty()) continue;
+        GeometryOps::Simplify(scratch, tolerance);
+        if (scratch.IsEmpty()) continue;
+        AddGeometry(scratch, next_feature++);
+    }
+}
+
+namespace {
+
+struct BufferWriter {
+    string body;
+    string header;
+
+    template <class T>
+    void Add(const string& name, const vector<T>& values) {
+        while (body.size() % 8 != 0) body += '\0';
+        if (!header.empty() && header.back() != '{') header += ',';
+        header += "\"" + name + "\":[" + std::to_string(body.size()) + "," +
+                  std::to_string(values.size() * sizeof(T)) + "]";
+        body.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+};
+
+} // namespace
+
+string GeoArrowLayerBuilder::Finish() {
+    BufferWriter writer;
+    writer.header = "{\"coords\":\"" + string(float64 ? "float64" : "float32") + "\",\"features\":" +
+                    std::to_string(points.GeometryCount() + lines.GeometryCount() + polygons.GeometryCount());
+
+    auto write_group = [&](const char* name, const Group& group, idx_t depth) {
+        if (group.GeometryCount() == 0) return;
+        writer.header += ",\"" + string(name) + "\":{\"count\":" + std::to_string(group.GeometryCount());
+        if (float64) {
+            writer.Add("coords", group.coords64);
+        } else {
+            writer.Add("coords", group.coords32);
+        }
+        writer.Add("geom_offsets", group.geom_offsets);
+        if (depth >= 2) writer.Add("part_offsets", group.part_offsets);
+        if (depth >= 3) writer.Add("ring_offsets", group.ring_offsets);
+        writer.Add("feature_ids", group.feature_ids);
+        writer.header += "}";
+    };
+    write_group("points", points, 1);
+    write_group("lines", lines, 2);
+    write_group("polygons", polygons, 3);
+    writer.header += "}";
+
+    // ヘッダは空白で8バイト境界まで埋め、本文の各バッファの境界を保つ
+    string out = "DGLB";
+    uint32_t header_len = uint32_t((writer.header.size() + 7) / 8 * 8);
+    out.append(reinterpret_cast<const char*>(&header_len), sizeof(uint32_t));
+    out += writer.header;
+    out.append(header_len - writer.header.size(), ' ');
+    out += writer.body;
+    return out;
+}
+
+} // namespace duckdb
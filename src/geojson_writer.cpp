@@ -0,0 +1,294 @@
+#include "geojson_writer.hpp"
+#include "geometry_ops.hpp"
+#include "fmt/format.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace duckdb {
+
+constexpr int GeoJSONGeometryWriter::MAX_PRECISION;
+
+namespace {
+
+static const double POW10[] = {1e0, 1e1, 1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                               1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15};
+// これ未満の整数は double で正確に表せる
+static constexpr double MAX_EXACT_INTEGER = 9007199254740992.0;
+
+// digits 桁の小数 scaled / 10^digits を書き出す（末尾の0は省く）
+static void AppendFixed(bool negative, uint64_t scaled, int digits, string& out) {
+    while (digits > 0 && scaled % 10 == 0) {
+        scaled /= 10;
+        digits--;
+    }
+    char buf[24];
+    char* end = buf + sizeof(buf);
+    char* ptr = end;
+    int written = 0;
+    do {
+        if (written == digits && digits > 0) *--ptr = '.';
+        *--ptr = char('0' + scaled % 10);
+        scaled /= 10;
+        written++;
+    } while (scaled != 0 || written <= digits);
+    if (negative && (end - ptr > 1 || *ptr != '0')) out += '-';
+    out.append(ptr, end - ptr);
+}
+
+// 最短の表現（"1.25"、"1e-07"、"1.5e+20"）の小数点以下の桁数
+static int DecimalPlaces(const string& text) {
+    auto exponent = text.find('e');
+    auto mantissa = text.substr(0, exponent);
+    auto point = mantissa.find('.');
+    int places = point == string::npos ? 0 : int(mantissa.size() - point - 1);
+    if (exponent != string::npos) places -= std::atoi(text.c_str() + exponent + 1);
+    return std::max(0, places);
+}
+
+// precision が負なら元の double に戻る最短の表現（JSONChunkWriter::AppendDouble）
+// 0以上なら小数点以下 precision 桁に丸める。丸めた値が double で正確な整数に収まる間は整数で組み立てる
+// 収まらない大きな値は、最短の表現が precision 桁以内ならそれを、超えるなら duckdb_fmt の固定小数点で書いて末尾の0を省く
+static void AppendCoordinate(double value, int precision, string& out) {
+    if (!std::isfinite(value)) {
+        out += "null";
+        return;
+    }
+    // -0 も 0 と書く
+    if (value == 0) {
+        out += '0';
+        return;
+    }
+    bool negative = std::signbit(value);
+    if (precision >= 0) {
+        double scaled = std::round(std::fabs(value) * POW10[precision]);
+        if (scaled < MAX_EXACT_INTEGER) {
+            AppendFixed(negative, uint64_t(scaled), precision, out);
+            return;
+        }
+    }
+    string shortest;
+    JSONChunkWriter::AppendDouble(value, shortest);
+    if (precision < 0 || DecimalPlaces(shortest) <= precision) {
+        out += shortest;
+        return;
+    }
+    duckdb_fmt::memory_buffer buffer;
+    duckdb_fmt::format_to(buffer, "{:.{}f}", value, precision);
+    const char* data = buffer.data();
+    idx_t len = buffer.size();
+    while (data[len - 1] == '0') len--;
+    if (data[len - 1] == '.') len--;
+    out.append(data, len);
+}
+
+static void WritePosition(const double* xy, int precision, string& out) {
+    out += '[';
+    AppendCoordinate(xy[0], precision, out);
+    out += ',';
+    AppendCoordinate(xy[1], precision, out);
+    out += ']';
+}
+
+static void WriteRing(const Geometry& geom, idx_t ring, int precision, string& out) {
+    out += '[';
+    for (idx_t v = geom.rings[ring]; v < geom.rings[ring + 1]; v++) {
+        if (v > geom.rings[ring]) out += ',';
+        WritePosition(&geom.xy[v * 2], precision, out);
+    }
+    out += ']';
+}
+
+static void WritePart(const Geometry& geom, idx_t part, int precision, string& out) {
+    switch (geom.type) {
+    case GeometryType::POINT:
+        WritePosition(&geom.xy[geom.rings[geom.parts[part]] * 2], precision, out);
+        break;
+    case GeometryType::LINESTRING:
+        WriteRing(geom, geom.parts[part], precision, out);
+        break;
+    default:
+        out += '[';
+        for (idx_t ring = geom.parts[part]; ring < geom.parts[part + 1]; ring++) {
+            if (ring > geom.parts[part]) out += ',';
+            WriteRing(geom, ring, precision, out);
+        }
+        out += ']';
+        break;
+    }
+}
+
+// WKBの頂点を1つ書き出す（M座標は捨てる）。空のPOINTはNaN座標なので [] にする
+static bool WriteWKBPosition(WKBCursor& cursor, idx_t dims, bool has_z, int precision, string& out) {
+    double xyz[3];
+    if (!cursor.Has(dims * sizeof(double))) return false;
+    for (idx_t i = 0; i < (has_z ? 3 : 2); i++) {
+        cursor.Read(xyz[i]);
+    }
+    cursor.ptr += (dims - (has_z ? 3 : 2)) * sizeof(double);
+    if (std::isnan(xyz[0]) && std::isnan(xyz[1])) {
+        out += "[]";
+        return true;
+    }
+    out += '[';
+    for (idx_t i = 0; i < (has_z ? 3 : 2); i++) {
+        if (i > 0) out += ',';
+        AppendCoordinate(xyz[i], precision, out);
+    }
+    out += ']';
+    return true;
+}
+
+static bool WriteWKBRing(WKBCursor& cursor, idx_t dims, bool has_z, int precision, string& out) {
+    uint32_t count;
+    if (!cursor.Read(count)) return false;
+    if (!cursor.Has(idx_t(count) * dims * sizeof(double))) return false;
+    out += '[';
+    for (uint32_t i = 0; i < count; i++) {
+        if (i > 0) out += ',';
+        WriteWKBPosition(cursor, dims, has_z, precision, out);
+    }
+    out += ']';
+    return true;
+}
+
+// 型 type（1〜6）の coordinates の配列を書き出す。Multi* の要素はそれぞれヘッダを持つ
+static bool WriteWKBCoordinates(WKBCursor& cursor, uint32_t type, idx_t dims, bool has_z, int precision,
+                                string& out) {
+    switch (type) {
+    case 1:
+        return WriteWKBPosition(cursor, dims, has_z, precision, out);
+    case 2:
+        return WriteWKBRing(cursor, dims, has_z, precision, out);
+    default:
+        break;
+    }
+    uint32_t count;
+    if (!cursor.Read(count)) return false;
+    out += '[';
+    for (uint32_t i = 0; i < count; i++) {
+        if (i > 0) out += ',';
+        if (type == 3) {
+            if (!WriteWKBRing(cursor, dims, has_z, precision, out)) return false;
+            continue;
+        }
+        uint32_t part_type;
+        idx_t part_dims;
+        bool part_has_z;
+        if (!cursor.ReadHeader(part_type, part_dims, part_has_z) || part_type != type - 3) return false;
+        if (!WriteWKBCoordinates(cursor, part_type, part_dims, part_has_z, precision, out)) return false;
+    }
+    out += ']';
+    return true;
+}
+
+static bool WriteWKBGeometry(WKBCursor& cursor, int precision, string& out, idx_t depth) {
+    static const char* NAMES[] = {"Point", "LineString", "Polygon", "MultiPoint", "MultiLineString", "MultiPolygon",
+                                  "GeometryCollection"};
+    if (depth > WKBCursor::MAX_NESTING) return false;
+    uint32_t type;
+    idx_t dims;
+    bool has_z;
+    if (!cursor.ReadHeader(type, dims, has_z)) return false;
+    if (type == 0 || type > 7) return false;
+    out += "{\"type\":\"";
+    out += NAMES[type - 1];
+    if (type == 7) {
+        uint32_t count;
+        if (!cursor.Read(count)) return false;
+        out += "\",\"geometries\":[";
+        for (uint32_t i = 0; i < count; i++) {
+            if (i > 0) out += ',';
+            if (!WriteWKBGeometry(cursor, precision, out, depth + 1)) return false;
+        }
+        out += "]}";
+        return true;
+    }
+    out += "\",\"coordinates\":";
+    if (!WriteWKBCoordinates(cursor, type, dims, has_z, precision, out)) return false;
+    out += '}';
+    return true;
+}
+
+} // namespace
+
+void GeoJSONGeometryWriter::Write(const Geometry& geom, string& out, int precision) {
+    static const char* NAMES[] = {"Point", "LineString", "Polygon"};
+    auto name = NAMES[uint8_t(geom.type) - 1];
+    bool multi = geom.multi || geom.PartCount() > 1;
+    out += "{\"type\":\"";
+    if (multi) out += "Multi";
+    out += name;
+    out += "\",\"coordinates\":";
+    if (multi) out += '[';
+    for (idx_t part = 0; part < geom.PartCount(); part++) {
+        if (part > 0) out += ',';
+        WritePart(geom, part, precision, out);
+    }
+    if (multi) out += ']';
+    out += '}';
+}
+
+bool GeoJSONGeometryWriter::WriteWKB(const char* data, idx_t size, string& out, int precision) {
+    WKBCursor cursor;
+    cursor.ptr = reinterpret_cast<const uint8_t*>(data);
+    cursor.end = cursor.ptr + size;
+    return WriteWKBGeometry(cursor, precision, out, 0);
+}
+
+WKBGeoJSONSerializer::WKBGeoJSONSerializer(const vector<string>& names, const vector<LogicalType>& types,
+                                           double tolerance_p, int precision_p)
+    : names(names), types(types), writer(names, types), tolerance(tolerance_p), precision(precision_p) {
+}
+
+void WKBGeoJSONSerializer::Begin(string& out) {
+    out += "{\"type\":\"FeatureCollection\",\"features\":[";
+}
+
+bool WKBGeoJSONSerializer::WriteGeometry(const string_t& wkb, string& out) {
+    if (tolerance <= 0) {
+        return GeoJSONGeometryWriter::WriteWKB(wkb.GetData(), wkb.GetSize(), out, precision);
+    }
+    if (!WKBReader::Read(wkb.GetData(), wkb.GetSize(), geom)) return false;
+    GeometryOps::Simplify(geom, tolerance);
+    if (geom.IsEmpty()) return false;
+    GeoJSONGeometryWriter::Write(geom, out, precision);
+    return true;
+}
+
+void WKBGeoJSONSerializer::Write(DataChunk& chunk, string& out) {
+    UnifiedVectorFormat wkb_data;
+    chunk.data[0].ToUnifiedFormat(chunk.size(), wkb_data);
+    auto wkbs = UnifiedVectorFormat::GetData<string_t>(wkb_data);
+    // ジオメトリは文字列の列を作らずに、Featureを組み立てている out に直接書く
+    writer.WriteFeatures(chunk, out, [&](idx_t row, string& geometry_out) {
+        auto idx = wkb_data.sel->get_index(row);
+        if (!wkb_data.validity.RowIsValid(idx)) return false;
+        return WriteGeometry(wkbs[idx], geometry_out);
+    });
+}
+
+unique_ptr<ResultSerializer> WKBGeoJSONSerializer::Clone() const {
+    return make_uniq<WKBGeoJSONSerializer>(names, types, tolerance, precision);
+}
+
+void WKBGeoJSONSerializer::WritePiece(DataChunk& chunk, string& piece) {
+    writer.ResetSeparator();
+    Write(chunk, piece);
+}
+
+void WKBGeoJSONSerializer::AppendPiece(const string& piece, string& out) {
+    writer.AppendRows(piece, out);
+}
+
+void WKBGeoJSONSerializer::End(string& out) {
+    out += "]}";
+}
+
+bool WKBGeoJSONSerializer::EndWithError(const string& message, string& out) {
+    out += "],\"error\":\"" + JSONChunkWriter::Escape(message) + "\",\"truncated\":true}";
+    return true;
+}
+
+} // namespace duckdb
@@ -0,0 +1,99 @@
+#include "geometry.hpp"
+
+#include <cmath>
+
+namespace duckdb {
+
+namespace {
+
+static bool ReadRing(WKBCursor& cursor, idx_t dims, Geometry& out, bool keep) {
+    uint32_t count;
+    if (!cursor.Read(count)) return false;
+    if (!cursor.Has(idx_t(count) * dims * sizeof(double))) return false;
+    if (!keep) {
+        cursor.ptr += idx_t(count) * dims * sizeof(double);
+        return true;
+    }
+    out.xy.reserve(out.xy.size() + idx_t(count) * 2);
+    for (uint32_t i = 0; i < count; i++) {
+        double x, y;
+        cursor.ReadVertex(dims, x, y);
+        out.AddVertex(x, y);
+    }
+    out.EndRing();
+    return true;
+}
+
+static bool ReadGeometry(WKBCursor& cursor, Geometry& out, idx_t depth) {
+    if (depth > WKBCursor::MAX_NESTING) return false;
+    uint32_t type;
+    idx_t dims;
+    bool has_z;
+    if (!cursor.ReadHeader(type, dims, has_z)) return false;
+
+    if (type >= 4) {
+        uint32_t count;
+        if (!cursor.Read(count)) return false;
+        out.multi = true;
+        for (uint32_t i = 0; i < count; i++) {
+            if (!ReadGeometry(cursor, out, depth + 1)) return false;
+        }
+        return type <= 7;
+    }
+    if (type == 0) return false;
+
+    auto base = GeometryType(type);
+    if (out.type == GeometryType::UNKNOWN) {
+        out.type = base;
+    }
+    bool keep = out.type == base;
+
+    switch (base) {
+    case GeometryType::POINT: {
+        double x, y;
+        if (!cursor.ReadVertex(dims, x, y)) return false;
+        // 空のPOINTはNaN座標で表現される
+        if (keep && !std::isnan(x) && !std::isnan(y)) {
+            out.AddVertex(x, y);
+            out.EndRing();
+            out.EndPart();
+        }
+        return true;
+    }
+    case GeometryType::LINESTRING: {
+        auto rings_before = out.RingCount();
+        if (!ReadRing(cursor, dims, out, keep)) return false;
+        if (keep && out.rings.back() > out.rings[rings_before]) {
+            out.EndPart();
+        } else if (keep) {
+            out.rings.pop_back();
+        }
+        return true;
+    }
+    case GeometryType::POLYGON: {
+        uint32_t ring_count;
+        if (!cursor.Read(ring_count)) return false;
+        for (uint32_t i = 0; i < ring_count; i++) {
+            if (!ReadRing(cursor, dims, out, keep)) return false;
+        }
+        if (keep && ring_count > 0) {
+            out.EndPart();
+        }
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+} // namespace
+
+bool WKBReader::Read(const char* data, idx_t size, Geometry& out) {
+    out.Clear();
+    WKBCursor cursor;
+    cursor.ptr = reinterpret_cast<const uint8_t*>(data);
+    cursor.end = cursor.ptr + size;
+    return ReadGeometry(cursor, out, 0);
+}
+
+} // namespace duckdb
@@ -0,0 +1,262 @@
+#include "geometry_ops.hpp"
+
+#include <cmath>
+
+namespace duckdb {
+
+namespace {
+
+struct ClipRect {
+    double min_x, min_y, max_x, max_y;
+
+    bool Contains(double x, double y) const {
+        return x >= min_x && x <= max_x && y >= min_y && y <= max_y;
+    }
+};
+
+// Liang–Barsky：線分 (x0,y0)-(x1,y1) のうち矩形内に残る区間 [t0, t1] を求める
+static bool ClipSegment(const ClipRect& rect, double x0, double y0, double x1, double y1, double& t0, double& t1) {
+    double dx = x1 - x0;
+    double dy = y1 - y0;
+    double p[4] = {-dx, dx, -dy, dy};
+    double q[4] = {x0 - rect.min_x, rect.max_x - x0, y0 - rect.min_y, rect.max_y - y0};
+    t0 = 0;
+    t1 = 1;
+    for (idx_t i = 0; i < 4; i++) {
+        if (p[i] == 0) {
+            if (q[i] < 0) return false;
+            continue;
+        }
+        double r = q[i] / p[i];
+        if (p[i] < 0) {
+            if (r > t1) return false;
+            if (r > t0) t0 = r;
+        } else {
+            if (r < t0) return false;
+            if (r < t1) t1 = r;
+        }
+    }
+    return true;
+}
+
+static void ClipLine(const ClipRect& rect, const double* xy, idx_t count, Geometry& out) {
+    bool open = false;
+    auto finish = [&]() {
+        out.EndRing();
+        out.EndPart();
+        open = false;
+    };
+    for (idx_t i = 0; i + 1 < count; i++) {
+        double x0 = xy[i * 2], y0 = xy[i * 2 + 1];
+        double x1 = xy[i * 2 + 2], y1 = xy[i * 2 + 3];
+        double t0, t1;
+        if (!ClipSegment(rect, x0, y0, x1, y1, t0, t1)) {
+            if (open) finish();
+            continue;
+        }
+        // 矩形の外から入ってきた線分は新しいパーツとして始める
+        if (!open || t0 > 0) {
+            if (open) finish();
+            out.AddVertex(x0 + t0 * (x1 - x0), y0 + t0 * (y1 - y0));
+            open = true;
+        }
+        out.AddVertex(x0 + t1 * (x1 - x0), y0 + t1 * (y1 - y0));
+        if (t1 < 1) finish();
+    }
+    if (open) finish();
+}
+
+// Sutherland–Hodgman：矩形の4辺で順に切り落とす。結果は閉じたリング（先頭と末尾が同じ点）
+static void ClipRing(const ClipRect& rect, const double* xy, idx_t count, vector<double>& result,
+                     vector<double>& scratch) {
+    result.assign(xy, xy + count * 2);
+    // 閉じるための末尾の重複点は外しておく
+    if (count > 1 && xy[0] == xy[count * 2 - 2] && xy[1] == xy[count * 2 - 1]) {
+        result.resize(result.size() - 2);
+    }
+    for (idx_t edge = 0; edge < 4 && !result.empty(); edge++) {
+        auto inside = [&](double x, double y) {
+            switch (edge) {
+            case 0: return x >= rect.min_x;
+            case 1: return x <= rect.max_x;
+            case 2: return y >= rect.min_y;
+            default: return y <= rect.max_y;
+            }
+        };
+        auto intersect = [&](double ax, double ay, double bx, double by) {
+            double t;
+            switch (edge) {
+            case 0: t = (rect.min_x - ax) / (bx - ax); break;
+            case 1: t = (rect.max_x - ax) / (bx - ax); break;
+            case 2: t = (rect.min_y - ay) / (by - ay); break;
+            default: t = (rect.max_y - ay) / (by - ay); break;
+            }
+            scratch.push_back(ax + t * (bx - ax));
+            scratch.push_back(ay + t * (by - ay));
+        };
+        scratch.clear();
+        idx_t n = result.size() / 2;
+        for (idx_t i = 0; i < n; i++) {
+            idx_t prev = (i + n - 1) % n;
+            double px = result[prev * 2], py = result[prev * 2 + 1];
+            double cx = result[i * 2], cy = result[i * 2 + 1];
+            bool cur_in = inside(cx, cy);
+            bool prev_in = inside(px, py);
+            if (cur_in) {
+                if (!prev_in) intersect(px, py, cx, cy);
+                scratch.push_back(cx);
+                scratch.push_back(cy);
+            } else if (prev_in) {
+                intersect(px, py, cx, cy);
+            }
+        }
+        result.swap(scratch);
+    }
+    if (!result.empty()) {
+        result.push_back(result[0]);
+        result.push_back(result[1]);
+    }
+}
+
+static double SquaredSegmentDistance(const double* p, const double* a, const double* b) {
+    double x = a[0], y = a[1];
+    double dx = b[0] - x, dy = b[1] - y;
+    if (dx != 0 || dy != 0) {
+        double t = ((p[0] - x) * dx + (p[1] - y) * dy) / (dx * dx + dy * dy);
+        if (t > 1) {
+            x = b[0];
+            y = b[1];
+        } else if (t > 0) {
+            x += dx * t;
+            y += dy * t;
+        }
+    }
+    dx = p[0] - x;
+    dy = p[1] - y;
+    return dx * dx + dy * dy;
+}
+
+// 再帰の代わりに区間のスタックで処理する（巨大なリングでもスタックを使い切らない）
+static void DouglasPeucker(const double* xy, idx_t count, double sq_tolerance, vector<uint8_t>& keep,
+                           vector<std::pair<idx_t, idx_t>>& stack) {
+    keep.assign(count, 0);
+    keep[0] = 1;
+    keep[count - 1] = 1;
+    stack.clear();
+    stack.emplace_back(0, count - 1);
+    while (!stack.empty()) {
+        auto range = stack.back();
+        stack.pop_back();
+        double max_sq = 0;
+        idx_t index = 0;
+        for (idx_t i = range.first + 1; i < range.second; i++) {
+            double sq = SquaredSegmentDistance(&xy[i * 2], &xy[range.first * 2], &xy[range.second * 2]);
+            if (sq > max_sq) {
+                max_sq = sq;
+                index = i;
+            }
+        }
+        if (max_sq > sq_tolerance) {
+            keep[index] = 1;
+            stack.emplace_back(range.first, index);
+            stack.emplace_back(index, range.second);
+        }
+    }
+}
+
+} // namespace
+
+void GeometryOps::Clip(const Geometry& in, double min_x, double min_y, double max_x, double max_y, Geometry& out) {
+    out.Clear();
+    out.type = in.type;
+    out.multi = in.multi;
+    ClipRect rect {min_x, min_y, max_x, max_y};
+
+    switch (in.type) {
+    case GeometryType::POINT:
+        for (idx_t i = 0; i < in.VertexCount(); i++) {
+            if (rect.Contains(in.xy[i * 2], in.xy[i * 2 + 1])) {
+                out.AddVertex(in.xy[i * 2], in.xy[i * 2 + 1]);
+                out.EndRing();
+                out.EndPart();
+            }
+        }
+        break;
+    case GeometryType::LINESTRING:
+        for (idx_t ring = 0; ring < in.RingCount(); ring++) {
+            ClipLine(rect, &in.xy[in.rings[ring] * 2], in.rings[ring + 1] - in.rings[ring], out);
+        }
+        break;
+    case GeometryType::POLYGON: {
+        vector<double> clipped, scratch;
+        for (idx_t part = 0; part < in.PartCount(); part++) {
+            auto rings_before = out.RingCount();
+            for (idx_t ring = in.parts[part]; ring < in.parts[part + 1]; ring++) {
+                ClipRing(rect, &in.xy[in.rings[ring] * 2], in.rings[ring + 1] - in.rings[ring], clipped, scratch);
+                if (clipped.size() < 8) {
+                    // 外周が消えたらパーツごと捨てる
+                    if (ring == in.parts[part]) break;
+                    continue;
+                }
+                out.xy.insert(out.xy.end(), clipped.begin(), clipped.end());
+                out.EndRing();
+            }
+            if (out.RingCount() > rings_before) out.EndPart();
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void GeometryOps::Simplify(Geometry& geom, double tolerance) {
+    if (tolerance <= 0 || geom.type == GeometryType::POINT || geom.IsEmpty()) return;
+    idx_t min_vertices = geom.type == GeometryType::POLYGON ? 4 : 2;
+    double sq_tolerance = tolerance * tolerance;
+
+    Geometry out;
+    out.Clear();
+    out.type = geom.type;
+    out.multi = geom.multi;
+    out.xy.reserve(geom.xy.size());
+    vector<uint8_t> keep;
+    vector<std::pair<idx_t, idx_t>> stack;
+
+    for (idx_t part = 0; part < geom.PartCount(); part++) {
+        auto rings_before = out.RingCount();
+        for (idx_t ring = geom.parts[part]; ring < geom.parts[part + 1]; ring++) {
+            auto start = geom.rings[ring];
+            auto count = geom.rings[ring + 1] - start;
+            if (count < min_vertices) {
+                if (ring == geom.parts[part]) break;
+                continue;
+            }
+            auto xy = &geom.xy[start * 2];
+            DouglasPeucker(xy, count, sq_tolerance, keep, stack);
+            idx_t kept = 0;
+            for (idx_t i = 0; i < count; i++) kept += keep[i];
+            if (kept < min_vertices) {
+                if (ring == geom.parts[part]) break;
+                continue;
+            }
+            for (idx_t i = 0; i < count; i++) {
+                if (keep[i]) out.AddVertex(xy[i * 2], xy[i * 2 + 1]);
+            }
+            out.EndRing();
+        }
+        if (out.RingCount() > rings_before) out.EndPart();
+    }
+    geom = std::move(out);
+}
+
+double GeometryOps::SignedRingArea(const double* xy, idx_t count) {
+    if (count < 3) return 0;
+    double sum = 0;
+    for (idx_t i = 0, j = count - 1; i < count; j = i++) {
+        sum += xy[j * 2] * xy[i * 2 + 1] - xy[i * 2] * xy[j * 2 + 1];
+    }
+    return sum / 2;
+}
+
+} // namespace duckdb
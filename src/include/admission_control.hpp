@@ -0,0 +1,76 @@
+#pragma once
+
+#include "duckdb.hpp"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+namespace duckdb {
+
+// DuckDBでクエリを実行するリクエストの種類ごとの入場制御
+// 地図のタイルやレイヤー（INTERACTIVE）と任意のSQL（BATCH）で同時実行数・待ち行列の長さ・
+// 1リクエストが使うスレッド数をそれぞれ制限し、重いクエリが地図の表示を塞がないようにする
+// INTERACTIVE が待っている間は BATCH を入れない
+class AdmissionController {
+public:
+    enum class Class { INTERACTIVE, BATCH };
+    static constexpr idx_t CLASS_COUNT = 2;
+
+    struct Limits {
+        // 同時に実行できる数
+        idx_t concurrency;
+        // 空きを待てる数。これを超えたリクエストは待たせずに断る
+        idx_t queue_depth;
+        // 1リクエストが並列処理に使うスレッド数
+        idx_t threads;
+    };
+
+    AdmissionController(Limits interactive, Limits batch);
+
+    // コア数とHTTPのワーカー数から決める既定の制限
+    // BATCH の実行中と待機中を合わせてもワーカーの半分までにし、残りは必ず INTERACTIVE に使えるようにする
+    static Limits DefaultLimits(Class cls, idx_t http_workers);
+
+    // 入場券。破棄されると枠を空ける
+    class Ticket {
+    public:
+        Ticket(AdmissionController& controller, Class cls);
+        ~Ticket();
+
+        idx_t Threads() const;
+
+    private:
+        AdmissionController& controller;
+        Class cls;
+    };
+
+    // 枠が空くまで待って入場券を返す
+    // 待ち行列が一杯なら（always_queue でなければ）待たずに、gave_up() が true になったら待つのをやめて nullptr を返す
+    unique_ptr<Ticket> Admit(Class cls, const std::function<bool()>& gave_up, bool always_queue = false);
+
+    // {"interactive":{"concurrency":..,"queue_depth":..,"threads":..,"running":..,"queued":..,"admitted":..,
+    //   "rejected":..,"wait_ms":..,"max_wait_ms":..},"batch":{..}}
+    string StatsJSON();
+
+private:
+    struct ClassState {
+        Limits limits;
+        idx_t running = 0;
+        idx_t queued = 0;
+        uint64_t admitted = 0;
+        uint64_t rejected = 0;
+        uint64_t wait_micros = 0;
+        uint64_t max_wait_micros = 0;
+    };
+
+    // ロックを取ってから呼ぶ
+    bool CanRun(Class cls) const;
+    void Release(Class cls);
+
+    std::mutex lock;
+    std::condition_variable released;
+    ClassState classes[CLASS_COUNT];
+};
+
+} // namespace duckdb
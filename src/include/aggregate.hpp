@@ -0,0 +1,36 @@
+#pragma once
+
+#include "duckdb.hpp"
+
+namespace duckdb {
+
+class QueryResult;
+
+// /api/aggregate の点のビニング
+// 点をズームzのWebメルカトル画素座標（世界幅 512 * 2^z、maplibre/deck.glと同じ）に写し、
+// size 画素のセルのIDをSQLで計算してDuckDBの並列GROUP BYで集計する
+// 六角形は尖った頂点が上下にある向きで、半径（中心から頂点まで）が size。
+// 中心は (col * w / 2, row * h / 2)（w = √3 * size, h = 3 * size）で、col と row の偶奇は常に一致する
+// 正方形は一辺 size で、セル (col, row) は [col * size, (col + 1) * size) × [row * size, (row + 1) * size)
+struct AggregateRequest {
+    enum class CellType { HEX, SQUARE };
+    enum class Function { COUNT, SUM, AVG, MIN, MAX };
+
+    CellType cell = CellType::HEX;
+    Function function = Function::COUNT;
+    string column;
+    int zoom = 0;
+    double size = 24;
+
+    // agg は count / sum(col) / avg(col) / min(col) / max(col)
+    bool ParseCell(const string& value, string& error);
+    bool ParseAggregate(const string& value, string& error);
+
+    // filter は WHERE 句の条件（空なら全件）
+    string BuildSQL(const string& table_name, const string& geom_col, const string& filter) const;
+
+    // {"cell":"hex","zoom":z,"size":s,"agg":"count","cells":N,"col":[..],"row":[..],"count":[..],"value":[..]}
+    string ResultToJSON(QueryResult& result) const;
+};
+
+} // namespace duckdb
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "duckdb.hpp"
+#include "duckdb/common/arrow/arrow.hpp"
+#include "duckdb/common/arrow/arrow_type_extension.hpp"
+#include "duckdb/main/client_properties.hpp"
+#include "result_serializer.hpp"
+
+namespace duckdb {
+
+// Arrow C Data Interface（ArrowSchema / ArrowArray）をArrow IPCストリーム形式に書き出す
+// https://arrow.apache.org/docs/format/Columnar.html#serialization-and-interprocess-communication-ipc
+// 辞書エンコード・Union・View型には対応しない
+class ArrowIPCWriter {
+public:
+    static void WriteSchema(const ArrowSchema& schema, string& out);
+    // array は schema と同じ構造のstruct配列（列が子配列）
+    static void WriteRecordBatch(const ArrowSchema& schema, const ArrowArray& array, string& out);
+    static void WriteEndOfStream(string& out);
+};
+
+// DuckDBのArrow変換（ArrowConverter）で各DataChunkをレコードバッチにする
+// IPCで表現できない型（ENUMなど）はVARCHARにキャストして送る
+class ArrowResultSerializer : public ResultSerializer {
+public:
+    ArrowResultSerializer(ClientContext& context, const vector<string>& names, const vector<LogicalType>& types,
+                          ClientProperties options);
+    ~ArrowResultSerializer() override;
+
+    string ContentType() const override {
+        return "application/vnd.apache.arrow.stream";
+    }
+    void Begin(string& out) override;
+    void Write(DataChunk& chunk, string& out) override;
+    void End(string& out) override;
+
+    static bool IsSupportedType(const LogicalType& type);
+
+private:
+    vector<string> names;
+    vector<LogicalType> arrow_types;
+    vector<bool> needs_cast;
+    ClientProperties options;
+    unordered_map<idx_t, const shared_ptr<ArrowTypeExtensionData>> extension_types;
+    DataChunk cast_chunk;
+    ArrowSchema schema;
+};
+
+} // namespace duckdb
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "duckdb.hpp"
+#include "spatial_index.hpp"
+#include "worker_pool.hpp"
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+
+namespace duckdb {
+
+class Connection;
+
+// 点の静的なKD木（kdbushと同じ配置）
+// 点の番号を x と y の中央値で交互に二分した順に並べ、座標も同じ順に持つ。NODE_SIZE個以下の区間は分けない
+class KDTree {
+public:
+    // xy は点の (x, y) を交互に並べたもの。上の方の階層は pool で thread_count 個に分けて並べる
+    KDTree(const vector<double>& xy, WorkerPool& pool, idx_t thread_count);
+
+    // 矩形内・円内の点の番号（構築時の並び）を返す
+    void Range(const BoundingBox& box, vector<uint32_t>& out) const;
+    void Within(double x, double y, double radius, vector<uint32_t>& out) const;
+
+    // 点の番号を木の並び（空間的に近い点が隣り合う）で返す
+    const vector<uint32_t>& Order() const {
+        return ids;
+    }
+
+    idx_t MemoryUsage() const {
+        return ids.size() * sizeof(uint32_t) + coords.size() * sizeof(double);
+    }
+
+    static constexpr idx_t NODE_SIZE = 64;
+
+private:
+    // box 内の点について fn(並べ替え後の位置, x, y) を呼ぶ
+    template <class FUNC>
+    void Visit(const BoundingBox& box, FUNC&& fn) const;
+    void Sort(const vector<double>& xy, idx_t left, idx_t right, idx_t axis, WorkerPool& pool, idx_t parallel_depth);
+
+    vector<uint32_t> ids;
+    vector<double> coords;
+};
+
+// supercluster と同じ階層的な点のクラスタリング
+// 点をWebメルカトルの [0, 1] 座標に写し、ズーム MAX_ZOOM + 1 を元の点として、
+// 1つ上のズームの点から半径 RADIUS 画素（タイル幅 EXTENT 画素）以内の点をまとめて重心に置き換えることを
+// ズーム0まで繰り返す。各ズームの点はKD木で引く
+class ClusterIndex {
+public:
+    // lon_lat は点の (経度, 緯度) を交互に並べたもの
+    ClusterIndex(const vector<double>& lon_lat, vector<int64_t> row_ids, WorkerPool& pool, idx_t thread_count);
+
+    // ズーム zoom で box（経度緯度）に入るクラスタを
+    // {"zoom":z,"clusters":N,"lon":[..],"lat":[..],"count":[..],"rowid":[..]} で返す
+    // 1点だけのクラスタは元の行のrowid、それ以外は null。MAX_ZOOM より大きいズームでは元の点をそのまま返す
+    string QueryJSON(int zoom, const BoundingBox& box) const;
+
+    idx_t Size() const {
+        return levels.back().counts.size();
+    }
+    idx_t MemoryUsage() const;
+
+    static constexpr int MAX_ZOOM = 16;
+    static constexpr double RADIUS = 40;
+    static constexpr double EXTENT = 512;
+
+private:
+    struct Level {
+        vector<double> xy;
+        vector<uint32_t> counts;
+        vector<int64_t> row_ids;
+        unique_ptr<KDTree> tree;
+    };
+
+    // next（ズーム zoom + 1）の点をまとめてズーム zoom の階層を作る
+    static void Cluster(const Level& next, int zoom, Level& out);
+
+    // levels[z] がズームzの階層
+    vector<Level> levels;
+};
+
+// テーブルごとのクラスタ索引。SpatialIndexManager と同じく初回アクセス時に作り、データが変わったら作り直す
+class ClusterIndexManager {
+public:
+    explicit ClusterIndexManager(WorkerPool& pool) : pool(pool) {
+    }
+
+    shared_ptr<const ClusterIndex> Get(Connection& conn, const string& table_name, const string& geom_col,
+                                       uint64_t version, idx_t threads);
+
+    // {"tables":..,"points":..,"bytes":..,"builds":..}
+    string StatsJSON();
+
+private:
+    static shared_ptr<const ClusterIndex> Build(Connection& conn, const string& table_name, const string& geom_col,
+                                                WorkerPool& pool, idx_t threads);
+
+    struct Entry {
+        uint64_t version;
+        std::shared_future<shared_ptr<const ClusterIndex>> index;
+    };
+
+    WorkerPool& pool;
+    std::mutex lock;
+    std::unordered_map<string, Entry> entries;
+    std::atomic<uint64_t> builds {0};
+};
+
+} // namespace duckdb
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "duckdb.hpp"
+#include "geometry.hpp"
+
+#include <unordered_map>
+
+namespace duckdb {
+
+// 回線の遅い環境向けのコンパクトなレイヤー形式（/api/layer?format=compact、Geobufに近い）
+// 座標は小数点以下 precision 桁の整数に量子化し、直前の頂点との差をzigzag可変長整数で書く（差は地物をまたいで続ける）
+// 属性のキーと値は重複を除いた辞書に入れ、地物からは番号で参照する
+//
+// 全体は "DGLC" に続けて可変長整数（varint）の列：
+//   precision, キーの数, キー（バイト長 + UTF-8）..., 値の数, 値..., 地物の数, 地物...
+//   値は種類の後に中身：0 文字列（バイト長 + UTF-8）, 1 double（8バイト LE）, 2 整数（zigzag）, 3 符号なし整数, 4 false, 5 true
+//   地物は GeoJSON の型番号（1 Point .. 6 MultiPolygon）, 座標, 属性の数, (キー番号, 値番号)...
+//   座標は Point: x y / LineString: 頂点数, x y... / Polygon: リング数, リングごとに LineString と同じ
+//   Multi* は要素数の後に要素を並べる。ポリゴンのリングは閉じる頂点を省く（読む側で先頭の頂点を補う）
+class CompactLayerBuilder {
+public:
+    // 列は x DOUBLE, y DOUBLE, wkb BLOB（点は x/y、それ以外は wkb に入っている）、残りの列を属性とする
+    // tolerance > 0 なら線とポリゴンをDouglas–Peuckerで簡略化してから追加する
+    CompactLayerBuilder(const vector<string>& names, const vector<LogicalType>& types, int precision,
+                        double tolerance);
+
+    void AddChunk(DataChunk& chunk);
+    string Finish() const;
+
+    idx_t FeatureCount() const {
+        return feature_count;
+    }
+
+    // ズームzで0.1ピクセル（256ピクセルのタイル）より細かくなる小数点以下の桁数
+    static int ZoomPrecision(int zoom);
+
+    static constexpr int MAX_PRECISION = 10;
+    // zoom も precision もないとき（約1cm）
+    static constexpr int DEFAULT_PRECISION = 7;
+    static constexpr const char* CONTENT_TYPE = "application/vnd.duckgl.compact";
+
+private:
+    // 座標を features に書く。量子化できない座標があれば false（書きかけた分は呼び出し側で捨てる）
+    bool WriteGeometry(const Geometry& geom);
+    bool WritePosition(double x, double y);
+    bool WriteRing(const Geometry& geom, idx_t ring, bool polygon);
+    bool WritePart(const Geometry& geom, idx_t part);
+    void WriteProperties(idx_t row);
+
+    // 属性列 col の行 row の値番号。NULLや表せない値は INVALID_VALUE
+    uint32_t InternValue(idx_t col, idx_t row);
+    uint32_t Intern(const string& encoded);
+
+    vector<string> keys;
+    vector<LogicalType> types;
+    // 属性列ごとのチャンクの値（値の種類に直接対応しない列はVARCHARへキャストしたもの）
+    vector<UnifiedVectorFormat> formats;
+    vector<unique_ptr<Vector>> casts;
+    vector<string> values;
+    std::unordered_map<string, uint32_t> value_index;
+    string features;
+    idx_t feature_count = 0;
+    int precision;
+    double scale;
+    double tolerance;
+    // 直前に書いた頂点（量子化済み）
+    int64_t last_x = 0;
+    int64_t last_y = 0;
+    vector<uint32_t> tags;
+    Geometry geom;
+
+    static constexpr uint32_t INVALID_VALUE = 0xFFFFFFFF;
+};
+
+} // namespace duckdb
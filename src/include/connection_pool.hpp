@@ -0,0 +1,80 @@
+#pragma once
+
+#include "duckdb.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+namespace duckdb {
+
+class Connection;
+class ConnectionPool;
+
+// プールから借りた接続。破棄されるとプールに返す（ムーブのみ）
+class PooledConnection {
+public:
+    PooledConnection() = default;
+    PooledConnection(ConnectionPool* pool, unique_ptr<Connection> conn);
+    PooledConnection(PooledConnection&& other) noexcept;
+    PooledConnection& operator=(PooledConnection&& other) noexcept;
+    ~PooledConnection();
+
+    Connection& operator*() const {
+        return *conn;
+    }
+    Connection* operator->() const {
+        return conn.get();
+    }
+
+    // 利用者のSQLを実行した接続は設定や一時テーブルが残りうるので、返さずに破棄する
+    void Discard() {
+        reusable = false;
+    }
+
+private:
+    void Release();
+
+    ConnectionPool* pool = nullptr;
+    unique_ptr<Connection> conn;
+    bool reusable = true;
+};
+
+// HTTPハンドラ用の再利用する接続の上限付きプール
+// 接続は必要になったときに size 個まで作り、全部使用中なら返却を待つ
+// 返却時に開いたままのトランザクションはロールバックし、失敗した接続は破棄する
+class ConnectionPool {
+public:
+    ConnectionPool(DatabaseInstance& db, idx_t size);
+
+    PooledConnection Acquire();
+
+    idx_t Size() const {
+        return size;
+    }
+
+    // {"size":..,"open":..,"idle":..,"acquired":..,"waited":..,"wait_ms":..,"max_wait_ms":..,"created":..,"discarded":..}
+    string StatsJSON();
+
+private:
+    friend class PooledConnection;
+    void Release(unique_ptr<Connection> conn, bool reusable);
+
+    DatabaseInstance& db;
+    idx_t size;
+
+    std::mutex lock;
+    std::condition_variable available;
+    vector<unique_ptr<Connection>> idle;
+    // 作成済みの接続の数（使用中 + idle）
+    idx_t open = 0;
+
+    std::atomic<uint64_t> acquired {0};
+    std::atomic<uint64_t> waited {0};
+    std::atomic<uint64_t> wait_micros {0};
+    std::atomic<uint64_t> max_wait_micros {0};
+    std::atomic<uint64_t> created {0};
+    std::atomic<uint64_t> discarded {0};
+};
+
+} // namespace duckdb
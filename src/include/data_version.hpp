@@ -0,0 +1,26 @@
+#pragma once
+
+#include "duckdb.hpp"
+
+namespace duckdb {
+
+// 書き込みを伴うコミット（DML・DDL）のたびに増えるデータバージョン
+// キャッシュはこの値をエントリに記録し、値が変わったら古いエントリとして扱う
+// 書き込み先はテーブル単位で記録し、別のテーブルへの書き込みでは値が変わらない
+// 書き込み先が分からないコミット（ALTER や Appender など）は全テーブルのバージョンを進める
+class DataVersion {
+public:
+    // どのテーブルへの書き込みでも増える値（ビューなど依存先が分からないもの用）
+    static uint64_t Current();
+    // table_name（スキーマなし、大文字小文字は区別しない）への書き込みか、書き込み先の分からないコミットで増える値
+    static uint64_t Current(const string& table_name);
+    // DDLか書き込み先の分からないコミットで増える値（カタログのキャッシュ用）
+    static uint64_t Catalog();
+
+    // 以後に開かれる接続のコミットを監視する
+    static void Register(DatabaseInstance& db);
+    // 既に開いている接続（duckgl_startを呼んだ接続など）のコミットを監視する
+    static void Track(ClientContext& context);
+};
+
+} // namespace duckdb
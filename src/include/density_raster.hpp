@@ -0,0 +1,65 @@
+#pragma once
+
+#include "duckdb.hpp"
+#include "geometry.hpp"
+#include "vector_tile.hpp"
+#include "worker_pool.hpp"
+
+namespace duckdb {
+
+class QueryResult;
+
+// 密度タイルの色付け（datashaderのshade）
+// 画素の値を how で [0, 1] に写し、cmap の色と透明度（最低でも MIN_ALPHA）を付ける。値が0の画素は透明
+struct TransferFunction {
+    enum class How { LINEAR, LOG, CBRT, EQ_HIST };
+    enum class ColorMap { FIRE, VIRIDIS, BLUES };
+
+    How how = How::EQ_HIST;
+    ColorMap cmap = ColorMap::FIRE;
+    // 値域の上限。0ならタイル内の最大値（eq_hist では使わない）
+    double span = 0;
+
+    // how は linear / log / cbrt / eq_hist、cmap は fire / viridis / blues
+    bool ParseHow(const string& value, string& error);
+    bool ParseColorMap(const string& value, string& error);
+
+    static constexpr uint8_t MIN_ALPHA = 40;
+};
+
+// 1タイル分の浮動小数の集計格子（一辺 projection.Extent() 画素、上の行から）
+// 点はその画素に、線とポリゴンの境界は通る画素それぞれに重み（既定は1）を足す
+class DensityRaster {
+public:
+    explicit DensityRaster(const TileProjection& projection);
+
+    // 列は x DOUBLE, y DOUBLE, wkb BLOB[, weight DOUBLE]（点は x/y、それ以外は wkb に入っている）
+    // weight がNULLの行は数えない
+    static string BuildSQL(const string& table_name, const string& geom_col, const string& weight,
+                           const string& filter);
+
+    // 結果のチャンクを pool の thread_count 個のタスクで取り合い、タスクごとの格子に足してから合計する
+    void Accumulate(QueryResult& result, WorkerPool& pool, idx_t thread_count);
+
+    // 画素ごとのfloat32（リトルエンディアン）をそのまま並べたもの
+    string ToFloat32() const;
+    string ToPNG(const TransferFunction& transfer) const;
+
+    uint32_t Size() const {
+        return size;
+    }
+
+    static constexpr const char* FLOAT32_CONTENT_TYPE = "application/octet-stream";
+
+private:
+    void AddChunk(DataChunk& chunk, vector<float>& target, Geometry& scratch) const;
+    // タイル内座標の線分を [0, size] に切り詰めて通る画素に足す。last は直前に足した画素（頂点の二重計上を避ける）
+    void AddSegment(double x0, double y0, double x1, double y1, float weight, vector<float>& target,
+                    int64_t& last) const;
+
+    TileProjection projection;
+    uint32_t size;
+    vector<float> grid;
+};
+
+} // namespace duckdb
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "duckdb.hpp"
+
+#include <cstdio>
+
+namespace duckdb {
+
+// Protocol Buffers の可変長整数
+inline void WriteVarint(uint64_t value, string& out) {
+    while (value >= 0x80) {
+        out += char((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += char(value);
+}
+
+// 符号付き整数を小さい絶対値ほど短い可変長整数になるように変換する
+inline uint64_t ZigZag(int64_t value) {
+    return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+}
+
+// タイルの属性値に型のまま書ける列型（それ以外は VARCHAR にキャストする）
+inline bool IsNativeValueType(LogicalTypeId id) {
+    switch (id) {
+    case LogicalTypeId::BOOLEAN:
+    case LogicalTypeId::TINYINT:
+    case LogicalTypeId::SMALLINT:
+    case LogicalTypeId::INTEGER:
+    case LogicalTypeId::BIGINT:
+    case LogicalTypeId::UTINYINT:
+    case LogicalTypeId::USMALLINT:
+    case LogicalTypeId::UINTEGER:
+    case LogicalTypeId::UBIGINT:
+    case LogicalTypeId::FLOAT:
+    case LogicalTypeId::DOUBLE:
+    case LogicalTypeId::VARCHAR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// SQLの識別子として二重引用符で囲む
+inline string QuoteIdentifier(const string& name) {
+    string quoted = "\"";
+    for (auto c : name) {
+        if (c == '"') quoted += '"';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+// SQLリテラル用に倍精度の値を丸めずに書き出す
+inline string SQLDouble(double value) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.17g", value);
+    return buf;
+}
+
+} // namespace duckdb
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "duckdb.hpp"
+#include "geometry.hpp"
+
+namespace duckdb {
+
+// レイヤー用のバイナリ形式（/api/layer）
+// 点・線・ポリゴンをGeoArrowのレイアウト（xyインターリーブ座標 + int32オフセット）で別々に溜め、
+// 先頭に "DGLB" + ヘッダ長(uint32) + JSONヘッダ、その後に8バイト境界で各バッファを並べる
+// ヘッダの各バッファは [本文（8 + ヘッダ長）先頭からのオフセット, バイト長]
+class GeoArrowLayerBuilder {
+public:
+    explicit GeoArrowLayerBuilder(bool float64, double tolerance = 0);
+
+    // 列は x DOUBLE, y DOUBLE, wkb BLOB（点は x/y、それ以外は wkb に入っている）
+    // tolerance > 0 なら線とポリゴンをDouglas–Peuckerで簡略化してから追加する
+    void AddChunk(DataChunk& chunk);
+    void AddPoint(double x, double y, uint32_t feature_id);
+    void AddGeometry(const Geometry& geom, uint32_t feature_id);
+
+    string Finish();
+
+    static constexpr const char* CONTENT_TYPE = "application/vnd.duckgl.geoarrow";
+
+private:
+    struct Group {
+        vector<float> coords32;
+        vector<double> coords64;
+        vector<uint32_t> geom_offsets {0};
+        vector<uint32_t> part_offsets {0};
+        vector<uint32_t> ring_offsets {0};
+        vector<uint32_t> feature_ids;
+
+        idx_t GeometryCount() const {
+            return feature_ids.size();
+        }
+    };
+
+    void AddVertices(Group& group, const double* xy, idx_t count);
+    uint32_t VertexCount(const Group& group) const;
+
+    bool float64;
+    double tolerance;
+    Group points;
+    Group lines;
+    Group polygons;
+    uint32_t next_feature = 0;
+    Geometry scratch;
+};
+
+} // namespace duckdb
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "duckdb.hpp"
+#include "geometry.hpp"
+#include "json_writer.hpp"
+
+namespace duckdb {
+
+// ジオメトリを GeoJSON の geometry オブジェクトとして書き出す
+// precision が負なら座標は元の double に戻る最短の桁数、0以上なら小数点以下その桁数に丸める（末尾の0は省く）
+class GeoJSONGeometryWriter {
+public:
+    static void Write(const Geometry& geom, string& out, int precision = -1);
+
+    // WKB（ISO / EWKB）を Geometry に展開せずに書き出す。GeometryCollection はそのまま、Z座標も書く
+    // 解析できない場合は false（out に書きかけた分は残る）
+    static bool WriteWKB(const char* data, idx_t size, string& out, int precision = -1);
+
+    static constexpr int MAX_PRECISION = 15;
+};
+
+// 先頭列のWKBからGeoJSONを直接書き、残りの列と合わせてFeatureCollectionとして書き出す
+// tolerance が正なら簡略化してから書く。簡略化で消えた地物（外周が潰れたポリゴンなど）や解析できないジオメトリは出力しない
+class WKBGeoJSONSerializer : public ResultSerializer {
+public:
+    WKBGeoJSONSerializer(const vector<string>& names, const vector<LogicalType>& types, double tolerance,
+                         int precision);
+
+    string ContentType() const override {
+        return "application/json";
+    }
+    void Begin(string& out) override;
+    void Write(DataChunk& chunk, string& out) override;
+    void End(string& out) override;
+    bool EndWithError(const string& message, string& out) override;
+
+    unique_ptr<ResultSerializer> Clone() const override;
+    void WritePiece(DataChunk& chunk, string& piece) override;
+    void AppendPiece(const string& piece, string& out) override;
+
+private:
+    bool WriteGeometry(const string_t& wkb, string& out);
+
+    vector<string> names;
+    vector<LogicalType> types;
+    JSONChunkWriter writer;
+    double tolerance;
+    int precision;
+    Geometry geom;
+};
+
+} // namespace duckdb
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "duckdb.hpp"
+
+namespace duckdb {
+
+// 次元ごとの基本ジオメトリ型（Multi*は multi フラグで表す）
+enum class GeometryType : uint8_t { UNKNOWN = 0, POINT = 1, LINESTRING = 2, POLYGON = 3 };
+
+// WKBを平坦化した表現（XYのみ）
+// parts[i]..parts[i+1] がパーツi（点・線・ポリゴン）のリング、rings[j]..rings[j+1] がリングjの頂点
+// 点は頂点1つのリング、線はリング1つのパーツとして扱う
+struct Geometry {
+    GeometryType type = GeometryType::UNKNOWN;
+    bool multi = false;
+    vector<double> xy;
+    vector<uint32_t> rings;
+    vector<uint32_t> parts;
+
+    void Clear() {
+        type = GeometryType::UNKNOWN;
+        multi = false;
+        xy.clear();
+        rings.assign(1, 0);
+        parts.assign(1, 0);
+    }
+
+    idx_t VertexCount() const {
+        return xy.size() / 2;
+    }
+    idx_t RingCount() const {
+        return rings.size() - 1;
+    }
+    idx_t PartCount() const {
+        return parts.size() - 1;
+    }
+    bool IsEmpty() const {
+        return PartCount() == 0;
+    }
+
+    void AddVertex(double x, double y) {
+        xy.push_back(x);
+        xy.push_back(y);
+    }
+    void EndRing() {
+        rings.push_back(uint32_t(VertexCount()));
+    }
+    void EndPart() {
+        parts.push_back(uint32_t(RingCount()));
+    }
+};
+
+// WKBを先頭から読み進めるカーソル（バイト順はジオメトリごとのヘッダで切り替える）
+struct WKBCursor {
+    // 入れ子にできるジオメトリの深さの上限
+    static constexpr idx_t MAX_NESTING = 16;
+
+    const uint8_t* ptr;
+    const uint8_t* end;
+    bool little_endian = true;
+
+    bool Has(idx_t n) const {
+        return idx_t(end - ptr) >= n;
+    }
+
+    bool ReadByte(uint8_t& value) {
+        if (!Has(1)) return false;
+        value = *ptr++;
+        return true;
+    }
+
+    template <class T>
+    bool Read(T& value) {
+        if (!Has(sizeof(T))) return false;
+        uint8_t bytes[sizeof(T)];
+        memcpy(bytes, ptr, sizeof(T));
+        if (!little_endian) {
+            for (idx_t i = 0; i < sizeof(T) / 2; i++) {
+                std::swap(bytes[i], bytes[sizeof(T) - 1 - i]);
+            }
+        }
+        memcpy(&value, bytes, sizeof(T));
+        ptr += sizeof(T);
+        return true;
+    }
+
+    // ジオメトリのヘッダ（バイト順と型）を読む。type は次元を除いた型（1〜7）、dims は頂点ごとの座標の数
+    // EWKBのフラグとISOの次元コードの両方に対応する
+    bool ReadHeader(uint32_t& type, idx_t& dims, bool& has_z) {
+        uint8_t order;
+        if (!ReadByte(order)) return false;
+        little_endian = order == 1;
+        if (!Read(type)) return false;
+        has_z = (type & 0x80000000) != 0;
+        bool has_m = (type & 0x40000000) != 0;
+        if (type & 0x20000000) {
+            uint32_t srid;
+            if (!Read(srid)) return false;
+        }
+        type &= 0x0FFFFFFF;
+        auto iso_dims = type / 1000;
+        type %= 1000;
+        if (iso_dims == 1 || iso_dims == 3) has_z = true;
+        if (iso_dims == 2 || iso_dims == 3) has_m = true;
+        dims = 2 + (has_z ? 1 : 0) + (has_m ? 1 : 0);
+        return true;
+    }
+
+    bool ReadVertex(idx_t dims, double& x, double& y) {
+        if (!Read(x) || !Read(y)) return false;
+        if (!Has((dims - 2) * sizeof(double))) return false;
+        ptr += (dims - 2) * sizeof(double);
+        return true;
+    }
+};
+
+// WKB（ISO / EWKB）を読んで Geometry に展開する
+// GeometryCollectionは最初の非空要素と同じ次元の要素だけを残す
+class WKBReader {
+public:
+    // 解析できない場合はfalse
+    static bool Read(const char* data, idx_t size, Geometry& out);
+};
+
+} // namespace duckdb
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "geometry.hpp"
+
+namespace duckdb {
+
+// Geometry に対する平面上の処理（座標系は呼び出し側で揃えておく）
+struct GeometryOps {
+    // 矩形でクリップする。ポリゴンはSutherland–Hodgman、線はLiang–Barskyで分割する
+    static void Clip(const Geometry& in, double min_x, double min_y, double max_x, double max_y, Geometry& out);
+
+    // Douglas–Peuckerで各リングを簡略化する。頂点が足りなくなったリング・パーツは取り除く
+    static void Simplify(Geometry& geom, double tolerance);
+
+    // 靴紐公式による符号付き面積 Σ(x_i * y_{i+1} - x_{i+1} * y_i) / 2
+    static double SignedRingArea(const double* xy, idx_t count);
+};
+
+} // namespace duckdb
@@ -1,7 +1,7 @@
 #ifndef HTTPLIB_WRAPPER_H
 #define HTTPLIB_WRAPPER_H
 
-// OpenSSL/zlib/brotliを無効化
+// OpenSSL/zlib/brotliを無効化（レスポンスの圧縮は response_compression.hpp で行う）
 // httplib.hはマクロが「定義されているか」で判定するため、
 // 事前にundefして定義されていない状態にする
 #ifdef CPPHTTPLIB_OPENSSL_SUPPORT
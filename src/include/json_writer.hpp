@@ -0,0 +1,99 @@
+#pragma once
+
+#include "duckdb.hpp"
+#include "result_serializer.hpp"
+
+#include <functional>
+
+namespace duckdb {
+
+// DataChunkを列単位でJSONに書き出すシリアライザ
+// 各列をUnifiedVectorFormatで一度だけ走査し、型ごとの書き込み関数で列バッファを作ってから行に組み立てる
+class JSONChunkWriter {
+public:
+    JSONChunkWriter(const vector<string>& names, const vector<LogicalType>& types);
+
+    // chunkの各行を {"col":value,...} として out に追記する（配列の区切りも管理する）
+    void WriteRows(DataChunk& chunk, string& out);
+
+    // 先頭列をGeoJSONジオメトリ文字列として扱い、残りをpropertiesとしてFeatureを追記する
+    // ジオメトリがNULLの行は出力しない
+    void WriteFeatures(DataChunk& chunk, string& out);
+
+    // 行rowのジオメトリを out に直接書き出す関数。出力しない行は false を返す（書きかけた分は捨てる）
+    using GeometryWriter = std::function<bool(idx_t row, string& out)>;
+    // 先頭列のジオメトリを geometry で書き、残りをpropertiesとしてFeatureを追記する
+    void WriteFeatures(DataChunk& chunk, string& out, const GeometryWriter& geometry);
+
+    // first_col 以降の列を行ごとに {"col":value,...} として out に追記し、各行の終わりの位置を ends に追加する（区切りは付けない）
+    void WriteObjects(DataChunk& chunk, idx_t first_col, string& out, vector<idx_t>& ends);
+
+    bool IsEmpty() const {
+        return first;
+    }
+
+    // 次に書く行を先頭として扱う（区切りを付けない）
+    void ResetSeparator() {
+        first = true;
+    }
+    // 別の JSONChunkWriter が ResetSeparator してから書いた行の並びを、区切りを補って追記する
+    void AppendRows(const string& rows, string& out);
+
+    static void WriteEscaped(const char* data, idx_t len, string& out);
+    static string Escape(const string& str);
+    // 元の double に読み戻せる最短の表現（NaN/Inf は JSON に存在しないので null）
+    static void AppendDouble(double value, string& out);
+
+    // 1列分のシリアライズ結果。行rowの値は data[offsets[row], offsets[row + 1])
+    struct ColumnBuffer {
+        string data;
+        vector<uint32_t> offsets;
+    };
+
+private:
+    void SerializeColumn(Vector& vec, const LogicalType& type, idx_t count, ColumnBuffer& buffer);
+    void SerializeColumns(DataChunk& chunk, idx_t first_col);
+
+    vector<string> keys;
+    vector<LogicalType> types;
+    vector<ColumnBuffer> columns;
+    bool first = true;
+};
+
+// JSONResultSerializer の文書の形
+enum class JSONLayout : uint8_t {
+    // 行の配列 [{..},..]
+    ARRAY,
+    // {"data":[{..},..]}。途中で失敗したら "error" と "truncated" のメンバを足して閉じる
+    ENVELOPE,
+    // GeoJSON FeatureCollection
+    FEATURES
+};
+
+// JSON配列（/api/query）またはGeoJSON FeatureCollection（/api/geojson）として結果を書き出す
+class JSONResultSerializer : public ResultSerializer {
+public:
+    JSONResultSerializer(const vector<string>& names, const vector<LogicalType>& types, JSONLayout layout);
+
+    string ContentType() const override {
+        return "application/json";
+    }
+    void Begin(string& out) override;
+    void Write(DataChunk& chunk, string& out) override;
+    void End(string& out) override;
+    // ENVELOPE と FeatureCollection は "error" と "truncated" のメンバを足して閉じる
+    // 配列は行と見分けられる置き場がないので閉じない（完全な文書としては読めなくなる）
+    bool EndWithError(const string& message, string& out) override;
+
+    unique_ptr<ResultSerializer> Clone() const override;
+    void WritePiece(DataChunk& chunk, string& piece) override;
+    void AppendPiece(const string& piece, string& out) override;
+
+private:
+    vector<string> names;
+    vector<LogicalType> types;
+    JSONChunkWriter writer;
+    JSONLayout layout;
+};
+
+} // namespace duckdb
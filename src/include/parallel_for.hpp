@@ -0,0 +1,58 @@
+#pragma once
+
+#include "duckdb.hpp"
+#include "worker_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+
+namespace duckdb {
+
+// これより小さい仕事はスレッドに分けない
+static constexpr idx_t MIN_ITEMS_PER_THREAD = 16384;
+
+// [0, count) を thread_count 個程度の区間に分け、fn(begin, end) を WorkerPool のタスクと呼んだスレッドで実行して待つ
+// 区間は空いているスレッドが順に取るので、プールが塞がっていても呼んだスレッドだけで最後まで進む（入れ子にしてもよい）
+// fn が投げた例外は全ての区間が終わってから投げ直す
+template <class FUNC>
+static void ParallelFor(WorkerPool& pool, idx_t count, idx_t thread_count, FUNC&& fn,
+                        idx_t min_per_thread = MIN_ITEMS_PER_THREAD) {
+    thread_count = std::min(thread_count, std::max<idx_t>(1, count / min_per_thread));
+    if (thread_count <= 1) {
+        fn(0, count);
+        return;
+    }
+    idx_t per_thread = (count + thread_count - 1) / thread_count;
+    idx_t ranges = (count + per_thread - 1) / per_thread;
+    std::atomic<idx_t> next {0};
+    std::mutex error_lock;
+    std::exception_ptr error;
+    auto run = [&]() {
+        while (true) {
+            idx_t range = next++;
+            if (range >= ranges) return;
+            idx_t begin = range * per_thread;
+            try {
+                fn(begin, std::min(begin + per_thread, count));
+            } catch (...) {
+                std::lock_guard<std::mutex> guard(error_lock);
+                if (!error) error = std::current_exception();
+            }
+        }
+    };
+    auto gate = make_shared_ptr<TaskGate>();
+    for (idx_t thread = 1; thread < ranges; thread++) {
+        pool.Submit([gate, &run]() {
+            if (!gate->Enter()) return;
+            run();
+            gate->Leave();
+        });
+    }
+    run();
+    gate->Close();
+    if (error) std::rethrow_exception(error);
+}
+
+} // namespace duckdb
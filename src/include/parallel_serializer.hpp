@@ -0,0 +1,35 @@
+#pragma once
+
+#include "duckdb.hpp"
+#include "result_serializer.hpp"
+#include "worker_pool.hpp"
+
+namespace duckdb {
+
+// 結果のチャンクを複数のスレッドでシリアライズし、取り出した順に連結する
+// QueryResult::Fetch はスレッドセーフではないので取り出しだけ順番に行い、取り出した順の番号を付ける
+// Write を呼んだスレッドと WorkerPool のタスクが Clone したシリアライザで断片を書き、
+// 番号順に揃ったものから元のシリアライザで out に連結する
+// 呼んだスレッドも同じように取り出して書くので、プールが塞がっていても順番に進む
+// 順番待ちの断片が溜まりすぎないよう、連結されていないチャンクはスレッド数の2倍までにする
+// シリアライザが Clone できない、またはスレッドが1つなら、これまでどおり順番に Write する
+class ParallelSerializer {
+public:
+    ParallelSerializer(ResultSerializer& serializer, WorkerPool& pool, idx_t threads);
+
+    // result の続きを out の大きさが target 以上になるか結果の終わりまでシリアライズし、out に追記する
+    // 終わりまで読んだら true（Fetch が失敗して終わった場合も true なので、呼び出し側で HasError を見る）
+    // 取り出しかシリアライズで例外が出たら、全てのスレッドを止めてから投げ直す
+    bool Write(QueryResult& result, string& out, idx_t target = DConstants::INVALID_INDEX);
+
+    idx_t Threads() const {
+        return clones.empty() ? 1 : clones.size();
+    }
+
+private:
+    ResultSerializer& serializer;
+    WorkerPool& pool;
+    vector<unique_ptr<ResultSerializer>> clones;
+};
+
+} // namespace duckdb
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "duckdb.hpp"
+
+namespace duckdb {
+
+// 8bit RGBAの画像をPNGに書き出す
+// IDAT の圧縮とチャンクの CRC は zlib を使う
+class PNGWriter {
+public:
+    // rgba は width * height * 4 バイト（上の行から）
+    static string EncodeRGBA(const uint8_t* rgba, uint32_t width, uint32_t height);
+
+    static constexpr const char* CONTENT_TYPE = "image/png";
+};
+
+} // namespace duckdb
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "duckdb.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+namespace duckdb {
+
+class Connection;
+
+// SQLエディタ用のサーバー側カーソル（POST /api/query?page=）
+// ストリーミングの結果を開いたまま持ち、ページごとに続きを読む。読んだ行は持たない
+// 各カーソルは専用の接続を持つ（任意のSQLなのでプールの接続は使わない）
+// IDLE_TIMEOUT 秒使われなかったカーソルは別スレッドが閉じる。MAX_CURSORS 個を超えたら最も長く使われていないものを閉じる
+class QueryCursorManager {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit QueryCursorManager(std::chrono::seconds idle_timeout = std::chrono::seconds(IDLE_TIMEOUT));
+    ~QueryCursorManager();
+
+    struct Cursor;
+
+    // ページを読む間カーソルを借りる。同じカーソルを読むリクエストは順番に待つ
+    // 最後まで読んだか失敗したカーソルは返すときに閉じる
+    class Lease {
+    public:
+        Lease(QueryCursorManager& manager, shared_ptr<Cursor> cursor);
+        ~Lease();
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        // 監視（切断と期限）に登録するための接続
+        Connection& GetConnection();
+
+        // 次の limit 行（0ならカーソルを開いたときのページの大きさ）を書き出す
+        // {"cursor":..,"offset":..,"rows":..,"done":..,"estimated_total":..,"total":..,"columns":[..],"data":[..]}
+        // cursor は続きがなければ null。estimated_total はDuckDBの見積もり（分からなければ null）、total は最後まで読んだときだけ
+        // data は /api/query と同じ形。読めなければ error に理由を入れて false
+        bool Page(idx_t limit, string& out, string& error);
+
+    private:
+        friend class QueryCursorManager;
+        QueryCursorManager& manager;
+        shared_ptr<Cursor> cursor;
+        std::unique_lock<std::mutex> guard;
+    };
+
+    // 実行を始めた結果（SendQuery）でカーソルを開き、最初のページを読むために借りた状態で返す
+    unique_ptr<Lease> Open(unique_ptr<Connection> conn, unique_ptr<QueryResult> result, int64_t estimated_total,
+                           idx_t page_size);
+
+    // 見つからない（閉じられた）なら nullptr
+    unique_ptr<Lease> Borrow(const string& id);
+
+    // 読んでいる途中なら中断する。見つからなければ false
+    bool Close(const string& id);
+
+    // {"open":..,"opened":..,"expired":..,"evicted":..}
+    string StatsJSON();
+
+    static constexpr int64_t IDLE_TIMEOUT = 60;
+    static constexpr idx_t MAX_CURSORS = 16;
+    // 1ページの最大行数
+    static constexpr idx_t MAX_PAGE_ROWS = 100000;
+
+    struct Cursor {
+        string id;
+        // manager のロックで守る
+        idx_t users = 0;
+        bool closed = false;
+        Clock::time_point last_used;
+
+        // ここから下は Lease（カーソルのロック）を持っている間だけ触る
+        std::mutex lock;
+        // 結果を破棄してから接続を閉じる（メンバは宣言の逆順に破棄される）
+        unique_ptr<Connection> conn;
+        unique_ptr<QueryResult> result;
+        vector<string> names;
+        vector<LogicalType> types;
+        int64_t estimated_total = -1;
+        idx_t page_size = 0;
+        // 読み終えた行数
+        idx_t offset = 0;
+        // 読みかけのチャンクとその中の位置
+        unique_ptr<DataChunk> pending;
+        idx_t pending_offset = 0;
+        bool done = false;
+        bool failed = false;
+    };
+
+private:
+    // lock を持った状態で呼ぶ。閉じたカーソルを返すので、ロックを外してから破棄すること
+    shared_ptr<Cursor> Remove(const string& id);
+    void Run();
+
+    std::chrono::seconds idle_timeout;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::unordered_map<string, shared_ptr<Cursor>> cursors;
+    // idは推測されにくい乱数にする
+    std::mt19937_64 random;
+    std::atomic<uint64_t> opened {0};
+    std::atomic<uint64_t> expired {0};
+    std::atomic<uint64_t> evicted {0};
+    std::thread thread;
+};
+
+} // namespace duckdb
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "duckdb.hpp"
+#include "admission_control.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+namespace duckdb {
+
+class Connection;
+
+// バックグラウンドで実行するSQLのジョブ（POST /api/jobs）
+// HTTPのワーカーを塞がないよう WORKERS 個の専用スレッドが順に実行し、結果のチャンクをメモリに持つ
+// 実行は BATCH の枠を取ってから始める
+// 各ジョブは専用の接続で実行する（任意のSQLなのでプールの接続は使わない）
+// 1つのジョブの結果が result_limit バイト（0なら無制限）を超えたら、そのジョブは失敗にして結果を捨てる
+class QueryJobManager {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    QueryJobManager(DatabaseInstance& db, AdmissionController& admission, idx_t result_limit);
+    ~QueryJobManager();
+
+    // ジョブを登録してidを返す
+    string Submit(const string& sql);
+
+    // {"id":..,"state":"queued|running|done|failed|cancelled","progress":..,"elapsed_ms":..,"rows":..,"columns":[..],"error":..}
+    // progress は0〜100（DuckDBが見積もれない間は null）。見つからなければ false
+    bool StatusJSON(const string& id, string& out);
+
+    // 終わったジョブの結果の offset 行目から limit 行を {"offset":..,"total":..,"data":[..]} で返す
+    // data は /api/query と同じ形。見つからなければ false、まだ終わっていなければ error に理由を入れて false
+    bool PageJSON(const string& id, idx_t offset, idx_t limit, string& out, string& error);
+
+    // 実行中なら中断し、ジョブを消す。見つからなければ false
+    bool Cancel(const string& id);
+
+    // {"queued":..,"running":..,"finished":..,"submitted":..,"cancelled":..,"result_bytes":..,"result_limit":..}
+    string StatsJSON();
+
+    static constexpr idx_t WORKERS = 2;
+    // 終わったジョブを残しておく時間（秒）と数
+    static constexpr int64_t FINISHED_TTL = 600;
+    static constexpr idx_t MAX_FINISHED = 32;
+    // 1ページの最大行数
+    static constexpr idx_t MAX_PAGE_ROWS = 100000;
+
+private:
+    enum class State { QUEUED, RUNNING, DONE, FAILED, CANCELLED };
+
+    struct Job {
+        string id;
+        string sql;
+        State state = State::QUEUED;
+        Clock::time_point submitted;
+        Clock::time_point started;
+        Clock::time_point finished;
+        // 実行中だけ設定する。触るのは manager のロックの中だけ
+        Connection* conn = nullptr;
+        std::atomic<bool> cancel {false};
+        idx_t rows = 0;
+        // 結果のチャンクの推定バイト数
+        idx_t bytes = 0;
+        string error;
+        vector<string> names;
+        vector<LogicalType> types;
+        // 終わるまでは実行スレッドだけが触る
+        vector<unique_ptr<DataChunk>> chunks;
+    };
+
+    static const char* StateName(State state);
+    // チャンクが持つデータのおおよそのバイト数（固定長の値、文字列の本体、リストや構造体の子）
+    static idx_t ChunkBytes(DataChunk& chunk);
+    void Run();
+    // 失敗したらエラーメッセージを返す
+    string Execute(Job& job, Connection& conn);
+    // 期限切れと上限を超えた分の終わったジョブを消す（ロックを取ってから呼ぶ）
+    void Expire();
+
+    DatabaseInstance& db;
+    AdmissionController& admission;
+    idx_t result_limit;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::deque<shared_ptr<Job>> queue;
+    std::unordered_map<string, shared_ptr<Job>> jobs;
+    // idは推測されにくい乱数にする
+    std::mt19937_64 random;
+    std::atomic<uint64_t> submitted {0};
+    std::atomic<uint64_t> cancelled {0};
+    vector<std::thread> workers;
+};
+
+} // namespace duckdb
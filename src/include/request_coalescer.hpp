@@ -0,0 +1,88 @@
+#pragma once
+
+#include "duckdb.hpp"
+#include "response_cache.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+namespace duckdb {
+
+// 同じ内容の同時リクエストをまとめる（single-flight）
+// キー（正規化したエンドポイントとパラメータ）とデータバージョンが同じものが実行中なら、後から来たリクエストは
+// 自分では実行せずにその完了を待ち、同じ不変の本文を受け取る
+class RequestCoalescer {
+public:
+    class Flight;
+
+    enum class Role {
+        // 自分が実行する（結果は Flight::Publish で渡す。待っていたものが代わりに実行する場合は誰も待っていない）
+        LEADER,
+        // 実行中だったものの結果を受け取った
+        SHARED,
+        // 待っている間に gave_up が true になった
+        GAVE_UP
+    };
+
+    // 実行中のものがなければ flight を作って LEADER を返す。あれば終わるまで待ち、結果を out に入れて SHARED を返す
+    // 実行していたものが結果を出さずに終わった（エラーや共有できない大きさのストリーム）場合は、
+    // 待っていたものがそれぞれ同時に自分で実行する（1つずつ順番に実行し直して待ち時間が積み重ならないように）
+    // そのとき返す flight は登録されないので、後から来たリクエストは新しく実行を始めたものを待つ
+    Role Join(const string& key, uint64_t version, const std::function<bool()>& gave_up, CachedResponse& out,
+              unique_ptr<Flight>& flight);
+
+    // {"in_flight":..,"executions":..,"coalesced":..,"abandoned":..}
+    string StatsJSON();
+
+private:
+    struct State {
+        bool done = false;
+        bool published = false;
+        CachedResponse response;
+    };
+
+    // lock を持った状態で呼ぶ
+    void Finish(const string& map_key, const shared_ptr<State>& state);
+
+    std::mutex lock;
+    std::condition_variable finished;
+    std::unordered_map<string, shared_ptr<State>> flights;
+
+    std::atomic<uint64_t> executions {0};
+    std::atomic<uint64_t> coalesced {0};
+    std::atomic<uint64_t> abandoned {0};
+};
+
+// 実行するリクエストが持つ。Publish せずに破棄されたら待っているリクエストを起こして実行を譲る
+class RequestCoalescer::Flight {
+public:
+    ~Flight();
+
+    Flight(const Flight&) = delete;
+    Flight& operator=(const Flight&) = delete;
+
+    // 待っているリクエストに本文を渡す
+    void Publish(const CachedResponse& response);
+
+    const string& Key() const {
+        return key;
+    }
+    uint64_t Version() const {
+        return version;
+    }
+
+private:
+    friend class RequestCoalescer;
+    Flight(RequestCoalescer& coalescer, string map_key, string key, uint64_t version, shared_ptr<State> state);
+
+    RequestCoalescer& coalescer;
+    string map_key;
+    string key;
+    uint64_t version;
+    shared_ptr<State> state;
+};
+
+} // namespace duckdb
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "duckdb.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace duckdb {
+
+class Connection;
+
+// 実行中のリクエストを別スレッドで定期的に調べ、クライアントが切断したか期限を過ぎたら
+// そのリクエストの接続で実行中のクエリを中断する（Connection::Interrupt）
+// 中断はクエリの開始で解除されるので、登録が外れるまで毎回中断し直す
+class RequestWatchdog {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit RequestWatchdog(std::chrono::milliseconds interval = std::chrono::milliseconds(100));
+    ~RequestWatchdog();
+
+    // 登録中のリクエスト。破棄されると監視を外す（接続をプールに返す前に破棄すること）
+    class Scope {
+    public:
+        Scope(RequestWatchdog& watchdog, Connection& conn, std::function<bool()> is_closed, Clock::time_point deadline);
+        ~Scope();
+
+        // 期限切れで中断した場合はtrue
+        bool TimedOut() const;
+        // 期限を外し、以降は切断だけを監視する（すでに期限切れなら中断は続ける）
+        void ClearDeadline();
+
+    private:
+        RequestWatchdog& watchdog;
+        uint64_t id;
+    };
+
+    // timeout_seconds <= 0 なら期限なし（切断だけを監視する）
+    unique_ptr<Scope> Watch(Connection& conn, std::function<bool()> is_closed, double timeout_seconds);
+
+    // {"active":..,"disconnects":..,"timeouts":..}
+    string StatsJSON();
+
+private:
+    struct Entry {
+        Connection* conn;
+        std::function<bool()> is_closed;
+        Clock::time_point deadline;
+        bool disconnected = false;
+        bool timed_out = false;
+    };
+
+    void Run();
+
+    std::chrono::milliseconds interval;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping = false;
+    uint64_t next_id = 0;
+    std::unordered_map<uint64_t, Entry> entries;
+    std::atomic<uint64_t> disconnects {0};
+    std::atomic<uint64_t> timeouts {0};
+    std::thread thread;
+};
+
+} // namespace duckdb
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "duckdb.hpp"
+#include "response_compression.hpp"
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace duckdb {
+
+// 本文を圧縮したもの。エンコーディングごとに最初に要求されたときに一度だけ作り、以後の送信で使い回す
+class CompressedBodies {
+public:
+    shared_ptr<const string> Get(ResponseCompression& compression, ResponseCompression::Encoding encoding,
+                                 const string& body);
+
+private:
+    std::mutex lock;
+    shared_ptr<const string> gzip;
+    shared_ptr<const string> deflate;
+};
+
+// シリアライズ済みレスポンス（本文は共有して複数のリクエストから同時に送れるよう不変にする）
+// コピーは圧縮したものも共有するので、キャッシュのエントリと待っていたリクエストに渡した本文は同じ圧縮を使う
+struct CachedResponse {
+    CachedResponse() {
+    }
+    CachedResponse(string content_type_p, shared_ptr<const string> body_p)
+        : content_type(std::move(content_type_p)), body(std::move(body_p)), compressed(make_shared_ptr<CompressedBodies>()) {
+    }
+
+    string content_type;
+    shared_ptr<const string> body;
+    shared_ptr<CompressedBodies> compressed;
+};
+
+// レスポンスのLRUキャッシュ
+// キーのハッシュでシャードに分け、シャードごとのロックと容量（全体の予算 / シャード数）で管理する
+// エントリは作成時のデータバージョンを持ち、バージョンが変わっていれば取り出す時に捨てる
+// 容量は圧縮前の本文で数える（圧縮したものはその数分の一なので数えない）
+class ResponseCache {
+public:
+    explicit ResponseCache(idx_t capacity, idx_t shard_count = 16);
+
+    bool Get(const string& key, uint64_t version, CachedResponse& out);
+    void Put(const string& key, uint64_t version, CachedResponse response);
+
+    // 1エントリとして保持できる最大のサイズ（これを超える本文は保存しない）
+    idx_t MaxEntrySize() const;
+    bool Enabled() const {
+        return capacity > 0;
+    }
+
+    // {"capacity":..,"bytes":..,"entries":..,"hits":..,"misses":..,"evictions":..,"insertions":..}
+    string StatsJSON();
+
+private:
+    struct Entry {
+        string key;
+        uint64_t version;
+        CachedResponse response;
+
+        idx_t Size() const {
+            return key.size() + response.body->size();
+        }
+    };
+
+    struct Shard {
+        std::mutex lock;
+        std::list<Entry> lru;
+        std::unordered_map<string, std::list<Entry>::iterator> index;
+        idx_t bytes = 0;
+    };
+
+    Shard& GetShard(const string& key);
+    // lock を持った状態で呼ぶ
+    void Erase(Shard& shard, std::list<Entry>::iterator entry);
+
+    idx_t capacity;
+    idx_t shard_capacity;
+    vector<unique_ptr<Shard>> shards;
+
+    std::atomic<uint64_t> hits {0};
+    std::atomic<uint64_t> misses {0};
+    std::atomic<uint64_t> evictions {0};
+    std::atomic<uint64_t> insertions {0};
+};
+
+} // namespace duckdb
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "duckdb.hpp"
+
+#include <atomic>
+
+#include <zlib.h>
+
+namespace duckdb {
+
+// Accept-Encoding に応じたレスポンスの圧縮（gzip / deflate）
+// 大きさが分かるレスポンスは threshold バイト未満なら圧縮しない。level が0なら圧縮しない
+// 圧縮はリクエストを処理しているHTTPのワーカースレッドで行う
+class ResponseCompression {
+public:
+    enum class Encoding { NONE, GZIP, DEFLATE };
+
+    ResponseCompression(int level, idx_t threshold);
+
+    // size が分からない（ストリーミングの）場合は DConstants::INVALID_INDEX
+    Encoding Choose(const string& accept_encoding, const string& content_type, idx_t size) const;
+
+    // Accept-Encoding が coding を受け付けるか（q=0 は受け付けない。* も見る）
+    static bool Accepts(const string& accept_encoding, const string& coding);
+    // テキストとMVTだけを圧縮する（PNGやバイナリの座標列はほとんど縮まない）
+    static bool IsCompressible(const string& content_type);
+    // Content-Encoding の値
+    static const char* Name(Encoding encoding);
+
+    // 一度に圧縮する
+    string Compress(Encoding encoding, const char* data, size_t size);
+
+    int Level() const {
+        return level;
+    }
+
+    // {"level":..,"threshold":..,"responses":..,"bytes_in":..,"bytes_out":..}
+    string StatsJSON();
+
+    static constexpr int DEFAULT_LEVEL = 6;
+    static constexpr const char* DEFAULT_THRESHOLD = "1KB";
+
+private:
+    friend class StreamCompressor;
+
+    int level;
+    idx_t threshold;
+    std::atomic<uint64_t> responses {0};
+    std::atomic<uint64_t> bytes_in {0};
+    std::atomic<uint64_t> bytes_out {0};
+};
+
+// チャンクごとに圧縮して送るための圧縮器
+// Write はそこまでの入力を出力しきる（Z_SYNC_FLUSH）ので、チャンクを受け取ったクライアントはすぐに展開できる
+class StreamCompressor {
+public:
+    StreamCompressor(ResponseCompression& compression, ResponseCompression::Encoding encoding);
+    ~StreamCompressor();
+
+    StreamCompressor(const StreamCompressor&) = delete;
+    StreamCompressor& operator=(const StreamCompressor&) = delete;
+
+    // 圧縮したものを out に追記する
+    void Write(const char* data, size_t size, string& out);
+    // 残りと終わり（gzipならCRCと長さ）を out に追記する
+    void Finish(string& out);
+
+private:
+    void Deflate(const char* data, size_t size, string& out, int flush);
+
+    ResponseCompression& compression;
+    z_stream stream;
+    uint64_t in = 0;
+    uint64_t out_size = 0;
+    bool finished = false;
+};
+
+} // namespace duckdb
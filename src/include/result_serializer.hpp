@@ -0,0 +1,39 @@
+#pragma once
+
+#include "duckdb.hpp"
+
+namespace duckdb {
+
+// クエリ結果をレスポンス本文に変換するインターフェース
+// Begin → Write（DataChunkごと）→ End の順に呼ばれ、出力は out に追記する
+//
+// 並列にシリアライズできるもの（ParallelSerializer）は Clone を実装する
+// Clone したものは別のスレッドで WritePiece を呼び、チャンクを前後と独立した断片にする
+// 断片は元のシリアライザの AppendPiece でチャンクの順に連結し、Write を順に呼んだのと同じ出力にする
+class ResultSerializer {
+public:
+    virtual ~ResultSerializer() = default;
+
+    virtual string ContentType() const = 0;
+    virtual void Begin(string& out) = 0;
+    virtual void Write(DataChunk& chunk, string& out) = 0;
+    virtual void End(string& out) = 0;
+    // 結果の途中で失敗したとき End の代わりに呼ぶ。本文の中でエラーを伝えられる形式なら閉じて true
+    // そうでない形式（Arrow IPC）は false で、本文は閉じない
+    virtual bool EndWithError(const string& message, string& out) {
+        return false;
+    }
+
+    // 同じ設定の独立したシリアライザ。状態をチャンクの間で持ち越すもの（Arrowの辞書など）は nullptr
+    virtual unique_ptr<ResultSerializer> Clone() const {
+        return nullptr;
+    }
+    virtual void WritePiece(DataChunk& chunk, string& piece) {
+        Write(chunk, piece);
+    }
+    virtual void AppendPiece(const string& piece, string& out) {
+        out += piece;
+    }
+};
+
+} // namespace duckdb
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "duckdb.hpp"
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+
+namespace duckdb {
+
+class Connection;
+
+// テーブル（ビューを含む）の列と、ジオメトリ型の列
+struct TableSchema {
+    string schema_name;
+    string name;
+    // ビューは依存するテーブルが分からないので、データバージョンにどの書き込みでも進む値を使う
+    bool view = false;
+    // 定義順の列名と型名（duckdb_columns() の data_type）
+    vector<string> columns;
+    vector<string> types;
+    // GEOMETRY 型の列の位置（列名ではなく型で判定する）
+    vector<idx_t> geometry_columns;
+
+    bool HasGeometry() const {
+        return !geometry_columns.empty();
+    }
+    // 地図に使うジオメトリ列（最初のGEOMETRY列）をSQL用に引用符で囲んで返す
+    string GeometryColumn() const;
+};
+
+// データバージョン時点のカタログの写し
+struct SchemaSnapshot {
+    uint64_t version = 0;
+    bool spatial = false;
+    vector<TableSchema> tables;
+    // テーブル名から tables の位置（同名のテーブルが複数のスキーマにある場合は最初のもの）
+    std::unordered_map<string, idx_t> by_name;
+
+    const TableSchema* Find(const string& table_name) const;
+
+    // /api/tables の応答
+    // [{"table_name":..,"table_schema":..,"geometry_column":..|null,"geometry_column_type":..|null,"columns":[..]}, ..]
+    // geometry_column_type は列の型名（GEOMETRY や GEOMETRY('EPSG:4326')）で、POINT などの形状の種類ではない
+    string TablesJSON() const;
+};
+
+// テーブルの列とspatial拡張の有無をキャッシュし、リクエストごとの LOAD spatial と information_schema の問い合わせをなくす
+// DDLはカタログのデータバージョン（DataVersion::Catalog）を進めるので、値が変わったら次の要求で読み直す
+class SchemaCache {
+public:
+    // version 以降の写しを返す。読み込み中なら他のリクエストもその結果を待って共有する
+    shared_ptr<const SchemaSnapshot> Get(Connection& conn, uint64_t version);
+
+    // 最後に読み込めた写し（まだ無ければ nullptr）。読み込みを待たないので、古い写しのこともある
+    shared_ptr<const SchemaSnapshot> Peek();
+
+    // 未知のテーブルを要求されたときなどに、次の Get で読み直させる
+    // 同じ version では一度だけ読み直し（false を返す）、見つからない名前のたびにカタログを読まない
+    bool Refresh(uint64_t version);
+    // 次の Get で必ず読み直す（読み込みに失敗したとき）
+    void Invalidate();
+
+    // {"version":..,"tables":..,"spatial":..,"loads":..}
+    string StatsJSON();
+
+private:
+    static shared_ptr<const SchemaSnapshot> Load(Connection& conn, uint64_t version);
+
+    std::mutex lock;
+    uint64_t loaded_version = 0;
+    // Refresh で読み直したバージョン
+    uint64_t refreshed_version = 0;
+    std::shared_future<shared_ptr<const SchemaSnapshot>> snapshot;
+    shared_ptr<const SchemaSnapshot> last_loaded;
+    std::atomic<uint64_t> loads {0};
+};
+
+} // namespace duckdb
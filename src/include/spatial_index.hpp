@@ -0,0 +1,84 @@
+#pragma once
+
+#include "duckdb.hpp"
+#include "worker_pool.hpp"
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+
+namespace duckdb {
+
+class Connection;
+
+struct BoundingBox {
+    double min_x, min_y, max_x, max_y;
+
+    bool Intersects(const BoundingBox& other) const {
+        return min_x <= other.max_x && max_x >= other.min_x && min_y <= other.max_y && max_y >= other.min_y;
+    }
+};
+
+// 地物の外接矩形とrowidを持つ静的なpacked Hilbert R-tree
+// 葉を中心点のHilbert値で並べ、NODE_SIZE個ずつまとめて上の階層を作る（flatbushと同じ配置）
+// boxes は葉から順に各階層のノードを並べたもの。ids は葉ではrowid、内部ノードでは最初の子の位置
+class HilbertRTree {
+public:
+    // 並べ替えと上の階層の構築は pool で thread_count 個に分けて行う
+    HilbertRTree(vector<BoundingBox> items, vector<int64_t> row_ids, WorkerPool& pool, idx_t thread_count);
+
+    // query と外接矩形が交わる地物のrowidを昇順で返す
+    void Search(const BoundingBox& query, vector<int64_t>& out) const;
+
+    idx_t Size() const {
+        return item_count;
+    }
+    idx_t MemoryUsage() const {
+        return boxes.size() * sizeof(BoundingBox) + ids.size() * sizeof(int64_t);
+    }
+
+    static constexpr idx_t NODE_SIZE = 16;
+
+private:
+    idx_t item_count;
+    vector<BoundingBox> boxes;
+    vector<int64_t> ids;
+    // level_bounds[k] は階層kの終わり（階層0が葉、最後が根）
+    vector<idx_t> level_bounds;
+};
+
+// テーブルごとのR-treeを初回アクセス時に作り、データバージョンが変わったら作り直す
+class SpatialIndexManager {
+public:
+    explicit SpatialIndexManager(WorkerPool& pool) : pool(pool) {
+    }
+
+    // 構築中の索引は他のリクエストも完了を待って共有する。構築できなければnullptr
+    // threads は構築するリクエストがアドミッション制御で割り当てられたスレッド数
+    shared_ptr<const HilbertRTree> Get(Connection& conn, const string& table_name, const string& geom_col,
+                                       uint64_t version, idx_t threads);
+
+    // rowidの集合をSQLの条件（rowid BETWEEN a AND b OR ...）にする
+    // 範囲の数が max_ranges を超える場合は間隔の狭い範囲同士をつないで減らす（余分な行は他の条件で落とす）
+    static string RowIdFilter(const vector<int64_t>& row_ids, idx_t max_ranges = 256);
+
+    // {"tables":..,"items":..,"bytes":..,"builds":..}
+    string StatsJSON();
+
+private:
+    static shared_ptr<const HilbertRTree> Build(Connection& conn, const string& table_name, const string& geom_col,
+                                                WorkerPool& pool, idx_t threads);
+
+    struct Entry {
+        uint64_t version;
+        std::shared_future<shared_ptr<const HilbertRTree>> index;
+    };
+
+    WorkerPool& pool;
+    std::mutex lock;
+    std::unordered_map<string, Entry> entries;
+    std::atomic<uint64_t> builds {0};
+};
+
+} // namespace duckdb
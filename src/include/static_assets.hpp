@@ -0,0 +1,44 @@
+#pragma once
+
+#include "duckdb.hpp"
+
+namespace duckdb {
+
+// ビルド時に埋め込んだフロントエンドのファイル（scripts/embed_assets.sh が embedded_assets.inc に生成する）
+struct StaticAsset {
+    // /assets/ の後ろの名前
+    const char* name;
+    const char* content_type;
+    // 内容のハッシュ（引用符付きの強いETag）
+    const char* etag;
+    const unsigned char* data;
+    size_t size;
+    // gzipしたもの
+    const unsigned char* gzip;
+    size_t gzip_size;
+};
+
+class StaticAssets {
+public:
+    // DUCKGL_EMBEDDED_ASSETS を付けてビルドした場合だけtrue
+    static bool Embedded();
+
+    // 埋め込まれていなければ nullptr
+    static const StaticAsset* Find(const string& name);
+
+    // HTMLから読み込むURL。埋め込まれていれば /assets/<name>?v=<ハッシュ>（長期間キャッシュさせるため内容ごとに変える）、
+    // なければ従来どおりCDN
+    static string URL(const string& name);
+
+    // 実行時に作る内容（HTML）の強いETag。内容のFNV-1aハッシュ
+    static string ETag(const string& content);
+
+    // If-None-Match のどれかが etag と一致するか（* を含む）
+    static bool ETagMatches(const string& if_none_match, const string& etag);
+
+    // 埋め込んだファイルは内容ごとにURLが変わるので1年間キャッシュさせる。HTMLは毎回確かめさせる
+    static constexpr const char* ASSET_CACHE_CONTROL = "public, max-age=31536000, immutable";
+    static constexpr const char* HTML_CACHE_CONTROL = "no-cache";
+};
+
+} // namespace duckdb
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "duckdb.hpp"
+#include "geometry.hpp"
+#include "json_writer.hpp"
+#include "worker_pool.hpp"
+
+#include <unordered_set>
+
+namespace duckdb {
+
+// 行政区画や筆界のように隣り合うポリゴンが境界を共有するレイヤーを TopoJSON（/api/topology）として書き出す
+// 座標を小数点以下 precision 桁の整数に量子化してから、複数のリングや線で使われる区間を1本の弧（arc）にまとめる
+// 地物は弧の番号（逆向きは ~番号）で形を表すので、共有する境界は1度しか出力されない
+// 簡略化は弧ごとに行うので、隣り合うポリゴンの共有する境界は同じ形に簡略化される（隙間や重なりができない）
+class TopologyBuilder {
+public:
+    // 列0がWKB、残りの列を属性とする。tolerance > 0 なら弧をDouglas–Peuckerで簡略化する（単位は度）
+    TopologyBuilder(string object_name, const vector<string>& names, const vector<LogicalType>& types,
+                    int precision, double tolerance);
+
+    void AddChunk(DataChunk& chunk);
+
+    // 弧を切り出して重複を除き、{"type":"Topology","transform":..,"objects":{name:..},"arcs":[..]} を返す
+    // 接続点の検出、弧の重複除去と簡略化は pool で thread_count 個に分けて行う（出力はスレッド数によらず同じ）
+    string Finish(WorkerPool& pool, idx_t thread_count);
+
+    struct Point {
+        int64_t x;
+        int64_t y;
+
+        bool operator==(const Point& other) const {
+            return x == other.x && y == other.y;
+        }
+        bool operator!=(const Point& other) const {
+            return !(*this == other);
+        }
+        bool operator<(const Point& other) const {
+            return x < other.x || (x == other.x && y < other.y);
+        }
+    };
+
+    struct PointHash {
+        size_t operator()(const Point& p) const {
+            uint64_t h = uint64_t(p.x) * 0x9E3779B97F4A7C15ULL;
+            h ^= uint64_t(p.y) + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2);
+            return size_t(h ^ (h >> 31));
+        }
+    };
+    using PointSet = std::unordered_set<Point, PointHash>;
+
+private:
+    enum class LineKind : uint8_t { POINT, LINE, RING };
+
+    struct Feature {
+        GeometryType type;
+        bool multi;
+        // parts[first_part]..parts[first_part + part_count] が地物のパーツ
+        uint32_t first_part;
+        uint32_t part_count;
+        // properties[property_ends[row], property_ends[row + 1]) が属性
+        idx_t row;
+    };
+
+    // 区間 [begin, end]（端を含む）を points から切り出した弧
+    struct Arc {
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    bool AddGeometry(const Geometry& geom, idx_t row);
+    // 頂点を量子化して連続する重複を除いて追加する。頂点が足りなければ追加しない
+    bool AddLine(const double* xy, idx_t count, LineKind kind);
+
+    // 2つ以上の弧の端になる点（接続点）を点のハッシュで thread_count 個に分けて求める
+    void FindJunctions(WorkerPool& pool, idx_t thread_count, vector<PointSet>& junctions) const;
+    // 線を接続点で弧に切る。接続点のないリングは最小の頂点から始まる1本の弧にする
+    void CutArcs(WorkerPool& pool, idx_t thread_count, const vector<PointSet>& junctions);
+    // 同じ（または逆向きの）弧を最初に現れたものにまとめる。refs は弧ごとの出力番号（逆向きは ~番号）
+    void DeduplicateArcs(WorkerPool& pool, idx_t thread_count, vector<int64_t>& refs,
+                         vector<uint32_t>& unique) const;
+    void WriteArc(const Arc& arc, double tolerance, string& out) const;
+    void WriteGeometry(const Feature& feature, const vector<int64_t>& refs, string& out) const;
+    void WriteLineArcs(idx_t line, const vector<int64_t>& refs, string& out) const;
+
+    string object_name;
+    JSONChunkWriter writer;
+    int precision;
+    double scale;
+    double tolerance;
+
+    vector<Feature> features;
+    // parts[i]..parts[i+1] がパーツiの線、lines[j]..lines[j+1] が線jの頂点
+    vector<uint32_t> parts {0};
+    vector<uint32_t> lines {0};
+    vector<LineKind> kinds;
+    vector<Point> points;
+    // 量子化した座標の最小値（transform.translate）
+    Point min_point {0, 0};
+
+    // line_arcs[j]..line_arcs[j+1] が線jを順につないだ弧
+    vector<Arc> arcs;
+    vector<uint32_t> line_arcs;
+
+    string properties;
+    vector<idx_t> property_ends {0};
+    idx_t rows = 0;
+    Geometry geom;
+};
+
+} // namespace duckdb
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "duckdb.hpp"
+#include "geometry.hpp"
+
+#include <unordered_map>
+
+namespace duckdb {
+
+// XYZタイル（左上原点、Webメルカトル）とタイル内座標（0..extent）の変換
+class TileProjection {
+public:
+    TileProjection(uint32_t z, uint32_t x, uint32_t y, uint32_t extent);
+
+    static bool IsValid(uint32_t z, uint32_t x, uint32_t y);
+
+    // 経度緯度をタイル内座標に変換する（タイルの外側は範囲外の値になる）
+    void Project(double lon, double lat, double& px, double& py) const;
+    void Project(Geometry& geom) const;
+
+    // タイル内座標で buffer だけ広げた範囲の経度緯度
+    void Bounds(double buffer, double& min_lon, double& min_lat, double& max_lon, double& max_lat) const;
+
+    uint32_t Extent() const {
+        return extent;
+    }
+
+    static constexpr uint32_t MAX_ZOOM = 24;
+
+private:
+    uint32_t z, x, y, extent;
+    double scale;
+};
+
+// Mapbox Vector Tile（v2）の1レイヤーをprotobufで書き出す
+// 属性のキーと値はレイヤー内で重複を除いてタグ（キー番号, 値番号）で参照する
+class MVTLayerEncoder {
+public:
+    MVTLayerEncoder(string name, uint32_t extent);
+
+    uint32_t AddKey(const string& key);
+    uint32_t StringValue(const char* data, idx_t len);
+    uint32_t DoubleValue(double value);
+    uint32_t IntValue(int64_t value);
+    uint32_t UIntValue(uint64_t value);
+    uint32_t BoolValue(bool value);
+
+    // geom はタイル内座標（クリップ済み）。整数に丸めた後に頂点が残らなければfalseを返し、地物を追加しない
+    // trueの場合は属性のタグを揃えて EndFeature を呼ぶ
+    bool BeginFeature(const Geometry& geom);
+    void EndFeature(const vector<uint32_t>& tags);
+
+    idx_t FeatureCount() const {
+        return feature_count;
+    }
+
+    // Tile.layers（フィールド3）として out に追記する。地物がなければ何も書かない
+    void Finish(string& out) const;
+
+private:
+    uint32_t InternValue(const string& encoded);
+    void QuantizeRing(const double* xy, idx_t count);
+
+    string name;
+    uint32_t extent;
+    vector<string> keys;
+    std::unordered_map<string, uint32_t> key_index;
+    vector<string> values;
+    std::unordered_map<string, uint32_t> value_index;
+    string features;
+    idx_t feature_count = 0;
+    uint32_t geom_type = 0;
+    vector<uint32_t> commands;
+    vector<int64_t> ring;
+};
+
+// /api/tiles の1タイルを組み立てる
+// 列0がWKB、残りの列を属性とし、投影 → クリップ → 簡略化 → 量子化の順に処理する
+class VectorTileBuilder {
+public:
+    VectorTileBuilder(const TileProjection& projection, const string& layer_name, const vector<string>& names,
+                      const vector<LogicalType>& types, double buffer, double tolerance);
+
+    void AddChunk(DataChunk& chunk);
+    string Finish() const;
+
+    static constexpr const char* CONTENT_TYPE = "application/vnd.mapbox-vector-tile";
+
+private:
+    // 属性列 col の行 row の値番号。NULLや表せない値は INVALID_VALUE
+    uint32_t InternValue(idx_t col, idx_t row);
+
+    TileProjection projection;
+    MVTLayerEncoder encoder;
+    vector<LogicalType> types;
+    vector<uint32_t> key_ids;
+    // 属性列ごとのチャンクの値（MVTの値型に直接対応しない列はVARCHARへキャストしたもの）
+    vector<UnifiedVectorFormat> formats;
+    vector<unique_ptr<Vector>> casts;
+    double buffer;
+    double tolerance;
+    vector<uint32_t> tags;
+    Geometry geom;
+    Geometry clipped;
+
+    static constexpr uint32_t INVALID_VALUE = 0xFFFFFFFF;
+};
+
+} // namespace duckdb
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "duckdb.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace duckdb {
+
+// サーバーが持つ常駐のワーカースレッドのプール
+// リクエストのたびにスレッドを作って捨てないよう、並列にする処理（結果のシリアライズ、索引・ラスター・トポロジーの構築）はここで実行する
+// タスクは投入した順に実行し、破棄するときはキューに残ったタスクを実行せずに捨ててスレッドを止める
+class WorkerPool {
+public:
+    explicit WorkerPool(idx_t size);
+    ~WorkerPool();
+
+    void Submit(std::function<void()> task);
+
+    idx_t Size() const {
+        return threads.size();
+    }
+
+private:
+    void Run();
+
+    std::mutex lock;
+    std::condition_variable available;
+    std::deque<std::function<void()>> tasks;
+    bool stopping = false;
+    vector<std::thread> threads;
+};
+
+// 呼び出し元のスタックを参照するタスクを WorkerPool に投げるときの門
+// 呼び出し元は自分でも同じ仕事をしてから Close し、始まっていたタスクの終わりを待つ
+// Close の後に始まったタスクは Enter が false を返すので、何もせずに終わる（呼び出し元の変数に触れない）
+class TaskGate {
+public:
+    bool Enter() {
+        std::lock_guard<std::mutex> guard(lock);
+        if (closed) return false;
+        active++;
+        return true;
+    }
+    void Leave() {
+        std::lock_guard<std::mutex> guard(lock);
+        if (--active == 0) idle.notify_all();
+    }
+    void Close() {
+        std::unique_lock<std::mutex> guard(lock);
+        closed = true;
+        idle.wait(guard, [&]() { return active == 0; });
+    }
+
+private:
+    std::mutex lock;
+    std::condition_variable idle;
+    idx_t active = 0;
+    bool closed = false;
+};
+
+} // namespace duckdb
@@ -0,0 +1,420 @@
+#include "json_writer.hpp"
+#include "duckdb/common/types/date.hpp"
+#include "duckdb/common/types/timestamp.hpp"
+#include "duckdb/common/vector_operations/vector_operations.hpp"
+#include "fmt/format.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace duckdb {
+
+static void AppendUnsigned(uint64_t value, string& out) {
+    char buf[20];
+    char* end = buf + sizeof(buf);
+    char* ptr = end;
+    do {
+        *--ptr = char('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    out.append(ptr, end - ptr);
+}
+
+static void AppendSigned(int64_t value, string& out) {
+    if (value < 0) {
+        out += '-';
+        AppendUnsigned(uint64_t(0) - uint64_t(value), out);
+    } else {
+        AppendUnsigned(uint64_t(value), out);
+    }
+}
+
+// JavaScript の Number（double）で正確に表せる整数の範囲（Number.MAX_SAFE_INTEGER = 2^53 - 1）
+static constexpr uint64_t MAX_SAFE_INTEGER = (uint64_t(1) << 53) - 1;
+
+// 64ビット整数は JSON.parse で丸められないよう、絶対値が 2^53 - 1 を超えるものだけ文字列にする
+static void AppendSafeSigned(int64_t value, string& out) {
+    if (value >= -int64_t(MAX_SAFE_INTEGER) && value <= int64_t(MAX_SAFE_INTEGER)) {
+        AppendSigned(value, out);
+        return;
+    }
+    out += '"';
+    AppendSigned(value, out);
+    out += '"';
+}
+
+static void AppendSafeUnsigned(uint64_t value, string& out) {
+    if (value <= MAX_SAFE_INTEGER) {
+        AppendUnsigned(value, out);
+        return;
+    }
+    out += '"';
+    AppendUnsigned(value, out);
+    out += '"';
+}
+
+// 10進で15桁までの値は double に変換して戻しても同じ文字列になる
+static constexpr uint8_t MAX_EXACT_DECIMAL_WIDTH = 15;
+
+// 整数を10進で書いた文字列（先頭に - が付きうる）が 2^53 - 1 以下の絶対値か
+static bool IsSafeIntegerText(const char* data, idx_t len) {
+    if (len > 0 && data[0] == '-') {
+        data++;
+        len--;
+    }
+    static const char* MAX_TEXT = "9007199254740991";
+    static const idx_t MAX_LEN = 16;
+    if (len != MAX_LEN) return len < MAX_LEN;
+    return memcmp(data, MAX_TEXT, MAX_LEN) <= 0;
+}
+
+// duckdb_fmt の {} は DuckDB の DOUBLE から VARCHAR へのキャストと同じ最短の往復表現（Grisu）
+// 整数値に付く ".0" は省く
+void JSONChunkWriter::AppendDouble(double value, string& out) {
+    if (!std::isfinite(value)) {
+        out += "null";
+        return;
+    }
+    duckdb_fmt::memory_buffer buffer;
+    duckdb_fmt::format_to(buffer, "{}", value);
+    idx_t len = buffer.size();
+    if (len > 2 && buffer.data()[len - 2] == '.' && buffer.data()[len - 1] == '0') len -= 2;
+    out.append(buffer.data(), len);
+}
+
+static void AppendFloat(float value, string& out) {
+    if (!std::isfinite(value)) {
+        out += "null";
+        return;
+    }
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%.7g", value);
+    if (float(strtod(buf, nullptr)) != value) {
+        len = snprintf(buf, sizeof(buf), "%.9g", value);
+    }
+    out.append(buf, len);
+}
+
+void JSONChunkWriter::WriteEscaped(const char* data, idx_t len, string& out) {
+    static const char* HEX = "0123456789abcdef";
+    idx_t run_start = 0;
+    for (idx_t i = 0; i < len; i++) {
+        auto c = static_cast<unsigned char>(data[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        out.append(data + run_start, i - run_start);
+        run_start = i + 1;
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        default:
+            out += "\\u00";
+            out += HEX[c >> 4];
+            out += HEX[c & 0xF];
+            break;
+        }
+    }
+    out.append(data + run_start, len - run_start);
+}
+
+string JSONChunkWriter::Escape(const string& str) {
+    string result;
+    WriteEscaped(str.c_str(), str.size(), result);
+    return result;
+}
+
+template <class T, class OP>
+static void WriteColumn(Vector& vec, idx_t count, JSONChunkWriter::ColumnBuffer& buffer, OP op) {
+    UnifiedVectorFormat vdata;
+    vec.ToUnifiedFormat(count, vdata);
+    auto values = UnifiedVectorFormat::GetData<T>(vdata);
+    auto& out = buffer.data;
+    for (idx_t row = 0; row < count; row++) {
+        auto idx = vdata.sel->get_index(row);
+        if (!vdata.validity.RowIsValid(idx)) {
+            out += "null";
+        } else {
+            op(values[idx], out);
+        }
+        buffer.offsets[row + 1] = uint32_t(out.size());
+    }
+}
+
+static void WriteStringColumn(Vector& vec, idx_t count, JSONChunkWriter::ColumnBuffer& buffer, bool quote) {
+    WriteColumn<string_t>(vec, count, buffer, [quote](const string_t& value, string& out) {
+        if (!quote) {
+            out.append(value.GetData(), value.GetSize());
+            return;
+        }
+        out += '"';
+        JSONChunkWriter::WriteEscaped(value.GetData(), value.GetSize(), out);
+        out += '"';
+    });
+}
+
+JSONChunkWriter::JSONChunkWriter(const vector<string>& names, const vector<LogicalType>& types_p)
+    : types(types_p), columns(types_p.size()) {
+    for (auto& name : names) {
+        keys.push_back("\"" + Escape(name) + "\":");
+    }
+}
+
+void JSONChunkWriter::SerializeColumn(Vector& vec, const LogicalType& type, idx_t count, ColumnBuffer& buffer) {
+    buffer.data.clear();
+    buffer.offsets.resize(count + 1);
+    buffer.offsets[0] = 0;
+
+    switch (type.id()) {
+    case LogicalTypeId::BOOLEAN:
+        WriteColumn<bool>(vec, count, buffer, [](bool v, string& out) { out += v ? "true" : "false"; });
+        break;
+    case LogicalTypeId::TINYINT:
+        WriteColumn<int8_t>(vec, count, buffer, [](int8_t v, string& out) { AppendSigned(v, out); });
+        break;
+    case LogicalTypeId::SMALLINT:
+        WriteColumn<int16_t>(vec, count, buffer, [](int16_t v, string& out) { AppendSigned(v, out); });
+        break;
+    case LogicalTypeId::INTEGER:
+        WriteColumn<int32_t>(vec, count, buffer, [](int32_t v, string& out) { AppendSigned(v, out); });
+        break;
+    case LogicalTypeId::BIGINT:
+        WriteColumn<int64_t>(vec, count, buffer, [](int64_t v, string& out) { AppendSafeSigned(v, out); });
+        break;
+    case LogicalTypeId::UTINYINT:
+        WriteColumn<uint8_t>(vec, count, buffer, [](uint8_t v, string& out) { AppendUnsigned(v, out); });
+        break;
+    case LogicalTypeId::USMALLINT:
+        WriteColumn<uint16_t>(vec, count, buffer, [](uint16_t v, string& out) { AppendUnsigned(v, out); });
+        break;
+    case LogicalTypeId::UINTEGER:
+        WriteColumn<uint32_t>(vec, count, buffer, [](uint32_t v, string& out) { AppendUnsigned(v, out); });
+        break;
+    case LogicalTypeId::UBIGINT:
+        WriteColumn<uint64_t>(vec, count, buffer, [](uint64_t v, string& out) { AppendSafeUnsigned(v, out); });
+        break;
+    case LogicalTypeId::FLOAT:
+        WriteColumn<float>(vec, count, buffer, [](float v, string& out) { AppendFloat(v, out); });
+        break;
+    case LogicalTypeId::DOUBLE:
+        WriteColumn<double>(vec, count, buffer, [](double v, string& out) { JSONChunkWriter::AppendDouble(v, out); });
+        break;
+    case LogicalTypeId::DATE:
+        WriteColumn<date_t>(vec, count, buffer, [](date_t v, string& out) {
+            out += '"';
+            out += Date::ToString(v);
+            out += '"';
+        });
+        break;
+    case LogicalTypeId::TIMESTAMP:
+        WriteColumn<timestamp_t>(vec, count, buffer, [](timestamp_t v, string& out) {
+            out += '"';
+            out += Timestamp::ToString(v);
+            out += '"';
+        });
+        break;
+    case LogicalTypeId::HUGEINT:
+    case LogicalTypeId::UHUGEINT: {
+        // 128ビット整数も64ビット整数と同じく、JavaScript で正確に表せないものは文字列にする
+        Vector str_vec(LogicalType::VARCHAR, count);
+        VectorOperations::DefaultCast(vec, str_vec, count);
+        WriteColumn<string_t>(str_vec, count, buffer, [](const string_t& value, string& out) {
+            bool quote = !IsSafeIntegerText(value.GetData(), value.GetSize());
+            if (quote) out += '"';
+            out.append(value.GetData(), value.GetSize());
+            if (quote) out += '"';
+        });
+        break;
+    }
+    case LogicalTypeId::DECIMAL: {
+        // 有効桁数が15以下なら double で正確に往復できるので数値、それより多い列は丸められないよう文字列にする
+        Vector str_vec(LogicalType::VARCHAR, count);
+        VectorOperations::DefaultCast(vec, str_vec, count);
+        WriteStringColumn(str_vec, count, buffer, DecimalType::GetWidth(type) > MAX_EXACT_DECIMAL_WIDTH);
+        break;
+    }
+    case LogicalTypeId::VARCHAR:
+        // JSON型（VARCHARのエイリアス）はそのまま埋め込む
+        WriteStringColumn(vec, count, buffer, !(type.HasAlias() && type.GetAlias() == "JSON"));
+        break;
+    default: {
+        // その他の型（INTERVAL, ネスト型など）は列ごとVARCHARへキャストしてから書き出す
+        Vector str_vec(LogicalType::VARCHAR, count);
+        VectorOperations::DefaultCast(vec, str_vec, count);
+        WriteStringColumn(str_vec, count, buffer, !type.IsNumeric());
+        break;
+    }
+    }
+}
+
+void JSONChunkWriter::SerializeColumns(DataChunk& chunk, idx_t first_col) {
+    for (idx_t col = first_col; col < chunk.ColumnCount(); col++) {
+        SerializeColumn(chunk.data[col], types[col], chunk.size(), columns[col]);
+    }
+}
+
+static void ReserveFor(string& out, idx_t additional) {
+    auto required = out.size() + additional;
+    if (required > out.capacity()) {
+        out.reserve(MaxValue<idx_t>(required, out.capacity() * 2));
+    }
+}
+
+void JSONChunkWriter::WriteRows(DataChunk& chunk, string& out) {
+    idx_t count = chunk.size();
+    idx_t col_count = chunk.ColumnCount();
+    SerializeColumns(chunk, 0);
+
+    idx_t estimate = count * (col_count + 3);
+    for (idx_t col = 0; col < col_count; col++) {
+        estimate += columns[col].data.size() + keys[col].size() * count;
+    }
+    ReserveFor(out, estimate);
+
+    for (idx_t row = 0; row < count; row++) {
+        if (!first) out += ',';
+        first = false;
+        out += '{';
+        for (idx_t col = 0; col < col_count; col++) {
+            if (col > 0) out += ',';
+            auto& buffer = columns[col];
+            out += keys[col];
+            out.append(buffer.data, buffer.offsets[row], buffer.offsets[row + 1] - buffer.offsets[row]);
+        }
+        out += '}';
+    }
+}
+
+void JSONChunkWriter::WriteObjects(DataChunk& chunk, idx_t first_col, string& out, vector<idx_t>& ends) {
+    idx_t count = chunk.size();
+    idx_t col_count = chunk.ColumnCount();
+    SerializeColumns(chunk, first_col);
+
+    idx_t estimate = count * (col_count + 2);
+    for (idx_t col = first_col; col < col_count; col++) {
+        estimate += columns[col].data.size() + keys[col].size() * count;
+    }
+    ReserveFor(out, estimate);
+
+    for (idx_t row = 0; row < count; row++) {
+        out += '{';
+        for (idx_t col = first_col; col < col_count; col++) {
+            if (col > first_col) out += ',';
+            auto& buffer = columns[col];
+            out += keys[col];
+            out.append(buffer.data, buffer.offsets[row], buffer.offsets[row + 1] - buffer.offsets[row]);
+        }
+        out += '}';
+        ends.push_back(out.size());
+    }
+}
+
+void JSONChunkWriter::AppendRows(const string& rows, string& out) {
+    // 全行がNULLジオメトリだったチャンクは空
+    if (rows.empty()) return;
+    if (!first) out += ',';
+    first = false;
+    out += rows;
+}
+
+void JSONChunkWriter::WriteFeatures(DataChunk& chunk, string& out) {
+    UnifiedVectorFormat geom_data;
+    chunk.data[0].ToUnifiedFormat(chunk.size(), geom_data);
+    auto geoms = UnifiedVectorFormat::GetData<string_t>(geom_data);
+    WriteFeatures(chunk, out, [&](idx_t row, string& geometry_out) {
+        auto geom_idx = geom_data.sel->get_index(row);
+        if (!geom_data.validity.RowIsValid(geom_idx)) return false;
+        geometry_out.append(geoms[geom_idx].GetData(), geoms[geom_idx].GetSize());
+        return true;
+    });
+}
+
+void JSONChunkWriter::WriteFeatures(DataChunk& chunk, string& out, const GeometryWriter& geometry) {
+    idx_t count = chunk.size();
+    idx_t col_count = chunk.ColumnCount();
+    SerializeColumns(chunk, 1);
+
+    idx_t estimate = count * (col_count + 48);
+    for (idx_t col = 1; col < col_count; col++) {
+        estimate += columns[col].data.size() + keys[col].size() * count;
+    }
+    ReserveFor(out, estimate);
+
+    for (idx_t row = 0; row < count; row++) {
+        auto row_start = out.size();
+        if (!first) out += ',';
+        out += "{\"type\":\"Feature\",\"geometry\":";
+        if (!geometry(row, out)) {
+            out.resize(row_start);
+            continue;
+        }
+        first = false;
+        out += ",\"properties\":{";
+        for (idx_t col = 1; col < col_count; col++) {
+            if (col > 1) out += ',';
+            auto& buffer = columns[col];
+            out += keys[col];
+            out.append(buffer.data, buffer.offsets[row], buffer.offsets[row + 1] - buffer.offsets[row]);
+        }
+        out += "}}";
+    }
+}
+
+JSONResultSerializer::JSONResultSerializer(const vector<string>& names, const vector<LogicalType>& types,
+                                           JSONLayout layout_p)
+    : names(names), types(types), writer(names, types), layout(layout_p) {
+}
+
+void JSONResultSerializer::Begin(string& out) {
+    switch (layout) {
+    case JSONLayout::ARRAY:
+        out += "[";
+        break;
+    case JSONLayout::ENVELOPE:
+        out += "{\"data\":[";
+        break;
+    case JSONLayout::FEATURES:
+        out += "{\"type\":\"FeatureCollection\",\"features\":[";
+        break;
+    }
+}
+
+void JSONResultSerializer::Write(DataChunk& chunk, string& out) {
+    if (layout == JSONLayout::FEATURES) {
+        writer.WriteFeatures(chunk, out);
+    } else {
+        writer.WriteRows(chunk, out);
+    }
+}
+
+void JSONResultSerializer::End(string& out) {
+    out += layout == JSONLayout::ARRAY ? "]" : "]}";
+}
+
+bool JSONResultSerializer::EndWithError(const string& message, string& out) {
+    if (layout == JSONLayout::ARRAY) return false;
+    out += "],\"error\":\"" + JSONChunkWriter::Escape(message) + "\",\"truncated\":true}";
+    return true;
+}
+
+unique_ptr<ResultSerializer> JSONResultSerializer::Clone() const {
+    return make_uniq<JSONResultSerializer>(names, types, layout);
+}
+
+void JSONResultSerializer::WritePiece(DataChunk& chunk, string& piece) {
+    writer.ResetSeparator();
+    Write(chunk, piece);
+}
+
+void JSONResultSerializer::AppendPiece(const string& piece, string& out) {
+    writer.AppendRows(piece, out);
+}
+
+} // namespace duckdb
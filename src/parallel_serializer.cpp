@@ -0,0 +1,124 @@
+#include "parallel_serializer.hpp"
+
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <mutex>
+
+namespace duckdb {
+
+ParallelSerializer::ParallelSerializer(ResultSerializer& serializer_p, WorkerPool& pool_p, idx_t threads)
+    : serializer(serializer_p), pool(pool_p) {
+    if (threads <= 1) return;
+    for (idx_t i = 0; i < threads; i++) {
+        auto clone = serializer.Clone();
+        if (!clone) {
+            clones.clear();
+            return;
+        }
+        clones.push_back(std::move(clone));
+    }
+}
+
+bool ParallelSerializer::Write(QueryResult& result, string& out, idx_t target) {
+    if (clones.empty()) {
+        while (out.size() < target) {
+            auto chunk = result.Fetch();
+            if (!chunk || chunk->size() == 0) return true;
+            serializer.Write(*chunk, out);
+        }
+        return false;
+    }
+
+    const idx_t window = clones.size() * 2;
+    std::mutex fetch_lock;
+    // ここから下は lock で守る
+    std::mutex lock;
+    std::condition_variable appended_cv;
+    idx_t fetched = 0;
+    idx_t appended = 0;
+    bool stop = false;
+    bool finished = false;
+    std::exception_ptr error;
+    std::map<idx_t, string> ready;
+
+    auto fail = [&]() {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!error) error = std::current_exception();
+        stop = true;
+        appended_cv.notify_all();
+    };
+    auto worker = [&](idx_t thread) {
+        auto& clone = *clones[thread];
+        string piece;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                appended_cv.wait(guard, [&]() { return stop || fetched - appended < window; });
+                if (stop) return;
+            }
+            unique_ptr<DataChunk> chunk;
+            idx_t sequence;
+            {
+                std::lock_guard<std::mutex> fetch_guard(fetch_lock);
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    if (stop) return;
+                }
+                try {
+                    chunk = result.Fetch();
+                } catch (...) {
+                    fail();
+                    return;
+                }
+                std::lock_guard<std::mutex> guard(lock);
+                if (!chunk || chunk->size() == 0) {
+                    finished = true;
+                    stop = true;
+                    appended_cv.notify_all();
+                    return;
+                }
+                sequence = fetched++;
+            }
+            piece.clear();
+            try {
+                clone.WritePiece(*chunk, piece);
+            } catch (...) {
+                fail();
+                return;
+            }
+            chunk.reset();
+
+            std::lock_guard<std::mutex> guard(lock);
+            if (error) return;
+            ready[sequence] = std::move(piece);
+            // 前の番号が揃っている分だけ連結する（後の番号は、前の番号を書いたスレッドが連結する）
+            auto next = ready.find(appended);
+            while (next != ready.end()) {
+                serializer.AppendPiece(next->second, out);
+                ready.erase(next);
+                appended++;
+                next = ready.find(appended);
+            }
+            if (out.size() >= target) stop = true;
+            appended_cv.notify_all();
+        }
+    };
+
+    // プールのタスクが始まる前に Write が終わったら、そのタスクは何もせずに終わる
+    // 始まったタスクは終わるまで待つ（worker が参照するこの関数のローカル変数を使い終わるまで）
+    auto gate = make_shared_ptr<TaskGate>();
+    for (idx_t thread = 1; thread < clones.size(); thread++) {
+        pool.Submit([gate, &worker, thread]() {
+            if (!gate->Enter()) return;
+            worker(thread);
+            gate->Leave();
+        });
+    }
+    worker(0);
+    gate->Close();
+    if (error) std::rethrow_exception(error);
+    return finished;
+}
+
+} // namespace duckdb
@@ -0,0 +1,59 @@
+#include "png_writer.hpp"
+
+#include <zlib.h>
+
+namespace duckdb {
+
+constexpr const char* PNGWriter::CONTENT_TYPE;
+
+namespace {
+
+static void WriteBigEndian(uint32_t value, string& out) {
+    out += char(value >> 24);
+    out += char((value >> 16) & 0xFF);
+    out += char((value >> 8) & 0xFF);
+    out += char(value & 0xFF);
+}
+
+static void WriteChunk(const char* type, const string& data, string& out) {
+    WriteBigEndian(uint32_t(data.size()), out);
+    string body = string(type, 4) + data;
+    out += body;
+    WriteBigEndian(uint32_t(crc32(0, reinterpret_cast<const Bytef*>(body.data()), uInt(body.size()))), out);
+}
+
+} // namespace
+
+string PNGWriter::EncodeRGBA(const uint8_t* rgba, uint32_t width, uint32_t height) {
+    // 各行の先頭にフィルタ種別0（なし）を付ける
+    idx_t stride = idx_t(width) * 4;
+    string raw;
+    raw.reserve((stride + 1) * height);
+    for (uint32_t row = 0; row < height; row++) {
+        raw += '\0';
+        raw.append(reinterpret_cast<const char*>(rgba + row * stride), stride);
+    }
+
+    // IDAT は zlib ストリーム（ヘッダ + deflate + Adler-32）
+    uLongf idat_size = compressBound(uLong(raw.size()));
+    string idat(idat_size, '\0');
+    if (compress2(reinterpret_cast<Bytef*>(&idat[0]), &idat_size, reinterpret_cast<const Bytef*>(raw.data()),
+                  uLong(raw.size()), Z_DEFAULT_COMPRESSION) != Z_OK) {
+        throw InternalException("PNG compression failed");
+    }
+    idat.resize(idat_size);
+
+    string header;
+    WriteBigEndian(width, header);
+    WriteBigEndian(height, header);
+    // 8bit、RGBA、deflate、フィルタ方式0、インターレースなし
+    header += string("\x08\x06\x00\x00\x00", 5);
+
+    string out = "\x89PNG\r\n\x1a\n";
+    WriteChunk("IHDR", header, out);
+    WriteChunk("IDAT", idat, out);
+    WriteChunk("IEND", string(), out);
+    return out;
+}
+
+} // namespace duckdb
@@ -0,0 +1,233 @@
+#include "query_cursors.hpp"
+#include "json_writer.hpp"
+#include "duckdb/main/connection.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace duckdb {
+
+constexpr int64_t QueryCursorManager::IDLE_TIMEOUT;
+constexpr idx_t QueryCursorManager::MAX_CURSORS;
+constexpr idx_t QueryCursorManager::MAX_PAGE_ROWS;
+
+QueryCursorManager::QueryCursorManager(std::chrono::seconds idle_timeout_p)
+    : idle_timeout(idle_timeout_p), random(std::random_device()()), thread([this]() { Run(); }) {
+}
+
+QueryCursorManager::~QueryCursorManager() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    thread.join();
+}
+
+shared_ptr<QueryCursorManager::Cursor> QueryCursorManager::Remove(const string& id) {
+    auto entry = cursors.find(id);
+    if (entry == cursors.end()) return nullptr;
+    auto cursor = entry->second;
+    cursors.erase(entry);
+    cursor->closed = true;
+    return cursor;
+}
+
+void QueryCursorManager::Run() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (!stopping) {
+        wake.wait_for(guard, std::chrono::seconds(1));
+        if (stopping) break;
+        auto now = Clock::now();
+        vector<shared_ptr<Cursor>> closing;
+        for (auto entry = cursors.begin(); entry != cursors.end();) {
+            auto& cursor = entry->second;
+            if (cursor->users == 0 && now - cursor->last_used >= idle_timeout) {
+                cursor->closed = true;
+                closing.push_back(cursor);
+                entry = cursors.erase(entry);
+                expired++;
+            } else {
+                ++entry;
+            }
+        }
+        // 結果と接続の破棄（実行中のクエリの後始末）はロックの外で行う
+        guard.unlock();
+        closing.clear();
+        guard.lock();
+    }
+}
+
+unique_ptr<QueryCursorManager::Lease> QueryCursorManager::Open(unique_ptr<Connection> conn,
+                                                               unique_ptr<QueryResult> result,
+                                                               int64_t estimated_total, idx_t page_size) {
+    auto cursor = make_shared_ptr<Cursor>();
+    cursor->names = result->names;
+    cursor->types = result->types;
+    cursor->conn = std::move(conn);
+    cursor->result = std::move(result);
+    cursor->estimated_total = estimated_total;
+    cursor->page_size = std::max<idx_t>(1, std::min(page_size, MAX_PAGE_ROWS));
+
+    shared_ptr<Cursor> oldest;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        // 上限に達していたら、読まれていないもののうち最も長く使われていないものを閉じる
+        if (cursors.size() >= MAX_CURSORS) {
+            for (auto& entry : cursors) {
+                auto& candidate = entry.second;
+                if (candidate->users == 0 && (!oldest || candidate->last_used < oldest->last_used)) {
+                    oldest = candidate;
+                }
+            }
+            if (oldest) {
+                Remove(oldest->id);
+                evicted++;
+            }
+        }
+        do {
+            char id[17];
+            snprintf(id, sizeof(id), "%016llx", (unsigned long long)random());
+            cursor->id = id;
+        } while (cursors.count(cursor->id));
+        cursor->users = 1;
+        cursor->last_used = Clock::now();
+        cursors[cursor->id] = cursor;
+    }
+    opened++;
+    return make_uniq<Lease>(*this, std::move(cursor));
+}
+
+unique_ptr<QueryCursorManager::Lease> QueryCursorManager::Borrow(const string& id) {
+    shared_ptr<Cursor> cursor;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto entry = cursors.find(id);
+        if (entry == cursors.end()) return nullptr;
+        cursor = entry->second;
+        cursor->users++;
+    }
+    auto lease = make_uniq<Lease>(*this, std::move(cursor));
+    // 待っている間に前のリクエストが最後まで読んで閉じていることがある（users は Lease の破棄で戻す）
+    bool closed;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        closed = lease->cursor->closed;
+    }
+    if (closed) return nullptr;
+    return lease;
+}
+
+bool QueryCursorManager::Close(const string& id) {
+    shared_ptr<Cursor> cursor;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        cursor = Remove(id);
+        if (!cursor) return false;
+        // 読んでいる途中なら止める（接続は Lease が返されるまで破棄されない）
+        if (cursor->users > 0) cursor->conn->Interrupt();
+    }
+    return true;
+}
+
+string QueryCursorManager::StatsJSON() {
+    idx_t open;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        open = cursors.size();
+    }
+    return "{\"open\":" + std::to_string(open) + ",\"opened\":" + std::to_string(opened.load()) +
+           ",\"expired\":" + std::to_string(expired.load()) + ",\"evicted\":" + std::to_string(evicted.load()) + "}";
+}
+
+QueryCursorManager::Lease::Lease(QueryCursorManager& manager_p, shared_ptr<Cursor> cursor_p)
+    : manager(manager_p), cursor(std::move(cursor_p)), guard(cursor->lock) {
+}
+
+QueryCursorManager::Lease::~Lease() {
+    bool closed;
+    {
+        std::lock_guard<std::mutex> manager_guard(manager.lock);
+        cursor->users--;
+        cursor->last_used = Clock::now();
+        if ((cursor->done || cursor->failed) && !cursor->closed) {
+            manager.Remove(cursor->id);
+        }
+        closed = cursor->closed;
+    }
+    // 閉じたカーソルの結果と接続は、まだ誰かが持っていてもここで放す（カーソルのロックは持ったまま）
+    if (closed) {
+        cursor->pending.reset();
+        cursor->result.reset();
+        cursor->conn.reset();
+    }
+}
+
+Connection& QueryCursorManager::Lease::GetConnection() {
+    return *cursor->conn;
+}
+
+bool QueryCursorManager::Lease::Page(idx_t limit, string& out, string& error) {
+    auto& c = *cursor;
+    if (limit == 0) limit = c.page_size;
+    limit = std::min(limit, MAX_PAGE_ROWS);
+
+    JSONResultSerializer serializer(c.names, c.types, JSONLayout::ARRAY);
+    string data;
+    serializer.Begin(data);
+    idx_t start = c.offset;
+    try {
+        idx_t remaining = limit;
+        while (!c.done) {
+            if (!c.pending) {
+                c.pending = c.result->Fetch();
+                c.pending_offset = 0;
+                if (!c.pending || c.pending->size() == 0) {
+                    c.pending.reset();
+                    if (c.result->HasError()) {
+                        c.failed = true;
+                        error = c.result->GetError();
+                        return false;
+                    }
+                    c.done = true;
+                    break;
+                }
+            }
+            // 続きがあるかを知るため、ページが埋まっても次のチャンクを1つ先に取っておく
+            if (remaining == 0) break;
+            auto available = c.pending->size() - c.pending_offset;
+            auto count = std::min(available, remaining);
+            if (c.pending_offset == 0 && count == available) {
+                serializer.Write(*c.pending, data);
+            } else {
+                SelectionVector sel(c.pending_offset, count);
+                DataChunk page;
+                page.InitializeEmpty(c.types);
+                page.Slice(*c.pending, sel, count);
+                serializer.Write(page, data);
+            }
+            c.pending_offset += count;
+            c.offset += count;
+            remaining -= count;
+            if (c.pending_offset == c.pending->size()) c.pending.reset();
+        }
+    } catch (std::exception& e) {
+        c.failed = true;
+        error = e.what();
+        return false;
+    }
+    serializer.End(data);
+
+    out = "{\"cursor\":" + (c.done ? string("null") : "\"" + c.id + "\"") + ",\"offset\":" + std::to_string(start) +
+          ",\"rows\":" + std::to_string(c.offset - start) + ",\"done\":" + (c.done ? "true" : "false") +
+          ",\"estimated_total\":" + (c.estimated_total >= 0 ? std::to_string(c.estimated_total) : string("null")) +
+          ",\"total\":" + (c.done ? std::to_string(c.offset) : string("null")) + ",\"columns\":[";
+    for (idx_t i = 0; i < c.names.size(); i++) {
+        if (i > 0) out += ",";
+        out += "\"" + JSONChunkWriter::Escape(c.names[i]) + "\"";
+    }
+    out += "],\"data\":" + data + "}";
+    return true;
+}
+
+} // namespace duckdb
@@ -0,0 +1,365 @@
+#include "query_jobs.hpp"
+#include "json_writer.hpp"
+#include "duckdb/main/connection.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace duckdb {
+
+constexpr idx_t QueryJobManager::WORKERS;
+constexpr int64_t QueryJobManager::FINISHED_TTL;
+constexpr idx_t QueryJobManager::MAX_FINISHED;
+constexpr idx_t QueryJobManager::MAX_PAGE_ROWS;
+
+QueryJobManager::QueryJobManager(DatabaseInstance& db_p, AdmissionController& admission_p, idx_t result_limit_p)
+    : db(db_p), admission(admission_p), result_limit(result_limit_p), random(std::random_device()()) {
+    for (idx_t i = 0; i < WORKERS; i++) {
+        workers.emplace_back([this]() { Run(); });
+    }
+}
+
+QueryJobManager::~QueryJobManager() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+        for (auto& item : jobs) {
+            auto& job = *item.second;
+            job.cancel = true;
+            if (job.conn) job.conn->Interrupt();
+        }
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+const char* QueryJobManager::StateName(State state) {
+    switch (state) {
+    case State::QUEUED:
+        return "queued";
+    case State::RUNNING:
+        return "running";
+    case State::DONE:
+        return "done";
+    case State::FAILED:
+        return "failed";
+    default:
+        return "cancelled";
+    }
+}
+
+string QueryJobManager::Submit(const string& sql) {
+    auto job = make_shared_ptr<Job>();
+    job->sql = sql;
+    job->submitted = Clock::now();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        Expire();
+        do {
+            char id[17];
+            snprintf(id, sizeof(id), "%016llx", (unsigned long long)random());
+            job->id = id;
+        } while (jobs.count(job->id));
+        jobs[job->id] = job;
+        queue.push_back(job);
+    }
+    submitted++;
+    wake.notify_one();
+    return job->id;
+}
+
+void QueryJobManager::Run() {
+    while (true) {
+        shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [this]() { return stopping || !queue.empty(); });
+            if (stopping) return;
+            job = queue.front();
+            queue.pop_front();
+        }
+
+        // 枠が空くまでは queued のまま。取り消されたら実行しない
+        auto ticket = admission.Admit(AdmissionController::Class::BATCH, [&]() { return job->cancel.load(); }, true);
+        if (!ticket) continue;
+
+        Connection conn(db);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            job->state = State::RUNNING;
+            job->started = Clock::now();
+            job->conn = &conn;
+        }
+        string error;
+        try {
+            error = Execute(*job, conn);
+        } catch (std::exception& e) {
+            error = e.what();
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        job->conn = nullptr;
+        job->error = std::move(error);
+        job->finished = Clock::now();
+        if (job->cancel) {
+            job->state = State::CANCELLED;
+        } else if (!job->error.empty()) {
+            job->state = State::FAILED;
+        } else {
+            job->state = State::DONE;
+        }
+        if (job->state != State::DONE) {
+            vector<unique_ptr<DataChunk>>().swap(job->chunks);
+            job->bytes = 0;
+        }
+        Expire();
+    }
+}
+
+static idx_t VectorBytes(Vector& vector, idx_t count) {
+    auto& type = vector.GetType();
+    switch (type.InternalType()) {
+    case PhysicalType::VARCHAR: {
+        // 12バイト以下の文字列は string_t の中にある
+        UnifiedVectorFormat data;
+        vector.ToUnifiedFormat(count, data);
+        auto strings = UnifiedVectorFormat::GetData<string_t>(data);
+        idx_t bytes = count * sizeof(string_t);
+        for (idx_t row = 0; row < count; row++) {
+            auto idx = data.sel->get_index(row);
+            if (data.validity.RowIsValid(idx) && !strings[idx].IsInlined()) bytes += strings[idx].GetSize();
+        }
+        return bytes;
+    }
+    case PhysicalType::LIST:
+        return count * sizeof(list_entry_t) + VectorBytes(ListVector::GetEntry(vector), ListVector::GetListSize(vector));
+    case PhysicalType::ARRAY:
+        return VectorBytes(ArrayVector::GetEntry(vector), count * ArrayType::GetSize(type));
+    case PhysicalType::STRUCT: {
+        idx_t bytes = 0;
+        for (auto& child : StructVector::GetEntries(vector)) {
+            bytes += VectorBytes(*child, count);
+        }
+        return bytes;
+    }
+    default:
+        return count * GetTypeIdSize(type.InternalType());
+    }
+}
+
+idx_t QueryJobManager::ChunkBytes(DataChunk& chunk) {
+    idx_t bytes = 0;
+    for (auto& vector : chunk.data) {
+        bytes += VectorBytes(vector, chunk.size());
+    }
+    return bytes;
+}
+
+string QueryJobManager::Execute(Job& job, Connection& conn) {
+    // 進捗（GetQueryProgress）はプログレスバーを有効にした接続でだけ計算される
+    conn.Query("SET enable_progress_bar = true; SET enable_progress_bar_print = false");
+
+    // 最後の文の結果を返す（/api/query と同じ）。それより前の文は順に実行するだけ
+    auto statements = conn.ExtractStatements(job.sql);
+    if (statements.empty()) return "No statements to execute";
+    for (idx_t i = 0; i + 1 < statements.size(); i++) {
+        if (job.cancel) return string();
+        auto result = conn.Query(std::move(statements[i]));
+        if (result->HasError()) {
+            return result->GetError();
+        }
+    }
+    if (job.cancel) return string();
+
+    // タスク単位で実行して、その間も取り消しを確かめる（中断は次のクエリの開始で解除されるため）
+    auto pending = conn.PendingQuery(std::move(statements.back()), true);
+    if (pending->HasError()) {
+        return pending->GetError();
+    }
+    PendingExecutionResult execution;
+    do {
+        if (job.cancel) conn.Interrupt();
+        execution = pending->ExecuteTask();
+        if (execution == PendingExecutionResult::BLOCKED) pending->WaitForTask();
+    } while (execution != PendingExecutionResult::EXECUTION_ERROR && !PendingQueryResult::IsResultReady(execution));
+    if (execution == PendingExecutionResult::EXECUTION_ERROR) {
+        return pending->GetError();
+    }
+    auto result = pending->Execute();
+    if (result->HasError()) {
+        return result->GetError();
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        job.names = result->names;
+        job.types = result->types;
+    }
+    while (!job.cancel) {
+        auto chunk = result->Fetch();
+        if (!chunk || chunk->size() == 0) {
+            if (result->HasError()) return result->GetError();
+            break;
+        }
+        auto bytes = ChunkBytes(*chunk);
+        if (result_limit > 0 && job.bytes + bytes > result_limit) {
+            return "Job result exceeds duckgl_job_result_limit (" + StringUtil::BytesToHumanReadableString(result_limit) +
+                   "); add a LIMIT, use a cursor (/api/query?page=N), or raise the setting";
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        job.rows += chunk->size();
+        job.bytes += bytes;
+        job.chunks.push_back(std::move(chunk));
+    }
+    return string();
+}
+
+void QueryJobManager::Expire() {
+    auto now = Clock::now();
+    vector<std::pair<Clock::time_point, string>> finished;
+    for (auto it = jobs.begin(); it != jobs.end();) {
+        auto& job = *it->second;
+        if (job.state == State::QUEUED || job.state == State::RUNNING) {
+            ++it;
+            continue;
+        }
+        if (now - job.finished > std::chrono::seconds(FINISHED_TTL)) {
+            it = jobs.erase(it);
+            continue;
+        }
+        finished.emplace_back(job.finished, job.id);
+        ++it;
+    }
+    if (finished.size() <= MAX_FINISHED) return;
+    std::sort(finished.begin(), finished.end());
+    for (idx_t i = 0; i < finished.size() - MAX_FINISHED; i++) {
+        jobs.erase(finished[i].second);
+    }
+}
+
+bool QueryJobManager::StatusJSON(const string& id, string& out) {
+    std::lock_guard<std::mutex> guard(lock);
+    Expire();
+    auto entry = jobs.find(id);
+    if (entry == jobs.end()) return false;
+    auto& job = *entry->second;
+
+    auto now = Clock::now();
+    double elapsed = 0;
+    if (job.state == State::RUNNING) {
+        elapsed = std::chrono::duration<double, std::milli>(now - job.started).count();
+    } else if (job.state != State::QUEUED) {
+        elapsed = std::chrono::duration<double, std::milli>(job.finished - job.started).count();
+    }
+    double progress = -1;
+    if (job.state == State::DONE) {
+        progress = 100;
+    } else if (job.state == State::RUNNING && job.conn) {
+        progress = job.conn->GetQueryProgress();
+    }
+
+    char numbers[96];
+    if (progress >= 0) {
+        snprintf(numbers, sizeof(numbers), "\"progress\":%.1f,\"elapsed_ms\":%.0f", std::min(progress, 100.0), elapsed);
+    } else {
+        snprintf(numbers, sizeof(numbers), "\"progress\":null,\"elapsed_ms\":%.0f", elapsed);
+    }
+    out = "{\"id\":\"" + job.id + "\",\"state\":\"" + StateName(job.state) + "\"," + numbers +
+          ",\"rows\":" + std::to_string(job.rows) + ",\"columns\":[";
+    for (idx_t i = 0; i < job.names.size(); i++) {
+        if (i > 0) out += ",";
+        out += "\"" + JSONChunkWriter::Escape(job.names[i]) + "\"";
+    }
+    out += "]";
+    if (!job.error.empty()) out += ",\"error\":\"" + JSONChunkWriter::Escape(job.error) + "\"";
+    out += "}";
+    return true;
+}
+
+bool QueryJobManager::PageJSON(const string& id, idx_t offset, idx_t limit, string& out, string& error) {
+    shared_ptr<Job> job;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        Expire();
+        auto entry = jobs.find(id);
+        if (entry == jobs.end()) return false;
+        job = entry->second;
+        if (job->state != State::DONE) {
+            error = job->state == State::FAILED ? job->error : string("Job is ") + StateName(job->state);
+            return false;
+        }
+    }
+
+    // 終わったジョブのチャンクは変更されないので、ロックを外して書き出す
+    limit = std::min(limit, MAX_PAGE_ROWS);
+    idx_t end = std::min(job->rows, offset + limit);
+    JSONResultSerializer serializer(job->names, job->types, JSONLayout::ARRAY);
+    out = "{\"offset\":" + std::to_string(offset) + ",\"total\":" + std::to_string(job->rows) + ",\"data\":";
+    serializer.Begin(out);
+    idx_t chunk_start = 0;
+    for (auto& chunk : job->chunks) {
+        idx_t chunk_end = chunk_start + chunk->size();
+        if (chunk_end > offset && chunk_start < end) {
+            idx_t begin = std::max(offset, chunk_start) - chunk_start;
+            idx_t count = std::min(end, chunk_end) - chunk_start - begin;
+            // 元のチャンクは複数のリクエストから読まれるので、参照するだけのチャンクを作って書き出す
+            SelectionVector sel(begin, count);
+            DataChunk page;
+            page.InitializeEmpty(job->types);
+            page.Slice(*chunk, sel, count);
+            serializer.Write(page, out);
+        }
+        if (chunk_end >= end) break;
+        chunk_start = chunk_end;
+    }
+    serializer.End(out);
+    out += "}";
+    return true;
+}
+
+bool QueryJobManager::Cancel(const string& id) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto entry = jobs.find(id);
+    if (entry == jobs.end()) return false;
+    auto job = entry->second;
+    jobs.erase(entry);
+    if (job->state == State::QUEUED) {
+        // 実行スレッドが取り出して枠を待っている場合もあるので、印も付ける
+        job->cancel = true;
+        queue.erase(std::remove(queue.begin(), queue.end(), job), queue.end());
+    } else if (job->state == State::RUNNING) {
+        job->cancel = true;
+        if (job->conn) job->conn->Interrupt();
+    } else {
+        return true;
+    }
+    cancelled++;
+    return true;
+}
+
+string QueryJobManager::StatsJSON() {
+    idx_t queued = 0, running = 0, finished = 0, result_bytes = 0;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto& item : jobs) {
+            result_bytes += item.second->bytes;
+            switch (item.second->state) {
+            case State::QUEUED:
+                queued++;
+                break;
+            case State::RUNNING:
+                running++;
+                break;
+            default:
+                finished++;
+            }
+        }
+    }
+    return "{\"queued\":" + std::to_string(queued) + ",\"running\":" + std::to_string(running) +
+           ",\"finished\":" + std::to_string(finished) + ",\"submitted\":" + std::to_string(submitted.load()) +
+           ",\"cancelled\":" + std::to_string(cancelled.load()) + ",\"result_bytes\":" + std::to_string(result_bytes) +
+           ",\"result_limit\":" + std::to_string(result_limit) + "}";
+}
+
+} // namespace duckdb
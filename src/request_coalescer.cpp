@@ -0,0 +1,80 @@
+#include "request_coalescer.hpp"
+
+#include <chrono>
+
+namespace duckdb {
+
+RequestCoalescer::Role RequestCoalescer::Join(const string& key, uint64_t version,
+                                              const std::function<bool()>& gave_up, CachedResponse& out,
+                                              unique_ptr<Flight>& flight) {
+    // 別のバージョンのデータから作る結果は別物
+    auto map_key = key + '\n' + std::to_string(version);
+    std::unique_lock<std::mutex> guard(lock);
+    auto found = flights.find(map_key);
+    if (found == flights.end()) {
+        auto state = make_shared_ptr<State>();
+        flights[map_key] = state;
+        executions++;
+        flight.reset(new Flight(*this, map_key, key, version, state));
+        return Role::LEADER;
+    }
+    auto state = found->second;
+    // 切断を確かめるため、起こされなくても100msごとに見直す
+    while (!state->done) {
+        if (gave_up && gave_up()) return Role::GAVE_UP;
+        finished.wait_for(guard, std::chrono::milliseconds(100));
+    }
+    if (state->published) {
+        out = state->response;
+        coalesced++;
+        return Role::SHARED;
+    }
+    // 実行していたものが結果を出さなかったので、待っていたものは他を待たずに自分で実行する
+    // この flight は登録しない（Publish は待っているもののいない状態に書くだけになる）
+    executions++;
+    flight.reset(new Flight(*this, map_key, key, version, make_shared_ptr<State>()));
+    return Role::LEADER;
+}
+
+void RequestCoalescer::Finish(const string& map_key, const shared_ptr<State>& state) {
+    state->done = true;
+    auto found = flights.find(map_key);
+    if (found != flights.end() && found->second == state) {
+        flights.erase(found);
+    }
+    finished.notify_all();
+}
+
+string RequestCoalescer::StatsJSON() {
+    idx_t in_flight;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        in_flight = flights.size();
+    }
+    return "{\"in_flight\":" + std::to_string(in_flight) + ",\"executions\":" + std::to_string(executions.load()) +
+           ",\"coalesced\":" + std::to_string(coalesced.load()) + ",\"abandoned\":" + std::to_string(abandoned.load()) +
+           "}";
+}
+
+RequestCoalescer::Flight::Flight(RequestCoalescer& coalescer_p, string map_key_p, string key_p, uint64_t version_p,
+                                 shared_ptr<State> state_p)
+    : coalescer(coalescer_p), map_key(std::move(map_key_p)), key(std::move(key_p)), version(version_p),
+      state(std::move(state_p)) {
+}
+
+RequestCoalescer::Flight::~Flight() {
+    std::lock_guard<std::mutex> guard(coalescer.lock);
+    if (state->done) return;
+    coalescer.abandoned++;
+    coalescer.Finish(map_key, state);
+}
+
+void RequestCoalescer::Flight::Publish(const CachedResponse& response) {
+    std::lock_guard<std::mutex> guard(coalescer.lock);
+    if (state->done) return;
+    state->response = response;
+    state->published = true;
+    coalescer.Finish(map_key, state);
+}
+
+} // namespace duckdb
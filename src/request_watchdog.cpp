@@ -0,0 +1,91 @@
+#include "request_watchdog.hpp"
+#include "duckdb/main/connection.hpp"
+
+namespace duckdb {
+
+RequestWatchdog::RequestWatchdog(std::chrono::milliseconds interval_p)
+    : interval(interval_p), thread([this]() { Run(); }) {
+}
+
+RequestWatchdog::~RequestWatchdog() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    thread.join();
+}
+
+RequestWatchdog::Scope::Scope(RequestWatchdog& watchdog_p, Connection& conn, std::function<bool()> is_closed,
+                              Clock::time_point deadline)
+    : watchdog(watchdog_p) {
+    std::lock_guard<std::mutex> guard(watchdog.lock);
+    id = watchdog.next_id++;
+    Entry entry;
+    entry.conn = &conn;
+    entry.is_closed = std::move(is_closed);
+    entry.deadline = deadline;
+    watchdog.entries.emplace(id, std::move(entry));
+}
+
+RequestWatchdog::Scope::~Scope() {
+    // 監視スレッドは同じロックの中で中断するので、外した後に接続へ触れることはない
+    std::lock_guard<std::mutex> guard(watchdog.lock);
+    watchdog.entries.erase(id);
+}
+
+bool RequestWatchdog::Scope::TimedOut() const {
+    std::lock_guard<std::mutex> guard(watchdog.lock);
+    auto entry = watchdog.entries.find(id);
+    return entry != watchdog.entries.end() && entry->second.timed_out;
+}
+
+void RequestWatchdog::Scope::ClearDeadline() {
+    std::lock_guard<std::mutex> guard(watchdog.lock);
+    auto entry = watchdog.entries.find(id);
+    if (entry != watchdog.entries.end()) entry->second.deadline = Clock::time_point::max();
+}
+
+unique_ptr<RequestWatchdog::Scope> RequestWatchdog::Watch(Connection& conn, std::function<bool()> is_closed,
+                                                          double timeout_seconds) {
+    auto deadline = Clock::time_point::max();
+    if (timeout_seconds > 0) {
+        deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(timeout_seconds));
+    }
+    return make_uniq<Scope>(*this, conn, std::move(is_closed), deadline);
+}
+
+void RequestWatchdog::Run() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (!stopping) {
+        wake.wait_for(guard, interval);
+        if (stopping) break;
+        auto now = Clock::now();
+        for (auto& item : entries) {
+            auto& entry = item.second;
+            if (!entry.timed_out && now >= entry.deadline) {
+                entry.timed_out = true;
+                timeouts++;
+            }
+            if (!entry.disconnected && !entry.timed_out && entry.is_closed && entry.is_closed()) {
+                entry.disconnected = true;
+                disconnects++;
+            }
+            if (entry.disconnected || entry.timed_out) {
+                entry.conn->Interrupt();
+            }
+        }
+    }
+}
+
+string RequestWatchdog::StatsJSON() {
+    idx_t active;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        active = entries.size();
+    }
+    return "{\"active\":" + std::to_string(active) + ",\"disconnects\":" + std::to_string(disconnects.load()) +
+           ",\"timeouts\":" + std::to_string(timeouts.load()) + "}";
+}
+
+} // namespace duckdb
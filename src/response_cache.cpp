@@ -0,0 +1,92 @@
+#include "response_cache.hpp"
+
+namespace duckdb {
+
+shared_ptr<const string> CompressedBodies::Get(ResponseCompression& compression, ResponseCompression::Encoding encoding,
+                                               const string& body) {
+    // 同時に来た最初の要求が重複して圧縮しないよう、圧縮する間もロックを持つ
+    std::lock_guard<std::mutex> guard(lock);
+    auto& slot = encoding == ResponseCompression::Encoding::GZIP ? gzip : deflate;
+    if (!slot) slot = make_shared_ptr<const string>(compression.Compress(encoding, body.data(), body.size()));
+    return slot;
+}
+
+ResponseCache::ResponseCache(idx_t capacity_p, idx_t shard_count)
+    : capacity(capacity_p), shard_capacity(capacity_p / shard_count) {
+    for (idx_t i = 0; i < shard_count; i++) {
+        shards.push_back(make_uniq<Shard>());
+    }
+}
+
+ResponseCache::Shard& ResponseCache::GetShard(const string& key) {
+    return *shards[std::hash<string>()(key) % shards.size()];
+}
+
+idx_t ResponseCache::MaxEntrySize() const {
+    return shard_capacity;
+}
+
+void ResponseCache::Erase(Shard& shard, std::list<Entry>::iterator entry) {
+    shard.bytes -= entry->Size();
+    shard.index.erase(entry->key);
+    shard.lru.erase(entry);
+}
+
+bool ResponseCache::Get(const string& key, uint64_t version, CachedResponse& out) {
+    if (!Enabled()) return false;
+    auto& shard = GetShard(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto found = shard.index.find(key);
+    if (found == shard.index.end()) {
+        misses++;
+        return false;
+    }
+    if (found->second->version != version) {
+        // テーブルが更新された後の古いエントリ
+        Erase(shard, found->second);
+        misses++;
+        return false;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+    out = found->second->response;
+    hits++;
+    return true;
+}
+
+void ResponseCache::Put(const string& key, uint64_t version, CachedResponse response) {
+    if (!Enabled() || !response.body) return;
+    Entry entry {key, version, std::move(response)};
+    auto size = entry.Size();
+    if (size > shard_capacity) return;
+
+    auto& shard = GetShard(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto found = shard.index.find(key);
+    if (found != shard.index.end()) {
+        Erase(shard, found->second);
+    }
+    while (shard.bytes + size > shard_capacity && !shard.lru.empty()) {
+        Erase(shard, std::prev(shard.lru.end()));
+        evictions++;
+    }
+    shard.lru.push_front(std::move(entry));
+    shard.index[key] = shard.lru.begin();
+    shard.bytes += size;
+    insertions++;
+}
+
+string ResponseCache::StatsJSON() {
+    idx_t bytes = 0;
+    idx_t entries = 0;
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        bytes += shard->bytes;
+        entries += shard->lru.size();
+    }
+    return "{\"capacity\":" + std::to_string(capacity) + ",\"bytes\":" + std::to_string(bytes) +
+           ",\"entries\":" + std::to_string(entries) + ",\"hits\":" + std::to_string(hits.load()) +
+           ",\"misses\":" + std::to_string(misses.load()) + ",\"evictions\":" + std::to_string(evictions.load()) +
+           ",\"insertions\":" + std::to_string(insertions.load()) + "}";
+}
+
+} // namespace duckdb
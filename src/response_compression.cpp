@@ -0,0 +1,139 @@
+#include "response_compression.hpp"
+#include "duckdb/common/exception.hpp"
+#include "duckdb/common/string_util.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace duckdb {
+
+constexpr int ResponseCompression::DEFAULT_LEVEL;
+constexpr const char* ResponseCompression::DEFAULT_THRESHOLD;
+
+ResponseCompression::ResponseCompression(int level_p, idx_t threshold_p)
+    : level(std::max(0, std::min(9, level_p))), threshold(threshold_p) {
+}
+
+// Accept-Encoding の coding の q 値。書かれていなければ -1
+static double Quality(const string& accept_encoding, const string& coding) {
+    double quality = -1;
+    for (auto& part : StringUtil::Split(accept_encoding, ',')) {
+        auto params = part.find(';');
+        auto name = part.substr(0, params);
+        StringUtil::Trim(name);
+        if (!StringUtil::CIEquals(name, coding)) continue;
+        quality = 1;
+        if (params == string::npos) break;
+        auto q = part.substr(params + 1);
+        StringUtil::Trim(q);
+        if (q.compare(0, 2, "q=") == 0) quality = std::strtod(q.c_str() + 2, nullptr);
+        break;
+    }
+    return quality;
+}
+
+bool ResponseCompression::Accepts(const string& accept_encoding, const string& coding) {
+    auto quality = Quality(accept_encoding, coding);
+    if (quality < 0) quality = Quality(accept_encoding, "*");
+    return quality > 0;
+}
+
+bool ResponseCompression::IsCompressible(const string& content_type) {
+    auto mime = content_type.substr(0, content_type.find(';'));
+    StringUtil::Trim(mime);
+    return StringUtil::StartsWith(mime, "text/") || mime == "application/json" || mime == "application/javascript" ||
+           mime == "application/vnd.mapbox-vector-tile" || mime == "application/vnd.duckgl.compact" ||
+           mime == "image/svg+xml";
+}
+
+const char* ResponseCompression::Name(Encoding encoding) {
+    switch (encoding) {
+    case Encoding::GZIP:
+        return "gzip";
+    case Encoding::DEFLATE:
+        return "deflate";
+    default:
+        return "identity";
+    }
+}
+
+ResponseCompression::Encoding ResponseCompression::Choose(const string& accept_encoding, const string& content_type,
+                                                          idx_t size) const {
+    if (level == 0 || !IsCompressible(content_type)) return Encoding::NONE;
+    if (size != DConstants::INVALID_INDEX && size < threshold) return Encoding::NONE;
+    // 両方受け付けるなら gzip
+    if (Accepts(accept_encoding, "gzip")) return Encoding::GZIP;
+    if (Accepts(accept_encoding, "deflate")) return Encoding::DEFLATE;
+    return Encoding::NONE;
+}
+
+string ResponseCompression::Compress(Encoding encoding, const char* data, size_t size) {
+    string out;
+    StreamCompressor compressor(*this, encoding);
+    out.reserve(size / 4);
+    compressor.Write(data, size, out);
+    compressor.Finish(out);
+    return out;
+}
+
+string ResponseCompression::StatsJSON() {
+    return "{\"level\":" + std::to_string(level) + ",\"threshold\":" + std::to_string(threshold) +
+           ",\"responses\":" + std::to_string(responses.load()) + ",\"bytes_in\":" + std::to_string(bytes_in.load()) +
+           ",\"bytes_out\":" + std::to_string(bytes_out.load()) + "}";
+}
+
+StreamCompressor::StreamCompressor(ResponseCompression& compression_p, ResponseCompression::Encoding encoding)
+    : compression(compression_p) {
+    memset(&stream, 0, sizeof(stream));
+    // 15 + 16 で gzip のヘッダとCRC、15 だけなら zlib 形式（HTTPの deflate）
+    int window_bits = encoding == ResponseCompression::Encoding::GZIP ? 15 + 16 : 15;
+    if (deflateInit2(&stream, compression.level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw InternalException("Could not initialize the response compressor");
+    }
+    compression.responses++;
+}
+
+StreamCompressor::~StreamCompressor() {
+    deflateEnd(&stream);
+    compression.bytes_in += in;
+    compression.bytes_out += out_size;
+}
+
+void StreamCompressor::Write(const char* data, size_t size, string& out) {
+    // avail_in は32ビットなので大きな入力は分けて渡す
+    const size_t piece = size_t(1) << 30;
+    while (size > piece) {
+        Deflate(data, piece, out, Z_NO_FLUSH);
+        data += piece;
+        size -= piece;
+    }
+    Deflate(data, size, out, Z_SYNC_FLUSH);
+}
+
+void StreamCompressor::Finish(string& out) {
+    if (finished) return;
+    Deflate(nullptr, 0, out, Z_FINISH);
+    finished = true;
+}
+
+void StreamCompressor::Deflate(const char* data, size_t size, string& out, int flush) {
+    in += size;
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream.avail_in = uInt(size);
+    auto start = out.size();
+    // 出力を直接 out の後ろに書き、足りなくなったら広げる
+    do {
+        auto used = out.size();
+        out.resize(used + std::max<size_t>(16 * 1024, std::min<size_t>(size / 2, 1024 * 1024)));
+        stream.next_out = reinterpret_cast<Bytef*>(&out[used]);
+        stream.avail_out = uInt(out.size() - used);
+        auto status = deflate(&stream, flush);
+        out.resize(out.size() - stream.avail_out);
+        if (status == Z_STREAM_ERROR) throw InternalException("Response compression failed");
+        if (flush == Z_FINISH && status == Z_STREAM_END) break;
+    } while (stream.avail_out == 0 || stream.avail_in > 0);
+    out_size += out.size() - start;
+}
+
+} // namespace duckdb
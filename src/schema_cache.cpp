@@ -0,0 +1,144 @@
+#include "schema_cache.hpp"
+#include "encoding_util.hpp"
+#include "json_writer.hpp"
+#include "duckdb/common/string_util.hpp"
+#include "duckdb/main/connection.hpp"
+
+namespace duckdb {
+
+static bool IsGeometryType(const string& type) {
+    // spatial拡張の GEOMETRY と、CRS付きの GEOMETRY('...')
+    return type == "GEOMETRY" || StringUtil::StartsWith(type, "GEOMETRY(");
+}
+
+string TableSchema::GeometryColumn() const {
+    if (geometry_columns.empty()) return string();
+    return QuoteIdentifier(columns[geometry_columns[0]]);
+}
+
+const TableSchema* SchemaSnapshot::Find(const string& table_name) const {
+    auto entry = by_name.find(table_name);
+    return entry == by_name.end() ? nullptr : &tables[entry->second];
+}
+
+string SchemaSnapshot::TablesJSON() const {
+    string out = "[";
+    for (idx_t i = 0; i < tables.size(); i++) {
+        auto& table = tables[i];
+        if (i > 0) out += ",";
+        out += "{\"table_name\":\"" + JSONChunkWriter::Escape(table.name) + "\",\"table_schema\":\"" +
+               JSONChunkWriter::Escape(table.schema_name) + "\",\"geometry_column\":";
+        if (table.HasGeometry()) {
+            auto column = table.geometry_columns[0];
+            out += "\"" + JSONChunkWriter::Escape(table.columns[column]) + "\",\"geometry_column_type\":\"" +
+                   JSONChunkWriter::Escape(table.types[column]) + "\"";
+        } else {
+            out += "null,\"geometry_column_type\":null";
+        }
+        out += ",\"columns\":[";
+        for (idx_t c = 0; c < table.columns.size(); c++) {
+            if (c > 0) out += ",";
+            out += "\"" + JSONChunkWriter::Escape(table.columns[c]) + "\"";
+        }
+        out += "]}";
+    }
+    return out + "]";
+}
+
+shared_ptr<const SchemaSnapshot> SchemaCache::Load(Connection& conn, uint64_t version) {
+    auto snapshot = make_shared_ptr<SchemaSnapshot>();
+    snapshot->version = version;
+    // LOADはデータベース全体に効くので、一度成功すれば以後の接続でも使える
+    snapshot->spatial = !conn.Query("LOAD spatial;")->HasError();
+
+    auto result = conn.Query("SELECT c.schema_name, c.table_name, c.column_name, c.data_type, v.view_name IS NOT NULL "
+                             "FROM duckdb_columns() c LEFT JOIN duckdb_views() v ON v.database_name = c.database_name "
+                             "AND v.schema_name = c.schema_name AND v.view_name = c.table_name "
+                             "WHERE NOT c.internal AND c.schema_name NOT IN ('information_schema', 'pg_catalog') "
+                             "ORDER BY c.database_name, c.schema_name, c.table_name, c.column_index");
+    if (result->HasError()) return nullptr;
+    while (true) {
+        auto chunk = result->Fetch();
+        if (!chunk || chunk->size() == 0) break;
+        for (idx_t row = 0; row < chunk->size(); row++) {
+            auto schema_name = chunk->GetValue(0, row).ToString();
+            auto table_name = chunk->GetValue(1, row).ToString();
+            if (snapshot->tables.empty() || snapshot->tables.back().name != table_name ||
+                snapshot->tables.back().schema_name != schema_name) {
+                TableSchema table;
+                table.schema_name = schema_name;
+                table.name = table_name;
+                table.view = chunk->GetValue(4, row).GetValue<bool>();
+                snapshot->by_name.emplace(table_name, snapshot->tables.size());
+                snapshot->tables.push_back(std::move(table));
+            }
+            auto& table = snapshot->tables.back();
+            auto type = chunk->GetValue(3, row).ToString();
+            if (IsGeometryType(type)) table.geometry_columns.push_back(table.columns.size());
+            table.columns.push_back(chunk->GetValue(2, row).ToString());
+            table.types.push_back(std::move(type));
+        }
+    }
+    return snapshot;
+}
+
+shared_ptr<const SchemaSnapshot> SchemaCache::Get(Connection& conn, uint64_t version) {
+    std::promise<shared_ptr<const SchemaSnapshot>> promise;
+    std::shared_future<shared_ptr<const SchemaSnapshot>> current;
+    bool load = false;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (snapshot.valid() && loaded_version >= version) {
+            current = snapshot;
+        } else {
+            current = promise.get_future().share();
+            snapshot = current;
+            loaded_version = version;
+            load = true;
+        }
+    }
+    if (load) {
+        shared_ptr<const SchemaSnapshot> loaded;
+        try {
+            loaded = Load(conn, version);
+        } catch (std::exception&) {
+            loaded = nullptr;
+        }
+        if (loaded) {
+            loads++;
+            std::lock_guard<std::mutex> guard(lock);
+            last_loaded = loaded;
+        } else {
+            Invalidate();
+        }
+        promise.set_value(loaded);
+    }
+    return current.get();
+}
+
+bool SchemaCache::Refresh(uint64_t version) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (refreshed_version >= version) return false;
+    refreshed_version = version;
+    loaded_version = 0;
+    return true;
+}
+
+void SchemaCache::Invalidate() {
+    std::lock_guard<std::mutex> guard(lock);
+    loaded_version = 0;
+}
+
+shared_ptr<const SchemaSnapshot> SchemaCache::Peek() {
+    std::lock_guard<std::mutex> guard(lock);
+    return last_loaded;
+}
+
+string SchemaCache::StatsJSON() {
+    auto current = Peek();
+    if (!current) return "{\"version\":null,\"tables\":0,\"spatial\":false,\"loads\":" + std::to_string(loads.load()) + "}";
+    return "{\"version\":" + std::to_string(current->version) + ",\"tables\":" + std::to_string(current->tables.size()) +
+           ",\"spatial\":" + (current->spatial ? "true" : "false") + ",\"loads\":" + std::to_string(loads.load()) + "}";
+}
+
+} // namespace duckdb
@@ -0,0 +1,317 @@
+#include "spatial_index.hpp"
+#include "encoding_util.hpp"
+#include "parallel_for.hpp"
+#include "duckdb/main/connection.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+namespace duckdb {
+
+constexpr idx_t HilbertRTree::NODE_SIZE;
+
+namespace {
+
+// 16bit格子上の(x, y)のHilbert曲線上の位置
+static uint32_t HilbertIndex(uint32_t x, uint32_t y) {
+    uint32_t a = x ^ y;
+    uint32_t b = 0xFFFF ^ a;
+    uint32_t c = 0xFFFF ^ (x | y);
+    uint32_t d = x & (y ^ 0xFFFF);
+
+    uint32_t A = a | (b >> 1);
+    uint32_t B = (a >> 1) ^ a;
+    uint32_t C = ((c >> 1) ^ (b & (d >> 1))) ^ c;
+    uint32_t D = ((a & (c >> 1)) ^ (d >> 1)) ^ d;
+
+    a = A; b = B; c = C; d = D;
+    A = (a & (a >> 2)) ^ (b & (b >> 2));
+    B = (a & (b >> 2)) ^ (b & ((a ^ b) >> 2));
+    C ^= (a & (c >> 2)) ^ (b & (d >> 2));
+    D ^= (b & (c >> 2)) ^ ((a ^ b) & (d >> 2));
+
+    a = A; b = B; c = C; d = D;
+    A = (a & (a >> 4)) ^ (b & (b >> 4));
+    B = (a & (b >> 4)) ^ (b & ((a ^ b) >> 4));
+    C ^= (a & (c >> 4)) ^ (b & (d >> 4));
+    D ^= (b & (c >> 4)) ^ ((a ^ b) & (d >> 4));
+
+    a = A; b = B; c = C; d = D;
+    C ^= (a & (c >> 8)) ^ (b & (d >> 8));
+    D ^= (b & (c >> 8)) ^ ((a ^ b) & (d >> 8));
+
+    a = C ^ (C >> 1);
+    b = D ^ (D >> 1);
+
+    uint32_t i0 = x ^ y;
+    uint32_t i1 = b | (0xFFFF ^ (i0 | a));
+
+    i0 = (i0 | (i0 << 8)) & 0x00FF00FF;
+    i0 = (i0 | (i0 << 4)) & 0x0F0F0F0F;
+    i0 = (i0 | (i0 << 2)) & 0x33333333;
+    i0 = (i0 | (i0 << 1)) & 0x55555555;
+
+    i1 = (i1 | (i1 << 8)) & 0x00FF00FF;
+    i1 = (i1 | (i1 << 4)) & 0x0F0F0F0F;
+    i1 = (i1 | (i1 << 2)) & 0x33333333;
+    i1 = (i1 | (i1 << 1)) & 0x55555555;
+
+    return (i1 << 1) | i0;
+}
+
+static void Extend(BoundingBox& box, const BoundingBox& other) {
+    box.min_x = std::min(box.min_x, other.min_x);
+    box.min_y = std::min(box.min_y, other.min_y);
+    box.max_x = std::max(box.max_x, other.max_x);
+    box.max_y = std::max(box.max_y, other.max_y);
+}
+
+static BoundingBox EmptyBox() {
+    return BoundingBox {std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity(),
+                        -std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity()};
+}
+
+} // namespace
+
+HilbertRTree::HilbertRTree(vector<BoundingBox> items, vector<int64_t> row_ids, WorkerPool& pool, idx_t thread_count)
+    : item_count(items.size()) {
+    idx_t n = item_count;
+    idx_t node_count = n;
+    level_bounds.push_back(n);
+    if (n == 0) return;
+    do {
+        n = (n + NODE_SIZE - 1) / NODE_SIZE;
+        node_count += n;
+        level_bounds.push_back(node_count);
+    } while (n > 1);
+
+    // 全体の範囲（スレッドごとに集計してからまとめる）
+    std::mutex bounds_lock;
+    auto bounds = EmptyBox();
+    ParallelFor(pool, item_count, thread_count, [&](idx_t begin, idx_t end) {
+        auto local = EmptyBox();
+        for (idx_t i = begin; i < end; i++) Extend(local, items[i]);
+        std::lock_guard<std::mutex> guard(bounds_lock);
+        Extend(bounds, local);
+    });
+
+    // 中心点を16bit格子に写してHilbert値を求める
+    double width = bounds.max_x > bounds.min_x ? bounds.max_x - bounds.min_x : 1;
+    double height = bounds.max_y > bounds.min_y ? bounds.max_y - bounds.min_y : 1;
+    vector<std::pair<uint32_t, idx_t>> order(item_count);
+    ParallelFor(pool, item_count, thread_count, [&](idx_t begin, idx_t end) {
+        for (idx_t i = begin; i < end; i++) {
+            auto& box = items[i];
+            auto hx = uint32_t(0xFFFF * ((box.min_x + box.max_x) / 2 - bounds.min_x) / width);
+            auto hy = uint32_t(0xFFFF * ((box.min_y + box.max_y) / 2 - bounds.min_y) / height);
+            order[i] = std::make_pair(HilbertIndex(hx, hy), i);
+        }
+    });
+
+    // 区間ごとに並列にソートし、隣り合う区間を併合していく
+    idx_t run = std::max<idx_t>(MIN_ITEMS_PER_THREAD, (item_count + thread_count - 1) / std::max<idx_t>(1, thread_count));
+    ParallelFor(pool, (item_count + run - 1) / run, thread_count, [&](idx_t begin, idx_t end) {
+        for (idx_t r = begin; r < end; r++) {
+            std::sort(order.begin() + r * run, order.begin() + std::min(item_count, (r + 1) * run));
+        }
+    }, 1);
+    for (; run < item_count; run *= 2) {
+        idx_t merges = (item_count + 2 * run - 1) / (2 * run);
+        ParallelFor(pool, merges, thread_count, [&](idx_t begin, idx_t end) {
+            for (idx_t m = begin; m < end; m++) {
+                idx_t first = m * 2 * run;
+                idx_t middle = std::min(first + run, item_count);
+                idx_t last = std::min(first + 2 * run, item_count);
+                if (middle >= last) continue;
+                std::inplace_merge(order.begin() + first, order.begin() + middle, order.begin() + last);
+            }
+        }, 1);
+    }
+
+    boxes.resize(node_count);
+    ids.resize(node_count);
+    ParallelFor(pool, item_count, thread_count, [&](idx_t begin, idx_t end) {
+        for (idx_t i = begin; i < end; i++) {
+            boxes[i] = items[order[i].second];
+            ids[i] = row_ids[order[i].second];
+        }
+    });
+
+    // 下の階層からNODE_SIZE個ずつまとめて親ノードを作る
+    for (idx_t level = 1; level < level_bounds.size(); level++) {
+        idx_t child_begin = level == 1 ? 0 : level_bounds[level - 2];
+        idx_t child_end = level_bounds[level - 1];
+        idx_t parent_begin = level_bounds[level - 1];
+        idx_t parent_count = level_bounds[level] - parent_begin;
+        ParallelFor(pool, parent_count, thread_count, [&](idx_t begin, idx_t end) {
+            for (idx_t p = begin; p < end; p++) {
+                idx_t first = child_begin + p * NODE_SIZE;
+                idx_t last = std::min(first + NODE_SIZE, child_end);
+                auto box = EmptyBox();
+                for (idx_t c = first; c < last; c++) Extend(box, boxes[c]);
+                boxes[parent_begin + p] = box;
+                ids[parent_begin + p] = int64_t(first);
+            }
+        });
+    }
+}
+
+void HilbertRTree::Search(const BoundingBox& query, vector<int64_t>& out) const {
+    out.clear();
+    if (item_count == 0) return;
+    vector<std::pair<idx_t, idx_t>> stack;
+    stack.emplace_back(boxes.size() - 1, level_bounds.size() - 1);
+    while (!stack.empty()) {
+        auto node = stack.back();
+        stack.pop_back();
+        if (!boxes[node.first].Intersects(query)) continue;
+        if (node.second == 0) {
+            out.push_back(ids[node.first]);
+            continue;
+        }
+        idx_t first = idx_t(ids[node.first]);
+        idx_t last = std::min(first + NODE_SIZE, level_bounds[node.second - 1]);
+        for (idx_t child = first; child < last; child++) {
+            stack.emplace_back(child, node.second - 1);
+        }
+    }
+    std::sort(out.begin(), out.end());
+}
+
+shared_ptr<const HilbertRTree> SpatialIndexManager::Build(Connection& conn, const string& table_name,
+                                                          const string& geom_col, WorkerPool& pool, idx_t threads) {
+    auto result = conn.SendQuery("SELECT rowid, ST_XMin(" + geom_col + "), ST_YMin(" + geom_col + "), ST_XMax(" +
+                                 geom_col + "), ST_YMax(" + geom_col + ") FROM " + QuoteIdentifier(table_name) +
+                                 " WHERE " + geom_col + " IS NOT NULL");
+    if (result->HasError()) return nullptr;
+
+    vector<BoundingBox> items;
+    vector<int64_t> row_ids;
+    while (true) {
+        auto chunk = result->Fetch();
+        if (!chunk || chunk->size() == 0) break;
+        idx_t count = chunk->size();
+        UnifiedVectorFormat data[5];
+        for (idx_t col = 0; col < 5; col++) {
+            chunk->data[col].ToUnifiedFormat(count, data[col]);
+        }
+        auto rowids = UnifiedVectorFormat::GetData<int64_t>(data[0]);
+        for (idx_t row = 0; row < count; row++) {
+            double values[4];
+            bool valid = true;
+            for (idx_t col = 1; col < 5 && valid; col++) {
+                auto idx = data[col].sel->get_index(row);
+                valid = data[col].validity.RowIsValid(idx);
+                values[col - 1] = valid ? UnifiedVectorFormat::GetData<double>(data[col])[idx] : 0;
+            }
+            // 空のジオメトリは外接矩形を持たない
+            if (!valid) continue;
+            items.push_back(BoundingBox {values[0], values[1], values[2], values[3]});
+            row_ids.push_back(rowids[data[0].sel->get_index(row)]);
+        }
+    }
+    if (result->HasError()) return nullptr;
+
+    return make_shared_ptr<const HilbertRTree>(std::move(items), std::move(row_ids), pool, std::max<idx_t>(1, threads));
+}
+
+shared_ptr<const HilbertRTree> SpatialIndexManager::Get(Connection& conn, const string& table_name,
+                                                        const string& geom_col, uint64_t version, idx_t threads) {
+    std::promise<shared_ptr<const HilbertRTree>> promise;
+    std::shared_future<shared_ptr<const HilbertRTree>> index;
+    bool build = false;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto entry = entries.find(table_name);
+        // 要求より新しいバージョンの索引はそのまま使える
+        if (entry != entries.end() && entry->second.version >= version) {
+            index = entry->second.index;
+        } else {
+            index = promise.get_future().share();
+            entries[table_name] = Entry {version, index};
+            build = true;
+        }
+    }
+    if (build) {
+        shared_ptr<const HilbertRTree> tree;
+        try {
+            tree = Build(conn, table_name, geom_col, pool, threads);
+        } catch (std::exception&) {
+            tree = nullptr;
+        }
+        if (tree) {
+            builds++;
+        } else {
+            // 失敗した索引は残さず、次のリクエストで作り直す
+            std::lock_guard<std::mutex> guard(lock);
+            auto entry = entries.find(table_name);
+            if (entry != entries.end() && entry->second.version == version) entries.erase(entry);
+        }
+        promise.set_value(tree);
+    }
+    return index.get();
+}
+
+string SpatialIndexManager::RowIdFilter(const vector<int64_t>& row_ids, idx_t max_ranges) {
+    if (row_ids.empty()) return "false";
+    vector<std::pair<int64_t, int64_t>> ranges;
+    for (auto id : row_ids) {
+        if (ranges.empty() || id > ranges.back().second + 1) {
+            ranges.emplace_back(id, id);
+        } else {
+            ranges.back().second = std::max(ranges.back().second, id);
+        }
+    }
+    if (ranges.size() > max_ranges) {
+        // 間隔の広い順に (max_ranges - 1) 箇所だけ区切りとして残す
+        vector<idx_t> gaps(ranges.size() - 1);
+        for (idx_t i = 0; i < gaps.size(); i++) gaps[i] = i;
+        std::nth_element(gaps.begin(), gaps.begin() + (max_ranges - 1), gaps.end(), [&](idx_t a, idx_t b) {
+            return ranges[a + 1].first - ranges[a].second > ranges[b + 1].first - ranges[b].second;
+        });
+        vector<bool> split(ranges.size(), false);
+        for (idx_t i = 0; i < max_ranges - 1; i++) split[gaps[i]] = true;
+        vector<std::pair<int64_t, int64_t>> merged;
+        merged.push_back(ranges[0]);
+        for (idx_t i = 1; i < ranges.size(); i++) {
+            if (split[i - 1]) {
+                merged.push_back(ranges[i]);
+            } else {
+                merged.back().second = ranges[i].second;
+            }
+        }
+        ranges.swap(merged);
+    }
+
+    string filter = "(";
+    for (idx_t i = 0; i < ranges.size(); i++) {
+        if (i > 0) filter += " OR ";
+        if (ranges[i].first == ranges[i].second) {
+            filter += "rowid = " + std::to_string(ranges[i].first);
+        } else {
+            filter += "rowid BETWEEN " + std::to_string(ranges[i].first) + " AND " + std::to_string(ranges[i].second);
+        }
+    }
+    return filter + ")";
+}
+
+string SpatialIndexManager::StatsJSON() {
+    idx_t tables = 0;
+    idx_t items = 0;
+    idx_t bytes = 0;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto& entry : entries) {
+            auto& index = entry.second.index;
+            if (index.wait_for(std::chrono::seconds(0)) != std::future_status::ready || !index.get()) continue;
+            tables++;
+            items += index.get()->Size();
+            bytes += index.get()->MemoryUsage();
+        }
+    }
+    return "{\"tables\":" + std::to_string(tables) + ",\"items\":" + std::to_string(items) +
+           ",\"bytes\":" + std::to_string(bytes) + ",\"builds\":" + std::to_string(builds.load()) + "}";
+}
+
+} // namespace duckdb
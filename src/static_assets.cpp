@@ -0,0 +1,84 @@
+#include "static_assets.hpp"
+#include "duckdb/common/string_util.hpp"
+
+#include <cstdio>
+
+#ifdef DUCKGL_EMBEDDED_ASSETS
+#include "embedded_assets.inc"
+#endif
+
+namespace duckdb {
+
+constexpr const char* StaticAssets::ASSET_CACHE_CONTROL;
+constexpr const char* StaticAssets::HTML_CACHE_CONTROL;
+
+namespace {
+
+struct CDNAsset {
+    const char* name;
+    const char* url;
+};
+
+// 埋め込んでいないビルドで読み込むURL（scripts/embed_assets.sh の既定のバージョンと合わせる）
+static const CDNAsset CDN_ASSETS[] = {
+    {"maplibre-gl.js", "https://unpkg.com/maplibre-gl@3.6.0/dist/maplibre-gl.js"},
+    {"maplibre-gl.css", "https://unpkg.com/maplibre-gl@3.6.0/dist/maplibre-gl.css"},
+    {"deck.gl.min.js", "https://unpkg.com/deck.gl@^9.0.0/dist.min.js"},
+    {"earcut.min.js", "https://unpkg.com/earcut@2.2.4/dist/earcut.min.js"},
+};
+
+} // namespace
+
+bool StaticAssets::Embedded() {
+#ifdef DUCKGL_EMBEDDED_ASSETS
+    return true;
+#else
+    return false;
+#endif
+}
+
+const StaticAsset* StaticAssets::Find(const string& name) {
+#ifdef DUCKGL_EMBEDDED_ASSETS
+    for (auto& asset : embedded_assets::ASSETS) {
+        if (name == asset.name) return &asset;
+    }
+#endif
+    return nullptr;
+}
+
+string StaticAssets::URL(const string& name) {
+    auto asset = Find(name);
+    if (asset) {
+        // ETagの引用符を外してバージョンにする
+        string etag = asset->etag;
+        return "/assets/" + name + "?v=" + etag.substr(1, etag.size() - 2);
+    }
+    for (auto& cdn : CDN_ASSETS) {
+        if (name == cdn.name) return cdn.url;
+    }
+    return string();
+}
+
+string StaticAssets::ETag(const string& content) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (auto c : content) {
+        hash ^= uint8_t(c);
+        hash *= 1099511628211ULL;
+    }
+    char buf[24];
+    snprintf(buf, sizeof(buf), "\"%016llx\"", (unsigned long long)hash);
+    return buf;
+}
+
+bool StaticAssets::ETagMatches(const string& if_none_match, const string& etag) {
+    for (auto& part : StringUtil::Split(if_none_match, ',')) {
+        auto candidate = part;
+        StringUtil::Trim(candidate);
+        // 弱い比較（W/ は無視する）
+        if (candidate.compare(0, 2, "W/") == 0) candidate = candidate.substr(2);
+        if (candidate == "*" || candidate == etag) return true;
+    }
+    return false;
+}
+
+} // namespace duckdb
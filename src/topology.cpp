@@ -0,0 +1,397 @@
+#include "topology.hpp"
+#include "geometry_ops.hpp"
+#include "parallel_for.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <unordered_map>
+
+namespace duckdb {
+
+namespace {
+
+// 1スレッドあたりの最小の線・弧の数
+static constexpr idx_t MIN_LINES_PER_THREAD = 1024;
+
+// ハッシュの上位ビットでスレッドに分ける（下位ビットは unordered_map のバケットに使われる）
+static idx_t Partition(const TopologyBuilder::Point& p, idx_t partitions) {
+    return idx_t(TopologyBuilder::PointHash()(p) >> 40) % partitions;
+}
+
+// 向きによらない弧のキー（両端の点と頂点数）
+static uint64_t ArcKey(const TopologyBuilder::Point& a, const TopologyBuilder::Point& b, idx_t count) {
+    TopologyBuilder::PointHash hash;
+    return (uint64_t(hash(a)) + uint64_t(hash(b))) ^ (uint64_t(count) * 0xC2B2AE3D27D4EB4FULL);
+}
+
+static void AppendInt(int64_t value, string& out) {
+    char buf[24];
+    int len = snprintf(buf, sizeof(buf), "%lld", (long long)value);
+    out.append(buf, len);
+}
+
+static void AppendPosition(int64_t x, int64_t y, string& out) {
+    out += '[';
+    AppendInt(x, out);
+    out += ',';
+    AppendInt(y, out);
+    out += ']';
+}
+
+} // namespace
+
+TopologyBuilder::TopologyBuilder(string object_name_p, const vector<string>& names, const vector<LogicalType>& types,
+                                 int precision_p, double tolerance_p)
+    : object_name(std::move(object_name_p)), writer(names, types), precision(precision_p),
+      scale(std::pow(10.0, precision_p)), tolerance(tolerance_p) {
+}
+
+bool TopologyBuilder::AddLine(const double* xy, idx_t count, LineKind kind) {
+    auto start = points.size();
+    for (idx_t i = 0; i < count; i++) {
+        double qx = std::round(xy[i * 2] * scale);
+        double qy = std::round(xy[i * 2 + 1] * scale);
+        // 経度緯度以外の座標系で極端に大きい値は表せない
+        if (!(std::fabs(qx) < 4e18) || !(std::fabs(qy) < 4e18)) {
+            points.resize(start);
+            return false;
+        }
+        Point p {int64_t(qx), int64_t(qy)};
+        // 量子化で同じ位置になった連続する頂点は1つにする
+        if (points.size() > start && points.back() == p) continue;
+        points.push_back(p);
+    }
+    if (kind == LineKind::RING && points.size() > start && points[start] != points.back()) {
+        points.push_back(points[start]);
+    }
+    idx_t min_vertices = kind == LineKind::POINT ? 1 : kind == LineKind::LINE ? 2 : 4;
+    if (points.size() - start < min_vertices) {
+        points.resize(start);
+        return false;
+    }
+    lines.push_back(uint32_t(points.size()));
+    kinds.push_back(kind);
+    return true;
+}
+
+bool TopologyBuilder::AddGeometry(const Geometry& geom, idx_t row) {
+    auto kind = geom.type == GeometryType::POINT        ? LineKind::POINT
+                : geom.type == GeometryType::LINESTRING ? LineKind::LINE
+                                                        : LineKind::RING;
+    Feature feature {geom.type, geom.multi || geom.PartCount() > 1, uint32_t(parts.size() - 1), 0, row};
+    for (idx_t part = 0; part < geom.PartCount(); part++) {
+        auto lines_before = kinds.size();
+        for (idx_t ring = geom.parts[part]; ring < geom.parts[part + 1]; ring++) {
+            auto start = geom.rings[ring];
+            if (!AddLine(&geom.xy[start * 2], geom.rings[ring + 1] - start, kind) && ring == geom.parts[part]) {
+                // 外周が潰れたらパーツごと捨てる
+                break;
+            }
+        }
+        if (kinds.size() > lines_before) {
+            parts.push_back(uint32_t(kinds.size()));
+            feature.part_count++;
+        }
+    }
+    if (feature.part_count == 0) return false;
+    features.push_back(feature);
+    return true;
+}
+
+void TopologyBuilder::AddChunk(DataChunk& chunk) {
+    idx_t count = chunk.size();
+    writer.WriteObjects(chunk, 1, properties, property_ends);
+
+    UnifiedVectorFormat wkb_data;
+    chunk.data[0].ToUnifiedFormat(count, wkb_data);
+    auto wkbs = UnifiedVectorFormat::GetData<string_t>(wkb_data);
+    for (idx_t row = 0; row < count; row++) {
+        auto idx = wkb_data.sel->get_index(row);
+        if (!wkb_data.validity.RowIsValid(idx)) continue;
+        if (!WKBReader::Read(wkbs[idx].GetData(), wkbs[idx].GetSize(), geom) || geom.IsEmpty()) continue;
+        AddGeometry(geom, rows + row);
+    }
+    rows += count;
+}
+
+// TopoJSON と同じ考え方で、ある点の前後の点の組（向きは問わない）が使われる場所によって違えば接続点とする
+// 線の端点は常に接続点。点のハッシュで分けた範囲ごとに別のスレッドが全ての線をなめる
+void TopologyBuilder::FindJunctions(WorkerPool& pool, idx_t thread_count, vector<PointSet>& junctions) const {
+    struct Neighbors {
+        Point prev;
+        Point next;
+        bool junction;
+    };
+    junctions.clear();
+    junctions.resize(thread_count);
+    ParallelFor(
+        pool, thread_count, thread_count,
+        [&](idx_t begin, idx_t end) {
+            for (idx_t partition = begin; partition < end; partition++) {
+                std::unordered_map<Point, Neighbors, PointHash> seen;
+                auto visit = [&](const Point& p, const Point& prev, const Point& next, bool endpoint) {
+                    if (Partition(p, thread_count) != partition) return;
+                    auto entry = seen.find(p);
+                    if (entry == seen.end()) {
+                        seen.emplace(p, Neighbors {prev, next, endpoint});
+                        return;
+                    }
+                    auto& n = entry->second;
+                    if (endpoint || !((n.prev == prev && n.next == next) || (n.prev == next && n.next == prev))) {
+                        n.junction = true;
+                    }
+                };
+                for (idx_t line = 0; line < kinds.size(); line++) {
+                    auto first = lines[line];
+                    auto count = lines[line + 1] - first;
+                    auto p = &points[first];
+                    if (kinds[line] == LineKind::RING) {
+                        // 最後の頂点は先頭と同じなので、残りを環として扱う
+                        auto m = count - 1;
+                        for (idx_t i = 0; i < m; i++) {
+                            visit(p[i], p[(i + m - 1) % m], p[(i + 1) % m], false);
+                        }
+                    } else if (kinds[line] == LineKind::LINE) {
+                        for (idx_t i = 0; i < count; i++) {
+                            bool endpoint = i == 0 || i == count - 1;
+                            visit(p[i], p[i > 0 ? i - 1 : i], p[i + 1 < count ? i + 1 : i], endpoint);
+                        }
+                    }
+                }
+                for (auto& entry : seen) {
+                    if (entry.second.junction) junctions[partition].insert(entry.first);
+                }
+            }
+        },
+        1);
+}
+
+void TopologyBuilder::CutArcs(WorkerPool& pool, idx_t thread_count, const vector<PointSet>& junctions) {
+    auto is_junction = [&](const Point& p) {
+        auto& set = junctions[Partition(p, thread_count)];
+        return set.find(p) != set.end();
+    };
+    idx_t line_count = kinds.size();
+    vector<vector<Arc>> cut(line_count);
+    // リングの回転はそのリングの頂点だけを書き換えるので、線ごとに別のスレッドで行える
+    ParallelFor(
+        pool, line_count, thread_count,
+        [&](idx_t begin, idx_t end) {
+            for (idx_t line = begin; line < end; line++) {
+                if (kinds[line] == LineKind::POINT) continue;
+                auto first = lines[line];
+                auto last = lines[line + 1] - 1;
+                auto& out = cut[line];
+                if (kinds[line] == LineKind::RING) {
+                    auto ring = points.begin() + first;
+                    auto m = last - first;
+                    idx_t start = 0;
+                    while (start < m && !is_junction(ring[start])) start++;
+                    if (start == m) {
+                        // 接続点がなければ同じリングが同じ弧になるよう最小の頂点から始める
+                        start = std::min_element(ring, ring + m) - ring;
+                        std::rotate(ring, ring + start, ring + m);
+                        points[last] = points[first];
+                        out.push_back(Arc {first, last});
+                        continue;
+                    }
+                    std::rotate(ring, ring + start, ring + m);
+                    points[last] = points[first];
+                }
+                auto start = first;
+                for (auto i = first + 1; i <= last; i++) {
+                    if (i == last || is_junction(points[i])) {
+                        out.push_back(Arc {start, i});
+                        start = i;
+                    }
+                }
+            }
+        },
+        MIN_LINES_PER_THREAD);
+
+    arcs.clear();
+    line_arcs.assign(1, 0);
+    for (auto& line : cut) {
+        arcs.insert(arcs.end(), line.begin(), line.end());
+        line_arcs.push_back(uint32_t(arcs.size()));
+    }
+}
+
+// 弧のキーで分けた範囲ごとに別のスレッドが弧を順になめ、最初に現れたものを代表にする（結果はスレッド数によらない）
+void TopologyBuilder::DeduplicateArcs(WorkerPool& pool, idx_t thread_count, vector<int64_t>& refs,
+                                      vector<uint32_t>& unique) const {
+    vector<int64_t> canonical(arcs.size());
+    ParallelFor(
+        pool, thread_count, thread_count,
+        [&](idx_t begin, idx_t end) {
+            for (idx_t partition = begin; partition < end; partition++) {
+                std::unordered_map<uint64_t, vector<uint32_t>> representatives;
+                for (idx_t a = 0; a < arcs.size(); a++) {
+                    auto& arc = arcs[a];
+                    auto count = arc.end - arc.begin + 1;
+                    auto key = ArcKey(points[arc.begin], points[arc.end], count);
+                    if ((key >> 40) % thread_count != partition) continue;
+                    auto& candidates = representatives[key];
+                    canonical[a] = int64_t(a);
+                    for (auto r : candidates) {
+                        auto& rep = arcs[r];
+                        if (rep.end - rep.begin + 1 != count) continue;
+                        if (std::equal(points.begin() + arc.begin, points.begin() + arc.end + 1,
+                                       points.begin() + rep.begin)) {
+                            canonical[a] = int64_t(r);
+                            break;
+                        }
+                        if (std::equal(points.begin() + arc.begin, points.begin() + arc.end + 1,
+                                       points.rbegin() + (points.size() - 1 - rep.end))) {
+                            canonical[a] = ~int64_t(r);
+                            break;
+                        }
+                    }
+                    if (canonical[a] == int64_t(a)) candidates.push_back(uint32_t(a));
+                }
+            }
+        },
+        1);
+
+    // 代表の弧に現れた順に番号を付ける（代表は必ずそれを参照する弧より前にある）
+    refs.resize(arcs.size());
+    unique.clear();
+    for (idx_t a = 0; a < arcs.size(); a++) {
+        auto c = canonical[a];
+        if (c == int64_t(a)) {
+            refs[a] = int64_t(unique.size());
+            unique.push_back(uint32_t(a));
+        } else if (c >= 0) {
+            refs[a] = refs[c];
+        } else {
+            refs[a] = ~refs[~c];
+        }
+    }
+}
+
+// 弧は先頭を translate からの位置、以降を直前の頂点との差で書く（TopoJSONの量子化された弧）
+void TopologyBuilder::WriteArc(const Arc& arc, double arc_tolerance, string& out) const {
+    Geometry line;
+    line.Clear();
+    bool closed = points[arc.begin] == points[arc.end];
+    line.type = closed ? GeometryType::POLYGON : GeometryType::LINESTRING;
+    for (auto i = arc.begin; i <= arc.end; i++) {
+        line.AddVertex(double(points[i].x), double(points[i].y));
+    }
+    line.EndRing();
+    line.EndPart();
+    if (arc_tolerance > 0) {
+        Geometry simplified = line;
+        GeometryOps::Simplify(simplified, arc_tolerance);
+        // 閉じた弧が潰れる場合は簡略化しない
+        if (!simplified.IsEmpty()) line = std::move(simplified);
+    }
+
+    int64_t x = min_point.x;
+    int64_t y = min_point.y;
+    out += '[';
+    for (idx_t v = 0; v < line.VertexCount(); v++) {
+        if (v > 0) out += ',';
+        auto px = int64_t(line.xy[v * 2]);
+        auto py = int64_t(line.xy[v * 2 + 1]);
+        AppendPosition(px - x, py - y, out);
+        x = px;
+        y = py;
+    }
+    out += ']';
+}
+
+void TopologyBuilder::WriteLineArcs(idx_t line, const vector<int64_t>& refs, string& out) const {
+    out += '[';
+    for (auto a = line_arcs[line]; a < line_arcs[line + 1]; a++) {
+        if (a > line_arcs[line]) out += ',';
+        AppendInt(refs[a], out);
+    }
+    out += ']';
+}
+
+void TopologyBuilder::WriteGeometry(const Feature& feature, const vector<int64_t>& refs, string& out) const {
+    static const char* NAMES[] = {"Point", "LineString", "Polygon"};
+    out += "{\"type\":\"";
+    if (feature.multi) out += "Multi";
+    out += NAMES[uint8_t(feature.type) - 1];
+    out += feature.type == GeometryType::POINT ? "\",\"coordinates\":" : "\",\"arcs\":";
+    if (feature.multi) out += '[';
+    for (idx_t part = feature.first_part; part < feature.first_part + feature.part_count; part++) {
+        if (part > feature.first_part) out += ',';
+        switch (feature.type) {
+        case GeometryType::POINT: {
+            auto& p = points[lines[parts[part]]];
+            AppendPosition(p.x - min_point.x, p.y - min_point.y, out);
+            break;
+        }
+        case GeometryType::LINESTRING:
+            WriteLineArcs(parts[part], refs, out);
+            break;
+        default:
+            out += '[';
+            for (auto line = parts[part]; line < parts[part + 1]; line++) {
+                if (line > parts[part]) out += ',';
+                WriteLineArcs(line, refs, out);
+            }
+            out += ']';
+            break;
+        }
+    }
+    if (feature.multi) out += ']';
+    out += ",\"properties\":";
+    out.append(properties, property_ends[feature.row], property_ends[feature.row + 1] - property_ends[feature.row]);
+    out += '}';
+}
+
+string TopologyBuilder::Finish(WorkerPool& pool, idx_t thread_count) {
+    thread_count = std::max<idx_t>(1, thread_count);
+    if (!points.empty()) min_point = points[0];
+    for (auto& p : points) {
+        min_point.x = std::min(min_point.x, p.x);
+        min_point.y = std::min(min_point.y, p.y);
+    }
+
+    {
+        vector<PointSet> junctions;
+        FindJunctions(pool, thread_count, junctions);
+        CutArcs(pool, thread_count, junctions);
+    }
+    vector<int64_t> refs;
+    vector<uint32_t> unique;
+    DeduplicateArcs(pool, thread_count, refs, unique);
+
+    // 簡略化と書き出しは弧ごとに独立なのでスレッドに分ける
+    vector<string> encoded(unique.size());
+    ParallelFor(
+        pool, unique.size(), thread_count,
+        [&](idx_t begin, idx_t end) {
+            for (idx_t i = begin; i < end; i++) {
+                WriteArc(arcs[unique[i]], tolerance * scale, encoded[i]);
+            }
+        },
+        MIN_LINES_PER_THREAD);
+
+    // 量子化の1単位は 10^-precision。translate は小数点以下 precision 桁で正確に書ける
+    char transform[160];
+    string step = precision == 0 ? "1" : "1e-" + std::to_string(precision);
+    snprintf(transform, sizeof(transform), "{\"scale\":[%s,%s],\"translate\":[%.*f,%.*f]}", step.c_str(),
+             step.c_str(), precision, double(min_point.x) / scale, precision, double(min_point.y) / scale);
+    string out = "{\"type\":\"Topology\",\"transform\":";
+    out += transform;
+    out += ",\"objects\":{\"" + JSONChunkWriter::Escape(object_name) + "\":{\"type\":\"GeometryCollection\",\"geometries\":[";
+    for (idx_t i = 0; i < features.size(); i++) {
+        if (i > 0) out += ',';
+        WriteGeometry(features[i], refs, out);
+    }
+    out += "]}},\"arcs\":[";
+    for (idx_t i = 0; i < encoded.size(); i++) {
+        if (i > 0) out += ',';
+        out += encoded[i];
+    }
+    out += "]}";
+    return out;
+}
+
+} // namespace duckdb
@@ -0,0 +1,373 @@
+#include "vector_tile.hpp"
+#include "encoding_util.hpp"
+#include "geometry_ops.hpp"
+
+#include <cmath>
+
+namespace duckdb {
+
+constexpr const char* VectorTileBuilder::CONTENT_TYPE;
+constexpr uint32_t VectorTileBuilder::INVALID_VALUE;
+constexpr uint32_t TileProjection::MAX_ZOOM;
+
+static constexpr double PI = 3.14159265358979323846;
+static constexpr double MAX_LATITUDE = 85.0511287798066;
+
+TileProjection::TileProjection(uint32_t z_p, uint32_t x_p, uint32_t y_p, uint32_t extent_p)
+    : z(z_p), x(x_p), y(y_p), extent(extent_p), scale(std::ldexp(1.0, int(z_p))) {
+}
+
+bool TileProjection::IsValid(uint32_t z, uint32_t x, uint32_t y) {
+    if (z > MAX_ZOOM) return false;
+    uint64_t n = uint64_t(1) << z;
+    return x < n && y < n;
+}
+
+void TileProjection::Project(double lon, double lat, double& px, double& py) const {
+    lat = std::max(-MAX_LATITUDE, std::min(MAX_LATITUDE, lat));
+    double s = std::sin(lat * PI / 180);
+    double wx = (lon + 180) / 360;
+    double wy = 0.5 - std::log((1 + s) / (1 - s)) / (4 * PI);
+    px = (wx * scale - x) * extent;
+    py = (wy * scale - y) * extent;
+}
+
+void TileProjection::Project(Geometry& geom) const {
+    for (idx_t i = 0; i < geom.VertexCount(); i++) {
+        Project(geom.xy[i * 2], geom.xy[i * 2 + 1], geom.xy[i * 2], geom.xy[i * 2 + 1]);
+    }
+}
+
+void TileProjection::Bounds(double buffer, double& min_lon, double& min_lat, double& max_lon,
+                            double& max_lat) const {
+    double margin = buffer / extent;
+    auto lon = [&](double tx) {
+        return std::max(-180.0, std::min(180.0, tx / scale * 360 - 180));
+    };
+    auto lat = [&](double ty) {
+        return std::atan(std::sinh(PI * (1 - 2 * ty / scale))) * 180 / PI;
+    };
+    min_lon = lon(x - margin);
+    max_lon = lon(x + 1 + margin);
+    // タイルのyは下向きなので上端が最大緯度になる
+    max_lat = lat(y - margin);
+    min_lat = lat(y + 1 + margin);
+}
+
+namespace {
+
+enum WireType : uint32_t { VARINT = 0, FIXED64 = 1, LENGTH_DELIMITED = 2 };
+
+static void WriteKey(uint32_t field, WireType wire, string& out) {
+    WriteVarint((field << 3) | wire, out);
+}
+
+static void WriteBytes(uint32_t field, const char* data, idx_t len, string& out) {
+    WriteKey(field, LENGTH_DELIMITED, out);
+    WriteVarint(len, out);
+    out.append(data, len);
+}
+
+static void WriteBytes(uint32_t field, const string& data, string& out) {
+    WriteBytes(field, data.data(), data.size(), out);
+}
+
+static void WritePacked(uint32_t field, const vector<uint32_t>& values, string& out) {
+    string packed;
+    for (auto value : values) {
+        WriteVarint(value, packed);
+    }
+    WriteBytes(field, packed, out);
+}
+
+static uint32_t Command(uint32_t id, uint32_t count) {
+    return (id & 0x7) | (count << 3);
+}
+
+enum MVTCommand : uint32_t { MOVE_TO = 1, LINE_TO = 2, CLOSE_PATH = 7 };
+enum MVTGeomType : uint32_t { MVT_POINT = 1, MVT_LINESTRING = 2, MVT_POLYGON = 3 };
+
+} // namespace
+
+MVTLayerEncoder::MVTLayerEncoder(string name_p, uint32_t extent_p) : name(std::move(name_p)), extent(extent_p) {
+}
+
+uint32_t MVTLayerEncoder::AddKey(const string& key) {
+    auto entry = key_index.find(key);
+    if (entry != key_index.end()) return entry->second;
+    auto id = uint32_t(keys.size());
+    keys.push_back(key);
+    key_index[key] = id;
+    return id;
+}
+
+uint32_t MVTLayerEncoder::InternValue(const string& encoded) {
+    auto entry = value_index.find(encoded);
+    if (entry != value_index.end()) return entry->second;
+    auto id = uint32_t(values.size());
+    values.push_back(encoded);
+    value_index[encoded] = id;
+    return id;
+}
+
+// Value メッセージ：string=1, float=2, double=3, int=4, uint=5, sint=6, bool=7
+uint32_t MVTLayerEncoder::StringValue(const char* data, idx_t len) {
+    string encoded;
+    WriteBytes(1, data, len, encoded);
+    return InternValue(encoded);
+}
+
+uint32_t MVTLayerEncoder::DoubleValue(double value) {
+    string encoded;
+    WriteKey(3, FIXED64, encoded);
+    encoded.append(reinterpret_cast<const char*>(&value), sizeof(double));
+    return InternValue(encoded);
+}
+
+uint32_t MVTLayerEncoder::IntValue(int64_t value) {
+    string encoded;
+    WriteKey(6, VARINT, encoded);
+    WriteVarint(ZigZag(value), encoded);
+    return InternValue(encoded);
+}
+
+uint32_t MVTLayerEncoder::UIntValue(uint64_t value) {
+    string encoded;
+    WriteKey(5, VARINT, encoded);
+    WriteVarint(value, encoded);
+    return InternValue(encoded);
+}
+
+uint32_t MVTLayerEncoder::BoolValue(bool value) {
+    string encoded;
+    WriteKey(7, VARINT, encoded);
+    WriteVarint(value ? 1 : 0, encoded);
+    return InternValue(encoded);
+}
+
+void MVTLayerEncoder::QuantizeRing(const double* xy, idx_t count) {
+    ring.clear();
+    for (idx_t i = 0; i < count; i++) {
+        int64_t qx = std::llround(xy[i * 2]);
+        int64_t qy = std::llround(xy[i * 2 + 1]);
+        // 丸めて同じ点になった連続頂点は1つにまとめる
+        if (!ring.empty() && ring[ring.size() - 2] == qx && ring[ring.size() - 1] == qy) continue;
+        ring.push_back(qx);
+        ring.push_back(qy);
+    }
+}
+
+bool MVTLayerEncoder::BeginFeature(const Geometry& geom) {
+    commands.clear();
+    // コマンドの座標はフィーチャー内で直前のカーソル位置からの差分
+    int64_t cx = 0, cy = 0;
+    auto cursor = [&](int64_t px, int64_t py) {
+        commands.push_back(uint32_t(ZigZag(px - cx)));
+        commands.push_back(uint32_t(ZigZag(py - cy)));
+        cx = px;
+        cy = py;
+    };
+
+    switch (geom.type) {
+    case GeometryType::POINT: {
+        geom_type = MVT_POINT;
+        commands.push_back(Command(MOVE_TO, uint32_t(geom.VertexCount())));
+        for (idx_t i = 0; i < geom.VertexCount(); i++) {
+            cursor(std::llround(geom.xy[i * 2]), std::llround(geom.xy[i * 2 + 1]));
+        }
+        if (geom.VertexCount() == 0) commands.clear();
+        break;
+    }
+    case GeometryType::LINESTRING:
+        geom_type = MVT_LINESTRING;
+        for (idx_t r = 0; r < geom.RingCount(); r++) {
+            QuantizeRing(&geom.xy[geom.rings[r] * 2], geom.rings[r + 1] - geom.rings[r]);
+            idx_t count = ring.size() / 2;
+            if (count < 2) continue;
+            commands.push_back(Command(MOVE_TO, 1));
+            cursor(ring[0], ring[1]);
+            commands.push_back(Command(LINE_TO, uint32_t(count - 1)));
+            for (idx_t i = 1; i < count; i++) {
+                cursor(ring[i * 2], ring[i * 2 + 1]);
+            }
+        }
+        break;
+    case GeometryType::POLYGON:
+        geom_type = MVT_POLYGON;
+        for (idx_t part = 0; part < geom.PartCount(); part++) {
+            for (idx_t r = geom.parts[part]; r < geom.parts[part + 1]; r++) {
+                bool exterior = r == geom.parts[part];
+                QuantizeRing(&geom.xy[geom.rings[r] * 2], geom.rings[r + 1] - geom.rings[r]);
+                // 終点はClosePathで表すので先頭と同じ末尾の点は落とす
+                if (ring.size() >= 4 && ring[0] == ring[ring.size() - 2] && ring[1] == ring[ring.size() - 1]) {
+                    ring.resize(ring.size() - 2);
+                }
+                idx_t count = ring.size() / 2;
+                double area = 0;
+                for (idx_t i = 0, j = count - 1; i < count; j = i++) {
+                    area += double(ring[j * 2]) * double(ring[i * 2 + 1]) - double(ring[i * 2]) * double(ring[j * 2 + 1]);
+                }
+                if (count < 3 || area == 0) {
+                    // 外周が潰れたらその穴も含めてパーツを捨てる
+                    if (exterior) break;
+                    continue;
+                }
+                // MVT v2：外周は面積が正（y下向きで時計回り）、穴は負
+                if ((area > 0) != exterior) {
+                    for (idx_t i = 0, j = count - 1; i < j; i++, j--) {
+                        std::swap(ring[i * 2], ring[j * 2]);
+                        std::swap(ring[i * 2 + 1], ring[j * 2 + 1]);
+                    }
+                }
+                commands.push_back(Command(MOVE_TO, 1));
+                cursor(ring[0], ring[1]);
+                commands.push_back(Command(LINE_TO, uint32_t(count - 1)));
+                for (idx_t i = 1; i < count; i++) {
+                    cursor(ring[i * 2], ring[i * 2 + 1]);
+                }
+                commands.push_back(Command(CLOSE_PATH, 1));
+            }
+        }
+        break;
+    default:
+        commands.clear();
+        break;
+    }
+    return !commands.empty();
+}
+
+void MVTLayerEncoder::EndFeature(const vector<uint32_t>& tags) {
+    // Feature メッセージ：tags=2, type=3, geometry=4
+    string feature;
+    if (!tags.empty()) WritePacked(2, tags, feature);
+    WriteKey(3, VARINT, feature);
+    WriteVarint(geom_type, feature);
+    WritePacked(4, commands, feature);
+    WriteBytes(2, feature, features);
+    feature_count++;
+}
+
+void MVTLayerEncoder::Finish(string& out) const {
+    if (feature_count == 0) return;
+    // Layer メッセージ：name=1, features=2, keys=3, values=4, extent=5, version=15
+    string layer;
+    WriteKey(15, VARINT, layer);
+    WriteVarint(2, layer);
+    WriteBytes(1, name, layer);
+    layer += features;
+    for (auto& key : keys) {
+        WriteBytes(3, key, layer);
+    }
+    for (auto& value : values) {
+        WriteBytes(4, value, layer);
+    }
+    WriteKey(5, VARINT, layer);
+    WriteVarint(extent, layer);
+    WriteBytes(3, layer, out);
+}
+
+VectorTileBuilder::VectorTileBuilder(const TileProjection& projection_p, const string& layer_name,
+                                     const vector<string>& names, const vector<LogicalType>& types_p,
+                                     double buffer_p, double tolerance_p)
+    : projection(projection_p), encoder(layer_name, projection_p.Extent()), types(types_p), buffer(buffer_p),
+      tolerance(tolerance_p) {
+    for (idx_t col = 1; col < names.size(); col++) {
+        key_ids.push_back(encoder.AddKey(names[col]));
+    }
+    formats.resize(key_ids.size());
+    casts.resize(key_ids.size());
+}
+
+uint32_t VectorTileBuilder::InternValue(idx_t col, idx_t row) {
+    auto& format = formats[col];
+    auto idx = format.sel->get_index(row);
+    if (!format.validity.RowIsValid(idx)) return INVALID_VALUE;
+    if (casts[col]) {
+        auto& str = UnifiedVectorFormat::GetData<string_t>(format)[idx];
+        return encoder.StringValue(str.GetData(), str.GetSize());
+    }
+    switch (types[col + 1].id()) {
+    case LogicalTypeId::BOOLEAN:
+        return encoder.BoolValue(UnifiedVectorFormat::GetData<bool>(format)[idx]);
+    case LogicalTypeId::TINYINT:
+        return encoder.IntValue(UnifiedVectorFormat::GetData<int8_t>(format)[idx]);
+    case LogicalTypeId::SMALLINT:
+        return encoder.IntValue(UnifiedVectorFormat::GetData<int16_t>(format)[idx]);
+    case LogicalTypeId::INTEGER:
+        return encoder.IntValue(UnifiedVectorFormat::GetData<int32_t>(format)[idx]);
+    case LogicalTypeId::BIGINT:
+        return encoder.IntValue(UnifiedVectorFormat::GetData<int64_t>(format)[idx]);
+    case LogicalTypeId::UTINYINT:
+        return encoder.UIntValue(UnifiedVectorFormat::GetData<uint8_t>(format)[idx]);
+    case LogicalTypeId::USMALLINT:
+        return encoder.UIntValue(UnifiedVectorFormat::GetData<uint16_t>(format)[idx]);
+    case LogicalTypeId::UINTEGER:
+        return encoder.UIntValue(UnifiedVectorFormat::GetData<uint32_t>(format)[idx]);
+    case LogicalTypeId::UBIGINT:
+        return encoder.UIntValue(UnifiedVectorFormat::GetData<uint64_t>(format)[idx]);
+    case LogicalTypeId::FLOAT:
+    case LogicalTypeId::DOUBLE: {
+        double value = types[col + 1].id() == LogicalTypeId::FLOAT
+                           ? double(UnifiedVectorFormat::GetData<float>(format)[idx])
+                           : UnifiedVectorFormat::GetData<double>(format)[idx];
+        // NaN/Infは属性なしとして扱う
+        if (!std::isfinite(value)) return INVALID_VALUE;
+        return encoder.DoubleValue(value);
+    }
+    default: {
+        auto& str = UnifiedVectorFormat::GetData<string_t>(format)[idx];
+        return encoder.StringValue(str.GetData(), str.GetSize());
+    }
+    }
+}
+
+void VectorTileBuilder::AddChunk(DataChunk& chunk) {
+    idx_t count = chunk.size();
+    for (idx_t col = 0; col < key_ids.size(); col++) {
+        auto& vec = chunk.data[col + 1];
+        if (IsNativeValueType(types[col + 1].id())) {
+            vec.ToUnifiedFormat(count, formats[col]);
+            continue;
+        }
+        casts[col] = make_uniq<Vector>(LogicalType::VARCHAR, count);
+        VectorOperations::DefaultCast(vec, *casts[col], count);
+        casts[col]->ToUnifiedFormat(count, formats[col]);
+    }
+
+    UnifiedVectorFormat wkb_data;
+    chunk.data[0].ToUnifiedFormat(count, wkb_data);
+    auto wkbs = UnifiedVectorFormat::GetData<string_t>(wkb_data);
+
+    double min = -buffer;
+    double max = projection.Extent() + buffer;
+    for (idx_t row = 0; row < count; row++) {
+        auto wkb_idx = wkb_data.sel->get_index(row);
+        if (!wkb_data.validity.RowIsValid(wkb_idx)) continue;
+        auto& wkb = wkbs[wkb_idx];
+        if (!WKBReader::Read(wkb.GetData(), wkb.GetSize(), geom) || geom.IsEmpty()) continue;
+
+        projection.Project(geom);
+        GeometryOps::Clip(geom, min, min, max, max, clipped);
+        if (clipped.IsEmpty()) continue;
+        // 許容誤差はタイル内座標で与えるので、ズームが上がるほど地理的な誤差は小さくなる
+        GeometryOps::Simplify(clipped, tolerance);
+        if (clipped.IsEmpty() || !encoder.BeginFeature(clipped)) continue;
+
+        tags.clear();
+        for (idx_t col = 0; col < key_ids.size(); col++) {
+            auto value = InternValue(col, row);
+            if (value == INVALID_VALUE) continue;
+            tags.push_back(key_ids[col]);
+            tags.push_back(value);
+        }
+        encoder.EndFeature(tags);
+    }
+}
+
+string VectorTileBuilder::Finish() const {
+    string out;
+    encoder.Finish(out);
+    return out;
+}
+
+} // namespace duckdb
@@ -0,0 +1,46 @@
+#include "worker_pool.hpp"
+
+namespace duckdb {
+
+WorkerPool::WorkerPool(idx_t size) {
+    size = std::max<idx_t>(1, size);
+    for (idx_t i = 0; i < size; i++) {
+        threads.emplace_back([this]() { Run(); });
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+        tasks.clear();
+    }
+    available.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::Submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        tasks.push_back(std::move(task));
+    }
+    available.notify_one();
+}
+
+void WorkerPool::Run() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            available.wait(guard, [&]() { return stopping || !tasks.empty(); });
+            if (stopping) return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+} // namespace duckdb
@@ -0,0 +1,82 @@
+"""HTTP API のテストの共通部分
+
+ビルドした拡張を Python の duckdb に読み込んでサーバーを起動し、各テストはそのサーバーに HTTP で問い合わせる。
+拡張のパスは DUCKGL_EXTENSION（既定は release ビルド）。Python の duckdb は拡張をビルドした DuckDB と同じバージョンのものを使う。
+"""
+
+import json
+import os
+import socket
+import urllib.error
+import urllib.request
+
+import duckdb
+import pytest
+
+ROOT = os.path.dirname(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+DEFAULT_EXTENSION = os.path.join(ROOT, "build", "release", "extension", "duckgl", "duckgl.duckdb_extension")
+
+
+class Server:
+    def __init__(self, con, port):
+        self.con = con
+        self.port = port
+        self.base_url = f"http://127.0.0.1:{port}"
+
+    def request(self, path, body=None, headers=None):
+        """(status, headers, body) を返す。エラーのステータスも例外にしない"""
+        data = body.encode() if isinstance(body, str) else body
+        request = urllib.request.Request(self.base_url + path, data=data, headers=headers or {},
+                                         method="POST" if data is not None else "GET")
+        try:
+            with urllib.request.urlopen(request) as response:
+                return response.status, response.headers, response.read()
+        except urllib.error.HTTPError as e:
+            return e.code, e.headers, e.read()
+
+    def get(self, path):
+        status, headers, body = self.request(path)
+        assert status == 200, body[:500]
+        return headers, body
+
+    def post(self, path, body):
+        status, headers, body = self.request(path, body)
+        assert status == 200, body[:500]
+        return headers, body
+
+    def stats(self):
+        return json.loads(self.get("/api/stats")[1])
+
+    def restart(self, **settings):
+        """設定を変えて同じポートで起動し直す（設定は duckgl_start の時点で読まれる）"""
+        for name, value in settings.items():
+            self.con.execute(f"SET {name} = '{value}'")
+        self.con.execute(f"SELECT duckgl_start('127.0.0.1', {self.port})")
+
+
+def free_port():
+    with socket.socket() as s:
+        s.bind(("127.0.0.1", 0))
+        return s.getsockname()[1]
+
+
+@pytest.fixture(scope="session")
+def server():
+    extension = os.environ.get("DUCKGL_EXTENSION", DEFAULT_EXTENSION)
+    if not os.path.exists(extension):
+        pytest.exit(f"{extension} がない。make release でビルドするか DUCKGL_EXTENSION で指定する", returncode=2)
+    con = duckdb.connect(config={"allow_unsigned_extensions": "true"})
+    con.execute(f"LOAD '{extension}'")
+    # 同じ表を別のテストで作り直すので、レスポンスキャッシュは使わない
+    con.execute("SET duckgl_cache_size = '0'")
+    port = free_port()
+    con.execute(f"SELECT duckgl_start('127.0.0.1', {port})")
+    yield Server(con, port)
+    con.execute("SELECT duckgl_stop()")
+
+
+@pytest.fixture(scope="session")
+def spatial(server):
+    server.con.execute("INSTALL spatial")
+    server.con.execute("LOAD spatial")
+    return server
@@ -0,0 +1,138 @@
+"""/api/arrow の Arrow IPC ストリームを pyarrow で読み、DuckDB 自身の Arrow 変換と同じになることを確かめる"""
+
+import pyarrow as pa
+import pytest
+
+ROWS = 5000  # 1チャンク（2048行）を超えて複数のレコードバッチになる数
+
+# (列名, 式)。どの列も7行ごとに NULL にする
+COLUMNS = [
+    ("b", "i % 3 = 0"),
+    ("i8", "(i % 100 - 50)::TINYINT"),
+    ("i16", "(i * 7 - 10000)::SMALLINT"),
+    ("i32", "(i * 1000003 % 2000000000)::INTEGER - 1000000000"),
+    ("i64", "(i::HUGEINT * 9007199254740993 % 9223372036854775807)::BIGINT - 4611686018427387904"),
+    ("u8", "(i % 256)::UTINYINT"),
+    ("u16", "(i % 65536)::USMALLINT"),
+    ("u32", "(i * 1000003 % 4294967295)::UINTEGER"),
+    ("u64", "(i::HUGEINT * 12345678901234567 % 18446744073709551615)::UBIGINT"),
+    ("i128", "(i - 2500)::HUGEINT * 17014118346046923173168730371588410"),
+    ("f32", "(i / 3)::FLOAT"),
+    ("f64", "i / 7.0 - 100"),
+    ("dec", "(i * 1.125)::DECIMAL(18, 3)"),
+    ("dec38", "(i * 12345678901234567.125)::DECIMAL(38, 10)"),
+    ("s", "'row ' || i::VARCHAR"),
+    ("s_long", "repeat('é', i % 40) || '末尾'"),
+    ("s_empty", "CASE WHEN i % 2 = 0 THEN '' ELSE 'x' END"),
+    ("bin", "('\\x00\\xFF' || i::VARCHAR)::BLOB"),
+    ("uid", "('00000000-0000-0000-0000-' || lpad(i::VARCHAR, 12, '0'))::UUID"),
+    ("d", "DATE '2000-01-01' + (i % 10000)::INTEGER"),
+    ("t", "TIME '00:00:00' + INTERVAL (i * 17) SECOND"),
+    ("ts", "TIMESTAMP '2001-02-03 04:05:06.789' + INTERVAL (i) MINUTE"),
+    ("ts_s", "(TIMESTAMP '2001-02-03' + INTERVAL (i) HOUR)::TIMESTAMP_S"),
+    ("ts_ms", "(TIMESTAMP '2001-02-03 00:00:00.123' + INTERVAL (i) HOUR)::TIMESTAMP_MS"),
+    ("ts_ns", "(TIMESTAMP '2001-02-03 00:00:00.123456' + INTERVAL (i) HOUR)::TIMESTAMP_NS"),
+    ("tstz", "(TIMESTAMP '2001-02-03 04:05:06' + INTERVAL (i) MINUTE)::TIMESTAMPTZ"),
+    ("iv", "INTERVAL (i % 13) MONTH + INTERVAL (i % 29) DAY + INTERVAL (i) MICROSECOND"),
+    ("l", "CASE WHEN i % 5 = 0 THEN [] ELSE range(i % 4)::INTEGER[] END"),
+    ("l_null", "[i::INTEGER, NULL, 2]"),
+    ("l_str", "['a' || i::VARCHAR, NULL, repeat('b', i % 20)]"),
+    ("l_l", "[[i::BIGINT], [], [1, 2, 3]]"),
+    ("arr", "[i::INTEGER, i + 1, i + 2]::INTEGER[3]"),
+    ("m", "MAP {'k' || (i % 3)::VARCHAR: i::INTEGER, 'z': -1}"),
+    ("st", "{'x': i::DOUBLE, 'name': 'n' || i::VARCHAR, 'inner': {'flag': i % 2 = 0}}"),
+    ("l_st", "[{'a': i::INTEGER, 'b': 'q'}, {'a': NULL, 'b': NULL}]"),
+]
+
+# IPC で表せない型は VARCHAR にキャストして送る
+FALLBACK_COLUMNS = [
+    ("en", "(['red', 'green', 'blue'][i % 3 + 1])::fallback_enum"),
+    ("un", "CASE WHEN i % 2 = 0 THEN i::INTEGER::UNION(num INTEGER, str VARCHAR) "
+           "ELSE ('u' || i::VARCHAR)::UNION(num INTEGER, str VARCHAR) END"),
+    ("ttz", "(TIME '01:02:03' + INTERVAL (i) SECOND)::TIMETZ"),
+]
+
+
+ALL_COLUMNS = COLUMNS + FALLBACK_COLUMNS
+
+
+@pytest.fixture(scope="module")
+def arrow_table(server):
+    server.con.execute("DROP TYPE IF EXISTS fallback_enum")
+    server.con.execute("CREATE TYPE fallback_enum AS ENUM ('red', 'green', 'blue')")
+    select_list = ", ".join(f"{expression} AS {name}" for name, expression in ALL_COLUMNS)
+    server.con.execute(f"CREATE OR REPLACE TABLE arrow_types AS SELECT i, {select_list} FROM range({ROWS}) t(i)")
+    server.con.execute(f"UPDATE arrow_types SET {', '.join(name + ' = NULL' for name, _ in ALL_COLUMNS)} WHERE i % 7 = 0")
+    yield
+    server.con.execute("DROP TABLE arrow_types")
+    server.con.execute("DROP TYPE fallback_enum")
+
+
+def read_stream(body):
+    reader = pa.ipc.open_stream(pa.BufferReader(body))
+    batches = list(reader)
+    return pa.Table.from_batches(batches, reader.schema), batches
+
+
+@pytest.mark.parametrize("stream", ["", "?stream=0"])
+def test_supported_types_round_trip(server, arrow_table, stream):
+    names = ["i"] + [name for name, _ in COLUMNS]
+    sql = f"SELECT {', '.join(names)} FROM arrow_types ORDER BY i"
+    headers, body = server.post("/api/arrow" + stream, sql)
+    assert headers["Content-Type"] == "application/vnd.apache.arrow.stream"
+    table, batches = read_stream(body)
+    assert len(batches) > 1
+    for batch in batches:
+        batch.validate(full=True)
+
+    expected = server.con.execute(sql).fetch_arrow_table()
+    assert table.schema.names == names
+    assert table.num_rows == ROWS
+    for name in names:
+        column = table.column(name)
+        assert column.type == expected.column(name).type, name
+        assert column.null_count == expected.column(name).null_count, name
+        assert column.to_pylist() == expected.column(name).to_pylist(), name
+
+
+def test_nulls_in_every_column(server, arrow_table):
+    names = [name for name, _ in COLUMNS]
+    _, body = server.post("/api/arrow", f"SELECT {', '.join(names)} FROM arrow_types ORDER BY i")
+    table, _ = read_stream(body)
+    for name in names:
+        # i % 7 = 0 の行だけが NULL
+        assert table.column(name).null_count == (ROWS + 6) // 7, name
+        assert table.column(name)[0].as_py() is None, name
+        assert table.column(name)[1].as_py() is not None, name
+
+
+def test_strings_and_nested_values(server, arrow_table):
+    _, body = server.post("/api/arrow", "SELECT s, s_long, s_empty, l_str, m, st, l_st FROM arrow_types WHERE i = 39")
+    row = read_stream(body)[0].to_pylist()[0]
+    assert row["s"] == "row 39"
+    assert row["s_long"] == "é" * 39 + "末尾"
+    assert row["s_empty"] == "x"
+    assert row["l_str"] == ["a39", None, "b" * 19]
+    assert sorted(row["m"]) == [("k0", 39), ("z", -1)]
+    assert row["st"] == {"x": 39.0, "name": "n39", "inner": {"flag": False}}
+    assert row["l_st"] == [{"a": 39, "b": "q"}, {"a": None, "b": None}]
+
+
+def test_unsupported_types_fall_back_to_varchar(server, arrow_table):
+    names = [name for name, _ in FALLBACK_COLUMNS]
+    sql = f"SELECT {', '.join(names)} FROM arrow_types ORDER BY i"
+    _, body = server.post("/api/arrow", sql)
+    table, _ = read_stream(body)
+    expected = server.con.execute(f"SELECT {', '.join(n + '::VARCHAR AS ' + n for n in names)} "
+                                  f"FROM arrow_types ORDER BY i").fetchall()
+    for index, name in enumerate(names):
+        assert pa.types.is_string(table.column(name).type) or pa.types.is_large_string(table.column(name).type), name
+        assert table.column(name).to_pylist() == [row[index] for row in expected], name
+    assert table.column("en").to_pylist()[1:4] == ["green", "blue", "red"]
+
+
+def test_empty_result(server, arrow_table):
+    _, body = server.post("/api/arrow", "SELECT i, s, l FROM arrow_types WHERE i < 0")
+    table, batches = read_stream(body)
+    assert table.schema.names == ["i", "s", "l"]
+    assert table.num_rows == 0
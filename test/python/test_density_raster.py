@@ -0,0 +1,166 @@
+"""/api/raster の密度タイルの画素を、点・線・ポリゴンの既知の配置で数える
+
+PNG は zlib で展開してフィルタを戻す標準の手順で読み、各チャンクの CRC も確かめる
+"""
+
+import math
+import struct
+import zlib
+
+import pytest
+
+SIZE = 256
+TILE = (1, 0, 0)  # 経度 -180..0、北半球
+
+
+def pixel_lon(px, tile=TILE):
+    z, x, _ = tile
+    return ((px / SIZE) + x) / 2 ** z * 360 - 180
+
+
+def pixel_lat(py, tile=TILE):
+    z, _, y = tile
+    return math.degrees(math.atan(math.sinh(math.pi * (1 - 2 * (py / SIZE + y) / 2 ** z))))
+
+
+def at(px, py):
+    return f"{pixel_lon(px)} {pixel_lat(py)}"
+
+
+def line(*points):
+    return "LINESTRING(" + ", ".join(at(px, py) for px, py in points) + ")"
+
+
+# 画素の中心（+0.5）に置き、期待する画素を一意にする
+FIXTURES = [
+    # 同じ画素の3点と別の画素の1点
+    f"POINT({at(10.5, 20.5)})",
+    f"POINT({at(10.5, 20.5)})",
+    f"POINT({at(10.5, 20.5)})",
+    f"POINT({at(100.5, 50.5)})",
+    # 横線：x = 20..60 の41画素
+    line((20.5, 200.5), (60.5, 200.5)),
+    # 折れ線：共有する頂点の画素は1回だけ数える（21 + 20 画素）
+    line((20.5, 210.5), (40.5, 210.5), (40.5, 230.5)),
+    # タイルの右端（経度0）を越える線は x = 128..255 の128画素
+    f"LINESTRING({at(128.5, 150.5)}, 90 {pixel_lat(150.5)})",
+    # ポリゴンの境界：閉じた環の始点も1回だけ数える（一辺21画素の正方形の周囲の80画素）
+    "POLYGON((" + ", ".join(at(px, py) for px, py in
+                            [(150.5, 20.5), (170.5, 20.5), (170.5, 40.5), (150.5, 40.5), (150.5, 20.5)]) + "))",
+]
+
+
+def expected_grid():
+    grid = {}
+
+    def add(px, py, value=1):
+        grid[(px, py)] = grid.get((px, py), 0) + value
+
+    add(10, 20, 3)
+    add(100, 50)
+    for px in range(20, 61):
+        add(px, 200)
+    for px in range(20, 41):
+        add(px, 210)
+    for py in range(211, 231):
+        add(40, py)
+    for px in range(128, 256):
+        add(px, 150)
+    for px in range(150, 171):
+        add(px, 20)
+        add(px, 40)
+    for py in range(21, 40):
+        add(150, py)
+        add(170, py)
+    return grid
+
+
+@pytest.fixture(scope="module")
+def raster_table(spatial):
+    spatial.con.execute("CREATE OR REPLACE TABLE raster_fixture (geom GEOMETRY)")
+    for wkt in FIXTURES:
+        spatial.con.execute("INSERT INTO raster_fixture VALUES (ST_GeomFromText(?))", [wkt])
+    yield spatial
+    spatial.con.execute("DROP TABLE raster_fixture")
+
+
+def read_png(data):
+    """(width, height, RGBA の行のリスト)"""
+    assert data[:8] == b"\x89PNG\r\n\x1a\n"
+    pos, chunks = 8, []
+    while pos < len(data):
+        length, kind = struct.unpack(">I4s", data[pos:pos + 8])
+        body = data[pos + 8:pos + 8 + length]
+        crc, = struct.unpack(">I", data[pos + 8 + length:pos + 12 + length])
+        assert zlib.crc32(kind + body) == crc, kind
+        chunks.append((kind, body))
+        pos += 12 + length
+    assert chunks[0][0] == b"IHDR" and chunks[-1][0] == b"IEND"
+    width, height, depth, color, _, _, interlace = struct.unpack(">IIBBBBB", chunks[0][1])
+    assert (depth, color, interlace) == (8, 6, 0)
+    raw = zlib.decompress(b"".join(body for kind, body in chunks if kind == b"IDAT"))
+    stride = width * 4
+    assert len(raw) == height * (stride + 1)
+    rows, previous = [], bytearray(stride)
+    for y in range(height):
+        kind, line_data = raw[y * (stride + 1)], bytearray(raw[y * (stride + 1) + 1:(y + 1) * (stride + 1)])
+        for i in range(stride):
+            a = line_data[i - 4] if i >= 4 else 0
+            b = previous[i]
+            c = previous[i - 4] if i >= 4 else 0
+            if kind == 1:
+                predictor = a
+            elif kind == 2:
+                predictor = b
+            elif kind == 3:
+                predictor = (a + b) // 2
+            elif kind == 4:
+                p = a + b - c
+                pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+                predictor = a if pa <= pb and pa <= pc else b if pb <= pc else c
+            else:
+                assert kind == 0
+                predictor = 0
+            line_data[i] = (line_data[i] + predictor) & 0xFF
+        rows.append(bytes(line_data))
+        previous = line_data
+    return width, height, rows
+
+
+def test_f32_pixel_counts(raster_table):
+    headers, body = raster_table.get("/api/raster/raster_fixture/%d/%d/%d?format=f32" % TILE)
+    assert headers["Content-Type"] == "application/octet-stream"
+    values = struct.unpack("<%df" % (SIZE * SIZE), body)
+    grid = {(i % SIZE, i // SIZE): v for i, v in enumerate(values) if v != 0}
+    assert grid == expected_grid()
+
+
+def test_weight_column(raster_table):
+    raster_table.con.execute("ALTER TABLE raster_fixture ADD COLUMN w DOUBLE DEFAULT 2.5")
+    try:
+        _, body = raster_table.get("/api/raster/raster_fixture/%d/%d/%d?format=f32&weight=w" % TILE)
+    finally:
+        raster_table.con.execute("ALTER TABLE raster_fixture DROP COLUMN w")
+    values = struct.unpack("<%df" % (SIZE * SIZE), body)
+    assert {(i % SIZE, i // SIZE): v for i, v in enumerate(values) if v != 0} == \
+        {pixel: v * 2.5 for pixel, v in expected_grid().items()}
+
+
+@pytest.mark.parametrize("how", ["eq_hist", "linear", "log", "cbrt"])
+def test_png_matches_counts(raster_table, how):
+    headers, body = raster_table.get("/api/raster/raster_fixture/%d/%d/%d?how=%s" % (TILE + (how,)))
+    assert headers["Content-Type"] == "image/png"
+    width, height, rows = read_png(body)
+    assert (width, height) == (SIZE, SIZE)
+    expected = expected_grid()
+    painted = {(x, y) for y, row in enumerate(rows) for x in range(SIZE) if row[x * 4 + 3] != 0}
+    # 値のある画素だけが不透明で、値が大きい画素（3点）は1の画素より不透明
+    assert painted == set(expected)
+    alpha = lambda x, y: rows[y][x * 4 + 3]
+    assert alpha(10, 20) > alpha(100, 50) >= 40
+
+
+def test_empty_tile_is_transparent(raster_table):
+    _, body = raster_table.get("/api/raster/raster_fixture/1/1/1")
+    width, height, rows = read_png(body)
+    assert all(row[x * 4 + 3] == 0 for row in rows for x in range(width))
@@ -0,0 +1,25 @@
+"""/api/query の JSON で、JavaScript の Number に丸められる数値を文字列にすることを確かめる"""
+
+import json
+
+
+def query(server, sql):
+    return json.loads(server.post("/api/query", sql)[1])
+
+
+def test_bigint_beyond_safe_integer_is_string(server):
+    rows = query(server, "SELECT 9007199254740991::BIGINT AS safe, 9007199254740993::BIGINT AS unsafe, "
+                         "-9007199254740993::HUGEINT AS huge")
+    assert rows == [{"safe": 9007199254740991, "unsafe": "9007199254740993", "huge": "-9007199254740993"}]
+
+
+def test_narrow_decimal_is_number(server):
+    rows = query(server, "SELECT 1234567890123.45::DECIMAL(15, 2) AS d, NULL::DECIMAL(15, 2) AS n")
+    assert rows == [{"d": 1234567890123.45, "n": None}]
+
+
+def test_wide_decimal_is_string(server):
+    rows = query(server, "SELECT v::DECIMAL(20, 2) AS d FROM (VALUES (1.5), (12345678901234567.89)) t(v) "
+                         "ORDER BY v")
+    # 列ごとに決まるので、double で表せる値も文字列になる
+    assert [row["d"] for row in rows] == ["1.50", "12345678901234567.89"]
@@ -0,0 +1,47 @@
+"""同時に来た同じ要求が1回の実行の結果を共有することを確かめる
+
+セッションのサーバーはレスポンスキャッシュを使わないので、共有されるのは実行中の結果だけ
+"""
+
+import threading
+from concurrent.futures import ThreadPoolExecutor
+
+import pytest
+
+CLIENTS = 6
+ROWS = 2_000_000
+RASTER = "/api/raster/coalesce_points/0/0/0?format=f32"
+
+
+@pytest.fixture(scope="module")
+def points(spatial):
+    # 最初の要求は索引の構築も含むので、他の要求が届くまで十分に時間がかかる
+    spatial.con.execute(f"""CREATE OR REPLACE TABLE coalesce_points AS
+        SELECT ST_Point((i * 7919 % 360000) / 1000.0 - 180, (i * 104729 % 170000) / 1000.0 - 85) AS geom
+        FROM range({ROWS}) t(i)""")
+    yield spatial
+    spatial.con.execute("DROP TABLE coalesce_points")
+
+
+def coalescing(server):
+    stats = server.stats()["coalescing"]
+    return stats["executions"], stats["coalesced"]
+
+
+def test_concurrent_requests_share_one_execution(points):
+    before = coalescing(points)
+    barrier = threading.Barrier(CLIENTS)
+
+    def fetch(_):
+        barrier.wait()
+        return points.get(RASTER)[1]
+
+    with ThreadPoolExecutor(CLIENTS) as pool:
+        bodies = list(pool.map(fetch, range(CLIENTS)))
+    after = coalescing(points)
+
+    assert all(body == bodies[0] for body in bodies)
+    executed, shared = after[0] - before[0], after[1] - before[1]
+    assert executed + shared == CLIENTS
+    assert shared >= 1
+    assert points.stats()["coalescing"]["in_flight"] == 0
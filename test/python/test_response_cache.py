@@ -0,0 +1,59 @@
+"""レスポンスキャッシュがテーブルごとのデータバージョンで無効になることを確かめる
+
+セッションのサーバーはキャッシュを使わないので、このモジュールの間だけキャッシュを有効にして起動し直す
+"""
+
+import pytest
+
+TILE = "/api/tiles/{}/0/0/0.mvt"
+
+
+@pytest.fixture(scope="module")
+def cached(spatial):
+    con = spatial.con
+    for table in ("cache_target", "cache_other"):
+        con.execute(f"CREATE OR REPLACE TABLE {table} AS SELECT 1 AS n, ST_Point(10, 20) AS geom")
+    spatial.restart(duckgl_cache_size="64MB")
+    yield spatial
+    spatial.restart(duckgl_cache_size="0")
+    con.execute("DROP TABLE cache_target")
+    con.execute("DROP TABLE cache_other")
+
+
+def cache_counts(server):
+    cache = server.stats()["cache"]
+    return cache["hits"], cache["misses"]
+
+
+def warm(server, table):
+    """キャッシュから返るまで同じタイルを要求する（最初の要求でカタログを読み直すので、1回では載らないことがある）"""
+    for _ in range(3):
+        hits, _ = cache_counts(server)
+        server.get(TILE.format(table))
+        if cache_counts(server)[0] > hits:
+            return
+    pytest.fail(f"{table} のタイルがキャッシュに載らない")
+
+
+def test_repeated_request_is_a_hit(cached):
+    warm(cached, "cache_target")
+    hits, misses = cache_counts(cached)
+    cached.get(TILE.format("cache_target"))
+    assert cache_counts(cached) == (hits + 1, misses)
+
+
+def test_write_to_the_table_is_a_miss(cached):
+    warm(cached, "cache_target")
+    cached.con.execute("INSERT INTO cache_target VALUES (2, ST_Point(11, 21))")
+    hits, misses = cache_counts(cached)
+    cached.get(TILE.format("cache_target"))
+    assert cache_counts(cached) == (hits, misses + 1)
+
+
+def test_write_to_another_table_is_a_hit(cached):
+    warm(cached, "cache_target")
+    cached.con.execute("INSERT INTO cache_other VALUES (2, ST_Point(11, 21))")
+    cached.con.execute("CREATE OR REPLACE TEMP TABLE cache_scratch AS SELECT 1 AS n")
+    hits, misses = cache_counts(cached)
+    cached.get(TILE.format("cache_target"))
+    assert cache_counts(cached) == (hits + 1, misses)
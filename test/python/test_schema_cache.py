@@ -0,0 +1,28 @@
+"""カタログの写しを、見つからないテーブルの要求ごとには読み直さないことを確かめる"""
+
+import json
+
+
+def schema_loads(server):
+    return server.stats()["schema"]["loads"]
+
+
+def test_unknown_table_reloads_once_per_catalog_version(spatial):
+    spatial.con.execute("CREATE OR REPLACE TABLE schema_bump (n INTEGER)")
+    spatial.request("/api/geojson/schema_missing")
+    loads = schema_loads(spatial)
+    for _ in range(3):
+        spatial.request("/api/geojson/schema_missing")
+    assert schema_loads(spatial) == loads
+    spatial.con.execute("DROP TABLE schema_bump")
+
+
+def test_geometry_column_type(spatial):
+    spatial.con.execute("CREATE OR REPLACE TABLE schema_points AS SELECT ST_Point(1, 2) AS geom, 1 AS n")
+    spatial.request("/api/geojson/schema_points")
+    tables = {t["table_name"]: t for t in json.loads(spatial.get("/api/tables")[1])}
+    table = tables["schema_points"]
+    assert table["geometry_column"] == "geom"
+    assert table["geometry_column_type"].startswith("GEOMETRY")
+    assert table["columns"] == ["geom", "n"]
+    spatial.con.execute("DROP TABLE schema_points")
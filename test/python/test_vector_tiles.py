@@ -0,0 +1,307 @@
+"""/api/tiles のタイルを仕様どおりに読み、コマンドとジグザグ符号化・クリップ後の環の向き・属性の重複除去・バッファの端を確かめる
+
+コマンドの整数列そのものを確かめるため、デコーダーは Mapbox Vector Tile 2.1 の仕様から書いたものを使う
+https://github.com/mapbox/vector-tile-spec/tree/master/2.1
+"""
+
+import math
+import struct
+
+import pytest
+
+EXTENT = 4096
+BUFFER = 64
+
+MOVE_TO, LINE_TO, CLOSE_PATH = 1, 2, 7
+POINT, LINESTRING, POLYGON = 1, 2, 3
+
+
+# ---- protobuf と MVT のデコーダー ----
+
+def read_varint(data, pos):
+    result = shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        result |= (byte & 0x7F) << shift
+        shift += 7
+        if byte < 0x80:
+            return result, pos
+
+
+def read_fields(data):
+    """(フィールド番号, 値) の列。varint は int、fixed64 / 長さ付きは bytes"""
+    pos, fields = 0, []
+    while pos < len(data):
+        key, pos = read_varint(data, pos)
+        field, wire = key >> 3, key & 7
+        if wire == 0:
+            value, pos = read_varint(data, pos)
+        elif wire == 1:
+            value, pos = data[pos:pos + 8], pos + 8
+        elif wire == 2:
+            length, pos = read_varint(data, pos)
+            value, pos = data[pos:pos + length], pos + length
+        elif wire == 5:
+            value, pos = data[pos:pos + 4], pos + 4
+        else:
+            raise AssertionError(f"unexpected wire type {wire}")
+        fields.append((field, value))
+    return fields
+
+
+def read_packed(data):
+    pos, values = 0, []
+    while pos < len(data):
+        value, pos = read_varint(data, pos)
+        values.append(value)
+    return values
+
+
+def unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def decode_value(data):
+    (field, value), = read_fields(data)
+    if field == 1:
+        return value.decode()
+    if field == 2:
+        return struct.unpack("<f", value)[0]
+    if field == 3:
+        return struct.unpack("<d", value)[0]
+    if field in (4, 5):
+        return value
+    if field == 6:
+        return unzigzag(value)
+    if field == 7:
+        return bool(value)
+    raise AssertionError(f"unexpected value field {field}")
+
+
+def decode_commands(commands, geom_type):
+    """コマンド列を環（線・点の並び）のリストにする。カーソルはフィーチャーの先頭で (0, 0)"""
+    x = y = 0
+    parts, current, pos = [], None, 0
+    while pos < len(commands):
+        command_id, count = commands[pos] & 7, commands[pos] >> 3
+        pos += 1
+        if command_id == CLOSE_PATH:
+            assert geom_type == POLYGON and count == 1 and current is not None
+            parts.append(current)
+            current = None
+            continue
+        assert command_id in (MOVE_TO, LINE_TO) and count > 0
+        if command_id == MOVE_TO:
+            # 点以外の MoveTo は1点ずつ
+            assert geom_type == POINT or count == 1
+            if current is not None and geom_type == LINESTRING:
+                parts.append(current)
+            current = [] if geom_type != POINT else (current or [])
+        else:
+            assert current, "LineTo without MoveTo"
+        for _ in range(count):
+            x += unzigzag(commands[pos])
+            y += unzigzag(commands[pos + 1])
+            pos += 2
+            current.append((x, y))
+    if current is not None and geom_type != POLYGON:
+        parts.append(current)
+    assert geom_type != POLYGON or current is None, "polygon ring without ClosePath"
+    return parts
+
+
+def decode_tile(data):
+    layers = {}
+    for field, layer_data in read_fields(data):
+        assert field == 3
+        layer = {"keys": [], "values": [], "features": [], "raw_values": []}
+        raw_features = []
+        for f, value in read_fields(layer_data):
+            if f == 1:
+                layer["name"] = value.decode()
+            elif f == 2:
+                raw_features.append(value)
+            elif f == 3:
+                layer["keys"].append(value.decode())
+            elif f == 4:
+                layer["raw_values"].append(bytes(value))
+                layer["values"].append(decode_value(value))
+            elif f == 5:
+                layer["extent"] = value
+            elif f == 15:
+                layer["version"] = value
+        for raw in raw_features:
+            fields = read_fields(raw)
+            tags = [t for f, v in fields if f == 2 for t in read_packed(v)]
+            geom_type = next(v for f, v in fields if f == 3)
+            commands = [c for f, v in fields if f == 4 for c in read_packed(v)]
+            assert len(tags) % 2 == 0
+            properties = {layer["keys"][tags[i]]: layer["values"][tags[i + 1]] for i in range(0, len(tags), 2)}
+            layer["features"].append({"type": geom_type, "tags": tags, "commands": commands,
+                                      "properties": properties, "geometry": decode_commands(commands, geom_type)})
+        layers[layer["name"]] = layer
+    return layers
+
+
+def ring_area(ring):
+    """仕様の面積（タイル座標、y下向き）。外周は正、穴は負"""
+    return sum(ring[i - 1][0] * ring[i][1] - ring[i][0] * ring[i - 1][1] for i in range(len(ring))) / 2
+
+
+# ---- 期待値 ----
+
+def project(lon, lat, z, x, y):
+    s = math.sin(math.radians(lat))
+    wx = (lon + 180) / 360
+    wy = 0.5 - math.log((1 + s) / (1 - s)) / (4 * math.pi)
+    scale = 2 ** z
+    return (wx * scale - x) * EXTENT, (wy * scale - y) * EXTENT
+
+
+def tile_point(lon, lat, tile=(1, 1, 0)):
+    px, py = project(lon, lat, *tile)
+    # C++ の llround と同じく 0.5 は0から遠い方へ
+    return int(math.copysign(math.floor(abs(px) + 0.5), px)), int(math.copysign(math.floor(abs(py) + 0.5), py))
+
+
+def lon_at(px, tile=(1, 1, 0)):
+    z, x, _ = tile
+    return (px / EXTENT + x) / 2 ** z * 360 - 180
+
+
+# タイル z=1 x=1 y=0（経度 0..180、北半球）に対する地物
+FEATURES = [
+    # 左端を越える反時計回りの外周と穴。外周はバッファの端（x = -64）で切られる
+    ("poly_ccw", 1, 1.5, True,
+     "POLYGON((-10 10, 30 10, 30 40, -10 40, -10 10), (5 15, 5 20, 10 20, 10 15, 5 15))"),
+    # タイル内の時計回りの外周
+    ("poly_cw", 1, 2.5, False, "POLYGON((40 20, 40 30, 60 30, 60 20, 40 20))"),
+    # タイル内の線（クリップされない）
+    (None, 2, 1.5, True, "LINESTRING(10 10, 20 20, 30 10)"),
+    # 左端を越える線
+    ("line_cut", 3, None, None, "LINESTRING(-20 5, 20 5)"),
+    # タイルを出て戻る線は2本に分かれる
+    ("line_split", 4, None, None, "LINESTRING(10 5, -20 5, -20 20, 10 20)"),
+    # 1点はタイル内、1点はバッファ内（負の座標）
+    ("points", 5, None, None, f"MULTIPOINT(45 45, {lon_at(-30)} 45)"),
+    # バッファの外の点は入らない
+    ("outside", 6, None, None, f"POINT({lon_at(-100)} 45)"),
+    # タイル全体を覆う面はバッファの正方形になる
+    ("cover", 7, None, None, "POLYGON((-20 -10, 179 -10, 179 84, -20 84, -20 -10))"),
+]
+
+
+@pytest.fixture(scope="module")
+def tile(spatial):
+    con = spatial.con
+    con.execute("CREATE OR REPLACE TABLE mvt_fixture (name VARCHAR, n INTEGER, v DOUBLE, ok BOOLEAN, geom GEOMETRY)")
+    for name, n, v, ok, wkt in FEATURES:
+        con.execute("INSERT INTO mvt_fixture VALUES (?, ?, ?, ?, ST_GeomFromText(?))", [name, n, v, ok, wkt])
+    # tolerance=0 で簡略化を止め、クリップと量子化だけを見る
+    headers, body = spatial.get("/api/tiles/mvt_fixture/1/1/0.mvt?tolerance=0")
+    assert headers["Content-Type"] == "application/vnd.mapbox-vector-tile"
+    yield decode_tile(body)
+    con.execute("DROP TABLE mvt_fixture")
+
+
+def feature(layer, name):
+    matches = [f for f in layer["features"] if f["properties"].get("name") == name]
+    assert len(matches) == 1, name
+    return matches[0]
+
+
+def test_layer_header(tile):
+    layer = tile["mvt_fixture"]
+    assert layer["version"] == 2
+    assert layer["extent"] == EXTENT
+    assert len(layer["features"]) == len(FEATURES) - 1
+
+
+def test_line_commands_and_zigzag(tile):
+    layer = tile["mvt_fixture"]
+    line = next(f for f in layer["features"] if "name" not in f["properties"])
+    assert line["type"] == LINESTRING
+    points = [tile_point(10, 10), tile_point(20, 20), tile_point(30, 10)]
+    # MoveTo(1) 絶対位置、LineTo(2) 直前の点からの差分
+    expected = [MOVE_TO | 1 << 3]
+    previous = (0, 0)
+    for i, point in enumerate(points):
+        if i == 1:
+            expected.append(LINE_TO | 2 << 3)
+        for delta in (point[0] - previous[0], point[1] - previous[1]):
+            expected.append((delta << 1) ^ (delta >> 63))
+        previous = point
+    assert line["commands"] == expected
+    assert line["geometry"] == [points]
+
+
+def test_negative_coordinates_in_buffer(tile):
+    points = feature(tile["mvt_fixture"], "points")
+    assert points["type"] == POINT
+    # 複数の点は1つの MoveTo にまとめる
+    assert points["commands"][0] == MOVE_TO | 2 << 3
+    assert points["geometry"] == [[tile_point(45, 45), (-30, tile_point(45, 45)[1])]]
+
+
+def test_features_outside_the_buffer_are_dropped(tile):
+    names = [f["properties"].get("name") for f in tile["mvt_fixture"]["features"]]
+    assert "outside" not in names
+
+
+def test_polygon_winding_after_clipping(tile):
+    layer = tile["mvt_fixture"]
+    for name in ("poly_ccw", "poly_cw", "cover"):
+        polygon = feature(layer, name)
+        assert polygon["type"] == POLYGON
+        exterior, *holes = polygon["geometry"]
+        assert ring_area(exterior) > 0, name
+        for hole in holes:
+            assert ring_area(hole) < 0, name
+    assert len(feature(layer, "poly_ccw")["geometry"]) == 2
+
+
+def test_polygon_clipped_at_buffer_edge(tile):
+    exterior, hole = feature(tile["mvt_fixture"], "poly_ccw")["geometry"]
+    right = tile_point(30, 10)[0]
+    top, bottom = tile_point(30, 40)[1], tile_point(30, 10)[1]
+    assert sorted(exterior) == sorted([(-BUFFER, top), (right, top), (right, bottom), (-BUFFER, bottom)])
+    assert sorted(hole) == sorted(tile_point(lon, lat) for lon, lat in [(5, 15), (5, 20), (10, 20), (10, 15)])
+
+
+def test_polygon_covering_the_tile_becomes_the_buffer_square(tile):
+    exterior, = feature(tile["mvt_fixture"], "cover")["geometry"]
+    xs = {x for x, _ in exterior}
+    ys = {y for _, y in exterior}
+    assert min(xs) == -BUFFER and min(ys) >= -BUFFER and max(ys) == EXTENT + BUFFER
+    for x, y in exterior:
+        assert -BUFFER <= x <= EXTENT + BUFFER and -BUFFER <= y <= EXTENT + BUFFER
+
+
+def test_lines_clipped_at_buffer_edge(tile):
+    layer = tile["mvt_fixture"]
+    y5 = tile_point(0, 5)[1]
+    assert feature(layer, "line_cut")["geometry"] == [[(-BUFFER, y5), tile_point(20, 5)]]
+    y20 = tile_point(0, 20)[1]
+    assert feature(layer, "line_split")["geometry"] == [[tile_point(10, 5), (-BUFFER, y5)],
+                                                        [(-BUFFER, y20), tile_point(10, 20)]]
+
+
+def test_properties_are_deduplicated(tile):
+    layer = tile["mvt_fixture"]
+    assert layer["keys"] == ["name", "n", "v", "ok"]
+    assert len(set(layer["raw_values"])) == len(layer["raw_values"])
+    ccw, cw = feature(layer, "poly_ccw"), feature(layer, "poly_cw")
+    assert ccw["properties"] == {"name": "poly_ccw", "n": 1, "v": 1.5, "ok": True}
+    assert cw["properties"] == {"name": "poly_cw", "n": 1, "v": 2.5, "ok": False}
+    # 同じ値（n = 1）は同じ番号で参照する
+    assert ccw["tags"][2:4] == cw["tags"][2:4]
+    # NULL の属性はタグを付けない
+    assert feature(layer, "line_cut")["properties"] == {"name": "line_cut", "n": 3}
+
+
+def test_empty_tile(spatial):
+    spatial.con.execute("CREATE OR REPLACE TABLE mvt_empty AS SELECT ST_Point(-100, -40) AS geom")
+    _, body = spatial.get("/api/tiles/mvt_empty/1/1/0.mvt")
+    assert body == b""
+    spatial.con.execute("DROP TABLE mvt_empty")